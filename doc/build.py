@@ -48,6 +48,7 @@ import StringIO
 
 # We know which headers constitute the external interface.
 EXTERNAL = """
+aead
 aes
 cf_config
 chash
@@ -63,6 +64,7 @@ sha3_shake
 norx
 poly1305
 chacha20poly1305
+secretbox
 drbg
 """.split()
 
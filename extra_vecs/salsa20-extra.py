@@ -2,6 +2,9 @@ import salsa20
 
 key = ('secretkey'*4)[:32]
 nonce = ('nonce'*2)[:8]
-keystream = salsa20.Salsa20_keystream(128, nonce, key)
 
-print """vector("%s", "%s", "%s");""" % (key.encode('hex'), nonce.encode('hex'), keystream.encode('hex'))
+# 1000 bytes crosses every multi-block boundary: a group of 8 blocks,
+# a group of 4, single blocks, then a partial block.
+for length in (128, 1000):
+    keystream = salsa20.Salsa20_keystream(length, nonce, key)
+    print """vector("%s", "%s", "%s");""" % (key.encode('hex'), nonce.encode('hex'), keystream.encode('hex'))
@@ -0,0 +1,110 @@
+/*
+ * cifra - embedded cryptography library
+ * Written in 2014 by Joseph Birr-Pixton <jpixton@gmail.com>
+ *
+ * To the extent possible under law, the author(s) have dedicated all
+ * copyright and related and neighboring rights to this software to the
+ * public domain worldwide. This software is distributed without any
+ * warranty.
+ *
+ * You should have received a copy of the CC0 Public Domain Dedication
+ * along with this software. If not, see
+ * <http://creativecommons.org/publicdomain/zero/1.0/>.
+ */
+
+#ifndef AEAD_H
+#define AEAD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * AEAD batches and fragments
+ * ==========================
+ * Types shared by the batch and scatter/gather interfaces of the
+ * AEAD modes.
+ */
+
+/**
+ * Batches
+ * -------
+ * Each AEAD mode has batch functions, which encrypt or decrypt
+ * many independent records under one key in one call.  They give
+ * the same results as calling the one-shot function on each record
+ * in turn, but do key-dependent setup once per batch and process
+ * blocks from several records together where possible.
+ */
+
+/* .. c:type:: cf_aead_record
+ * One record in a batch.
+ *
+ * .. c:member:: cf_aead_record.nonce
+ * Nonce for this record.
+ *
+ * .. c:member:: cf_aead_record.nnonce
+ * Length of nonce.  The same restrictions apply as for the mode's
+ * one-shot function.
+ *
+ * .. c:member:: cf_aead_record.header
+ * Additionally authenticated data (AAD).
+ *
+ * .. c:member:: cf_aead_record.nheader
+ * Length of AAD.
+ *
+ * .. c:member:: cf_aead_record.in
+ * Input: plaintext when encrypting, ciphertext when decrypting.
+ *
+ * .. c:member:: cf_aead_record.nbytes
+ * Length of input (and output).
+ *
+ * .. c:member:: cf_aead_record.out
+ * Output: `nbytes` bytes are written here.
+ *
+ * .. c:member:: cf_aead_record.tag
+ * Authentication tag.  This is written when encrypting, and read
+ * when decrypting.  The tag length is given for the whole batch.
+ *
+ * .. c:member:: cf_aead_record.err
+ * Written when decrypting: 0 on success, non-zero on error.
+ * `out` is cleared on error.
+ */
+typedef struct
+{
+  const uint8_t *nonce;
+  size_t nnonce;
+  const uint8_t *header;
+  size_t nheader;
+  const uint8_t *in;
+  size_t nbytes;
+  uint8_t *out;
+  uint8_t *tag;
+  int err;
+} cf_aead_record;
+
+/**
+ * Scatter/gather
+ * --------------
+ * Each AEAD mode also has _iov variants of its encrypt and decrypt
+ * functions.  These take AAD, input and output as lists of fragments,
+ * so fragmented buffers don't need to be copied into linear memory
+ * first.  The input and output lists may be split differently, but
+ * must have the same total length.  Blocks which straddle a fragment
+ * boundary are handled internally.
+ */
+
+/* .. c:type:: cf_iovec
+ * One fragment of a scatter/gather list.
+ *
+ * .. c:member:: cf_iovec.base
+ * Start of fragment.
+ *
+ * .. c:member:: cf_iovec.len
+ * Length of fragment, in bytes.  May be zero.
+ */
+typedef struct
+{
+  void *base;
+  size_t len;
+} cf_iovec;
+
+#endif
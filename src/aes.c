@@ -276,6 +276,82 @@ void cf_aes_encrypt(const cf_aes_context *ctx,
   write32_be(state[3], out + 12);
 }
 
+/* How many blocks the _blocks functions work on in lockstep. */
+#define AES_INTERLEAVE 4
+
+static void load_blocks(uint32_t state[][4], const uint8_t *in, size_t n)
+{
+  for (size_t i = 0; i < n; i++, in += AES_BLOCKSZ)
+  {
+    state[i][0] = read32_be(in + 0);
+    state[i][1] = read32_be(in + 4);
+    state[i][2] = read32_be(in + 8);
+    state[i][3] = read32_be(in + 12);
+  }
+}
+
+static void store_blocks(uint32_t state[][4], uint8_t *out, size_t n)
+{
+  for (size_t i = 0; i < n; i++, out += AES_BLOCKSZ)
+  {
+    write32_be(state[i][0], out + 0);
+    write32_be(state[i][1], out + 4);
+    write32_be(state[i][2], out + 8);
+    write32_be(state[i][3], out + 12);
+  }
+}
+
+void cf_aes_encrypt_blocks(const cf_aes_context *ctx,
+                           const uint8_t *in,
+                           uint8_t *out,
+                           size_t nblocks)
+{
+  assert(ctx->rounds == AES128_ROUNDS ||
+         ctx->rounds == AES192_ROUNDS ||
+         ctx->rounds == AES256_ROUNDS);
+
+  uint32_t state[AES_INTERLEAVE][4];
+
+  while (nblocks)
+  {
+    size_t n = MIN(nblocks, (size_t) AES_INTERLEAVE);
+    load_blocks(state, in, n);
+
+    /* Each round is applied to all n blocks before moving on,
+     * so the blocks' (independent) work can overlap. */
+    const uint32_t *round_keys = ctx->ks;
+    for (size_t i = 0; i < n; i++)
+      add_round_key(state[i], round_keys);
+    round_keys += 4;
+
+    for (uint32_t round = 1; round < ctx->rounds; round++)
+    {
+      for (size_t i = 0; i < n; i++)
+      {
+        sub_block(state[i]);
+        shift_rows(state[i]);
+        mix_columns(state[i]);
+        add_round_key(state[i], round_keys);
+      }
+      round_keys += 4;
+    }
+
+    for (size_t i = 0; i < n; i++)
+    {
+      sub_block(state[i]);
+      shift_rows(state[i]);
+      add_round_key(state[i], round_keys);
+    }
+
+    store_blocks(state, out, n);
+    in += n * AES_BLOCKSZ;
+    out += n * AES_BLOCKSZ;
+    nblocks -= n;
+  }
+
+  mem_clean(state, sizeof state);
+}
+
 #if CF_AES_ENCRYPT_ONLY == 0
 static const uint8_t S_inv[256] =
 {
@@ -395,6 +471,55 @@ void cf_aes_decrypt(const cf_aes_context *ctx,
   write32_be(state[2], out + 8);
   write32_be(state[3], out + 12);
 }
+
+void cf_aes_decrypt_blocks(const cf_aes_context *ctx,
+                           const uint8_t *in,
+                           uint8_t *out,
+                           size_t nblocks)
+{
+  assert(ctx->rounds == AES128_ROUNDS ||
+         ctx->rounds == AES192_ROUNDS ||
+         ctx->rounds == AES256_ROUNDS);
+
+  uint32_t state[AES_INTERLEAVE][4];
+
+  while (nblocks)
+  {
+    size_t n = MIN(nblocks, (size_t) AES_INTERLEAVE);
+    load_blocks(state, in, n);
+
+    const uint32_t *round_keys = &ctx->ks[ctx->rounds << 2];
+    for (size_t i = 0; i < n; i++)
+      add_round_key(state[i], round_keys);
+    round_keys -= 4;
+
+    for (uint32_t round = ctx->rounds - 1; round != 0; round--)
+    {
+      for (size_t i = 0; i < n; i++)
+      {
+        inv_shift_rows(state[i]);
+        inv_sub_block(state[i]);
+        add_round_key(state[i], round_keys);
+        inv_mix_columns(state[i]);
+      }
+      round_keys -= 4;
+    }
+
+    for (size_t i = 0; i < n; i++)
+    {
+      inv_shift_rows(state[i]);
+      inv_sub_block(state[i]);
+      add_round_key(state[i], round_keys);
+    }
+
+    store_blocks(state, out, n);
+    in += n * AES_BLOCKSZ;
+    out += n * AES_BLOCKSZ;
+    nblocks -= n;
+  }
+
+  mem_clean(state, sizeof state);
+}
 #else
 void cf_aes_decrypt(const cf_aes_context *ctx,
                     const uint8_t in[AES_BLOCKSZ],
@@ -402,6 +527,14 @@ void cf_aes_decrypt(const cf_aes_context *ctx,
 {
   abort();
 }
+
+void cf_aes_decrypt_blocks(const cf_aes_context *ctx,
+                           const uint8_t *in,
+                           uint8_t *out,
+                           size_t nblocks)
+{
+  abort();
+}
 #endif
 
 void cf_aes_finish(cf_aes_context *ctx)
@@ -412,6 +545,8 @@ void cf_aes_finish(cf_aes_context *ctx)
 const cf_prp cf_aes = {
   .blocksz = AES_BLOCKSZ,
   .encrypt = (cf_prp_block) cf_aes_encrypt,
-  .decrypt = (cf_prp_block) cf_aes_decrypt
+  .decrypt = (cf_prp_block) cf_aes_decrypt,
+  .encrypt_blocks = (cf_prp_blocks) cf_aes_encrypt_blocks,
+  .decrypt_blocks = (cf_prp_blocks) cf_aes_decrypt_blocks
 };
 
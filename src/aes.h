@@ -138,6 +138,40 @@ extern void cf_aes_decrypt(const cf_aes_context *ctx,
                            const uint8_t in[AES_BLOCKSZ],
                            uint8_t out[AES_BLOCKSZ]);
 
+/* .. c:function:: $DECL
+ * Encrypts `nblocks` independent blocks, from :c:data:`in` to
+ * :c:data:`out`.  These may alias.
+ *
+ * This gives the same results as calling :c:func:`cf_aes_encrypt`
+ * on each block, but works on several blocks at once.
+ *
+ * :param ctx: expanded key context
+ * :param in: input blocks (read)
+ * :param out: output blocks (written)
+ * :param nblocks: number of blocks
+ */
+extern void cf_aes_encrypt_blocks(const cf_aes_context *ctx,
+                                  const uint8_t *in,
+                                  uint8_t *out,
+                                  size_t nblocks);
+
+/* .. c:function:: $DECL
+ * Decrypts `nblocks` independent blocks, from :c:data:`in` to
+ * :c:data:`out`.  These may alias.
+ *
+ * This gives the same results as calling :c:func:`cf_aes_decrypt`
+ * on each block, but works on several blocks at once.
+ *
+ * :param ctx: expanded key context
+ * :param in: input blocks (read)
+ * :param out: output blocks (written)
+ * :param nblocks: number of blocks
+ */
+extern void cf_aes_decrypt_blocks(const cf_aes_context *ctx,
+                                  const uint8_t *in,
+                                  uint8_t *out,
+                                  size_t nblocks);
+
 /* .. c:function:: $DECL
  * Erase scheduled key material.
  *
@@ -255,6 +255,24 @@ static inline void incr_le(uint8_t *v, size_t len)
   }
 }
 
+/** Increments the little-endian integer of len (non-zero) bytes
+ *  held in the words at v, least significant word first.  This is
+ *  incr_le for data which has been read into words with read32_le. */
+static inline void incr_le32(uint32_t *v, size_t len)
+{
+  for (; len >= 4; v++, len -= 4)
+  {
+    if (++*v != 0)
+      return;
+  }
+
+  if (len)
+  {
+    uint32_t mask = (UINT32_C(1) << (8 * len)) - 1;
+    *v = (*v & ~mask) | ((*v + 1) & mask);
+  }
+}
+
 /** Increments the integer stored at v (of non-zero length len)
  *  with the most significant byte last. */
 static inline void incr_be(uint8_t *v, size_t len)
@@ -15,6 +15,8 @@
 #include "handy.h"
 #include "prp.h"
 #include "modes.h"
+#include "iov.h"
+#include "bitops.h"
 #include "tassert.h"
 
 #include <string.h>
@@ -38,9 +40,23 @@ static void zero_pad(cf_cbcmac_stream *cm)
   cf_cbcmac_stream_finish_block_zero(cm);
 }
 
+static void mac_piece(void *vctx, const uint8_t *data, size_t len)
+{
+  cf_cbcmac_stream_update(vctx, data, len);
+}
+
+/* Adds the message at the given fragments to the MAC. */
+static void add_iov(cf_cbcmac_stream *cm, const cf_iovec *iov, size_t niov)
+{
+  cf_iov_cursor c;
+  cf_iov_init(&c, iov, niov);
+  cf_iov_read(&c, cf_iov_len(iov, niov), mac_piece, cm);
+}
+
 /* nb. block is general workspace. */
 static void add_aad(cf_cbcmac_stream *cm, uint8_t block[CF_MAXBLOCK],
-                    const uint8_t *header, size_t nheader)
+                    const cf_iovec *header, size_t nheaderiov,
+                    size_t nheader)
 {
   assert(nheader <= 0xffffffff); /* we don't support 64 bit lengths. */
 
@@ -55,7 +71,7 @@ static void add_aad(cf_cbcmac_stream *cm, uint8_t block[CF_MAXBLOCK],
     cf_cbcmac_stream_update(cm, block, 6);
   }
 
-  cf_cbcmac_stream_update(cm, header, nheader);
+  add_iov(cm, header, nheaderiov);
   zero_pad(cm);
 }
 
@@ -84,18 +100,149 @@ static void build_ctr_nonce(uint8_t ctr_nonce[CF_MAXBLOCK],
   memset(ctr_nonce + 1 + nnonce, 0, L);
 }
 
-void cf_ccm_encrypt(const cf_prp *prp, void *prpctx,
-                    const uint8_t *plain, size_t nplain, size_t L,
-                    const uint8_t *header, size_t nheader,
-                    const uint8_t *nonce, size_t nnonce,
-                    uint8_t *cipher,
-                    uint8_t *tag, size_t ntag)
+/* Starts counter mode at A_1 (A_0 is used for the tag). */
+static void ccm_ctr_init(cf_ctr *ctr, const cf_prp *prp, void *prpctx,
+                         size_t L, const uint8_t A0[CF_MAXBLOCK])
+{
+  cf_ctr_init(ctr, prp, prpctx, A0);
+  cf_ctr_custom_counter(ctr, prp->blocksz - L, L);
+  incr_be(ctr->nonce + prp->blocksz - L, L);
+}
+
+/* The message is MACed and encrypted (or decrypted) in one pass.
+ * Each step encrypts the next CBC-MAC block together with a counter
+ * block in one multi-block PRP call, so the CTR work fills the gaps
+ * in the latency-bound MAC chain.
+ *
+ * When decrypting, the MAC input depends on the key stream, so the
+ * key stream is made one block ahead. */
+typedef struct
+{
+  cf_cbcmac_stream *cm;     /* chaining value is in cm->cbc.block */
+  cf_ctr *ctr;
+  uint8_t ks[CF_MAXBLOCK];  /* decryption: key stream for the next block */
+} ccm_pipe;
+
+/* MACs the whole block mac_in, and writes the key stream block for
+ * the next counter to ks. */
+static void pipe_step(ccm_pipe *p, const uint8_t *mac_in, uint8_t *ks)
+{
+  const cf_prp *prp = p->ctr->prp;
+  size_t blocksz = prp->blocksz;
+  uint8_t blocks[2 * CF_MAXBLOCK];
+
+  xor_bb(blocks, p->cm->cbc.block, mac_in, blocksz);
+  memcpy(blocks + blocksz, p->ctr->nonce, blocksz);
+  incr_be(p->ctr->nonce + p->ctr->counter_offset, p->ctr->counter_width);
+
+  cf_prp_encrypt_blocks(prp, p->ctr->prpctx, blocks, blocks, 2);
+
+  memcpy(p->cm->cbc.block, blocks, blocksz);
+  memcpy(ks, blocks + blocksz, blocksz);
+  mem_clean(blocks, sizeof blocks);
+}
+
+static void encrypt_blocks(void *vctx, const uint8_t *in, uint8_t *out, size_t nblocks)
+{
+  ccm_pipe *p = vctx;
+  size_t blocksz = p->ctr->prp->blocksz;
+  uint8_t ks[CF_MAXBLOCK];
+
+  for (; nblocks; nblocks--, in += blocksz, out += blocksz)
+  {
+    pipe_step(p, in, ks);
+    xor_bb(out, in, ks, blocksz);
+  }
+
+  mem_clean(ks, sizeof ks);
+}
+
+static void decrypt_blocks(void *vctx, const uint8_t *in, uint8_t *out, size_t nblocks)
+{
+  ccm_pipe *p = vctx;
+  size_t blocksz = p->ctr->prp->blocksz;
+  uint8_t plain[CF_MAXBLOCK];
+
+  for (; nblocks; nblocks--, in += blocksz, out += blocksz)
+  {
+    xor_bb(plain, in, p->ks, blocksz);
+    pipe_step(p, plain, p->ks);
+    memcpy(out, plain, blocksz);
+  }
+
+  mem_clean(plain, sizeof plain);
+}
+
+/* MACs the plaintext and encrypts or decrypts it, from in to out.
+ * cm must be at a block boundary, and ctr at A_1. */
+static void ccm_message(cf_cbcmac_stream *cm, cf_ctr *ctr,
+                        const cf_iovec *in, size_t niniov,
+                        const cf_iovec *out, size_t noutiov,
+                        size_t nbytes, int encrypt)
+{
+  const cf_prp *prp = ctr->prp;
+  size_t blocksz = prp->blocksz;
+  size_t ntail = nbytes % blocksz;
+  ccm_pipe p = { cm, ctr };
+  cf_iov_cursor inc, outc;
+
+  assert(cm->used == 0);
+
+  if (!encrypt)
+  {
+    memcpy(p.ks, ctr->nonce, blocksz);
+    incr_be(ctr->nonce + ctr->counter_offset, ctr->counter_width);
+    prp->encrypt(ctr->prpctx, p.ks, p.ks);
+  }
+
+  cf_iov_init(&inc, in, niniov);
+  cf_iov_init(&outc, out, noutiov);
+  cf_iov_transform_blocks(&inc, &outc, nbytes / blocksz, blocksz,
+                          encrypt ? encrypt_blocks : decrypt_blocks,
+                          &p);
+
+  /* Final partial block: zero padded for the MAC. */
+  if (ntail)
+  {
+    uint8_t block[CF_MAXBLOCK] = { 0 }, ks[CF_MAXBLOCK];
+    cf_iov_gather(&inc, block, ntail);
+
+    if (encrypt)
+    {
+      pipe_step(&p, block, ks);
+      xor_bb(block, block, ks, ntail);
+    } else {
+      xor_bb(block, block, p.ks, ntail);
+      cf_cbcmac_stream_update(cm, block, ntail);
+      zero_pad(cm);
+    }
+
+    cf_iov_scatter(&outc, block, ntail);
+    mem_clean(block, sizeof block);
+    mem_clean(ks, sizeof ks);
+  }
+
+  mem_clean(&p, sizeof p);
+}
+
+/* Encryption given A_0 and S_0 = E_K(A_0). */
+static void ccm_encrypt_core(const cf_prp *prp, void *prpctx,
+                             const cf_iovec *plain, size_t nplainiov, size_t L,
+                             const cf_iovec *header, size_t nheaderiov,
+                             const uint8_t *nonce, size_t nnonce,
+                             const uint8_t A0[CF_MAXBLOCK],
+                             const uint8_t S0[CF_MAXBLOCK],
+                             const cf_iovec *cipher, size_t ncipheriov,
+                             uint8_t *tag, size_t ntag)
 {
   uint8_t block[CF_MAXBLOCK];
+  size_t nplain = cf_iov_len(plain, nplainiov);
+  size_t nheader = cf_iov_len(header, nheaderiov);
 
   assert(ntag >= 4 && ntag <= 16 && ntag % 2 == 0);
   assert(L >= 2 && L <= 8);
   assert(nnonce == prp->blocksz - L - 1);
+  assert(cf_iov_len(cipher, ncipheriov) == nplain);
 
   cf_cbcmac_stream cm;
   cf_cbcmac_stream_init(&cm, prp, prpctx);
@@ -107,59 +254,46 @@ void cf_ccm_encrypt(const cf_prp *prp, void *prpctx,
 
   /* Add AAD with length prefix, if present. */
   if (nheader)
-    add_aad(&cm, block, header, nheader);
-
-  /* Add message. */
-  cf_cbcmac_stream_update(&cm, plain, nplain);
-  zero_pad(&cm);
-
-  /* Finish tag. */
-  cf_cbcmac_stream_nopad_final(&cm, block);
-
-  /* Start encryption. */
-  /* Construct A_0 */
-  uint8_t ctr_nonce[CF_MAXBLOCK];
-  build_ctr_nonce(ctr_nonce, L, nonce, nnonce);
+    add_aad(&cm, block, header, nheaderiov, nheader);
 
+  /* Add and encrypt message. */
   cf_ctr ctr;
-  cf_ctr_init(&ctr, prp, prpctx, ctr_nonce);
-  cf_ctr_custom_counter(&ctr, prp->blocksz - L, L);
+  ccm_ctr_init(&ctr, prp, prpctx, L, A0);
+  ccm_message(&cm, &ctr,
+              plain, nplainiov,
+              cipher, ncipheriov,
+              nplain, 1);
 
-  /* Encrypt tag first. */
-  cf_ctr_cipher(&ctr, block, block, prp->blocksz);
-  memcpy(tag, block, ntag);
+  /* Finish tag, and encrypt it. */
+  cf_cbcmac_stream_nopad_final(&cm, block);
+  xor_bb(tag, block, S0, ntag);
 
-  /* Then encrypt message. */
-  cf_ctr_cipher(&ctr, plain, cipher, nplain);
+  mem_clean(block, sizeof block);
+  mem_clean(&ctr, sizeof ctr);
 }
 
-int cf_ccm_decrypt(const cf_prp *prp, void *prpctx,
-                   const uint8_t *cipher, size_t ncipher, size_t L,
-                   const uint8_t *header, size_t nheader,
-                   const uint8_t *nonce, size_t nnonce,
-                   const uint8_t *tag, size_t ntag,
-                   uint8_t *plain)
+/* Decryption given A_0 and S_0 = E_K(A_0). */
+static int ccm_decrypt_core(const cf_prp *prp, void *prpctx,
+                            const cf_iovec *cipher, size_t ncipheriov, size_t L,
+                            const cf_iovec *header, size_t nheaderiov,
+                            const uint8_t *nonce, size_t nnonce,
+                            const uint8_t A0[CF_MAXBLOCK],
+                            const uint8_t S0[CF_MAXBLOCK],
+                            const uint8_t *tag, size_t ntag,
+                            const cf_iovec *plain, size_t nplainiov)
 {
   uint8_t block[CF_MAXBLOCK];
+  size_t ncipher = cf_iov_len(cipher, ncipheriov);
+  size_t nheader = cf_iov_len(header, nheaderiov);
   
   assert(ntag >= 4 && ntag <= 16 && ntag % 2 == 0);
   assert(L >= 2 && L <= 8);
   assert(nnonce == prp->blocksz - L - 1);
-
-  uint8_t ctr_nonce[CF_MAXBLOCK];
-  build_ctr_nonce(ctr_nonce, L, nonce, nnonce);
-
-  cf_ctr ctr;
-  cf_ctr_init(&ctr, prp, prpctx, ctr_nonce);
-  cf_ctr_custom_counter(&ctr, prp->blocksz - L, L);
+  assert(cf_iov_len(plain, nplainiov) == ncipher);
 
   /* Decrypt tag. */
   uint8_t plain_tag[CF_MAXBLOCK];
-  cf_ctr_cipher(&ctr, tag, plain_tag, ntag);
-  cf_ctr_discard_block(&ctr);
-
-  /* Decrypt message. */
-  cf_ctr_cipher(&ctr, cipher, plain, ncipher);
+  xor_bb(plain_tag, tag, S0, ntag);
 
   cf_cbcmac_stream cm;
   cf_cbcmac_stream_init(&cm, prp, prpctx);
@@ -170,10 +304,15 @@ int cf_ccm_decrypt(const cf_prp *prp, void *prpctx,
              L, ncipher, nheader, ntag);
 
   if (nheader)
-    add_aad(&cm, block, header, nheader);
-  
-  cf_cbcmac_stream_update(&cm, plain, ncipher);
-  zero_pad(&cm);
+    add_aad(&cm, block, header, nheaderiov, nheader);
+
+  /* Decrypt and add message. */
+  cf_ctr ctr;
+  ccm_ctr_init(&ctr, prp, prpctx, L, A0);
+  ccm_message(&cm, &ctr,
+              cipher, ncipheriov,
+              plain, nplainiov,
+              ncipher, 0);
 
   /* Finish tag. */
   cf_cbcmac_stream_nopad_final(&cm, block);
@@ -183,11 +322,171 @@ int cf_ccm_decrypt(const cf_prp *prp, void *prpctx,
   if (!mem_eq(block, plain_tag, ntag))
   {
     err = 1;
-    mem_clean(plain, ncipher);
+    cf_iov_clean(plain, nplainiov);
   }
 
   mem_clean(block, sizeof block);
   mem_clean(plain_tag, sizeof plain_tag);
+  mem_clean(&ctr, sizeof ctr);
+  return err;
+}
+
+void cf_ccm_encrypt_iov(const cf_prp *prp, void *prpctx,
+                        const cf_iovec *plain, size_t nplainiov, size_t L,
+                        const cf_iovec *header, size_t nheaderiov,
+                        const uint8_t *nonce, size_t nnonce,
+                        const cf_iovec *cipher, size_t ncipheriov,
+                        uint8_t *tag, size_t ntag)
+{
+  /* Construct A_0 */
+  uint8_t A0[CF_MAXBLOCK], S0[CF_MAXBLOCK];
+  build_ctr_nonce(A0, L, nonce, nnonce);
+  prp->encrypt(prpctx, A0, S0);
+
+  ccm_encrypt_core(prp, prpctx,
+                   plain, nplainiov, L,
+                   header, nheaderiov,
+                   nonce, nnonce,
+                   A0, S0,
+                   cipher, ncipheriov,
+                   tag, ntag);
+
+  mem_clean(S0, sizeof S0);
+}
+
+int cf_ccm_decrypt_iov(const cf_prp *prp, void *prpctx,
+                       const cf_iovec *cipher, size_t ncipheriov, size_t L,
+                       const cf_iovec *header, size_t nheaderiov,
+                       const uint8_t *nonce, size_t nnonce,
+                       const uint8_t *tag, size_t ntag,
+                       const cf_iovec *plain, size_t nplainiov)
+{
+  uint8_t A0[CF_MAXBLOCK], S0[CF_MAXBLOCK];
+  build_ctr_nonce(A0, L, nonce, nnonce);
+  prp->encrypt(prpctx, A0, S0);
+
+  int err = ccm_decrypt_core(prp, prpctx,
+                             cipher, ncipheriov, L,
+                             header, nheaderiov,
+                             nonce, nnonce,
+                             A0, S0,
+                             tag, ntag,
+                             plain, nplainiov);
+
+  mem_clean(S0, sizeof S0);
+  return err;
+}
+
+void cf_ccm_encrypt(const cf_prp *prp, void *prpctx,
+                    const uint8_t *plain, size_t nplain, size_t L,
+                    const uint8_t *header, size_t nheader,
+                    const uint8_t *nonce, size_t nnonce,
+                    uint8_t *cipher,
+                    uint8_t *tag, size_t ntag)
+{
+  cf_iovec plain_iov = { (void *) plain, nplain },
+           header_iov = { (void *) header, nheader },
+           cipher_iov = { cipher, nplain };
+
+  cf_ccm_encrypt_iov(prp, prpctx,
+                     &plain_iov, 1, L,
+                     &header_iov, 1,
+                     nonce, nnonce,
+                     &cipher_iov, 1,
+                     tag, ntag);
+}
+
+int cf_ccm_decrypt(const cf_prp *prp, void *prpctx,
+                   const uint8_t *cipher, size_t ncipher, size_t L,
+                   const uint8_t *header, size_t nheader,
+                   const uint8_t *nonce, size_t nnonce,
+                   const uint8_t *tag, size_t ntag,
+                   uint8_t *plain)
+{
+  cf_iovec cipher_iov = { (void *) cipher, ncipher },
+           header_iov = { (void *) header, nheader },
+           plain_iov = { plain, ncipher };
+
+  return cf_ccm_decrypt_iov(prp, prpctx,
+                            &cipher_iov, 1, L,
+                            &header_iov, 1,
+                            nonce, nnonce,
+                            tag, ntag,
+                            &plain_iov, 1);
+}
+
+/* Batches are done in groups of this many records: the
+ * S_0 blocks for a group are found in one PRP call. */
+#define CCM_LANES 8
+
+static int ccm_batch(const cf_prp *prp, void *prpctx,
+                     cf_aead_record *recs, size_t nrecs,
+                     size_t L, size_t ntag, int encrypt)
+{
+  uint8_t A0[CCM_LANES][CF_MAXBLOCK], S0[CCM_LANES][CF_MAXBLOCK];
+  size_t blocksz = prp->blocksz;
+  int err = 0;
+
+  while (nrecs)
+  {
+    size_t n = MIN(nrecs, (size_t) CCM_LANES);
+
+    /* A_0 for each record, contiguous for the PRP. */
+    uint8_t *A0s = A0[0], *S0s = S0[0];
+    for (size_t i = 0; i < n; i++)
+    {
+      assert(recs[i].nnonce == blocksz - L - 1);
+      build_ctr_nonce(A0s + i * blocksz, L, recs[i].nonce, recs[i].nnonce);
+    }
+
+    cf_prp_encrypt_blocks(prp, prpctx, A0s, S0s, n);
+
+    for (size_t i = 0; i < n; i++)
+    {
+      cf_aead_record *r = &recs[i];
+      cf_iovec in = { (void *) r->in, r->nbytes },
+               header = { (void *) r->header, r->nheader },
+               out = { r->out, r->nbytes };
+
+      if (encrypt)
+      {
+        ccm_encrypt_core(prp, prpctx,
+                         &in, 1, L,
+                         &header, 1,
+                         r->nonce, r->nnonce,
+                         A0s + i * blocksz, S0s + i * blocksz,
+                         &out, 1,
+                         r->tag, ntag);
+      } else {
+        r->err = ccm_decrypt_core(prp, prpctx,
+                                  &in, 1, L,
+                                  &header, 1,
+                                  r->nonce, r->nnonce,
+                                  A0s + i * blocksz, S0s + i * blocksz,
+                                  r->tag, ntag,
+                                  &out, 1);
+        err |= r->err;
+      }
+    }
+
+    recs += n;
+    nrecs -= n;
+  }
+
+  mem_clean(S0, sizeof S0);
   return err;
 }
 
+void cf_ccm_encrypt_batch(const cf_prp *prp, void *prpctx,
+                          cf_aead_record *recs, size_t nrecs,
+                          size_t L, size_t ntag)
+{
+  ccm_batch(prp, prpctx, recs, nrecs, L, ntag, 1);
+}
+
+int cf_ccm_decrypt_batch(const cf_prp *prp, void *prpctx,
+                         cf_aead_record *recs, size_t nrecs,
+                         size_t L, size_t ntag)
+{
+  return ccm_batch(prp, prpctx, recs, nrecs, L, ntag, 0);
+}
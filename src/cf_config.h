@@ -56,4 +56,46 @@
 # define CF_CACHE_SIDE_CHANNEL_PROTECTION CF_SIDE_CHANNEL_PROTECTION
 #endif
 
+/* .. c:macro:: CF_SIMD
+ * Define this as 1 to use vector (SIMD) instructions where available,
+ * or 0 to use only portable code.
+ *
+ * This uses GCC/clang vector extensions, so it compiles to SSE2 on x86
+ * and NEON on ARM.  Code paths which need instruction set extensions
+ * (like AVX2) are selected at runtime according to the CPU.
+ * **This option alters the ABI**: it changes the layout of
+ * :c:type:`cf_poly1305`.
+ *
+ * The default is on when building with GCC or clang for x86 or for
+ * little-endian ARM with NEON, and off otherwise.
+ */
+#ifndef CF_SIMD
+# if (defined(__GNUC__) || defined(__clang__)) && \
+     __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ && \
+     (defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__)) || \
+      defined(__ARM_NEON) || defined(__aarch64__))
+#  define CF_SIMD 1
+# else
+#  define CF_SIMD 0
+# endif
+#endif
+
+/* .. c:macro:: CF_POLY1305_64BIT
+ * Define this as 1 to do Poly1305 arithmetic with three 44-bit limbs
+ * and 64x64 to 128-bit multiplication, or 0 to use five 26-bit limbs
+ * and 32x32 to 64-bit multiplication.  Both are constant time.
+ * **This option alters the ABI**: it changes the layout of
+ * :c:type:`cf_poly1305`.
+ *
+ * The default is on when the compiler has a 128-bit integer type
+ * (which usually means a 64-bit target), and off otherwise.
+ */
+#ifndef CF_POLY1305_64BIT
+# if defined(__SIZEOF_INT128__)
+#  define CF_POLY1305_64BIT 1
+# else
+#  define CF_POLY1305_64BIT 0
+# endif
+#endif
+
 #endif
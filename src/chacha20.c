@@ -15,36 +15,38 @@
 #include "bitops.h"
 #include "salsa20.h"
 #include "blockwise.h"
+#include "handy.h"
+#include "simd.h"
 #include "tassert.h"
 
 #include <string.h>
 #include <stdlib.h>
 
-void cf_chacha20_core(const uint8_t key0[16],
-                      const uint8_t key1[16],
-                      const uint8_t nonce[16],
-                      const uint8_t constant[16],
-                      uint8_t out[64])
+/* Reads the core function input into x. */
+static void chacha20_setup(uint32_t x[16],
+                           const uint8_t key0[16],
+                           const uint8_t key1[16],
+                           const uint8_t nonce[16],
+                           const uint8_t constant[16])
+{
+  for (int i = 0; i < 4; i++)
+  {
+    x[i] = read32_le(constant + 4 * i);
+    x[4 + i] = read32_le(key0 + 4 * i);
+    x[8 + i] = read32_le(key1 + 4 * i);
+    x[12 + i] = read32_le(nonce + 4 * i);
+  }
+}
+
+/* The ChaCha core function, on words, with the given (even) number
+ * of rounds.  Every caller passes a constant, so this is specialised
+ * for each variant. */
+static inline void chacha_block(const uint32_t x[16], uint32_t out[16], int rounds)
 {
-  uint32_t z0, z1, z2, z3, z4, z5, z6, z7,
-           z8, z9, za, zb, zc, zd, ze, zf;
-
-  uint32_t x0 = z0 = read32_le(constant + 0),
-           x1 = z1 = read32_le(constant + 4),
-           x2 = z2 = read32_le(constant + 8),
-           x3 = z3 = read32_le(constant + 12),
-           x4 = z4 = read32_le(key0 + 0),
-           x5 = z5 = read32_le(key0 + 4),
-           x6 = z6 = read32_le(key0 + 8),
-           x7 = z7 = read32_le(key0 + 12),
-           x8 = z8 = read32_le(key1 + 0),
-           x9 = z9 = read32_le(key1 + 4),
-           xa = za = read32_le(key1 + 8),
-           xb = zb = read32_le(key1 + 12),
-           xc = zc = read32_le(nonce + 0),
-           xd = zd = read32_le(nonce + 4),
-           xe = ze = read32_le(nonce + 8),
-           xf = zf = read32_le(nonce + 12);
+  uint32_t z0 = x[0], z1 = x[1], z2 = x[2], z3 = x[3],
+           z4 = x[4], z5 = x[5], z6 = x[6], z7 = x[7],
+           z8 = x[8], z9 = x[9], za = x[10], zb = x[11],
+           zc = x[12], zd = x[13], ze = x[14], zf = x[15];
 
 #define QUARTER(a, b, c, d) \
   a += b; d = rotl32(d ^ a, 16); \
@@ -52,7 +54,7 @@ void cf_chacha20_core(const uint8_t key0[16],
   a += b; d = rotl32(d ^ a, 8);  \
   c += d; b = rotl32(b ^ c, 7);
 
-  for (int i = 0; i < 10; i++)
+  for (int i = 0; i < rounds; i += 2)
   {
     QUARTER(z0, z4, z8, zc);
     QUARTER(z1, z5, z9, zd);
@@ -64,57 +66,90 @@ void cf_chacha20_core(const uint8_t key0[16],
     QUARTER(z3, z4, z9, ze);
   }
 
-  x0 += z0;
-  x1 += z1;
-  x2 += z2;
-  x3 += z3;
-  x4 += z4;
-  x5 += z5;
-  x6 += z6;
-  x7 += z7;
-  x8 += z8;
-  x9 += z9;
-  xa += za;
-  xb += zb;
-  xc += zc;
-  xd += zd;
-  xe += ze;
-  xf += zf;
-
-  write32_le(x0, out + 0);
-  write32_le(x1, out + 4);
-  write32_le(x2, out + 8);
-  write32_le(x3, out + 12);
-  write32_le(x4, out + 16);
-  write32_le(x5, out + 20);
-  write32_le(x6, out + 24);
-  write32_le(x7, out + 28);
-  write32_le(x8, out + 32);
-  write32_le(x9, out + 36);
-  write32_le(xa, out + 40);
-  write32_le(xb, out + 44);
-  write32_le(xc, out + 48);
-  write32_le(xd, out + 52);
-  write32_le(xe, out + 56);
-  write32_le(xf, out + 60);
+  out[0] = x[0] + z0;
+  out[1] = x[1] + z1;
+  out[2] = x[2] + z2;
+  out[3] = x[3] + z3;
+  out[4] = x[4] + z4;
+  out[5] = x[5] + z5;
+  out[6] = x[6] + z6;
+  out[7] = x[7] + z7;
+  out[8] = x[8] + z8;
+  out[9] = x[9] + z9;
+  out[10] = x[10] + za;
+  out[11] = x[11] + zb;
+  out[12] = x[12] + zc;
+  out[13] = x[13] + zd;
+  out[14] = x[14] + ze;
+  out[15] = x[15] + zf;
+}
+
+void cf_chacha20_core(const uint8_t key0[16],
+                      const uint8_t key1[16],
+                      const uint8_t nonce[16],
+                      const uint8_t constant[16],
+                      uint8_t out[64])
+{
+  uint32_t x[16], y[16];
+
+  chacha20_setup(x, key0, key1, nonce, constant);
+  chacha_block(x, y, 20);
+
+  for (int i = 0; i < 16; i++)
+    write32_le(y[i], out + 4 * i);
 }
 
+#if CF_SIMD
+/* Multi-block cores: 4 blocks at once with 128-bit vectors, and 8 at
+ * once with AVX2 where the CPU has it. */
+#define VQUARTER(a, b, c, d) \
+  a += b; d = CF_SIMD_ROTL32(d ^ a, 16); \
+  c += d; b = CF_SIMD_ROTL32(b ^ c, 12); \
+  a += b; d = CF_SIMD_ROTL32(d ^ a, 8);  \
+  c += d; b = CF_SIMD_ROTL32(b ^ c, 7);
+
+#define CHACHA_FN chacha_core_x4
+#define CHACHA_VEC cf_u32x4
+#define CHACHA_LANES 4
+#define CHACHA_ATTR
+#define CHACHA_XOR CF_SIMD_XOR_4X4
+#include "chacha20.simd.c"
+#undef CHACHA_FN
+#undef CHACHA_VEC
+#undef CHACHA_LANES
+#undef CHACHA_ATTR
+#undef CHACHA_XOR
+
+#if CF_SIMD_HAVE_AVX2
+#define CHACHA_FN chacha_core_x8
+#define CHACHA_VEC cf_u32x8
+#define CHACHA_LANES 8
+#define CHACHA_ATTR CF_SIMD_AVX2
+#define CHACHA_XOR CF_SIMD_XOR_4X8
+#include "chacha20.simd.c"
+#undef CHACHA_FN
+#undef CHACHA_VEC
+#undef CHACHA_LANES
+#undef CHACHA_ATTR
+#undef CHACHA_XOR
+#endif
+
+#undef VQUARTER
+#endif
+
 static const uint8_t *chacha20_tau = (const uint8_t *) "expand 16-byte k";
 static const uint8_t *chacha20_sigma = (const uint8_t *) "expand 32-byte k";
 
-static void set_key(cf_chacha20_ctx *ctx, const uint8_t *key, size_t nkey)
+static void set_state(cf_chacha20_ctx *ctx, const uint8_t *key, size_t nkey,
+                      const uint8_t nonce[16])
 {
   switch (nkey)
   {
     case 16:
-      memcpy(ctx->key0, key, 16);
-      memcpy(ctx->key1, key, 16);
-      ctx->constant = chacha20_tau;
+      chacha20_setup(ctx->state, key, key, nonce, chacha20_tau);
       break;
     case 32:
-      memcpy(ctx->key0, key, 16);
-      memcpy(ctx->key1, key + 16, 16);
-      ctx->constant = chacha20_sigma;
+      chacha20_setup(ctx->state, key, key + 16, nonce, chacha20_sigma);
       break;
     default:
       abort();
@@ -123,38 +158,396 @@ static void set_key(cf_chacha20_ctx *ctx, const uint8_t *key, size_t nkey)
 
 void cf_chacha20_init(cf_chacha20_ctx *ctx, const uint8_t *key, size_t nkey, const uint8_t nonce[8])
 {
-  set_key(ctx, key, nkey);
-  memset(ctx->nonce, 0, sizeof ctx->nonce);
-  memcpy(ctx->nonce + 8, nonce, 8);
-  ctx->nblock = 0;
-  ctx->ncounter = 8;
+  uint8_t fullnonce[16] = { 0 };
+  memcpy(fullnonce + 8, nonce, 8);
+  cf_chacha20_init_custom(ctx, key, nkey, fullnonce, 8);
 }
 
 void cf_chacha20_init_custom(cf_chacha20_ctx *ctx, const uint8_t *key, size_t nkey,
                              const uint8_t nonce[16], size_t ncounter)
 {
-  assert(ncounter > 0);
-  set_key(ctx, key, nkey);
-  memcpy(ctx->nonce, nonce, sizeof ctx->nonce);
-  ctx->nblock = 0;
+  assert(ncounter > 0 && ncounter <= 16);
+  set_state(ctx, key, nkey, nonce);
+  ctx->counter = 12;
   ctx->ncounter = ncounter;
+  ctx->nblock = 0;
+}
+
+void cf_hchacha20(const uint8_t key[32], const uint8_t nonce[16], uint8_t out[32])
+{
+  uint32_t x[16], y[16];
+
+  chacha20_setup(x, key, key + 16, nonce, chacha20_sigma);
+  chacha_block(x, y, 20);
+
+  /* Undo the feed-forward, and keep words 0-3 and 12-15. */
+  for (int i = 0; i < 4; i++)
+  {
+    write32_le(y[i] - x[i], out + 4 * i);
+    write32_le(y[12 + i] - x[12 + i], out + 16 + 4 * i);
+  }
+
+  mem_clean(x, sizeof x);
+  mem_clean(y, sizeof y);
+}
+
+void cf_xchacha20_init(cf_chacha20_ctx *ctx, const uint8_t key[32], const uint8_t nonce[24])
+{
+  uint8_t subkey[32], fullnonce[16] = { 0 };
+
+  cf_hchacha20(key, nonce, subkey);
+  memcpy(fullnonce + 8, nonce + 16, 8);
+  cf_chacha20_init_custom(ctx, subkey, sizeof subkey, fullnonce, 8);
+
+  mem_clean(subkey, sizeof subkey);
+}
+
+static inline void chacha_next_block(cf_chacha20_ctx *ctx, uint8_t *out, int rounds)
+{
+  uint32_t ks[16];
+
+  chacha_block(ctx->state, ks, rounds);
+  incr_le32(ctx->state + ctx->counter, ctx->ncounter);
+
+  for (int i = 0; i < 16; i++)
+    write32_le(ks[i], out + 4 * i);
 }
 
 static void cf_chacha20_next_block(void *vctx, uint8_t *out)
 {
-  cf_chacha20_ctx *ctx = vctx;
-  cf_chacha20_core(ctx->key0,
-                   ctx->key1,
-                   ctx->nonce,
-                   ctx->constant,
-                   out);
-  incr_le(ctx->nonce, ctx->ncounter);
+  chacha_next_block(vctx, out, 20);
 }
 
-void cf_chacha20_cipher(cf_chacha20_ctx *ctx, const uint8_t *input, uint8_t *output, size_t bytes)
+static void cf_chacha12_next_block(void *vctx, uint8_t *out)
+{
+  chacha_next_block(vctx, out, 12);
+}
+
+static void cf_chacha8_next_block(void *vctx, uint8_t *out)
+{
+  chacha_next_block(vctx, out, 8);
+}
+
+#if CF_SIMD
+/* Writes input states for nlanes blocks to x, in the form the
+ * multi-block cores want, and advances the counter.  Only the
+ * nonce/counter words differ between blocks; fill_key says whether
+ * to write the others too. */
+static void chacha20_load_lanes(cf_chacha20_ctx *ctx, uint32_t *x,
+                                size_t nlanes, int fill_key)
+{
+  for (size_t l = 0; l < nlanes; l++)
+  {
+    for (size_t w = fill_key ? 0 : 12; w < 16; w++)
+      x[w * nlanes + l] = ctx->state[w];
+    incr_le32(ctx->state + ctx->counter, ctx->ncounter);
+  }
+}
+/* XORs key stream into whole blocks, several at a time.  Returns
+ * the number of bytes done: any remainder is less than 4 blocks. */
+static size_t chacha_cipher_lanes(cf_chacha20_ctx *ctx,
+                                  const uint8_t *input, uint8_t *output,
+                                  size_t bytes, int rounds)
+{
+  uint32_t x[16 * 8];
+  size_t done = 0, nlanes = 4, loaded = 0;
+
+#if CF_SIMD_HAVE_AVX2
+  if (cf_simd_have_avx2() && bytes >= 64 * 8)
+    nlanes = 8;
+#endif
+
+  while (bytes - done >= 64 * 4)
+  {
+    /* Drop to 4 lanes for the last few blocks. */
+    if (bytes - done < 64 * nlanes)
+      nlanes = 4;
+
+    chacha20_load_lanes(ctx, x, nlanes, loaded != nlanes);
+    loaded = nlanes;
+
+#if CF_SIMD_HAVE_AVX2
+    if (nlanes == 8)
+      chacha_core_x8(x, input + done, output + done, rounds);
+    else
+#endif
+      chacha_core_x4(x, input + done, output + done, rounds);
+
+    done += 64 * nlanes;
+  }
+
+  mem_clean(x, sizeof x);
+  return done;
+}
+#endif
+
+/* The body of the cipher functions.  next_block must produce one
+ * block with the same number of rounds. */
+static inline void chacha_cipher(cf_chacha20_ctx *ctx,
+                                 const uint8_t *input, uint8_t *output, size_t bytes,
+                                 int rounds, cf_blockwise_out_fn next_block)
 {
+  /* Use up any key stream left over from last time. */
+  if (ctx->nblock)
+  {
+    size_t taken = MIN(bytes, ctx->nblock);
+    cf_blockwise_xor(ctx->block, &ctx->nblock, 64,
+                     input, output, taken,
+                     next_block,
+                     ctx);
+    input += taken;
+    output += taken;
+    bytes -= taken;
+  }
+
+#if CF_SIMD
+  /* Runs of whole blocks: use the multi-block cores. */
+  if (bytes >= 64 * 4)
+  {
+    size_t done = chacha_cipher_lanes(ctx, input, output, bytes, rounds);
+    input += done;
+    output += done;
+    bytes -= done;
+  }
+#endif
+
+  /* Whole blocks go directly from input to output. */
+  if (bytes >= 64)
+  {
+    uint32_t ks[16];
+
+    while (bytes >= 64)
+    {
+      chacha_block(ctx->state, ks, rounds);
+      incr_le32(ctx->state + ctx->counter, ctx->ncounter);
+
+      for (int i = 0; i < 16; i++)
+        write32_le(read32_le(input + 4 * i) ^ ks[i], output + 4 * i);
+
+      input += 64;
+      output += 64;
+      bytes -= 64;
+    }
+
+    mem_clean(ks, sizeof ks);
+  }
+
+  /* Remaining partial block. */
   cf_blockwise_xor(ctx->block, &ctx->nblock, 64,
                    input, output, bytes,
-                   cf_chacha20_next_block,
+                   next_block,
                    ctx);
 }
+
+void cf_chacha20_cipher(cf_chacha20_ctx *ctx, const uint8_t *input, uint8_t *output, size_t bytes)
+{
+  chacha_cipher(ctx, input, output, bytes, 20, cf_chacha20_next_block);
+}
+
+void cf_chacha12_cipher(cf_chacha20_ctx *ctx, const uint8_t *input, uint8_t *output, size_t bytes)
+{
+  chacha_cipher(ctx, input, output, bytes, 12, cf_chacha12_next_block);
+}
+
+void cf_chacha8_cipher(cf_chacha20_ctx *ctx, const uint8_t *input, uint8_t *output, size_t bytes)
+{
+  chacha_cipher(ctx, input, output, bytes, 8, cf_chacha8_next_block);
+}
+
+/* Sets the counter bytes of ctx's state to block, truncated or
+ * zero-extended to the counter's length. */
+static void chacha20_set_counter(cf_chacha20_ctx *ctx, uint64_t block)
+{
+  uint32_t *v = ctx->state + ctx->counter;
+
+  for (size_t i = 0; i < ctx->ncounter; i++)
+  {
+    uint32_t byte = i < 8 ? (uint32_t) (block >> (8 * i)) & 0xff : 0;
+    size_t shift = 8 * (i % 4);
+    v[i / 4] = (v[i / 4] & ~(UINT32_C(0xff) << shift)) | (byte << shift);
+  }
+}
+
+/* The body of the seek functions.  next_block must produce one
+ * block with the rounds of the cipher the context is used with. */
+static void chacha_seek(cf_chacha20_ctx *ctx, uint64_t offset,
+                        cf_blockwise_out_fn next_block)
+{
+  chacha20_set_counter(ctx, offset / 64);
+  ctx->nblock = 0;
+
+  /* Start part way into a block: generate it, and keep the tail. */
+  if (offset % 64)
+  {
+    next_block(ctx, ctx->block);
+    ctx->nblock = 64 - offset % 64;
+  }
+}
+
+void cf_chacha20_seek(cf_chacha20_ctx *ctx, uint64_t offset)
+{
+  chacha_seek(ctx, offset, cf_chacha20_next_block);
+}
+
+void cf_chacha12_seek(cf_chacha20_ctx *ctx, uint64_t offset)
+{
+  chacha_seek(ctx, offset, cf_chacha12_next_block);
+}
+
+void cf_chacha8_seek(cf_chacha20_ctx *ctx, uint64_t offset)
+{
+  chacha_seek(ctx, offset, cf_chacha8_next_block);
+}
+
+void cf_chacha20_cipher_slice(const cf_chacha20_ctx *ctx, uint64_t offset,
+                              const uint8_t *input, uint8_t *output, size_t count)
+{
+  cf_chacha20_ctx local = *ctx;
+
+  cf_chacha20_seek(&local, offset);
+  cf_chacha20_cipher(&local, input, output, count);
+  mem_clean(&local, sizeof local);
+}
+
+/* Starts a ChaCha20 context for item. */
+static void chacha20_item_init(cf_chacha20_ctx *ctx, const cf_chacha20_item *item)
+{
+  uint8_t fullnonce[16];
+
+  write32_le(item->counter, fullnonce);
+  memcpy(fullnonce + 4, item->nonce, 12);
+  cf_chacha20_init_custom(ctx, item->key, 32, fullnonce, 4);
+}
+
+#if CF_SIMD
+/* Items of at least this many bytes are better done on their own
+ * with cf_chacha20_cipher, which uses every lane for one item. */
+#define BATCH_ALONE (64 * 8)
+
+/* One message being processed by chacha20_batch_lanes. */
+typedef struct
+{
+  cf_chacha20_item *item;
+  uint32_t counter;
+  size_t done;
+} chacha_lane;
+
+/* Each lane runs one message: each step makes the next key stream
+ * block of every lane's message.  Finished lanes are refilled with
+ * the next short message. */
+static void chacha20_batch_lanes(cf_chacha20_item *items, size_t nitems,
+                                 size_t nlanes)
+{
+  static const uint8_t zeroes[64 * 8];
+  chacha_lane lanes[8] = { { 0 } };
+  uint32_t x[16 * 8];
+  uint8_t ks[64 * 8];
+  size_t next = 0, nactive = 0;
+
+  memset(x, 0, sizeof x);
+
+  while (1)
+  {
+    /* Fill idle lanes while there are messages left. */
+    for (size_t l = 0; l < nlanes; l++)
+    {
+      while (lanes[l].item == NULL && next < nitems)
+      {
+        cf_chacha20_item *item = &items[next++];
+
+        if (item->nbytes == 0 || item->nbytes >= BATCH_ALONE)
+          continue;
+
+        lanes[l].item = item;
+        lanes[l].counter = item->counter;
+        lanes[l].done = 0;
+        nactive++;
+
+        /* The lane's input state, apart from the counter. */
+        for (size_t w = 0; w < 4; w++)
+          x[w * nlanes + l] = read32_le(chacha20_sigma + 4 * w);
+        for (size_t w = 0; w < 8; w++)
+          x[(4 + w) * nlanes + l] = read32_le(item->key + 4 * w);
+        for (size_t w = 0; w < 3; w++)
+          x[(13 + w) * nlanes + l] = read32_le(item->nonce + 4 * w);
+      }
+    }
+
+    if (nactive == 0)
+      break;
+
+    /* Each lane's block counter.  Idle lanes make key stream
+     * that is never used. */
+    for (size_t l = 0; l < nlanes; l++)
+      x[12 * nlanes + l] = lanes[l].counter;
+
+#if CF_SIMD_HAVE_AVX2
+    if (nlanes == 8)
+      chacha_core_x8(x, zeroes, ks, 20);
+    else
+#endif
+      chacha_core_x4(x, zeroes, ks, 20);
+
+    /* Use each lane's block, and retire finished lanes. */
+    for (size_t l = 0; l < nlanes; l++)
+    {
+      chacha_lane *lane = &lanes[l];
+
+      if (lane->item == NULL)
+        continue;
+
+      cf_chacha20_item *item = lane->item;
+      size_t take = MIN(item->nbytes - lane->done, (size_t) 64);
+      const uint8_t *in = item->in + lane->done;
+      uint8_t *out = item->out + lane->done;
+
+      if (take == 64)
+      {
+        for (size_t j = 0; j < 64; j += 16)
+          cf_simd_xor16(in + j, out + j, ks + 64 * l + j);
+      } else {
+        xor_bb(out, in, ks + 64 * l, take);
+      }
+
+      lane->done += take;
+      lane->counter++;
+
+      if (lane->done == item->nbytes)
+      {
+        lane->item = NULL;
+        nactive--;
+      }
+    }
+  }
+
+  mem_clean(x, sizeof x);
+  mem_clean(ks, sizeof ks);
+}
+#endif
+
+void cf_chacha20_batch(cf_chacha20_item *items, size_t nitems)
+{
+  for (size_t i = 0; i < nitems; i++)
+  {
+    cf_chacha20_item *item = &items[i];
+    cf_chacha20_ctx ctx;
+
+#if CF_SIMD
+    if (item->nbytes < BATCH_ALONE)
+      continue;
+#endif
+
+    chacha20_item_init(&ctx, item);
+    cf_chacha20_cipher(&ctx, item->in, item->out, item->nbytes);
+    mem_clean(&ctx, sizeof ctx);
+  }
+
+#if CF_SIMD
+  size_t nlanes = 4;
+#if CF_SIMD_HAVE_AVX2
+  if (cf_simd_have_avx2())
+    nlanes = 8;
+#endif
+  chacha20_batch_lanes(items, nitems, nlanes);
+#endif
+}
@@ -0,0 +1,78 @@
+/*
+ * cifra - embedded cryptography library
+ * Written in 2014 by Joseph Birr-Pixton <jpixton@gmail.com>
+ *
+ * To the extent possible under law, the author(s) have dedicated all
+ * copyright and related and neighboring rights to this software to the
+ * public domain worldwide. This software is distributed without any
+ * warranty.
+ *
+ * You should have received a copy of the CC0 Public Domain Dedication
+ * along with this software. If not, see
+ * <http://creativecommons.org/publicdomain/zero/1.0/>.
+ */
+
+/* Multi-block ChaCha core.  This is included by chacha20.c once for
+ * each vector width, with these defined:
+ *
+ * CHACHA_FN: function name.
+ * CHACHA_VEC: vector type.
+ * CHACHA_LANES: number of 32-bit lanes in CHACHA_VEC.
+ * CHACHA_ATTR: function attributes.
+ * CHACHA_XOR: CF_SIMD_XOR_4X4 or CF_SIMD_XOR_4X8, to match.
+ *
+ * `rounds` is the number of rounds: 8, 12 or 20.
+ *
+ * Lane l of each vector works on block l.  in[w * CHACHA_LANES + l]
+ * is word w of the input state for block l.  The key stream for
+ * these blocks, one after another, is XORed with 64 * CHACHA_LANES
+ * bytes of input and written to output.
+ */
+CHACHA_ATTR
+static void CHACHA_FN(const uint32_t *in,
+                      const uint8_t *input, uint8_t *output,
+                      int rounds)
+{
+  CHACHA_VEC x[16];
+
+  for (int w = 0; w < 16; w++)
+    memcpy(&x[w], in + w * CHACHA_LANES, sizeof x[w]);
+
+  CHACHA_VEC z0 = x[0], z1 = x[1], z2 = x[2], z3 = x[3],
+             z4 = x[4], z5 = x[5], z6 = x[6], z7 = x[7],
+             z8 = x[8], z9 = x[9], za = x[10], zb = x[11],
+             zc = x[12], zd = x[13], ze = x[14], zf = x[15];
+
+  for (int i = 0; i < rounds; i += 2)
+  {
+    VQUARTER(z0, z4, z8, zc);
+    VQUARTER(z1, z5, z9, zd);
+    VQUARTER(z2, z6, za, ze);
+    VQUARTER(z3, z7, zb, zf);
+    VQUARTER(z0, z5, za, zf);
+    VQUARTER(z1, z6, zb, zc);
+    VQUARTER(z2, z7, z8, zd);
+    VQUARTER(z3, z4, z9, ze);
+  }
+
+  x[0] += z0;
+  x[1] += z1;
+  x[2] += z2;
+  x[3] += z3;
+  x[4] += z4;
+  x[5] += z5;
+  x[6] += z6;
+  x[7] += z7;
+  x[8] += z8;
+  x[9] += z9;
+  x[10] += za;
+  x[11] += zb;
+  x[12] += zc;
+  x[13] += zd;
+  x[14] += ze;
+  x[15] += zf;
+
+  for (int w = 0; w < 16; w += 4)
+    CHACHA_XOR(x[w], x[w + 1], x[w + 2], x[w + 3],
+               input + 4 * w, output + 4 * w, 64);
+}
@@ -16,7 +16,9 @@
 #include "salsa20.h"
 #include "poly1305.h"
 #include "bitops.h"
+#include "iov.h"
 #include "handy.h"
+#include "tassert.h"
 
 #define ENCRYPT 1
 #define DECRYPT 0
@@ -24,91 +26,195 @@
 #define SUCCESS 0
 #define FAILURE 1
 
-static int process(const uint8_t key[static 32],
-                   const uint8_t nonce[static 12],
-                   const uint8_t *header, size_t nheader,
-                   const uint8_t *input, size_t nbytes,
-                   uint8_t *output,
-                   int mode,
-                   uint8_t tag[static 16])
+/* The message is encrypted and MACed, or MACed and decrypted, in
+ * chunks of this many bytes: each chunk is still in L1 cache when
+ * it is read the second time.  This is a whole number of ChaCha20
+ * and Poly1305 blocks, so both stay on their multi-block paths, and
+ * is large enough that the per-call costs of those paths are
+ * small. */
+#define CHUNK 8192
+
+#define PADLEN(x) ((16 - ((x) & 0xf)) & 0xf)
+
+static const uint8_t zeroes[16] = { 0 };
+
+void cf_chacha20poly1305_init(cf_chacha20poly1305_ctx *ctx,
+                              const uint8_t key[static 32],
+                              const uint8_t nonce[static 12])
 {
-  /* First, generate the Poly1305 key by running ChaCha20 with the
-   * given key and a zero counter.  The first half of the
-   * 64-byte output is the key. */
+  /* First, generate the Poly1305 key: it is the first half of
+   * the ChaCha20 block with the given key and a zero counter. */
   uint8_t fullnonce[16] = { 0 };
   memcpy(fullnonce + 4, nonce, 12);
 
-  uint8_t polykey[32] = { 0 };
-  cf_chacha20_ctx chacha;
-  cf_chacha20_init_custom(&chacha, key, 32, fullnonce, 4);
-  cf_chacha20_cipher(&chacha, polykey, polykey, sizeof polykey);
+  uint8_t polykey[64];
+  cf_chacha20_core(key, key + 16, fullnonce,
+                   (const uint8_t *) "expand 32-byte k", polykey);
 
   /* Now initialise Poly1305. */
-  cf_poly1305 poly;
-  cf_poly1305_init(&poly, polykey, polykey + 16);
-  mem_clean(polykey, sizeof polykey);
-
-  /* Discard next 32 bytes of chacha20 key stream. */
-  cf_chacha20_cipher(&chacha, polykey, polykey, sizeof polykey);
+  cf_poly1305_init(&ctx->poly, polykey, polykey + 16);
   mem_clean(polykey, sizeof polykey);
 
-  /* The input to Poly1305 is:
-   * AAD || pad(AAD) || cipher || pad(cipher) || len_64(aad) || len_64(cipher) */
-  uint8_t padbuf[16] = { 0 };
+  /* The message is encrypted from block 1 onwards. */
+  fullnonce[0] = 1;
+  cf_chacha20_init_custom(&ctx->chacha, key, 32, fullnonce, 4);
 
-#define PADLEN(x) ((16 - ((x) & 0xf)) & 0xf)
+  ctx->nheader = 0;
+  ctx->nbytes = 0;
+  ctx->payload = 0;
+}
 
-  /* AAD || pad(AAD) */
-  cf_poly1305_update(&poly, header, nheader);
-  cf_poly1305_update(&poly, padbuf, PADLEN(nheader));
+/* The input to Poly1305 is:
+ * AAD || pad(AAD) || cipher || pad(cipher) || len_64(aad) || len_64(cipher) */
+void cf_chacha20poly1305_aad(cf_chacha20poly1305_ctx *ctx,
+                             const uint8_t *header, size_t nheader)
+{
+  assert(!ctx->payload);
+  cf_poly1305_update(&ctx->poly, header, nheader);
+  ctx->nheader += nheader;
+}
 
-  /* || cipher */
-  if (mode == ENCRYPT)
+/* Moves from AAD to the message, if we haven't already:
+ * || pad(AAD) */
+static void start_payload(cf_chacha20poly1305_ctx *ctx)
+{
+  if (!ctx->payload)
   {
-    /* If we're encrypting, we compute the ciphertext
-     * before inputting it into the MAC. */
-    cf_chacha20_cipher(&chacha, input, output, nbytes);
-    cf_poly1305_update(&poly, output, nbytes);
-  } else {
-    /* Otherwise: decryption -- input the ciphertext.
-     * Delay actual decryption until we checked the MAC. */
-    cf_poly1305_update(&poly, input, nbytes);
+    cf_poly1305_update(&ctx->poly, zeroes, PADLEN(ctx->nheader));
+    ctx->payload = 1;
   }
+}
 
-  /* || pad(cipher) */
-  cf_poly1305_update(&poly, padbuf, PADLEN(nbytes));
+/* || cipher
+ *
+ * If we're encrypting, we compute the ciphertext before
+ * inputting it into the MAC.  If we're decrypting, we input
+ * the ciphertext and decrypt it in the same pass. */
+void cf_chacha20poly1305_encrypt_update(cf_chacha20poly1305_ctx *ctx,
+                                        const uint8_t *plaintext,
+                                        uint8_t *ciphertext,
+                                        size_t nbytes)
+{
+  start_payload(ctx);
+  ctx->nbytes += nbytes;
 
-  /* || len_64(aad) || len_64(cipher) */
-  write64_le(nheader, padbuf);
-  write64_le(nbytes, padbuf + 8);
-  cf_poly1305_update(&poly, padbuf, sizeof padbuf);
+  while (nbytes)
+  {
+    size_t take = MIN(nbytes, (size_t) CHUNK);
+    cf_chacha20_cipher(&ctx->chacha, plaintext, ciphertext, take);
+    cf_poly1305_update(&ctx->poly, ciphertext, take);
+    plaintext += take;
+    ciphertext += take;
+    nbytes -= take;
+  }
+}
 
-  /* MAC computation is now complete. */
+void cf_chacha20poly1305_decrypt_update(cf_chacha20poly1305_ctx *ctx,
+                                        const uint8_t *ciphertext,
+                                        uint8_t *plaintext,
+                                        size_t nbytes)
+{
+  start_payload(ctx);
+  ctx->nbytes += nbytes;
 
-  if (mode == ENCRYPT)
+  /* MAC before decrypting: in and out may be the same. */
+  while (nbytes)
   {
-    cf_poly1305_finish(&poly, tag);
-    mem_clean(&chacha, sizeof chacha);
-    return SUCCESS;
+    size_t take = MIN(nbytes, (size_t) CHUNK);
+    cf_poly1305_update(&ctx->poly, ciphertext, take);
+    cf_chacha20_cipher(&ctx->chacha, ciphertext, plaintext, take);
+    ciphertext += take;
+    plaintext += take;
+    nbytes -= take;
   }
+}
+
+/* Finishes the MAC: || pad(cipher) || len_64(aad) || len_64(cipher) */
+static void finish(cf_chacha20poly1305_ctx *ctx, uint8_t tag[static 16])
+{
+  uint8_t lengths[16];
+
+  start_payload(ctx);
+  cf_poly1305_update(&ctx->poly, zeroes, PADLEN(ctx->nbytes));
+
+  write64_le(ctx->nheader, lengths);
+  write64_le(ctx->nbytes, lengths + 8);
+  cf_poly1305_update(&ctx->poly, lengths, sizeof lengths);
+
+  cf_poly1305_finish(&ctx->poly, tag);
+  mem_clean(ctx, sizeof *ctx);
+}
 
-  /* Decrypt mode: calculate tag, and check it.
-   * If it's correct, proceed with decryption. */
+void cf_chacha20poly1305_encrypt_final(cf_chacha20poly1305_ctx *ctx,
+                                       uint8_t tag[static 16])
+{
+  finish(ctx, tag);
+}
+
+int cf_chacha20poly1305_decrypt_final(cf_chacha20poly1305_ctx *ctx,
+                                      const uint8_t tag[static 16])
+{
   uint8_t checktag[16];
-  cf_poly1305_finish(&poly, checktag);
+  finish(ctx, checktag);
 
-  if (mem_eq(checktag, tag, sizeof checktag))
+  int err = mem_eq(checktag, tag, sizeof checktag) ? SUCCESS : FAILURE;
+  mem_clean(checktag, sizeof checktag);
+  return err;
+}
+
+static void aad_piece(void *vctx, const uint8_t *data, size_t len)
+{
+  cf_chacha20poly1305_aad(vctx, data, len);
+}
+
+static void encrypt_piece(void *vctx, const uint8_t *in, uint8_t *out, size_t len)
+{
+  cf_chacha20poly1305_encrypt_update(vctx, in, out, len);
+}
+
+static void decrypt_piece(void *vctx, const uint8_t *in, uint8_t *out, size_t len)
+{
+  cf_chacha20poly1305_decrypt_update(vctx, in, out, len);
+}
+
+static int process(const uint8_t key[static 32],
+                   const uint8_t nonce[static 12],
+                   const cf_iovec *header, size_t nheaderiov,
+                   const cf_iovec *input, size_t ninputiov,
+                   const cf_iovec *output, size_t noutputiov,
+                   int mode,
+                   uint8_t tag[static 16])
+{
+  size_t nheader = cf_iov_len(header, nheaderiov);
+  size_t nbytes = cf_iov_len(input, ninputiov);
+  assert(cf_iov_len(output, noutputiov) == nbytes);
+
+  cf_chacha20poly1305_ctx ctx;
+  cf_iov_cursor in, out;
+
+  cf_chacha20poly1305_init(&ctx, key, nonce);
+
+  cf_iov_init(&in, header, nheaderiov);
+  cf_iov_read(&in, nheader, aad_piece, &ctx);
+
+  cf_iov_init(&in, input, ninputiov);
+  cf_iov_init(&out, output, noutputiov);
+  cf_iov_transform(&in, &out, nbytes,
+                   mode == ENCRYPT ? encrypt_piece : decrypt_piece,
+                   &ctx);
+
+  if (mode == ENCRYPT)
   {
-    cf_chacha20_cipher(&chacha, input, output, nbytes);
-    mem_clean(&chacha, sizeof chacha);
-    mem_clean(checktag, sizeof checktag);
+    cf_chacha20poly1305_encrypt_final(&ctx, tag);
     return SUCCESS;
-  } else {
-    mem_clean(output, nbytes);
-    mem_clean(&chacha, sizeof chacha);
-    mem_clean(checktag, sizeof checktag);
-    return FAILURE;
   }
+
+  /* Decrypt mode: if the tag is wrong, remove the plaintext
+   * we already wrote. */
+  int err = cf_chacha20poly1305_decrypt_final(&ctx, tag);
+  if (err)
+    cf_iov_clean(output, noutputiov);
+  return err;
 }
 
 void cf_chacha20poly1305_encrypt(const uint8_t key[static 32],
@@ -118,11 +224,15 @@ void cf_chacha20poly1305_encrypt(const uint8_t key[static 32],
                                  uint8_t *ciphertext,
                                  uint8_t tag[static 16])
 {
+  cf_iovec header_iov = { (void *) header, nheader },
+           plain_iov = { (void *) plaintext, nbytes },
+           cipher_iov = { ciphertext, nbytes };
+
   process(key,
           nonce,
-          header, nheader,
-          plaintext, nbytes,
-          ciphertext,
+          &header_iov, 1,
+          &plain_iov, 1,
+          &cipher_iov, 1,
           ENCRYPT,
           tag);
 }
@@ -137,12 +247,280 @@ int cf_chacha20poly1305_decrypt(const uint8_t key[static 32],
   uint8_t ourtag[16];
   memcpy(ourtag, tag, sizeof ourtag);
 
+  cf_iovec header_iov = { (void *) header, nheader },
+           cipher_iov = { (void *) ciphertext, nbytes },
+           plain_iov = { plaintext, nbytes };
+
+  return process(key,
+                 nonce,
+                 &header_iov, 1,
+                 &cipher_iov, 1,
+                 &plain_iov, 1,
+                 DECRYPT,
+                 ourtag);
+}
+
+void cf_chacha20poly1305_encrypt_iov(const uint8_t key[static 32],
+                                     const uint8_t nonce[static 12],
+                                     const cf_iovec *header, size_t nheaderiov,
+                                     const cf_iovec *plaintext, size_t nplainiov,
+                                     const cf_iovec *ciphertext, size_t ncipheriov,
+                                     uint8_t tag[static 16])
+{
+  process(key,
+          nonce,
+          header, nheaderiov,
+          plaintext, nplainiov,
+          ciphertext, ncipheriov,
+          ENCRYPT,
+          tag);
+}
+
+int cf_chacha20poly1305_decrypt_iov(const uint8_t key[static 32],
+                                    const uint8_t nonce[static 12],
+                                    const cf_iovec *header, size_t nheaderiov,
+                                    const cf_iovec *ciphertext, size_t ncipheriov,
+                                    const uint8_t tag[static 16],
+                                    const cf_iovec *plaintext, size_t nplainiov)
+{
+  uint8_t ourtag[16];
+  memcpy(ourtag, tag, sizeof ourtag);
+
   return process(key,
                  nonce,
-                 header, nheader,
-                 ciphertext, nbytes,
-                 plaintext,
+                 header, nheaderiov,
+                 ciphertext, ncipheriov,
+                 plaintext, nplainiov,
                  DECRYPT,
                  ourtag);
 }
 
+void cf_chacha20poly1305_encrypt_batch(const uint8_t key[static 32],
+                                       cf_aead_record *recs, size_t nrecs)
+{
+  for (size_t i = 0; i < nrecs; i++)
+  {
+    cf_aead_record *r = &recs[i];
+    cf_iovec header = { (void *) r->header, r->nheader },
+             in = { (void *) r->in, r->nbytes },
+             out = { r->out, r->nbytes };
+
+    assert(r->nnonce == 12);
+    process(key,
+            r->nonce,
+            &header, 1,
+            &in, 1,
+            &out, 1,
+            ENCRYPT,
+            r->tag);
+  }
+}
+
+int cf_chacha20poly1305_decrypt_batch(const uint8_t key[static 32],
+                                      cf_aead_record *recs, size_t nrecs)
+{
+  int err = 0;
+
+  for (size_t i = 0; i < nrecs; i++)
+  {
+    cf_aead_record *r = &recs[i];
+    cf_iovec header = { (void *) r->header, r->nheader },
+             in = { (void *) r->in, r->nbytes },
+             out = { r->out, r->nbytes };
+
+    assert(r->nnonce == 12);
+    r->err = process(key,
+                     r->nonce,
+                     &header, 1,
+                     &in, 1,
+                     &out, 1,
+                     DECRYPT,
+                     r->tag);
+    err |= r->err;
+  }
+
+  return err;
+}
+
+/* The many-key functions work on groups of this many packets:
+ * enough to keep every lane busy, while the per-packet state
+ * stays on the stack.  Without SIMD there are no lanes to fill,
+ * so small targets get a small group. */
+#if CF_SIMD
+# define MULTI_GROUP 32
+#else
+# define MULTI_GROUP 8
+#endif
+
+/* Per-packet state for the many-key functions. */
+typedef struct
+{
+  uint8_t polykey[32];
+  uint8_t lengths[16];
+  cf_iovec mac[5];
+} multi_state;
+
+/* Sets up the Poly1305 key stream for each packet in cipher, and
+ * the MAC input and key for each packet in mac.  The MAC input is
+ * AAD || pad(AAD) || cipher || pad(cipher) || len_64(aad) || len_64(cipher),
+ * as fragments; cipher is each packet's input or output. */
+static void multi_setup(cf_chacha20poly1305_packet *pkts, size_t npkts,
+                        int mode, multi_state *st,
+                        cf_chacha20_item *cipher, cf_poly1305_item *mac)
+{
+  for (size_t i = 0; i < npkts; i++)
+  {
+    cf_chacha20poly1305_packet *p = &pkts[i];
+    void *ct = mode == ENCRYPT ? p->out : (void *) p->in;
+
+    memset(st[i].polykey, 0, sizeof st[i].polykey);
+    cipher[i] = (cf_chacha20_item) {
+      .key = p->key,
+      .nonce = p->nonce,
+      .counter = 0,
+      .in = st[i].polykey,
+      .out = st[i].polykey,
+      .nbytes = sizeof st[i].polykey
+    };
+
+    write64_le(p->nheader, st[i].lengths);
+    write64_le(p->nbytes, st[i].lengths + 8);
+
+    st[i].mac[0] = (cf_iovec) { (void *) p->header, p->nheader };
+    st[i].mac[1] = (cf_iovec) { (void *) zeroes, PADLEN(p->nheader) };
+    st[i].mac[2] = (cf_iovec) { ct, p->nbytes };
+    st[i].mac[3] = (cf_iovec) { (void *) zeroes, PADLEN(p->nbytes) };
+    st[i].mac[4] = (cf_iovec) { st[i].lengths, sizeof st[i].lengths };
+
+    mac[i] = (cf_poly1305_item) {
+      .key = st[i].polykey,
+      .iov = st[i].mac,
+      .niov = 5,
+      .tag = p->tag
+    };
+  }
+}
+
+/* The message key stream item for packet p: from block 1. */
+static cf_chacha20_item multi_payload(const cf_chacha20poly1305_packet *p)
+{
+  return (cf_chacha20_item) {
+    .key = p->key,
+    .nonce = p->nonce,
+    .counter = 1,
+    .in = p->in,
+    .out = p->out,
+    .nbytes = p->nbytes
+  };
+}
+
+void cf_chacha20poly1305_encrypt_multi(cf_chacha20poly1305_packet *pkts, size_t npkts)
+{
+  multi_state st[MULTI_GROUP];
+  cf_chacha20_item cipher[2 * MULTI_GROUP];
+  cf_poly1305_item mac[MULTI_GROUP];
+
+  while (npkts)
+  {
+    size_t n = MIN(npkts, (size_t) MULTI_GROUP);
+
+    /* Poly1305 keys and messages together, then the MACs. */
+    multi_setup(pkts, n, ENCRYPT, st, cipher, mac);
+    for (size_t i = 0; i < n; i++)
+      cipher[n + i] = multi_payload(&pkts[i]);
+
+    cf_chacha20_batch(cipher, 2 * n);
+    cf_poly1305_batch(mac, n);
+
+    pkts += n;
+    npkts -= n;
+  }
+
+  mem_clean(st, sizeof st);
+}
+
+int cf_chacha20poly1305_decrypt_multi(cf_chacha20poly1305_packet *pkts, size_t npkts)
+{
+  multi_state st[MULTI_GROUP];
+  cf_chacha20_item cipher[MULTI_GROUP];
+  cf_poly1305_item mac[MULTI_GROUP];
+  int err = 0;
+
+  while (npkts)
+  {
+    size_t n = MIN(npkts, (size_t) MULTI_GROUP), nok = 0;
+
+    /* Poly1305 keys, then check the MACs, then decrypt the
+     * packets which passed: in and out may be the same. */
+    multi_setup(pkts, n, DECRYPT, st, cipher, mac);
+    cf_chacha20_batch(cipher, n);
+    cf_poly1305_verify_batch(mac, n);
+
+    for (size_t i = 0; i < n; i++)
+    {
+      pkts[i].err = mac[i].err ? FAILURE : SUCCESS;
+      err |= pkts[i].err;
+
+      if (pkts[i].err)
+        mem_clean(pkts[i].out, pkts[i].nbytes);
+      else
+        cipher[nok++] = multi_payload(&pkts[i]);
+    }
+
+    cf_chacha20_batch(cipher, nok);
+
+    pkts += n;
+    npkts -= n;
+  }
+
+  mem_clean(st, sizeof st);
+  return err;
+}
+
+/* Finds the subkey and 96-bit nonce for XChaCha20-Poly1305. */
+static void xchacha_setup(const uint8_t key[static 32],
+                          const uint8_t nonce[static 24],
+                          uint8_t subkey[static 32],
+                          uint8_t subnonce[static 12])
+{
+  cf_hchacha20(key, nonce, subkey);
+  memset(subnonce, 0, 4);
+  memcpy(subnonce + 4, nonce + 16, 8);
+}
+
+void cf_xchacha20poly1305_encrypt(const uint8_t key[static 32],
+                                  const uint8_t nonce[static 24],
+                                  const uint8_t *header, size_t nheader,
+                                  const uint8_t *plaintext, size_t nbytes,
+                                  uint8_t *ciphertext,
+                                  uint8_t tag[static 16])
+{
+  uint8_t subkey[32], subnonce[12];
+  xchacha_setup(key, nonce, subkey, subnonce);
+
+  cf_chacha20poly1305_encrypt(subkey, subnonce,
+                              header, nheader,
+                              plaintext, nbytes,
+                              ciphertext, tag);
+
+  mem_clean(subkey, sizeof subkey);
+}
+
+int cf_xchacha20poly1305_decrypt(const uint8_t key[static 32],
+                                 const uint8_t nonce[static 24],
+                                 const uint8_t *header, size_t nheader,
+                                 const uint8_t *ciphertext, size_t nbytes,
+                                 const uint8_t tag[static 16],
+                                 uint8_t *plaintext)
+{
+  uint8_t subkey[32], subnonce[12];
+  xchacha_setup(key, nonce, subkey, subnonce);
+
+  int err = cf_chacha20poly1305_decrypt(subkey, subnonce,
+                                        header, nheader,
+                                        ciphertext, nbytes,
+                                        tag, plaintext);
+
+  mem_clean(subkey, sizeof subkey);
+  return err;
+}
@@ -18,6 +18,10 @@
 #include <stdint.h>
 #include <stddef.h>
 
+#include "aead.h"
+#include "salsa20.h"
+#include "poly1305.h"
+
 /**
  * The ChaCha20-Poly1305 AEAD construction
  * =======================================
@@ -27,7 +31,8 @@
  *
  * It uses a 256-bit key and a 96-bit nonce.
  *
- * This is a one-shot interface.
+ * There are one-shot functions, and an incremental interface
+ * for messages which arrive in pieces.
  */
 
 /* .. c:function:: $DECL
@@ -70,4 +75,315 @@ int cf_chacha20poly1305_decrypt(const uint8_t key[static 32],
                                 const uint8_t tag[static 16],
                                 uint8_t *plaintext);
 
+/* .. c:function:: $DECL
+ * ChaCha20-Poly1305 authenticated encryption, with fragmented input
+ * and output.
+ *
+ * This gives the same results as :c:func:`cf_chacha20poly1305_encrypt`
+ * on the concatenation of each list of fragments.
+ *
+ * :param key: key material.
+ * :param nonce: per-message nonce.
+ * :param header/nheaderiov: header fragments.
+ * :param plaintext/nplainiov: plaintext fragments.
+ * :param ciphertext/ncipheriov: ciphertext output fragments.  These must have the same total length as `plaintext`.
+ * :param tag: authentication tag output buffer.
+ */
+void cf_chacha20poly1305_encrypt_iov(const uint8_t key[static 32],
+                                     const uint8_t nonce[static 12],
+                                     const cf_iovec *header, size_t nheaderiov,
+                                     const cf_iovec *plaintext, size_t nplainiov,
+                                     const cf_iovec *ciphertext, size_t ncipheriov,
+                                     uint8_t tag[static 16]);
+
+/* .. c:function:: $DECL
+ * ChaCha20-Poly1305 authenticated decryption, with fragmented input
+ * and output.
+ *
+ * :return: 0 on success, non-zero on error.  Plaintext is zeroed on error.
+ *
+ * :param key: key material.
+ * :param nonce: per-message nonce.
+ * :param header/nheaderiov: header fragments.
+ * :param ciphertext/ncipheriov: ciphertext fragments.
+ * :param tag: authentication tag.
+ * :param plaintext/nplainiov: plaintext output fragments.  These must have the same total length as `ciphertext`.
+ */
+int cf_chacha20poly1305_decrypt_iov(const uint8_t key[static 32],
+                                    const uint8_t nonce[static 12],
+                                    const cf_iovec *header, size_t nheaderiov,
+                                    const cf_iovec *ciphertext, size_t ncipheriov,
+                                    const uint8_t tag[static 16],
+                                    const cf_iovec *plaintext, size_t nplainiov);
+
+/* .. c:function:: $DECL
+ * ChaCha20-Poly1305 authenticated encryption of a batch of records
+ * under one key.
+ *
+ * This gives the same results as :c:func:`cf_chacha20poly1305_encrypt`
+ * on each record.  Each record's nonce must be 12 bytes, and its tag
+ * 16 bytes.
+ *
+ * :param key: key material.
+ * :param recs: records to encrypt.  See :c:type:`cf_aead_record`.
+ * :param nrecs: number of records.
+ */
+void cf_chacha20poly1305_encrypt_batch(const uint8_t key[static 32],
+                                       cf_aead_record *recs, size_t nrecs);
+
+/* .. c:function:: $DECL
+ * ChaCha20-Poly1305 authenticated decryption of a batch of records
+ * under one key.
+ *
+ * Each record's `err` member is set as for
+ * :c:func:`cf_chacha20poly1305_decrypt`, and its output is zeroed
+ * on error.
+ *
+ * :return: 0 if every record was decrypted successfully, non-zero otherwise.
+ *
+ * :param key: key material.
+ * :param recs: records to decrypt.  See :c:type:`cf_aead_record`.
+ * :param nrecs: number of records.
+ */
+int cf_chacha20poly1305_decrypt_batch(const uint8_t key[static 32],
+                                      cf_aead_record *recs, size_t nrecs);
+
+/**
+ * Many keys
+ * ---------
+ * These encrypt or decrypt many packets, each under its own key, in
+ * one call.  Where the CPU has vector instructions for it, packets
+ * from different keys are assigned one per vector lane, so small
+ * packets for many sessions fill the lanes and run much faster than
+ * one at a time.
+ *
+ * Packets are handled in groups whose state is kept on the stack.
+ * This takes about 9KB of stack on 64-bit platforms when `CF_SIMD`
+ * is enabled, and about 2KB without it.
+ */
+
+/* .. c:type:: cf_chacha20poly1305_packet
+ * One packet for :c:func:`cf_chacha20poly1305_encrypt_multi` or
+ * :c:func:`cf_chacha20poly1305_decrypt_multi`.  The array of
+ * packets doubles as the completion array: each packet's result is
+ * written back into it.
+ *
+ * .. c:member:: cf_chacha20poly1305_packet.key
+ * 32 byte key for this packet.
+ *
+ * .. c:member:: cf_chacha20poly1305_packet.nonce
+ * 12 byte nonce for this packet.
+ *
+ * .. c:member:: cf_chacha20poly1305_packet.header
+ * Additionally authenticated data (AAD).
+ *
+ * .. c:member:: cf_chacha20poly1305_packet.nheader
+ * Length of AAD.
+ *
+ * .. c:member:: cf_chacha20poly1305_packet.in
+ * Input: plaintext when encrypting, ciphertext when decrypting.
+ *
+ * .. c:member:: cf_chacha20poly1305_packet.nbytes
+ * Length of input (and output).
+ *
+ * .. c:member:: cf_chacha20poly1305_packet.out
+ * Output: `nbytes` bytes are written here.  This may be the same
+ * as `in`.
+ *
+ * .. c:member:: cf_chacha20poly1305_packet.tag
+ * 16 byte tag.  This is written when encrypting, and read when
+ * decrypting.
+ *
+ * .. c:member:: cf_chacha20poly1305_packet.err
+ * Written when decrypting: 0 on success, non-zero on error.
+ * `out` is cleared on error.
+ */
+typedef struct
+{
+  const uint8_t *key;
+  const uint8_t *nonce;
+  const uint8_t *header;
+  size_t nheader;
+  const uint8_t *in;
+  size_t nbytes;
+  uint8_t *out;
+  uint8_t *tag;
+  int err;
+} cf_chacha20poly1305_packet;
+
+/* .. c:function:: $DECL
+ * ChaCha20-Poly1305 authenticated encryption of many packets, each
+ * under its own key.
+ *
+ * This gives the same results as :c:func:`cf_chacha20poly1305_encrypt`
+ * on each packet.
+ *
+ * :param pkts: packets to encrypt.  See :c:type:`cf_chacha20poly1305_packet`.
+ * :param npkts: number of packets.
+ */
+void cf_chacha20poly1305_encrypt_multi(cf_chacha20poly1305_packet *pkts, size_t npkts);
+
+/* .. c:function:: $DECL
+ * ChaCha20-Poly1305 authenticated decryption of many packets, each
+ * under its own key.
+ *
+ * Each packet's `err` member is set as for
+ * :c:func:`cf_chacha20poly1305_decrypt`, and its output is zeroed
+ * on error.
+ *
+ * :return: 0 if every packet was decrypted successfully, non-zero otherwise.
+ *
+ * :param pkts: packets to decrypt.  See :c:type:`cf_chacha20poly1305_packet`.
+ * :param npkts: number of packets.
+ */
+int cf_chacha20poly1305_decrypt_multi(cf_chacha20poly1305_packet *pkts, size_t npkts);
+
+/**
+ * Incremental interface
+ * ---------------------
+ * This processes a message in pieces of any length, in constant
+ * memory.  Call :c:func:`cf_chacha20poly1305_init`, then
+ * :c:func:`cf_chacha20poly1305_aad` any number of times, then the
+ * update function for the direction any number of times, then the
+ * final function for the direction.  All the AAD must come before
+ * any of the message.
+ *
+ * .. warning::
+ *
+ *    When decrypting, plaintext is output before the tag is checked.
+ *    Don't act on any of it until :c:func:`cf_chacha20poly1305_decrypt_final`
+ *    succeeds, and throw it all away if it does not.
+ */
+
+/* .. c:type:: cf_chacha20poly1305_ctx
+ * Incremental ChaCha20-Poly1305 context.
+ *
+ * .. c:member:: cf_chacha20poly1305_ctx.chacha
+ * ChaCha20 context for the message.
+ *
+ * .. c:member:: cf_chacha20poly1305_ctx.poly
+ * Poly1305 context for the MAC.
+ *
+ * .. c:member:: cf_chacha20poly1305_ctx.nheader
+ * Number of AAD bytes so far.
+ *
+ * .. c:member:: cf_chacha20poly1305_ctx.nbytes
+ * Number of message bytes so far.
+ *
+ * .. c:member:: cf_chacha20poly1305_ctx.payload
+ * Non-zero once the message has started; the AAD is then padded
+ * and no more can be added.
+ */
+typedef struct
+{
+  cf_chacha20_ctx chacha;
+  cf_poly1305 poly;
+  uint64_t nheader;
+  uint64_t nbytes;
+  int payload;
+} cf_chacha20poly1305_ctx;
+
+/* .. c:function:: $DECL
+ * Starts encrypting or decrypting a message.
+ *
+ * :param ctx: context (written).
+ * :param key: key material.
+ * :param nonce: per-message nonce.
+ */
+void cf_chacha20poly1305_init(cf_chacha20poly1305_ctx *ctx,
+                              const uint8_t key[static 32],
+                              const uint8_t nonce[static 12]);
+
+/* .. c:function:: $DECL
+ * Adds `nheader` bytes of AAD.  This must not be called after
+ * the message has started.
+ */
+void cf_chacha20poly1305_aad(cf_chacha20poly1305_ctx *ctx,
+                             const uint8_t *header, size_t nheader);
+
+/* .. c:function:: $DECL
+ * Encrypts the next `nbytes` bytes of the message.
+ * `plaintext` and `ciphertext` may be the same.
+ */
+void cf_chacha20poly1305_encrypt_update(cf_chacha20poly1305_ctx *ctx,
+                                        const uint8_t *plaintext,
+                                        uint8_t *ciphertext,
+                                        size_t nbytes);
+
+/* .. c:function:: $DECL
+ * Finishes encrypting, and writes the tag.  `ctx` is wiped.
+ */
+void cf_chacha20poly1305_encrypt_final(cf_chacha20poly1305_ctx *ctx,
+                                       uint8_t tag[static 16]);
+
+/* .. c:function:: $DECL
+ * Decrypts the next `nbytes` bytes of the message.
+ * `ciphertext` and `plaintext` may be the same.
+ */
+void cf_chacha20poly1305_decrypt_update(cf_chacha20poly1305_ctx *ctx,
+                                        const uint8_t *ciphertext,
+                                        uint8_t *plaintext,
+                                        size_t nbytes);
+
+/* .. c:function:: $DECL
+ * Finishes decrypting, and checks the tag.  `ctx` is wiped.
+ *
+ * :return: 0 if the tag is correct, non-zero otherwise.
+ */
+int cf_chacha20poly1305_decrypt_final(cf_chacha20poly1305_ctx *ctx,
+                                      const uint8_t tag[static 16]);
+
+/**
+ * XChaCha20-Poly1305
+ * ------------------
+ * This is ChaCha20-Poly1305 with a 192-bit nonce, which is large
+ * enough that nonces can be chosen at random without coordination.
+ *
+ * The key and the first 16 bytes of the nonce give a subkey
+ * (with :c:func:`cf_hchacha20`).  The message is then processed
+ * with ChaCha20-Poly1305 under the subkey, with a 96-bit nonce of
+ * four zero bytes then the last 8 bytes of the nonce.  This matches
+ * draft-irtf-cfrg-xchacha and libsodium.
+ */
+
+/* .. c:function:: $DECL
+ * XChaCha20-Poly1305 authenticated encryption.
+ *
+ * :param key: key material.
+ * :param nonce: per-message nonce.
+ * :param header: header buffer.
+ * :param nheader: number of header bytes.
+ * :param plaintext: plaintext bytes to be encrypted.
+ * :param nbytes: number of plaintext/ciphertext bytes.
+ * :param ciphertext: ciphertext output buffer, nbytes in length.
+ * :param tag: authentication tag output buffer.
+ */
+void cf_xchacha20poly1305_encrypt(const uint8_t key[static 32],
+                                  const uint8_t nonce[static 24],
+                                  const uint8_t *header, size_t nheader,
+                                  const uint8_t *plaintext, size_t nbytes,
+                                  uint8_t *ciphertext,
+                                  uint8_t tag[static 16]);
+
+/* .. c:function:: $DECL
+ * XChaCha20-Poly1305 authenticated decryption.
+ *
+ * :return: 0 on success, non-zero on error.  Plaintext is zeroed on error.
+ *
+ * :param key: key material.
+ * :param nonce: per-message nonce.
+ * :param header: header buffer.
+ * :param nheader: number of header bytes.
+ * :param ciphertext: ciphertext bytes to be decrypted.
+ * :param nbytes: number of plaintext/ciphertext bytes.
+ * :param tag: authentication tag.
+ * :param plaintext: plaintext output buffer, nbytes in length.
+ */
+int cf_xchacha20poly1305_decrypt(const uint8_t key[static 32],
+                                 const uint8_t nonce[static 24],
+                                 const uint8_t *header, size_t nheader,
+                                 const uint8_t *ciphertext, size_t nbytes,
+                                 const uint8_t tag[static 16],
+                                 uint8_t *plaintext);
+
 #endif
@@ -16,6 +16,7 @@
 #include "handy.h"
 #include "bitops.h"
 #include "sha2.h"
+#include "salsa20.h"
 #include "tassert.h"
 
 #include <string.h>
@@ -431,3 +432,78 @@ void cf_hmac_drbg_reseed(cf_hmac_drbg *ctx,
   /* 3. reseed_counter = 1 */
   ctx->reseed_counter = 1;
 }
+
+/* Makes a new buffer of key stream under the key at the start of
+ * the buffer.  Its first 32 bytes replace the key. */
+static void chacha20_rng_refill(cf_chacha20_rng *ctx)
+{
+  cf_chacha20_ctx chacha;
+  uint8_t key[32];
+
+  memcpy(key, ctx->buf, sizeof key);
+  cf_chacha20_init(&chacha, key, sizeof key, ctx->stream);
+  mem_clean(key, sizeof key);
+
+  memset(ctx->buf, 0, sizeof ctx->buf);
+  cf_chacha20_cipher(&chacha, ctx->buf, ctx->buf, sizeof ctx->buf);
+  ctx->nbuf = sizeof ctx->buf - 32;
+
+  mem_clean(&chacha, sizeof chacha);
+}
+
+void cf_chacha20_rng_init(cf_chacha20_rng *ctx,
+                          const uint8_t seed[32],
+                          uint64_t stream)
+{
+  mem_clean(ctx, sizeof *ctx);
+  memcpy(ctx->buf, seed, 32);
+  write64_le(stream, ctx->stream);
+  chacha20_rng_refill(ctx);
+}
+
+void cf_chacha20_rng_gen(cf_chacha20_rng *ctx,
+                         void *out, size_t nout)
+{
+  uint8_t *bout = out;
+
+  while (nout)
+  {
+    /* Large requests: key stream goes straight to the output,
+     * after the next key. */
+    if (ctx->nbuf == 0 && nout >= sizeof ctx->buf)
+    {
+      cf_chacha20_ctx chacha;
+
+      cf_chacha20_init(&chacha, ctx->buf, 32, ctx->stream);
+      memset(ctx->buf, 0, 32);
+      cf_chacha20_cipher(&chacha, ctx->buf, ctx->buf, 32);
+
+      memset(bout, 0, nout);
+      cf_chacha20_cipher(&chacha, bout, bout, nout);
+      mem_clean(&chacha, sizeof chacha);
+      return;
+    }
+
+    if (ctx->nbuf == 0)
+      chacha20_rng_refill(ctx);
+
+    uint8_t *avail = ctx->buf + sizeof ctx->buf - ctx->nbuf;
+    size_t take = MIN(nout, ctx->nbuf);
+    memcpy(bout, avail, take);
+    mem_clean(avail, take);
+
+    bout += take;
+    nout -= take;
+    ctx->nbuf -= take;
+  }
+}
+
+void cf_chacha20_rng_fork(cf_chacha20_rng *ctx,
+                          cf_chacha20_rng *child,
+                          uint64_t stream)
+{
+  uint8_t seed[32];
+  cf_chacha20_rng_gen(ctx, seed, sizeof seed);
+  cf_chacha20_rng_init(child, seed, stream);
+  mem_clean(seed, sizeof seed);
+}
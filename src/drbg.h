@@ -188,4 +188,80 @@ extern void cf_hmac_drbg_gen_additional(cf_hmac_drbg *ctx,
                                         const void *addnl, size_t naddnl,
                                         void *out, size_t nout);
 
+/**
+ * ChaCha20 fast-key-erasure RNG
+ * =============================
+ * This is a ChaCha20-based generator using the "fast key erasure"
+ * construction.  Each refill runs ChaCha20 under the current key
+ * to make a buffer of key stream.  The first 32 bytes of that become
+ * the next key, replacing the old one, and the rest is handed out
+ * as output.  Output bytes are wiped from the buffer as they are
+ * handed out, so a later compromise of the state reveals nothing
+ * about earlier output.
+ *
+ * Refills make many blocks at once, using the multi-block ChaCha20
+ * paths.  Most small requests, such as nonces and IDs, are then a
+ * `memcpy` from the buffer.
+ *
+ * This is not an SP800-90A DRBG, and does not track reseeding.
+ * Seed it with 32 bytes from a good source, such as the operating
+ * system or one of the DRBGs above.
+ *
+ * A context must not be used by several threads at once.  Give each
+ * thread its own instance (for example, in thread-local storage),
+ * created with :c:func:`cf_chacha20_rng_fork` from a parent, or
+ * seeded separately.  The `stream` parameter gives independent,
+ * reproducible streams from one seed, which suits deterministic
+ * parallel simulations.
+ */
+
+/* .. c:macro:: CF_CHACHA20_RNG_BUFSZ
+ * Size of the key stream buffer, in bytes.  The first 32 bytes of
+ * each refill are the next key.
+ */
+#define CF_CHACHA20_RNG_BUFSZ (64 * 12)
+
+/* .. c:type:: cf_chacha20_rng
+ * ChaCha20 fast-key-erasure RNG context.
+ *
+ * .. c:member:: cf_chacha20_rng.buf
+ * Key stream buffer.  The first 32 bytes are the key for the next
+ * refill.
+ *
+ * .. c:member:: cf_chacha20_rng.nbuf
+ * Number of bytes at end of `buf` not yet handed out.
+ *
+ * .. c:member:: cf_chacha20_rng.stream
+ * Stream ID, used as the ChaCha20 nonce.
+ */
+typedef struct
+{
+  uint8_t buf[CF_CHACHA20_RNG_BUFSZ];
+  size_t nbuf;
+  uint8_t stream[8];
+} cf_chacha20_rng;
+
+/* .. c:function:: $DECL
+ * Initialises the generator state `ctx` with a 32 byte `seed` and
+ * a stream ID.  Different stream IDs with the same seed give
+ * independent output.
+ */
+extern void cf_chacha20_rng_init(cf_chacha20_rng *ctx,
+                                 const uint8_t seed[32],
+                                 uint64_t stream);
+
+/* .. c:function:: $DECL
+ * Generates pseudo-random output, writing `nout` bytes at `out`.
+ */
+extern void cf_chacha20_rng_gen(cf_chacha20_rng *ctx,
+                                void *out, size_t nout);
+
+/* .. c:function:: $DECL
+ * Initialises `child` with a seed taken from `ctx`'s output, and
+ * the given stream ID.  Use this to make per-thread instances.
+ */
+extern void cf_chacha20_rng_fork(cf_chacha20_rng *ctx,
+                                 cf_chacha20_rng *child,
+                                 uint64_t stream);
+
 #endif
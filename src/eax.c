@@ -15,14 +15,14 @@
 #include "handy.h"
 #include "prp.h"
 #include "modes.h"
+#include "iov.h"
+#include "bitops.h"
 #include "tassert.h"
 
 #include <string.h>
 
-static void cmac_compute_n(cf_cmac_stream *ctx,
-                           uint8_t t,
-                           const uint8_t *input, size_t ninput,
-                           uint8_t out[CF_MAXBLOCK])
+/* Starts computing OMAC^t_K over a message of nbytes. */
+static void omac_start(cf_cmac_stream *ctx, uint8_t t, size_t nbytes)
 {
   size_t blocksz = ctx->cmac.prp->blocksz;
   assert(blocksz > 0);
@@ -32,44 +32,176 @@ static void cmac_compute_n(cf_cmac_stream *ctx,
   firstblock[blocksz - 1] = t;
 
   cf_cmac_stream_reset(ctx);
-  if (ninput)
+  cf_cmac_stream_update(ctx, firstblock, blocksz, nbytes == 0);
+}
+
+/* Message input for omac_start, in pieces. */
+typedef struct
+{
+  cf_cmac_stream *cmac;
+  size_t remaining;
+} omac_input;
+
+static void omac_piece(void *vctx, const uint8_t *data, size_t len)
+{
+  omac_input *oi = vctx;
+  oi->remaining -= len;
+  cf_cmac_stream_update(oi->cmac, data, len, oi->remaining == 0);
+}
+
+static void omac_compute_iov(cf_cmac_stream *ctx,
+                             uint8_t t,
+                             const cf_iovec *iov, size_t niov,
+                             uint8_t out[CF_MAXBLOCK])
+{
+  omac_input oi = { ctx, cf_iov_len(iov, niov) };
+  cf_iov_cursor c;
+
+  omac_start(ctx, t, oi.remaining);
+  cf_iov_init(&c, iov, niov);
+  cf_iov_read(&c, oi.remaining, omac_piece, &oi);
+  cf_cmac_stream_final(ctx, out);
+}
+
+static void ctr_piece(void *vctx, const uint8_t *in, uint8_t *out, size_t len)
+{
+  cf_ctr_cipher(vctx, in, out, len);
+}
+
+/* The message is encrypted and OMAC^2 is computed over the
+ * ciphertext in one pass.  Each step encrypts the next
+ * CMAC block together with a counter block in one multi-block PRP
+ * call, so the CTR work fills the gaps in the latency-bound MAC
+ * chain.
+ *
+ * The CMAC block for a step is the previous ciphertext block, so
+ * the final block (which needs a subkey) is left for eax_message
+ * to finish. */
+typedef struct
+{
+  const cf_cmac *cmac;
+  cf_ctr *ctr;
+  uint8_t Y[CF_MAXBLOCK];        /* chaining value */
+  uint8_t pending[CF_MAXBLOCK];  /* next CMAC block */
+} eax_pipe;
+
+/* MACs the pending block, and writes the key stream block for the
+ * next counter to ks. */
+static void pipe_step(eax_pipe *p, uint8_t ks[CF_MAXBLOCK])
+{
+  const cf_prp *prp = p->cmac->prp;
+  size_t blocksz = prp->blocksz;
+  uint8_t blocks[2 * CF_MAXBLOCK];
+
+  xor_bb(blocks, p->Y, p->pending, blocksz);
+  memcpy(blocks + blocksz, p->ctr->nonce, blocksz);
+  incr_be(p->ctr->nonce + p->ctr->counter_offset, p->ctr->counter_width);
+
+  cf_prp_encrypt_blocks(prp, p->cmac->prpctx, blocks, blocks, 2);
+
+  memcpy(p->Y, blocks, blocksz);
+  memcpy(ks, blocks + blocksz, blocksz);
+  mem_clean(blocks, sizeof blocks);
+}
+
+static void pipe_blocks(void *vctx, const uint8_t *in, uint8_t *out, size_t nblocks)
+{
+  eax_pipe *p = vctx;
+  size_t blocksz = p->cmac->prp->blocksz;
+  uint8_t ks[CF_MAXBLOCK];
+
+  for (; nblocks; nblocks--, in += blocksz, out += blocksz)
+  {
+    pipe_step(p, ks);
+    xor_bb(out, in, ks, blocksz);
+    memcpy(p->pending, out, blocksz);
+  }
+
+  mem_clean(ks, sizeof ks);
+}
+
+/* Encrypts the message with CTR_K^NN, from in to out, and computes
+ * CC = OMAC_K^2(C). */
+static void eax_message(cf_cmac_stream *cmac,
+                        const uint8_t NN[CF_MAXBLOCK],
+                        const cf_iovec *in, size_t niniov,
+                        const cf_iovec *out, size_t noutiov,
+                        size_t nbytes,
+                        uint8_t CC[CF_MAXBLOCK])
+{
+  const cf_prp *prp = cmac->cmac.prp;
+  size_t blocksz = prp->blocksz;
+  size_t ntail = nbytes % blocksz;
+  cf_ctr ctr;
+  eax_pipe p = { &cmac->cmac, &ctr };
+  cf_iov_cursor inc, outc;
+
+  cf_ctr_init(&ctr, prp, cmac->cmac.prpctx, NN);
+  memset(p.Y, 0, blocksz);
+  memset(p.pending, 0, blocksz);
+  p.pending[blocksz - 1] = 2;
+
+  cf_iov_init(&inc, in, niniov);
+  cf_iov_init(&outc, out, noutiov);
+  cf_iov_transform_blocks(&inc, &outc, nbytes / blocksz, blocksz,
+                          pipe_blocks, &p);
+
+  if (ntail)
   {
-    cf_cmac_stream_update(ctx, firstblock, blocksz, 0);
-    cf_cmac_stream_update(ctx, input, ninput, 1);
+    uint8_t block[CF_MAXBLOCK], ks[CF_MAXBLOCK];
+    cf_iov_gather(&inc, block, ntail);
+    pipe_step(&p, ks);
+    xor_bb(block, block, ks, ntail);
+    memcpy(p.pending, block, ntail);
+
+    cf_iov_scatter(&outc, block, ntail);
+    mem_clean(block, sizeof block);
+    mem_clean(ks, sizeof ks);
+
+    /* Final block is padded, and P is XORed in. */
+    p.pending[ntail] = 0x80;
+    memset(p.pending + ntail + 1, 0, blocksz - ntail - 1);
+    xor_bb(p.pending, p.pending, cmac->cmac.P, blocksz);
   } else {
-    cf_cmac_stream_update(ctx, firstblock, blocksz, 1);
+    /* Final block is whole (this includes the prefix block for an
+     * empty message), and B is XORed in. */
+    xor_bb(p.pending, p.pending, cmac->cmac.B, blocksz);
   }
 
-  cf_cmac_stream_final(ctx, out);
+  xor_bb(CC, p.Y, p.pending, blocksz);
+  prp->encrypt(cmac->cmac.prpctx, CC, CC);
+
+  mem_clean(&p, sizeof p);
+  mem_clean(&ctr, sizeof ctr);
 }
 
-void cf_eax_encrypt(const cf_prp *prp, void *prpctx,
-                    const uint8_t *plain, size_t nplain,
-                    const uint8_t *header, size_t nheader,
-                    const uint8_t *nonce, size_t nnonce,
-                    uint8_t *cipher, /* the same size as nplain */
-                    uint8_t *tag, size_t ntag)
+/* Encryption, given a CMAC context for the key. */
+static void eax_encrypt_core(cf_cmac_stream *cmac,
+                             const cf_iovec *plain, size_t nplainiov,
+                             const cf_iovec *header, size_t nheaderiov,
+                             const uint8_t *nonce, size_t nnonce,
+                             const cf_iovec *cipher, size_t ncipheriov,
+                             uint8_t *tag, size_t ntag)
 {
+  const cf_prp *prp = cmac->cmac.prp;
   uint8_t NN[CF_MAXBLOCK],
           HH[CF_MAXBLOCK],
           CC[CF_MAXBLOCK];
-
-  cf_cmac_stream cmac;
-  cf_cmac_stream_init(&cmac, prp, prpctx);
+  size_t nplain = cf_iov_len(plain, nplainiov);
+  assert(cf_iov_len(cipher, ncipheriov) == nplain);
 
   /* NN = OMAC_K^0(N) */
-  cmac_compute_n(&cmac, 0, nonce, nnonce, NN);
+  cf_iovec nonce_iov = { (void *) nonce, nnonce };
+  omac_compute_iov(cmac, 0, &nonce_iov, 1, NN);
 
   /* HH = OMAC_K^1(H) */
-  cmac_compute_n(&cmac, 1, header, nheader, HH);
+  omac_compute_iov(cmac, 1, header, nheaderiov, HH);
 
-  /* C = CTR_K^NN(M) */
-  cf_ctr ctr;
-  cf_ctr_init(&ctr, prp, prpctx, NN);
-  cf_ctr_cipher(&ctr, plain, cipher, nplain);
-
-  /* CC = OMAC_K^2(C) */
-  cmac_compute_n(&cmac, 2, cipher, nplain, CC);
+  /* C = CTR_K^NN(M), CC = OMAC_K^2(C) */
+  eax_message(cmac, NN,
+              plain, nplainiov,
+              cipher, ncipheriov,
+              nplain, CC);
 
   /* Tag = NN ^ CC ^ HH
    * T = Tag [ first tau bits ] */
@@ -78,39 +210,179 @@ void cf_eax_encrypt(const cf_prp *prp, void *prpctx,
     tag[i] = NN[i] ^ CC[i] ^ HH[i];
 }
 
-int cf_eax_decrypt(const cf_prp *prp, void *prpctx,
-                   const uint8_t *cipher, size_t ncipher,
-                   const uint8_t *header, size_t nheader,
-                   const uint8_t *nonce, size_t nnonce,
-                   const uint8_t *tag, size_t ntag,
-                   uint8_t *plain) /* the same size as ncipher */
+/* Decryption, given a CMAC context for the key. */
+static int eax_decrypt_core(cf_cmac_stream *cmac,
+                            const cf_iovec *cipher, size_t ncipheriov,
+                            const cf_iovec *header, size_t nheaderiov,
+                            const uint8_t *nonce, size_t nnonce,
+                            const uint8_t *tag, size_t ntag,
+                            const cf_iovec *plain, size_t nplainiov)
 {
+  const cf_prp *prp = cmac->cmac.prp;
   uint8_t NN[CF_MAXBLOCK],
           HH[CF_MAXBLOCK],
           CC[CF_MAXBLOCK];
-
-  cf_cmac_stream cmac;
-  cf_cmac_stream_init(&cmac, prp, prpctx);
+  size_t ncipher = cf_iov_len(cipher, ncipheriov);
+  assert(cf_iov_len(plain, nplainiov) == ncipher);
 
   /* NN = OMAC_K^0(N) */
-  cmac_compute_n(&cmac, 0, nonce, nnonce, NN);
+  cf_iovec nonce_iov = { (void *) nonce, nnonce };
+  omac_compute_iov(cmac, 0, &nonce_iov, 1, NN);
 
   /* HH = OMAC_K^1(H) */
-  cmac_compute_n(&cmac, 1, header, nheader, HH);
+  omac_compute_iov(cmac, 1, header, nheaderiov, HH);
 
-  /* CC = OMAC_K^2(C) */
-  cmac_compute_n(&cmac, 2, cipher, ncipher, CC);
+  /* CC = OMAC_K^2(C).  The tag is checked before anything is
+   * decrypted, so nothing is written to plain on error. */
+  omac_compute_iov(cmac, 2, cipher, ncipheriov, CC);
 
   uint8_t tt[CF_MAXBLOCK];
   assert(ntag && ntag <= prp->blocksz);
   for (size_t i = 0; i < ntag; i++)
     tt[i] = NN[i] ^ CC[i] ^ HH[i];
 
-  if (!mem_eq(tt, tag, ntag))
+  int err = !mem_eq(tt, tag, ntag);
+  mem_clean(tt, sizeof tt);
+  if (err)
     return 1;
 
+  /* M = CTR_K^NN(C) */
   cf_ctr ctr;
-  cf_ctr_init(&ctr, prp, prpctx, NN);
-  cf_ctr_cipher(&ctr, cipher, plain, ncipher);
+  cf_iov_cursor in, out;
+  cf_ctr_init(&ctr, prp, cmac->cmac.prpctx, NN);
+  cf_iov_init(&in, cipher, ncipheriov);
+  cf_iov_init(&out, plain, nplainiov);
+  cf_iov_transform(&in, &out, ncipher, ctr_piece, &ctr);
+  mem_clean(&ctr, sizeof ctr);
   return 0;
 }
+
+void cf_eax_encrypt_iov(const cf_prp *prp, void *prpctx,
+                        const cf_iovec *plain, size_t nplainiov,
+                        const cf_iovec *header, size_t nheaderiov,
+                        const uint8_t *nonce, size_t nnonce,
+                        const cf_iovec *cipher, size_t ncipheriov,
+                        uint8_t *tag, size_t ntag)
+{
+  cf_cmac_stream cmac;
+  cf_cmac_stream_init(&cmac, prp, prpctx);
+
+  eax_encrypt_core(&cmac,
+                   plain, nplainiov,
+                   header, nheaderiov,
+                   nonce, nnonce,
+                   cipher, ncipheriov,
+                   tag, ntag);
+}
+
+int cf_eax_decrypt_iov(const cf_prp *prp, void *prpctx,
+                       const cf_iovec *cipher, size_t ncipheriov,
+                       const cf_iovec *header, size_t nheaderiov,
+                       const uint8_t *nonce, size_t nnonce,
+                       const uint8_t *tag, size_t ntag,
+                       const cf_iovec *plain, size_t nplainiov)
+{
+  cf_cmac_stream cmac;
+  cf_cmac_stream_init(&cmac, prp, prpctx);
+
+  return eax_decrypt_core(&cmac,
+                          cipher, ncipheriov,
+                          header, nheaderiov,
+                          nonce, nnonce,
+                          tag, ntag,
+                          plain, nplainiov);
+}
+
+void cf_eax_encrypt(const cf_prp *prp, void *prpctx,
+                    const uint8_t *plain, size_t nplain,
+                    const uint8_t *header, size_t nheader,
+                    const uint8_t *nonce, size_t nnonce,
+                    uint8_t *cipher, /* the same size as nplain */
+                    uint8_t *tag, size_t ntag)
+{
+  cf_iovec plain_iov = { (void *) plain, nplain },
+           header_iov = { (void *) header, nheader },
+           cipher_iov = { cipher, nplain };
+
+  cf_eax_encrypt_iov(prp, prpctx,
+                     &plain_iov, 1,
+                     &header_iov, 1,
+                     nonce, nnonce,
+                     &cipher_iov, 1,
+                     tag, ntag);
+}
+
+int cf_eax_decrypt(const cf_prp *prp, void *prpctx,
+                   const uint8_t *cipher, size_t ncipher,
+                   const uint8_t *header, size_t nheader,
+                   const uint8_t *nonce, size_t nnonce,
+                   const uint8_t *tag, size_t ntag,
+                   uint8_t *plain) /* the same size as ncipher */
+{
+  cf_iovec cipher_iov = { (void *) cipher, ncipher },
+           header_iov = { (void *) header, nheader },
+           plain_iov = { plain, ncipher };
+
+  return cf_eax_decrypt_iov(prp, prpctx,
+                            &cipher_iov, 1,
+                            &header_iov, 1,
+                            nonce, nnonce,
+                            tag, ntag,
+                            &plain_iov, 1);
+}
+
+void cf_eax_encrypt_batch(const cf_prp *prp, void *prpctx,
+                          cf_aead_record *recs, size_t nrecs,
+                          size_t ntag)
+{
+  /* The CMAC subkeys are found once for the whole batch. */
+  cf_cmac_stream cmac;
+  cf_cmac_stream_init(&cmac, prp, prpctx);
+
+  for (size_t i = 0; i < nrecs; i++)
+  {
+    cf_aead_record *r = &recs[i];
+    cf_iovec in = { (void *) r->in, r->nbytes },
+             header = { (void *) r->header, r->nheader },
+             out = { r->out, r->nbytes };
+
+    eax_encrypt_core(&cmac,
+                     &in, 1,
+                     &header, 1,
+                     r->nonce, r->nnonce,
+                     &out, 1,
+                     r->tag, ntag);
+  }
+
+  mem_clean(&cmac, sizeof cmac);
+}
+
+int cf_eax_decrypt_batch(const cf_prp *prp, void *prpctx,
+                         cf_aead_record *recs, size_t nrecs,
+                         size_t ntag)
+{
+  cf_cmac_stream cmac;
+  cf_cmac_stream_init(&cmac, prp, prpctx);
+  int err = 0;
+
+  for (size_t i = 0; i < nrecs; i++)
+  {
+    cf_aead_record *r = &recs[i];
+    cf_iovec in = { (void *) r->in, r->nbytes },
+             header = { (void *) r->header, r->nheader },
+             out = { r->out, r->nbytes };
+
+    r->err = eax_decrypt_core(&cmac,
+                              &in, 1,
+                              &header, 1,
+                              r->nonce, r->nnonce,
+                              r->tag, ntag,
+                              &out, 1);
+    if (r->err)
+      mem_clean(r->out, r->nbytes);
+    err |= r->err;
+  }
+
+  mem_clean(&cmac, sizeof cmac);
+  return err;
+}
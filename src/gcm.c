@@ -18,6 +18,7 @@
 #include "blockwise.h"
 #include "bitops.h"
 #include "gf128.h"
+#include "iov.h"
 #include "tassert.h"
 
 #include <string.h>
@@ -113,27 +114,17 @@ static void ghash_final(ghash_ctx *ctx, uint8_t out[16])
   cf_gf128_tobytes_be(ctx->Y, out);
 }
 
-void cf_gcm_encrypt(const cf_prp *prp, void *prpctx,
-                    const uint8_t *plain, size_t nplain,
-                    const uint8_t *header, size_t nheader,
-                    const uint8_t *nonce, size_t nnonce,
-                    uint8_t *cipher, /* the same size as nplain */
-                    uint8_t *tag, size_t ntag)
+/* Produce CTR nonce, Y_0:
+ *
+ * if len(IV) == 96
+ *   Y_0 = IV || 0^31 || 1
+ * otherwise
+ *   Y_0 = GHASH(H, {}, IV)
+ */
+static void gcm_y0(uint8_t H[16],
+                   const uint8_t *nonce, size_t nnonce,
+                   uint8_t Y0[16])
 {
-  uint8_t H[16] = { 0 };
-  uint8_t Y0[16]; 
-
-  /* H = E_K(0^128) */
-  prp->encrypt(prpctx, H, H);
-
-  /* Produce CTR nonce, Y_0:
-   *
-   * if len(IV) == 96
-   *   Y_0 = IV || 0^31 || 1
-   * otherwise
-   *   Y_0 = GHASH(H, {}, IV)
-   */
-
   if (nnonce == 12)
   {
     memcpy(Y0, nonce, nnonce);
@@ -144,90 +135,121 @@ void cf_gcm_encrypt(const cf_prp *prp, void *prpctx,
     ghash_init(&gh, H);
     ghash_add_cipher(&gh, nonce, nnonce);
     ghash_final(&gh, Y0);
+    mem_clean(&gh, sizeof gh);
   }
+}
 
-  /* Hash AAD */
-  ghash_ctx gh;
-  ghash_init(&gh, H);
-  ghash_add_aad(&gh, header, nheader);
+/* Starts counter mode at Y_1 (Y_0 is used for the tag). */
+static void gcm_ctr_init(cf_ctr *ctr, const cf_prp *prp, void *prpctx,
+                         const uint8_t Y0[16])
+{
+  cf_ctr_init(ctr, prp, prpctx, Y0);
+  cf_ctr_custom_counter(ctr, 12, 4); /* counter is 2^32 */
+  incr_be(ctr->nonce + 12, 4);
+}
 
-  /* Produce ciphertext */
-  uint8_t e_Y0[16] = { 0 };
+/* Streaming state for the message. */
+typedef struct
+{
   cf_ctr ctr;
-  cf_ctr_init(&ctr, prp, prpctx, Y0);
-  cf_ctr_custom_counter(&ctr, 12, 4); /* counter is 2^32 */
-  cf_ctr_cipher(&ctr, e_Y0, e_Y0, sizeof e_Y0); /* first block is tag offset */
-  cf_ctr_cipher(&ctr, plain, cipher, nplain);
+  ghash_ctx gh;
+} gcm_stream;
+
+static void gcm_aad_piece(void *vctx, const uint8_t *data, size_t len)
+{
+  ghash_add_aad(vctx, data, len);
+}
+
+static void gcm_cipher_piece(void *vctx, const uint8_t *data, size_t len)
+{
+  ghash_add_cipher(vctx, data, len);
+}
+
+static void gcm_encrypt_piece(void *vctx, const uint8_t *in, uint8_t *out, size_t len)
+{
+  gcm_stream *st = vctx;
+  cf_ctr_cipher(&st->ctr, in, out, len);
+  ghash_add_cipher(&st->gh, out, len);
+}
+
+static void gcm_decrypt_piece(void *vctx, const uint8_t *in, uint8_t *out, size_t len)
+{
+  gcm_stream *st = vctx;
+  cf_ctr_cipher(&st->ctr, in, out, len);
+}
+
+static void gcm_hash_aad(ghash_ctx *gh, const cf_iovec *header, size_t nheaderiov)
+{
+  cf_iov_cursor c;
+  cf_iov_init(&c, header, nheaderiov);
+  cf_iov_read(&c, cf_iov_len(header, nheaderiov), gcm_aad_piece, gh);
+}
+
+/* Encryption given H and E_K(Y_0). */
+static void gcm_encrypt_core(const cf_prp *prp, void *prpctx,
+                             uint8_t H[16],
+                             const uint8_t Y0[16],
+                             const uint8_t e_Y0[16],
+                             const cf_iovec *plain, size_t nplainiov,
+                             const cf_iovec *header, size_t nheaderiov,
+                             const cf_iovec *cipher, size_t ncipheriov,
+                             uint8_t *tag, size_t ntag)
+{
+  size_t nplain = cf_iov_len(plain, nplainiov);
+  assert(cf_iov_len(cipher, ncipheriov) == nplain);
+
+  gcm_stream st;
+
+  /* Hash AAD */
+  ghash_init(&st.gh, H);
+  gcm_hash_aad(&st.gh, header, nheaderiov);
 
-  /* Hash ciphertext */
-  ghash_add_cipher(&gh, cipher, nplain);
+  /* Produce and hash ciphertext */
+  cf_iov_cursor in, out;
+  cf_iov_init(&in, plain, nplainiov);
+  cf_iov_init(&out, cipher, ncipheriov);
+  gcm_ctr_init(&st.ctr, prp, prpctx, Y0);
+  cf_iov_transform(&in, &out, nplain, gcm_encrypt_piece, &st);
 
   /* Post-process ghash output */
   uint8_t full_tag[16] = { 0 };
-  ghash_final(&gh, full_tag);
+  ghash_final(&st.gh, full_tag);
   
   assert(ntag > 1 && ntag <= 16);
   xor_bb(tag, full_tag, e_Y0, ntag);
 
-  mem_clean(H, sizeof H);
-  mem_clean(Y0, sizeof Y0);
-  mem_clean(e_Y0, sizeof e_Y0);
   mem_clean(full_tag, sizeof full_tag);
-  mem_clean(&gh, sizeof gh);
-  mem_clean(&ctr, sizeof ctr);
+  mem_clean(&st, sizeof st);
 }
 
-int cf_gcm_decrypt(const cf_prp *prp, void *prpctx,
-                   const uint8_t *cipher, size_t ncipher,
-                   const uint8_t *header, size_t nheader,
-                   const uint8_t *nonce, size_t nnonce,
-                   const uint8_t *tag, size_t ntag,
-                   uint8_t *plain)
+/* Decryption given H and E_K(Y_0). */
+static int gcm_decrypt_core(const cf_prp *prp, void *prpctx,
+                            uint8_t H[16],
+                            const uint8_t Y0[16],
+                            const uint8_t e_Y0[16],
+                            const cf_iovec *cipher, size_t ncipheriov,
+                            const cf_iovec *header, size_t nheaderiov,
+                            const uint8_t *tag, size_t ntag,
+                            const cf_iovec *plain, size_t nplainiov)
 {
-  uint8_t H[16] = { 0 };
-  uint8_t Y0[16]; 
-
-  /* H = E_K(0^128) */
-  prp->encrypt(prpctx, H, H);
+  size_t ncipher = cf_iov_len(cipher, ncipheriov);
+  assert(cf_iov_len(plain, nplainiov) == ncipher);
 
-  /* Produce CTR nonce, Y_0:
-   *
-   * if len(IV) == 96
-   *   Y_0 = IV || 0^31 || 1
-   * otherwise
-   *   Y_0 = GHASH(H, {}, IV)
-   */
+  gcm_stream st;
+  cf_iov_cursor in, out;
 
-  if (nnonce == 12)
-  {
-    memcpy(Y0, nonce, nnonce);
-    Y0[12] = Y0[13] = Y0[14] = 0x00;
-    Y0[15] = 0x01;
-  } else {
-    ghash_ctx gh;
-    ghash_init(&gh, H);
-    ghash_add_cipher(&gh, nonce, nnonce);
-    ghash_final(&gh, Y0);
-  }
-  
   /* Hash AAD. */
-  ghash_ctx gh;
-  ghash_init(&gh, H);
-  ghash_add_aad(&gh, header, nheader);
-
-  /* Start counter mode, to obtain offset on tag. */
-  uint8_t e_Y0[16] = { 0 };
-  cf_ctr ctr;
-  cf_ctr_init(&ctr, prp, prpctx, Y0);
-  cf_ctr_custom_counter(&ctr, 12, 4);
-  cf_ctr_cipher(&ctr, e_Y0, e_Y0, sizeof e_Y0);
+  ghash_init(&st.gh, H);
+  gcm_hash_aad(&st.gh, header, nheaderiov);
 
-  /* Hash ciphertext. */
-  ghash_add_cipher(&gh, cipher, ncipher);
+  /* Hash ciphertext.  It is only decrypted once the tag is known
+   * to be good, so nothing is written to plain on error. */
+  cf_iov_init(&in, cipher, ncipheriov);
+  cf_iov_read(&in, ncipher, gcm_cipher_piece, &st.gh);
 
   /* Produce tag. */
   uint8_t full_tag[16];
-  ghash_final(&gh, full_tag);
+  ghash_final(&st.gh, full_tag);
   assert(ntag > 1 && ntag <= 16);
   xor_bb(full_tag, full_tag, e_Y0, ntag);
 
@@ -236,15 +258,181 @@ int cf_gcm_decrypt(const cf_prp *prp, void *prpctx,
     goto x_err;
   
   /* Complete decryption. */
-  cf_ctr_cipher(&ctr, cipher, plain, ncipher);
+  cf_iov_init(&in, cipher, ncipheriov);
+  cf_iov_init(&out, plain, nplainiov);
+  gcm_ctr_init(&st.ctr, prp, prpctx, Y0);
+  cf_iov_transform(&in, &out, ncipher, gcm_decrypt_piece, &st);
   err = 0;
  
 x_err:
+  mem_clean(full_tag, sizeof full_tag);
+  mem_clean(&st, sizeof st);
+  return err;
+}
+
+void cf_gcm_encrypt_iov(const cf_prp *prp, void *prpctx,
+                        const cf_iovec *plain, size_t nplainiov,
+                        const cf_iovec *header, size_t nheaderiov,
+                        const uint8_t *nonce, size_t nnonce,
+                        const cf_iovec *cipher, size_t ncipheriov,
+                        uint8_t *tag, size_t ntag)
+{
+  uint8_t H[16] = { 0 };
+  uint8_t Y0[16], e_Y0[16];
+
+  /* H = E_K(0^128) */
+  prp->encrypt(prpctx, H, H);
+
+  gcm_y0(H, nonce, nnonce, Y0);
+  prp->encrypt(prpctx, Y0, e_Y0); /* first block is tag offset */
+
+  gcm_encrypt_core(prp, prpctx, H, Y0, e_Y0,
+                   plain, nplainiov,
+                   header, nheaderiov,
+                   cipher, ncipheriov,
+                   tag, ntag);
+
+  mem_clean(H, sizeof H);
+  mem_clean(Y0, sizeof Y0);
+  mem_clean(e_Y0, sizeof e_Y0);
+}
+
+int cf_gcm_decrypt_iov(const cf_prp *prp, void *prpctx,
+                       const cf_iovec *cipher, size_t ncipheriov,
+                       const cf_iovec *header, size_t nheaderiov,
+                       const uint8_t *nonce, size_t nnonce,
+                       const uint8_t *tag, size_t ntag,
+                       const cf_iovec *plain, size_t nplainiov)
+{
+  uint8_t H[16] = { 0 };
+  uint8_t Y0[16], e_Y0[16];
+
+  /* H = E_K(0^128) */
+  prp->encrypt(prpctx, H, H);
+
+  gcm_y0(H, nonce, nnonce, Y0);
+  prp->encrypt(prpctx, Y0, e_Y0);
+
+  int err = gcm_decrypt_core(prp, prpctx, H, Y0, e_Y0,
+                             cipher, ncipheriov,
+                             header, nheaderiov,
+                             tag, ntag,
+                             plain, nplainiov);
+
+  mem_clean(H, sizeof H);
+  mem_clean(Y0, sizeof Y0);
+  mem_clean(e_Y0, sizeof e_Y0);
+  return err;
+}
+
+void cf_gcm_encrypt(const cf_prp *prp, void *prpctx,
+                    const uint8_t *plain, size_t nplain,
+                    const uint8_t *header, size_t nheader,
+                    const uint8_t *nonce, size_t nnonce,
+                    uint8_t *cipher, /* the same size as nplain */
+                    uint8_t *tag, size_t ntag)
+{
+  cf_iovec plain_iov = { (void *) plain, nplain },
+           header_iov = { (void *) header, nheader },
+           cipher_iov = { cipher, nplain };
+
+  cf_gcm_encrypt_iov(prp, prpctx,
+                     &plain_iov, 1,
+                     &header_iov, 1,
+                     nonce, nnonce,
+                     &cipher_iov, 1,
+                     tag, ntag);
+}
+
+int cf_gcm_decrypt(const cf_prp *prp, void *prpctx,
+                   const uint8_t *cipher, size_t ncipher,
+                   const uint8_t *header, size_t nheader,
+                   const uint8_t *nonce, size_t nnonce,
+                   const uint8_t *tag, size_t ntag,
+                   uint8_t *plain)
+{
+  cf_iovec cipher_iov = { (void *) cipher, ncipher },
+           header_iov = { (void *) header, nheader },
+           plain_iov = { plain, ncipher };
+
+  return cf_gcm_decrypt_iov(prp, prpctx,
+                            &cipher_iov, 1,
+                            &header_iov, 1,
+                            nonce, nnonce,
+                            tag, ntag,
+                            &plain_iov, 1);
+}
+
+/* Batches are done in groups of this many records: the
+ * E_K(Y_0) blocks for a group are found in one PRP call. */
+#define GCM_LANES 8
+
+static int gcm_batch(const cf_prp *prp, void *prpctx,
+                     cf_aead_record *recs, size_t nrecs,
+                     size_t ntag, int encrypt)
+{
+  uint8_t H[16] = { 0 };
+  uint8_t Y0[GCM_LANES][16], e_Y0[GCM_LANES][16];
+  int err = 0;
+
+  /* H = E_K(0^128), once for the whole batch. */
+  prp->encrypt(prpctx, H, H);
+
+  while (nrecs)
+  {
+    size_t n = MIN(nrecs, (size_t) GCM_LANES);
+
+    for (size_t i = 0; i < n; i++)
+      gcm_y0(H, recs[i].nonce, recs[i].nnonce, Y0[i]);
+
+    cf_prp_encrypt_blocks(prp, prpctx, Y0[0], e_Y0[0], n);
+
+    for (size_t i = 0; i < n; i++)
+    {
+      cf_aead_record *r = &recs[i];
+      cf_iovec in = { (void *) r->in, r->nbytes },
+               header = { (void *) r->header, r->nheader },
+               out = { r->out, r->nbytes };
+
+      if (encrypt)
+      {
+        gcm_encrypt_core(prp, prpctx, H, Y0[i], e_Y0[i],
+                         &in, 1,
+                         &header, 1,
+                         &out, 1,
+                         r->tag, ntag);
+      } else {
+        r->err = gcm_decrypt_core(prp, prpctx, H, Y0[i], e_Y0[i],
+                                  &in, 1,
+                                  &header, 1,
+                                  r->tag, ntag,
+                                  &out, 1);
+        if (r->err)
+          mem_clean(r->out, r->nbytes);
+        err |= r->err;
+      }
+    }
+
+    recs += n;
+    nrecs -= n;
+  }
+
   mem_clean(H, sizeof H);
   mem_clean(Y0, sizeof Y0);
   mem_clean(e_Y0, sizeof e_Y0);
-  mem_clean(full_tag, sizeof full_tag);
-  mem_clean(&gh, sizeof gh);
-  mem_clean(&ctr, sizeof ctr);
   return err;
 }
+
+void cf_gcm_encrypt_batch(const cf_prp *prp, void *prpctx,
+                          cf_aead_record *recs, size_t nrecs,
+                          size_t ntag)
+{
+  gcm_batch(prp, prpctx, recs, nrecs, ntag, 1);
+}
+
+int cf_gcm_decrypt_batch(const cf_prp *prp, void *prpctx,
+                         cf_aead_record *recs, size_t nrecs,
+                         size_t ntag)
+{
+  return gcm_batch(prp, prpctx, recs, nrecs, ntag, 0);
+}
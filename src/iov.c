@@ -0,0 +1,189 @@
+/*
+ * cifra - embedded cryptography library
+ * Written in 2014 by Joseph Birr-Pixton <jpixton@gmail.com>
+ *
+ * To the extent possible under law, the author(s) have dedicated all
+ * copyright and related and neighboring rights to this software to the
+ * public domain worldwide. This software is distributed without any
+ * warranty.
+ *
+ * You should have received a copy of the CC0 Public Domain Dedication
+ * along with this software. If not, see
+ * <http://creativecommons.org/publicdomain/zero/1.0/>.
+ */
+
+#include "iov.h"
+#include "prp.h"
+#include "handy.h"
+#include "tassert.h"
+
+#include <string.h>
+
+size_t cf_iov_len(const cf_iovec *iov, size_t niov)
+{
+  size_t len = 0;
+  for (size_t i = 0; i < niov; i++)
+    len += iov[i].len;
+  return len;
+}
+
+void cf_iov_init(cf_iov_cursor *c, const cf_iovec *iov, size_t niov)
+{
+  c->iov = iov;
+  c->niov = niov;
+  c->offset = 0;
+}
+
+/* Returns the contiguous bytes available at c (skipping
+ * any exhausted fragments), and sets *ptr to them, or to NULL if
+ * there are none. */
+static size_t iov_span(cf_iov_cursor *c, uint8_t **ptr)
+{
+  while (c->niov && c->offset == c->iov->len)
+  {
+    c->iov++;
+    c->niov--;
+    c->offset = 0;
+  }
+
+  if (c->niov == 0)
+  {
+    *ptr = NULL;
+    return 0;
+  }
+
+  *ptr = (uint8_t *) c->iov->base + c->offset;
+  return c->iov->len - c->offset;
+}
+
+static void iov_advance(cf_iov_cursor *c, size_t n)
+{
+  c->offset += n;
+  assert(c->offset <= c->iov->len);
+}
+
+void cf_iov_gather(cf_iov_cursor *c, uint8_t *out, size_t n)
+{
+  while (n)
+  {
+    uint8_t *ptr;
+    size_t take = MIN(n, iov_span(c, &ptr));
+    assert(take);
+    memcpy(out, ptr, take);
+    iov_advance(c, take);
+    out += take;
+    n -= take;
+  }
+}
+
+void cf_iov_scatter(cf_iov_cursor *c, const uint8_t *in, size_t n)
+{
+  while (n)
+  {
+    uint8_t *ptr;
+    size_t take = MIN(n, iov_span(c, &ptr));
+    assert(take);
+    memcpy(ptr, in, take);
+    iov_advance(c, take);
+    in += take;
+    n -= take;
+  }
+}
+
+void cf_iov_clean(const cf_iovec *iov, size_t niov)
+{
+  for (size_t i = 0; i < niov; i++)
+    mem_clean(iov[i].base, iov[i].len);
+}
+
+void cf_iov_read(cf_iov_cursor *c, size_t nbytes,
+                 cf_iov_in_fn process, void *ctx)
+{
+  while (nbytes)
+  {
+    uint8_t *ptr;
+    size_t take = MIN(nbytes, iov_span(c, &ptr));
+    assert(take);
+    process(ctx, ptr, take);
+    iov_advance(c, take);
+    nbytes -= take;
+  }
+}
+
+void cf_iov_transform(cf_iov_cursor *in, cf_iov_cursor *out, size_t nbytes,
+                      cf_iov_inout_fn process, void *ctx)
+{
+  while (nbytes)
+  {
+    uint8_t *inp, *outp;
+    size_t take = MIN(iov_span(in, &inp), iov_span(out, &outp));
+    take = MIN(nbytes, take);
+    assert(take);
+    process(ctx, inp, outp, take);
+    iov_advance(in, take);
+    iov_advance(out, take);
+    nbytes -= take;
+  }
+}
+
+void cf_iov_read_blocks(cf_iov_cursor *c, size_t nblocks, size_t nblock,
+                        cf_iov_blocks_in_fn process, void *ctx)
+{
+  uint8_t block[CF_MAXBLOCK];
+
+  assert(nblock <= CF_MAXBLOCK);
+
+  while (nblocks)
+  {
+    uint8_t *ptr;
+    size_t avail = iov_span(c, &ptr) / nblock;
+
+    if (avail)
+    {
+      size_t n = MIN(nblocks, avail);
+      process(ctx, ptr, n);
+      iov_advance(c, n * nblock);
+      nblocks -= n;
+    } else {
+      /* This block straddles a fragment boundary. */
+      cf_iov_gather(c, block, nblock);
+      process(ctx, block, 1);
+      nblocks--;
+    }
+  }
+
+  mem_clean(block, sizeof block);
+}
+
+void cf_iov_transform_blocks(cf_iov_cursor *in, cf_iov_cursor *out,
+                             size_t nblocks, size_t nblock,
+                             cf_iov_blocks_fn process, void *ctx)
+{
+  uint8_t block[CF_MAXBLOCK];
+
+  assert(nblock <= CF_MAXBLOCK);
+
+  while (nblocks)
+  {
+    uint8_t *inp, *outp;
+    size_t avail = MIN(iov_span(in, &inp), iov_span(out, &outp)) / nblock;
+
+    if (avail)
+    {
+      size_t n = MIN(nblocks, avail);
+      process(ctx, inp, outp, n);
+      iov_advance(in, n * nblock);
+      iov_advance(out, n * nblock);
+      nblocks -= n;
+    } else {
+      /* This block straddles a fragment boundary in the input,
+       * output, or both. */
+      cf_iov_gather(in, block, nblock);
+      process(ctx, block, block, 1);
+      cf_iov_scatter(out, block, nblock);
+      nblocks--;
+    }
+  }
+
+  mem_clean(block, sizeof block);
+}
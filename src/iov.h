@@ -0,0 +1,83 @@
+/*
+ * cifra - embedded cryptography library
+ * Written in 2014 by Joseph Birr-Pixton <jpixton@gmail.com>
+ *
+ * To the extent possible under law, the author(s) have dedicated all
+ * copyright and related and neighboring rights to this software to the
+ * public domain worldwide. This software is distributed without any
+ * warranty.
+ *
+ * You should have received a copy of the CC0 Public Domain Dedication
+ * along with this software. If not, see
+ * <http://creativecommons.org/publicdomain/zero/1.0/>.
+ */
+
+#ifndef IOV_H
+#define IOV_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "aead.h"
+
+/* A position in a list of fragments. */
+typedef struct
+{
+  const cf_iovec *iov;
+  size_t niov;
+  size_t offset;  /* within iov[0] */
+} cf_iov_cursor;
+
+/* Processing function for cf_iov_read. */
+typedef void (*cf_iov_in_fn)(void *ctx, const uint8_t *data, size_t len);
+
+/* Processing function for cf_iov_transform. */
+typedef void (*cf_iov_inout_fn)(void *ctx, const uint8_t *in, uint8_t *out, size_t len);
+
+/* Processing function for cf_iov_read_blocks. */
+typedef void (*cf_iov_blocks_in_fn)(void *ctx, const uint8_t *in, size_t nblocks);
+
+/* Processing function for cf_iov_transform_blocks. */
+typedef void (*cf_iov_blocks_fn)(void *ctx, const uint8_t *in, uint8_t *out, size_t nblocks);
+
+/* Returns the total length of the given fragments. */
+size_t cf_iov_len(const cf_iovec *iov, size_t niov);
+
+/* Starts a cursor at the start of the given fragments. */
+void cf_iov_init(cf_iov_cursor *c, const cf_iovec *iov, size_t niov);
+
+/* Copies the next n bytes at c to out. */
+void cf_iov_gather(cf_iov_cursor *c, uint8_t *out, size_t n);
+
+/* Copies n bytes from in to the next n bytes at c. */
+void cf_iov_scatter(cf_iov_cursor *c, const uint8_t *in, size_t n);
+
+/* Zeroes every fragment. */
+void cf_iov_clean(const cf_iovec *iov, size_t niov);
+
+/* Calls process on each contiguous piece of the next nbytes at c.
+ * process is never called with a zero length. */
+void cf_iov_read(cf_iov_cursor *c, size_t nbytes,
+                 cf_iov_in_fn process, void *ctx);
+
+/* Calls process on each piece of the next nbytes at in and out
+ * which is contiguous in both.  process is never called with a
+ * zero length. */
+void cf_iov_transform(cf_iov_cursor *in, cf_iov_cursor *out, size_t nbytes,
+                      cf_iov_inout_fn process, void *ctx);
+
+/* Calls process on the next nblocks blocks of nblock bytes at c.
+ * Runs of whole blocks which are contiguous are passed in one call;
+ * blocks which straddle fragments are gathered into a buffer first.
+ * nblock must be no more than CF_MAXBLOCK. */
+void cf_iov_read_blocks(cf_iov_cursor *c, size_t nblocks, size_t nblock,
+                        cf_iov_blocks_in_fn process, void *ctx);
+
+/* As cf_iov_read_blocks, but with output: blocks which straddle
+ * fragments in either list are processed in buffers, and the
+ * output is scattered afterwards. */
+void cf_iov_transform_blocks(cf_iov_cursor *in, cf_iov_cursor *out,
+                             size_t nblocks, size_t nblock,
+                             cf_iov_blocks_fn process, void *ctx);
+
+#endif
@@ -0,0 +1,285 @@
+/*
+ * cifra - embedded cryptography library
+ * Written in 2014 by Joseph Birr-Pixton <jpixton@gmail.com>
+ *
+ * To the extent possible under law, the author(s) have dedicated all
+ * copyright and related and neighboring rights to this software to the
+ * public domain worldwide. This software is distributed without any
+ * warranty.
+ *
+ * You should have received a copy of the CC0 Public Domain Dedication
+ * along with this software. If not, see
+ * <http://creativecommons.org/publicdomain/zero/1.0/>.
+ */
+
+#include "handy.h"
+#include "prp.h"
+#include "modes.h"
+#include "bitops.h"
+#include "tassert.h"
+
+#include <string.h>
+
+/* How many wrapped keys cf_kw_unwrap_batch works on at once. */
+#define KW_LANES 8
+
+/* RFC3394 2.2.3.1 default IV. */
+static const uint8_t kw_iv[8] = { 0xa6, 0xa6, 0xa6, 0xa6, 0xa6, 0xa6, 0xa6, 0xa6 };
+
+/* RFC5649 3 alternative IV prefix. */
+static const uint8_t kwp_iv[4] = { 0xa6, 0x59, 0x59, 0xa6 };
+
+static void xor_t(uint8_t A[8], uint64_t t)
+{
+  uint8_t tbuf[8];
+  write64_be(t, tbuf);
+  xor_bb(A, A, tbuf, 8);
+}
+
+/* The RFC3394 wrapping function W, with the given initial value.
+ * R is already in wrapped + 8, and is n 64-bit blocks long. */
+static void kw_wrap_core(const cf_prp *prp, void *prpctx,
+                         const uint8_t iv[8],
+                         uint8_t *wrapped, size_t n)
+{
+  uint8_t block[16];
+  uint8_t *R = wrapped + 8;
+
+  memcpy(block, iv, 8);
+
+  for (uint64_t j = 0; j < 6; j++)
+  {
+    for (size_t i = 1; i <= n; i++)
+    {
+      memcpy(block + 8, R + 8 * (i - 1), 8);
+      prp->encrypt(prpctx, block, block);
+      memcpy(R + 8 * (i - 1), block + 8, 8);
+      xor_t(block, n * j + i);
+    }
+  }
+
+  memcpy(wrapped, block, 8);
+  mem_clean(block, sizeof block);
+}
+
+void cf_kw_wrap(const cf_prp *prp, void *prpctx,
+                const uint8_t *plain, size_t nplain,
+                uint8_t *wrapped)
+{
+  assert(prp->blocksz == 16);
+  assert(nplain >= 16 && nplain % 8 == 0);
+
+  memmove(wrapped + 8, plain, nplain);
+  kw_wrap_core(prp, prpctx, kw_iv, wrapped, nplain / 8);
+}
+
+void cf_kwp_wrap(const cf_prp *prp, void *prpctx,
+                 const uint8_t *plain, size_t nplain,
+                 uint8_t *wrapped)
+{
+  assert(prp->blocksz == 16);
+  assert(nplain > 0 && nplain <= 0xffffffff);
+
+  uint8_t iv[8];
+  size_t npadded = CF_KWP_WRAPPED_SIZE(nplain) - 8;
+
+  memcpy(iv, kwp_iv, 4);
+  write32_be((uint32_t) nplain, iv + 4);
+
+  memmove(wrapped + 8, plain, nplain);
+  memset(wrapped + 8 + nplain, 0, npadded - nplain);
+
+  if (npadded == 8)
+  {
+    /* Exactly one block: it is encrypted directly. */
+    memcpy(wrapped, iv, 8);
+    prp->encrypt(prpctx, wrapped, wrapped);
+  } else {
+    kw_wrap_core(prp, prpctx, iv, wrapped, npadded / 8);
+  }
+}
+
+/* One wrapped key being unwrapped by cf_kw_unwrap_batch.
+ *
+ * This runs the RFC3394 unwrapping function W^-1 one step at a
+ * time, with j and i counting down.  R lives in item->plain.
+ *
+ * n == 1 is only possible for KWP, and means the single
+ * wrapped block is decrypted directly. */
+typedef struct
+{
+  cf_kw_item *item;
+  uint8_t A[8];
+  size_t n;
+  uint64_t j;
+  size_t i;
+  int done;
+} kw_lane;
+
+/* Starts unwrapping item into lane.  Returns 0 and sets item->err
+ * if item cannot be a valid wrapped key. */
+static int kw_lane_start(kw_lane *lane, cf_kw_item *item)
+{
+  size_t nmin = item->padded ? 16 : 24;
+
+  item->nplain = 0;
+  item->err = 0;
+
+  if (item->nwrapped < nmin || item->nwrapped % 8 != 0)
+  {
+    if (item->nwrapped >= 8)
+      mem_clean(item->plain, item->nwrapped - 8);
+    item->err = 1;
+    return 0;
+  }
+
+  lane->item = item;
+  memcpy(lane->A, item->wrapped, 8);
+  memmove(item->plain, item->wrapped + 8, item->nwrapped - 8);
+  lane->n = (item->nwrapped - 8) / 8;
+  lane->j = lane->n == 1 ? 0 : 5;
+  lane->i = lane->n;
+  lane->done = 0;
+  return 1;
+}
+
+static void kw_lane_load(const kw_lane *lane, uint8_t block[16])
+{
+  memcpy(block, lane->A, 8);
+  if (lane->n != 1)
+    xor_t(block, lane->n * lane->j + lane->i);
+  memcpy(block + 8, lane->item->plain + 8 * (lane->i - 1), 8);
+}
+
+static void kw_lane_store(kw_lane *lane, const uint8_t block[16])
+{
+  memcpy(lane->A, block, 8);
+  memcpy(lane->item->plain + 8 * (lane->i - 1), block + 8, 8);
+
+  if (lane->i > 1)
+  {
+    lane->i--;
+  } else if (lane->j > 0) {
+    lane->i = lane->n;
+    lane->j--;
+  } else {
+    lane->done = 1;
+  }
+}
+
+/* Checks the recovered initial value, and sets the item's
+ * nplain and err. */
+static void kw_lane_finish(kw_lane *lane)
+{
+  cf_kw_item *item = lane->item;
+  size_t nr = item->nwrapped - 8;
+  unsigned ok;
+
+  if (item->padded)
+  {
+    uint32_t mli = read32_be(lane->A + 4);
+    ok = mem_eq(lane->A, kwp_iv, 4);
+    ok &= mli > nr - 8 && mli <= nr;
+
+    if (ok)
+    {
+      uint8_t pad = 0;
+      for (size_t k = mli; k < nr; k++)
+        pad |= item->plain[k];
+      ok &= pad == 0;
+      item->nplain = mli;
+    }
+  } else {
+    ok = mem_eq(lane->A, kw_iv, 8);
+    item->nplain = nr;
+  }
+
+  if (!ok)
+  {
+    mem_clean(item->plain, nr);
+    item->nplain = 0;
+    item->err = 1;
+  }
+}
+
+int cf_kw_unwrap_batch(const cf_prp *prp, void *prpctx,
+                       cf_kw_item *items, size_t nitems)
+{
+  assert(prp->blocksz == 16);
+
+  kw_lane lanes[KW_LANES];
+  uint8_t blocks[KW_LANES * 16];
+  size_t nlanes = 0, next = 0;
+
+  while (1)
+  {
+    /* Keep the lanes full while there are items left. */
+    while (nlanes < KW_LANES && next < nitems)
+    {
+      if (kw_lane_start(&lanes[nlanes], &items[next++]))
+        nlanes++;
+    }
+
+    if (nlanes == 0)
+      break;
+
+    /* One step of each independent chain, in one call. */
+    for (size_t l = 0; l < nlanes; l++)
+      kw_lane_load(&lanes[l], blocks + 16 * l);
+
+    cf_prp_decrypt_blocks(prp, prpctx, blocks, blocks, nlanes);
+
+    for (size_t l = 0; l < nlanes; l++)
+      kw_lane_store(&lanes[l], blocks + 16 * l);
+
+    /* Retire finished lanes. */
+    for (size_t l = 0; l < nlanes; )
+    {
+      if (lanes[l].done)
+      {
+        kw_lane_finish(&lanes[l]);
+        lanes[l] = lanes[--nlanes];
+      } else {
+        l++;
+      }
+    }
+  }
+
+  mem_clean(lanes, sizeof lanes);
+  mem_clean(blocks, sizeof blocks);
+
+  int err = 0;
+  for (size_t k = 0; k < nitems; k++)
+    err |= items[k].err;
+  return err;
+}
+
+int cf_kw_unwrap(const cf_prp *prp, void *prpctx,
+                 const uint8_t *wrapped, size_t nwrapped,
+                 uint8_t *plain)
+{
+  cf_kw_item item = {
+    .wrapped = wrapped,
+    .nwrapped = nwrapped,
+    .plain = plain,
+    .padded = 0
+  };
+
+  return cf_kw_unwrap_batch(prp, prpctx, &item, 1);
+}
+
+int cf_kwp_unwrap(const cf_prp *prp, void *prpctx,
+                  const uint8_t *wrapped, size_t nwrapped,
+                  uint8_t *plain, size_t *nplain)
+{
+  cf_kw_item item = {
+    .wrapped = wrapped,
+    .nwrapped = nwrapped,
+    .plain = plain,
+    .padded = 1
+  };
+
+  int err = cf_kw_unwrap_batch(prp, prpctx, &item, 1);
+  *nplain = item.nplain;
+  return err;
+}
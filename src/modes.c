@@ -12,6 +12,7 @@
  * <http://creativecommons.org/publicdomain/zero/1.0/>.
  */
 
+#include "handy.h"
 #include "prp.h"
 #include "modes.h"
 #include "bitops.h"
@@ -59,6 +60,10 @@ void cf_cbc_decrypt(cf_cbc *ctx, const uint8_t *input, uint8_t *output, size_t b
 }
 
 /* CTR */
+
+/* How many blocks of key stream cf_ctr_cipher makes at once. */
+#define CTR_LANES 8
+
 void cf_ctr_init(cf_ctr *ctx, const cf_prp *prp, void *prpctx, const uint8_t nonce[CF_MAXBLOCK])
 {
   memset(ctx, 0, sizeof *ctx);
@@ -86,8 +91,50 @@ static void ctr_next_block(void *vctx, uint8_t *out)
 
 void cf_ctr_cipher(cf_ctr *ctx, const uint8_t *input, uint8_t *output, size_t bytes)
 {
+  size_t blocksz = ctx->prp->blocksz;
+
+  /* Use up any key stream left over from last time. */
+  if (ctx->nkeymat)
+  {
+    size_t taken = MIN(bytes, ctx->nkeymat);
+    cf_blockwise_xor(ctx->keymat, &ctx->nkeymat,
+                     blocksz,
+                     input, output, taken,
+                     ctr_next_block,
+                     ctx);
+    input += taken;
+    output += taken;
+    bytes -= taken;
+  }
+
+  /* Whole blocks: produce several blocks of key stream per PRP call. */
+  if (bytes >= blocksz)
+  {
+    uint8_t keymat[CTR_LANES * CF_MAXBLOCK];
+
+    while (bytes >= blocksz)
+    {
+      size_t n = MIN(bytes / blocksz, (size_t) CTR_LANES);
+
+      for (size_t i = 0; i < n; i++)
+      {
+        memcpy(keymat + i * blocksz, ctx->nonce, blocksz);
+        incr_be(ctx->nonce + ctx->counter_offset, ctx->counter_width);
+      }
+
+      cf_prp_encrypt_blocks(ctx->prp, ctx->prpctx, keymat, keymat, n);
+      xor_bb(output, input, keymat, n * blocksz);
+      input += n * blocksz;
+      output += n * blocksz;
+      bytes -= n * blocksz;
+    }
+
+    mem_clean(keymat, sizeof keymat);
+  }
+
+  /* Remaining partial block. */
   cf_blockwise_xor(ctx->keymat, &ctx->nkeymat,
-                   ctx->prp->blocksz,
+                   blocksz,
                    input, output, bytes,
                    ctr_next_block,
                    ctx);
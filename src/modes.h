@@ -19,6 +19,7 @@
 #include <stdint.h>
 
 #include "prp.h"
+#include "aead.h"
 
 /**
  * Block cipher modes
@@ -374,6 +375,84 @@ int cf_eax_decrypt(const cf_prp *prp, void *prpctx,
                    const uint8_t *tag, size_t ntag,
                    uint8_t *plain);
 
+/* .. c:function:: $DECL
+ * EAX authenticated encryption, with fragmented input and output.
+ *
+ * This gives the same results as :c:func:`cf_eax_encrypt` on the
+ * concatenation of each list of fragments.
+ *
+ * This function does not fail.
+ *
+ * :param prp/prpctx: describe the block cipher to use.
+ * :param plain/nplainiov: message plaintext fragments.
+ * :param header/nheaderiov: AAD fragments.
+ * :param nonce/nnonce: nonce, as for :c:func:`cf_eax_encrypt`.
+ * :param cipher/ncipheriov: ciphertext output fragments.  These must have the same total length as `plain`.
+ * :param tag/ntag: authentication tag output, as for :c:func:`cf_eax_encrypt`.
+ */
+void cf_eax_encrypt_iov(const cf_prp *prp, void *prpctx,
+                        const cf_iovec *plain, size_t nplainiov,
+                        const cf_iovec *header, size_t nheaderiov,
+                        const uint8_t *nonce, size_t nnonce,
+                        const cf_iovec *cipher, size_t ncipheriov,
+                        uint8_t *tag, size_t ntag);
+
+/* .. c:function:: $DECL
+ * EAX authenticated decryption, with fragmented input and output.
+ *
+ * This gives the same results as :c:func:`cf_eax_decrypt` on the
+ * concatenation of each list of fragments.
+ *
+ * :return: 0 on success, non-zero on error.  As for :c:func:`cf_eax_decrypt`.
+ *
+ * :param prp/prpctx: describe the block cipher to use.
+ * :param cipher/ncipheriov: message ciphertext fragments.
+ * :param header/nheaderiov: AAD fragments.
+ * :param nonce/nnonce: nonce.
+ * :param tag/ntag: authentication tag, as for :c:func:`cf_eax_decrypt`.
+ * :param plain/nplainiov: plaintext output fragments.  These must have the same total length as `cipher`.
+ */
+int cf_eax_decrypt_iov(const cf_prp *prp, void *prpctx,
+                       const cf_iovec *cipher, size_t ncipheriov,
+                       const cf_iovec *header, size_t nheaderiov,
+                       const uint8_t *nonce, size_t nnonce,
+                       const uint8_t *tag, size_t ntag,
+                       const cf_iovec *plain, size_t nplainiov);
+
+/* .. c:function:: $DECL
+ * EAX authenticated encryption of a batch of records under one key.
+ *
+ * This gives the same results as :c:func:`cf_eax_encrypt` on each
+ * record, but finds the CMAC subkeys only once per batch.
+ *
+ * This function does not fail.
+ *
+ * :param prp/prpctx: describe the block cipher to use.
+ * :param recs: records to encrypt.  See :c:type:`cf_aead_record`.
+ * :param nrecs: number of records.
+ * :param ntag: authentication tag length for every record.
+ */
+void cf_eax_encrypt_batch(const cf_prp *prp, void *prpctx,
+                          cf_aead_record *recs, size_t nrecs,
+                          size_t ntag);
+
+/* .. c:function:: $DECL
+ * EAX authenticated decryption of a batch of records under one key.
+ *
+ * Each record's `err` member is set as for :c:func:`cf_eax_decrypt`,
+ * and its output is cleared on error.
+ *
+ * :return: 0 if every record was decrypted successfully, non-zero otherwise.
+ *
+ * :param prp/prpctx: describe the block cipher to use.
+ * :param recs: records to decrypt.  See :c:type:`cf_aead_record`.
+ * :param nrecs: number of records.
+ * :param ntag: authentication tag length for every record.
+ */
+int cf_eax_decrypt_batch(const cf_prp *prp, void *prpctx,
+                         cf_aead_record *recs, size_t nrecs,
+                         size_t ntag);
+
 /**
  * GCM
  * ---
@@ -434,6 +513,85 @@ int cf_gcm_decrypt(const cf_prp *prp, void *prpctx,
                    const uint8_t *tag, size_t ntag,
                    uint8_t *plain);
 
+/* .. c:function:: $DECL
+ * GCM authenticated encryption, with fragmented input and output.
+ *
+ * This gives the same results as :c:func:`cf_gcm_encrypt` on the
+ * concatenation of each list of fragments.
+ *
+ * This function does not fail.
+ *
+ * :param prp/prpctx: describe the block cipher to use.
+ * :param plain/nplainiov: message plaintext fragments.
+ * :param header/nheaderiov: AAD fragments.
+ * :param nonce/nnonce: nonce, as for :c:func:`cf_gcm_encrypt`.
+ * :param cipher/ncipheriov: ciphertext output fragments.  These must have the same total length as `plain`.
+ * :param tag/ntag: authentication tag output, as for :c:func:`cf_gcm_encrypt`.
+ */
+void cf_gcm_encrypt_iov(const cf_prp *prp, void *prpctx,
+                        const cf_iovec *plain, size_t nplainiov,
+                        const cf_iovec *header, size_t nheaderiov,
+                        const uint8_t *nonce, size_t nnonce,
+                        const cf_iovec *cipher, size_t ncipheriov,
+                        uint8_t *tag, size_t ntag);
+
+/* .. c:function:: $DECL
+ * GCM authenticated decryption, with fragmented input and output.
+ *
+ * This gives the same results as :c:func:`cf_gcm_decrypt` on the
+ * concatenation of each list of fragments.
+ *
+ * :return: 0 on success, non-zero on error.  As for :c:func:`cf_gcm_decrypt`.
+ *
+ * :param prp/prpctx: describe the block cipher to use.
+ * :param cipher/ncipheriov: message ciphertext fragments.
+ * :param header/nheaderiov: AAD fragments.
+ * :param nonce/nnonce: nonce.
+ * :param tag/ntag: authentication tag, as for :c:func:`cf_gcm_decrypt`.
+ * :param plain/nplainiov: plaintext output fragments.  These must have the same total length as `cipher`.
+ */
+int cf_gcm_decrypt_iov(const cf_prp *prp, void *prpctx,
+                       const cf_iovec *cipher, size_t ncipheriov,
+                       const cf_iovec *header, size_t nheaderiov,
+                       const uint8_t *nonce, size_t nnonce,
+                       const uint8_t *tag, size_t ntag,
+                       const cf_iovec *plain, size_t nplainiov);
+
+/* .. c:function:: $DECL
+ * GCM authenticated encryption of a batch of records under one key.
+ *
+ * This gives the same results as :c:func:`cf_gcm_encrypt` on each
+ * record, but finds H only once per batch, and
+ * finds the tag masks for several records in each block cipher call.
+ *
+ * This function does not fail.
+ *
+ * :param prp/prpctx: describe the block cipher to use.
+ * :param recs: records to encrypt.  See :c:type:`cf_aead_record`.
+ * :param nrecs: number of records.
+ * :param ntag: authentication tag length for every record.
+ */
+void cf_gcm_encrypt_batch(const cf_prp *prp, void *prpctx,
+                          cf_aead_record *recs, size_t nrecs,
+                          size_t ntag);
+
+/* .. c:function:: $DECL
+ * GCM authenticated decryption of a batch of records under one key.
+ *
+ * Each record's `err` member is set as for :c:func:`cf_gcm_decrypt`,
+ * and its output is cleared on error.
+ *
+ * :return: 0 if every record was decrypted successfully, non-zero otherwise.
+ *
+ * :param prp/prpctx: describe the block cipher to use.
+ * :param recs: records to decrypt.  See :c:type:`cf_aead_record`.
+ * :param nrecs: number of records.
+ * :param ntag: authentication tag length for every record.
+ */
+int cf_gcm_decrypt_batch(const cf_prp *prp, void *prpctx,
+                         cf_aead_record *recs, size_t nrecs,
+                         size_t ntag);
+
 /**
  * CCM
  * ---
@@ -499,6 +657,89 @@ int cf_ccm_decrypt(const cf_prp *prp, void *prpctx,
                    const uint8_t *tag, size_t ntag,
                    uint8_t *plain);
 
+/* .. c:function:: $DECL
+ * CCM authenticated encryption, with fragmented input and output.
+ *
+ * This gives the same results as :c:func:`cf_ccm_encrypt` on the
+ * concatenation of each list of fragments.
+ *
+ * This function does not fail.
+ *
+ * :param prp/prpctx: describe the block cipher to use.
+ * :param plain/nplainiov: message plaintext fragments.
+ * :param L: length of the message length encoding.  See :c:func:`cf_ccm_encrypt`.
+ * :param header/nheaderiov: AAD fragments.
+ * :param nonce/nnonce: nonce, as for :c:func:`cf_ccm_encrypt`.
+ * :param cipher/ncipheriov: ciphertext output fragments.  These must have the same total length as `plain`.
+ * :param tag/ntag: authentication tag output, as for :c:func:`cf_ccm_encrypt`.
+ */
+void cf_ccm_encrypt_iov(const cf_prp *prp, void *prpctx,
+                        const cf_iovec *plain, size_t nplainiov, size_t L,
+                        const cf_iovec *header, size_t nheaderiov,
+                        const uint8_t *nonce, size_t nnonce,
+                        const cf_iovec *cipher, size_t ncipheriov,
+                        uint8_t *tag, size_t ntag);
+
+/* .. c:function:: $DECL
+ * CCM authenticated decryption, with fragmented input and output.
+ *
+ * This gives the same results as :c:func:`cf_ccm_decrypt` on the
+ * concatenation of each list of fragments.
+ *
+ * :return: 0 on success, non-zero on error.  As for :c:func:`cf_ccm_decrypt`.
+ *
+ * :param prp/prpctx: describe the block cipher to use.
+ * :param cipher/ncipheriov: message ciphertext fragments.
+ * :param L: length of the message length encoding.  See :c:func:`cf_ccm_encrypt`.
+ * :param header/nheaderiov: AAD fragments.
+ * :param nonce/nnonce: nonce.
+ * :param tag/ntag: authentication tag, as for :c:func:`cf_ccm_decrypt`.
+ * :param plain/nplainiov: plaintext output fragments.  These must have the same total length as `cipher`.
+ */
+int cf_ccm_decrypt_iov(const cf_prp *prp, void *prpctx,
+                       const cf_iovec *cipher, size_t ncipheriov, size_t L,
+                       const cf_iovec *header, size_t nheaderiov,
+                       const uint8_t *nonce, size_t nnonce,
+                       const uint8_t *tag, size_t ntag,
+                       const cf_iovec *plain, size_t nplainiov);
+
+/* .. c:function:: $DECL
+ * CCM authenticated encryption of a batch of records under one key.
+ *
+ * This gives the same results as :c:func:`cf_ccm_encrypt` on each
+ * record, but finds the tag masks for several records in each
+ * block cipher call.
+ *
+ * This function does not fail.
+ *
+ * :param prp/prpctx: describe the block cipher to use.
+ * :param recs: records to encrypt.  See :c:type:`cf_aead_record`.
+ * :param nrecs: number of records.
+ * :param L: length of the message length encoding.  See :c:func:`cf_ccm_encrypt`.
+ * :param ntag: authentication tag length for every record.
+ */
+void cf_ccm_encrypt_batch(const cf_prp *prp, void *prpctx,
+                          cf_aead_record *recs, size_t nrecs,
+                          size_t L, size_t ntag);
+
+/* .. c:function:: $DECL
+ * CCM authenticated decryption of a batch of records under one key.
+ *
+ * Each record's `err` member is set as for :c:func:`cf_ccm_decrypt`,
+ * and its output is cleared on error.
+ *
+ * :return: 0 if every record was decrypted successfully, non-zero otherwise.
+ *
+ * :param prp/prpctx: describe the block cipher to use.
+ * :param recs: records to decrypt.  See :c:type:`cf_aead_record`.
+ * :param nrecs: number of records.
+ * :param L: length of the message length encoding.  See :c:func:`cf_ccm_encrypt`.
+ * :param ntag: authentication tag length for every record.
+ */
+int cf_ccm_decrypt_batch(const cf_prp *prp, void *prpctx,
+                         cf_aead_record *recs, size_t nrecs,
+                         size_t L, size_t ntag);
+
 /**
  * OCB
  * ---
@@ -557,4 +798,211 @@ int cf_ocb_decrypt(const cf_prp *prp, void *prpctx,
                    const uint8_t *nonce, size_t nnonce,
                    const uint8_t *tag, size_t ntag,
                    uint8_t *plain);
+
+/* .. c:function:: $DECL
+ * OCB authenticated encryption, with fragmented input and output.
+ *
+ * This gives the same results as :c:func:`cf_ocb_encrypt` on the
+ * concatenation of each list of fragments.
+ *
+ * This function does not fail.
+ *
+ * :param prp/prpctx: describe the block cipher to use.
+ * :param plain/nplainiov: message plaintext fragments.
+ * :param header/nheaderiov: AAD fragments.
+ * :param nonce/nnonce: nonce, as for :c:func:`cf_ocb_encrypt`.
+ * :param cipher/ncipheriov: ciphertext output fragments.  These must have the same total length as `plain`.
+ * :param tag/ntag: authentication tag output, as for :c:func:`cf_ocb_encrypt`.
+ */
+void cf_ocb_encrypt_iov(const cf_prp *prp, void *prpctx,
+                        const cf_iovec *plain, size_t nplainiov,
+                        const cf_iovec *header, size_t nheaderiov,
+                        const uint8_t *nonce, size_t nnonce,
+                        const cf_iovec *cipher, size_t ncipheriov,
+                        uint8_t *tag, size_t ntag);
+
+/* .. c:function:: $DECL
+ * OCB authenticated decryption, with fragmented input and output.
+ *
+ * This gives the same results as :c:func:`cf_ocb_decrypt` on the
+ * concatenation of each list of fragments.
+ *
+ * :return: 0 on success, non-zero on error.  As for :c:func:`cf_ocb_decrypt`.
+ *
+ * :param prp/prpctx: describe the block cipher to use.
+ * :param cipher/ncipheriov: message ciphertext fragments.
+ * :param header/nheaderiov: AAD fragments.
+ * :param nonce/nnonce: nonce.
+ * :param tag/ntag: authentication tag, as for :c:func:`cf_ocb_decrypt`.
+ * :param plain/nplainiov: plaintext output fragments.  These must have the same total length as `cipher`.
+ */
+int cf_ocb_decrypt_iov(const cf_prp *prp, void *prpctx,
+                       const cf_iovec *cipher, size_t ncipheriov,
+                       const cf_iovec *header, size_t nheaderiov,
+                       const uint8_t *nonce, size_t nnonce,
+                       const uint8_t *tag, size_t ntag,
+                       const cf_iovec *plain, size_t nplainiov);
+
+/* .. c:function:: $DECL
+ * OCB authenticated encryption of a batch of records under one key.
+ *
+ * This gives the same results as :c:func:`cf_ocb_encrypt` on each
+ * record, but finds the L values only once per batch, and
+ * finds the nonce-dependent offsets for several records in each
+ * block cipher call.
+ *
+ * This function does not fail.
+ *
+ * :param prp/prpctx: describe the block cipher to use.
+ * :param recs: records to encrypt.  See :c:type:`cf_aead_record`.
+ * :param nrecs: number of records.
+ * :param ntag: authentication tag length for every record.
+ */
+void cf_ocb_encrypt_batch(const cf_prp *prp, void *prpctx,
+                          cf_aead_record *recs, size_t nrecs,
+                          size_t ntag);
+
+/* .. c:function:: $DECL
+ * OCB authenticated decryption of a batch of records under one key.
+ *
+ * Each record's `err` member is set as for :c:func:`cf_ocb_decrypt`,
+ * and its output is cleared on error.
+ *
+ * :return: 0 if every record was decrypted successfully, non-zero otherwise.
+ *
+ * :param prp/prpctx: describe the block cipher to use.
+ * :param recs: records to decrypt.  See :c:type:`cf_aead_record`.
+ * :param nrecs: number of records.
+ * :param ntag: authentication tag length for every record.
+ */
+int cf_ocb_decrypt_batch(const cf_prp *prp, void *prpctx,
+                         cf_aead_record *recs, size_t nrecs,
+                         size_t ntag);
+
+/**
+ * Key wrap
+ * --------
+ *
+ * AES key wrap, as standardised in RFC3394 (KW) and RFC5649 (KWP,
+ * 'with padding').  These are defined only for block ciphers with
+ * a 128-bit block size.
+ *
+ * KW wraps keys which are a multiple of 8 bytes long, and at least
+ * 16 bytes.  KWP wraps keys of any non-zero length.  Wrapped keys
+ * are 8 bytes longer than their (padded) plaintext.
+ *
+ * Unwrapping is a chain of 6n dependent block decryptions for an
+ * n-block key.  :c:func:`cf_kw_unwrap_batch` unwraps many keys at
+ * once, doing one step of several keys' chains in each call to
+ * :c:member:`cf_prp.decrypt_blocks`.
+ */
+
+/* .. c:macro:: CF_KWP_WRAPPED_SIZE
+ * The wrapped length of a KWP key of the given length. */
+#define CF_KWP_WRAPPED_SIZE(nplain) ((((nplain) + 7) & ~(size_t) 7) + 8)
+
+/* .. c:function:: $DECL
+ * KW key wrapping.
+ *
+ * This function does not fail.
+ *
+ * :param prp/prpctx: describe the block cipher to use (the KEK).
+ * :param plain: key to wrap.
+ * :param nplain: length of key.  Must be a multiple of 8, and at least 16.
+ * :param wrapped: wrapped key output.  `nplain + 8` bytes are written here.
+ */
+void cf_kw_wrap(const cf_prp *prp, void *prpctx,
+                const uint8_t *plain, size_t nplain,
+                uint8_t *wrapped);
+
+/* .. c:function:: $DECL
+ * KW key unwrapping.
+ *
+ * :return: 0 on success, non-zero on error.  `plain` is cleared on error.
+ *
+ * :param prp/prpctx: describe the block cipher to use (the KEK).
+ * :param wrapped: wrapped key.
+ * :param nwrapped: length of wrapped key.
+ * :param plain: key output.  `nwrapped - 8` bytes are written here.
+ */
+int cf_kw_unwrap(const cf_prp *prp, void *prpctx,
+                 const uint8_t *wrapped, size_t nwrapped,
+                 uint8_t *plain);
+
+/* .. c:function:: $DECL
+ * KWP key wrapping.
+ *
+ * This function does not fail.
+ *
+ * :param prp/prpctx: describe the block cipher to use (the KEK).
+ * :param plain: key to wrap.
+ * :param nplain: length of key.  Must be non-zero, and fit in 32 bits.
+ * :param wrapped: wrapped key output.  `CF_KWP_WRAPPED_SIZE(nplain)` bytes are written here.
+ */
+void cf_kwp_wrap(const cf_prp *prp, void *prpctx,
+                 const uint8_t *plain, size_t nplain,
+                 uint8_t *wrapped);
+
+/* .. c:function:: $DECL
+ * KWP key unwrapping.
+ *
+ * :return: 0 on success, non-zero on error.  `plain` is cleared on error.
+ *
+ * :param prp/prpctx: describe the block cipher to use (the KEK).
+ * :param wrapped: wrapped key.
+ * :param nwrapped: length of wrapped key.
+ * :param plain: key output.  Up to `nwrapped - 8` bytes are written here.
+ * :param nplain: the length of the key is written here.
+ */
+int cf_kwp_unwrap(const cf_prp *prp, void *prpctx,
+                  const uint8_t *wrapped, size_t nwrapped,
+                  uint8_t *plain, size_t *nplain);
+
+/* .. c:type:: cf_kw_item
+ * One wrapped key for :c:func:`cf_kw_unwrap_batch`.
+ *
+ * .. c:member:: cf_kw_item.wrapped
+ * Wrapped key (read).
+ *
+ * .. c:member:: cf_kw_item.nwrapped
+ * Length of wrapped key.
+ *
+ * .. c:member:: cf_kw_item.plain
+ * Key output.  Up to `nwrapped - 8` bytes are written here.
+ *
+ * .. c:member:: cf_kw_item.nplain
+ * Length of unwrapped key (written).
+ *
+ * .. c:member:: cf_kw_item.padded
+ * Non-zero if this is a KWP wrapped key, zero for KW.
+ *
+ * .. c:member:: cf_kw_item.err
+ * 0 if this key was unwrapped successfully, non-zero otherwise
+ * (written).  `plain` is cleared on error.
+ */
+typedef struct
+{
+  const uint8_t *wrapped;
+  size_t nwrapped;
+  uint8_t *plain;
+  size_t nplain;
+  int padded;
+  int err;
+} cf_kw_item;
+
+/* .. c:function:: $DECL
+ * Unwraps `nitems` independent keys, all wrapped with the same KEK.
+ *
+ * Keys may be a mixture of KW and KWP, and of different lengths.
+ * Each item's result is the same as from :c:func:`cf_kw_unwrap` or
+ * :c:func:`cf_kwp_unwrap`.
+ *
+ * :return: 0 if every key was unwrapped successfully, non-zero otherwise.
+ *
+ * :param prp/prpctx: describe the block cipher to use (the KEK).
+ * :param items: keys to unwrap.
+ * :param nitems: number of keys.
+ */
+int cf_kw_unwrap_batch(const cf_prp *prp, void *prpctx,
+                       cf_kw_item *items, size_t nitems);
 #endif
@@ -18,29 +18,31 @@
 #include "handy.h"
 #include "blockwise.h"
 #include "tassert.h"
+#include "simd.h"
 
 #include <string.h>
 
+/* This is also the state of cf_norx32_ctx. */
+typedef struct cf_norx32_state norx32_ctx;
+
 typedef struct
 {
-  uint32_t s[16];
-} norx32_ctx;
+  uint64_t s[16];
+} norx64_ctx;
 
 /* Domain separation constants */
 #define DOMAIN_HEADER   0x01
 #define DOMAIN_PAYLOAD  0x02
 #define DOMAIN_TRAILER  0x04
 #define DOMAIN_TAG      0x08
+#define DOMAIN_BRANCH   0x10
+#define DOMAIN_MERGE    0x20
 
-#define WORD_BYTES 4
-#define WORD_BITS 32
 #define ROUNDS 4
 #define DEGREE 1
-#define TAG_BITS 128
-#define RATE_BYTES 48
 #define RATE_WORDS 12
 
-static void permute(norx32_ctx *restrict ctx)
+static void norx32_permute(norx32_ctx *restrict ctx)
 {
 #ifdef CORTEX_M0
   /* Register usage: A-D r2, r3, r4, r5.
@@ -127,274 +129,508 @@ static void permute(norx32_ctx *restrict ctx)
 #undef P
 }
 
-static void init(norx32_ctx *ctx,
-                 const uint8_t key[static 16],
-                 const uint8_t nonce[static 8])
-{
-  /* 1. Basic setup */
-  ctx->s[0] = read32_le(nonce + 0);
-  ctx->s[1] = read32_le(nonce + 4);
-  ctx->s[2] = 0xb707322f;
-  ctx->s[3] = 0xa0c7c90d;
-
-  ctx->s[4] = read32_le(key + 0);
-  ctx->s[5] = read32_le(key + 4);
-  ctx->s[6] = read32_le(key + 8);
-  ctx->s[7] = read32_le(key + 12);
-
-  ctx->s[8] = 0xa3d8d930;
-  ctx->s[9] = 0x3fa8b72c;
-  ctx->s[10] = 0xed84eb49;
-  ctx->s[11] = 0xedca4787;
-
-  ctx->s[12] = 0x335463eb;
-  ctx->s[13] = 0xf994220b;
-  ctx->s[14] = 0xbe0bf5c9;
-  ctx->s[15] = 0xd7c49104;
-
-  /* 2. Parameter integration
-   * w = 32
-   * l = 4
-   * p = 1
-   * t = 128
-   */
-  ctx->s[12] ^= WORD_BITS;
-  ctx->s[13] ^= ROUNDS;
-  ctx->s[14] ^= DEGREE;
-  ctx->s[15] ^= TAG_BITS;
-
-  permute(ctx);
-}
-
-/* Input domain separation constant for next step, and final permutation of
- * preceeding step. */
-static void switch_domain(norx32_ctx *ctx, uint32_t constant)
-{
-  ctx->s[15] ^= constant;
-  permute(ctx);
-}
-
-typedef struct
+static void norx64_permute(norx64_ctx *restrict ctx)
 {
-  norx32_ctx *ctx;
-  uint32_t type;
-} blockctx;
+#define P(u, v, w, rr) \
+  (u) = ((u) ^ (v)) ^ (((u) & (v)) << 1); \
+  (w) = rotr64((u) ^ (w), rr);
 
-static void input_block_final(void *vctx, const uint8_t *data)
-{
-  blockctx *bctx = vctx;
-  norx32_ctx *ctx = bctx->ctx;
+#define G(s, a, b, c, d) \
+  P(s[a], s[b], s[d], 8) \
+  P(s[c], s[d], s[b], 19) \
+  P(s[a], s[b], s[d], 40) \
+  P(s[c], s[d], s[b], 63)
 
-  /* just xor-in data. */
-  for (int i = 0; i < RATE_WORDS; i++)
+  for (int i = 0; i < ROUNDS; i++)
   {
-    ctx->s[i] ^= read32_le(data);
-    data += WORD_BYTES;
+    /* columns */
+    G(ctx->s, 0, 4, 8, 12);
+    G(ctx->s, 1, 5, 9, 13);
+    G(ctx->s, 2, 6, 10, 14);
+    G(ctx->s, 3, 7, 11, 15);
+
+    /* diagonals */
+    G(ctx->s, 0, 5, 10, 15);
+    G(ctx->s, 1, 6, 11, 12);
+    G(ctx->s, 2, 7, 8, 13);
+    G(ctx->s, 3, 4, 9, 14);
   }
+
+#undef G
+#undef P
 }
 
-static void input_block(void *vctx, const uint8_t *data)
+/* Initialisation constants u2, u3, u8..u15.  These are F^2(0, 1, .., 15)
+ * for each word size, where F is one round of the permutation. */
+static const uint32_t norx32_u[10] = {
+  0xb707322f, 0xa0c7c90d,
+  0xa3d8d930, 0x3fa8b72c, 0xed84eb49, 0xedca4787,
+  0x335463eb, 0xf994220b, 0xbe0bf5c9, 0xd7c49104
+};
+
+static const uint64_t norx64_u[10] = {
+  0x9dfba13db4289311, 0xef9eb4bf5a97f2c8,
+  0xb15e641748de5e6b, 0xaa95e955e10f8410,
+  0x28d1034441a9dd40, 0x7f31bbf964e93bf5,
+  0xb5e9e22493dffb96, 0xb980c852479fafbd,
+  0xda24516bf55eafd4, 0x86026ae8536f1501
+};
+
+#define NORX_FN(name) norx32_ ## name
+#define NORX_ENCRYPT cf_norx32_encrypt
+#define NORX_DECRYPT cf_norx32_decrypt
+#define WORD uint32_t
+#define WORD_BYTES 4
+#define WORD_BITS 32
+#define READ_WORD read32_le
+#define WRITE_WORD write32_le
+#include "norx.core.c"
+#undef NORX_FN
+#undef NORX_ENCRYPT
+#undef NORX_DECRYPT
+#undef WORD
+#undef WORD_BYTES
+#undef WORD_BITS
+#undef READ_WORD
+#undef WRITE_WORD
+
+/* Incremental NORX32.  Header and trailer are buffered a block at a
+ * time, as input() does.  Payload bytes are processed as they come,
+ * but the domain switch which starts a block is only done once the
+ * first byte of that block is seen: until then, the current block
+ * might be the last. */
+enum
+{
+  PHASE_HEADER,
+  PHASE_PAYLOAD,
+  PHASE_TRAILER
+};
+
+void cf_norx32_init(cf_norx32_ctx *ctx,
+                    const uint8_t key[static 16],
+                    const uint8_t nonce[static 8])
 {
-  /* Process block, then prepare for the next one. */
-  blockctx *bctx = vctx;
-  input_block_final(vctx, data);
-  switch_domain(bctx->ctx, bctx->type);
+  memset(ctx, 0, sizeof *ctx);
+  norx32_init(&ctx->state, key, nonce, DEGREE);
+  ctx->phase = PHASE_HEADER;
 }
 
-static void input(norx32_ctx *ctx, uint32_t type,
-                  const uint8_t *buf, size_t nbuf)
+static void norx32_absorb(cf_norx32_ctx *ctx, uint32_t type,
+                          const uint8_t *buf, size_t nbuf)
 {
-  uint8_t partial[RATE_BYTES];
-  size_t npartial = 0;
-  blockctx bctx = { ctx, type };
+  norx32_blockctx bctx = { &ctx->state, type };
+
+  if (nbuf && !ctx->started)
+  {
+    norx32_switch_domain(&ctx->state, type);
+    ctx->started = 1;
+  }
 
-  /* Process input. */
-  cf_blockwise_accumulate(partial, &npartial, sizeof partial,
+  cf_blockwise_accumulate(ctx->partial, &ctx->npartial, sizeof ctx->partial,
                           buf, nbuf,
-                          input_block,
+                          norx32_input_block,
                           &bctx);
-
-  /* Now pad partial. This contains the trailing portion of buf. */
-  memset(partial + npartial, 0, sizeof(partial) - npartial);
-  partial[npartial] = 0x01;
-  partial[sizeof(partial) - 1] ^= 0x80;
-
-  input_block_final(&bctx, partial);
 }
 
-static void do_header(norx32_ctx *ctx, const uint8_t *buf, size_t nbuf)
+/* Pads and absorbs the last block of header or trailer. */
+static void norx32_absorb_final(cf_norx32_ctx *ctx)
 {
-  if (nbuf)
+  norx32_blockctx bctx = { &ctx->state, 0 };
+
+  if (ctx->started)
   {
-    switch_domain(ctx, DOMAIN_HEADER);
-    input(ctx, DOMAIN_HEADER, buf, nbuf);
+    memset(ctx->partial + ctx->npartial, 0, sizeof(ctx->partial) - ctx->npartial);
+    ctx->partial[ctx->npartial] = 0x01;
+    ctx->partial[sizeof(ctx->partial) - 1] ^= 0x80;
+    norx32_input_block_final(&bctx, ctx->partial);
   }
+
+  mem_clean(ctx->partial, sizeof ctx->partial);
+  ctx->npartial = 0;
+  ctx->started = 0;
 }
 
-static void do_trailer(norx32_ctx *ctx, const uint8_t *buf, size_t nbuf)
+/* Pads the last block of payload. */
+static void norx32_payload_final(cf_norx32_ctx *ctx)
 {
-  if (nbuf)
+  const size_t rate = sizeof ctx->partial;
+
+  if (ctx->started)
   {
-    switch_domain(ctx, DOMAIN_TRAILER);
-    input(ctx, DOMAIN_TRAILER, buf, nbuf);
+    if (ctx->npartial == rate)
+    {
+      norx32_switch_domain(&ctx->state, DOMAIN_PAYLOAD);
+      ctx->npartial = 0;
+    }
+
+    ctx->state.s[ctx->npartial / 4] ^= 0x01 << ((ctx->npartial % 4) * 8);
+    ctx->state.s[RATE_WORDS - 1] ^= 0x80000000;
   }
+
+  ctx->npartial = 0;
+  ctx->started = 0;
 }
 
-static void body_block_encrypt(norx32_ctx *ctx,
-                               const uint8_t plain[static RATE_BYTES],
-                               uint8_t cipher[static RATE_BYTES])
+/* Moves on to phase, finishing the ones before it. */
+static void norx32_enter(cf_norx32_ctx *ctx, int phase)
 {
-  for (int i = 0; i < RATE_WORDS; i++)
+  assert(ctx->phase <= phase);
+
+  if (ctx->phase == PHASE_HEADER && phase > PHASE_HEADER)
+  {
+    norx32_absorb_final(ctx);
+    ctx->phase = PHASE_PAYLOAD;
+  }
+
+  if (ctx->phase == PHASE_PAYLOAD && phase > PHASE_PAYLOAD)
   {
-    ctx->s[i] ^= read32_le(plain);
-    write32_le(ctx->s[i], cipher);
-    plain += WORD_BYTES;
-    cipher += WORD_BYTES;
+    norx32_payload_final(ctx);
+    ctx->phase = PHASE_TRAILER;
   }
 }
 
-static void encrypt_body(norx32_ctx *ctx,
-                         const uint8_t *plain, uint8_t *cipher, size_t nbytes)
+static void norx32_payload(cf_norx32_ctx *ctx,
+                           const uint8_t *in, uint8_t *out, size_t nbytes,
+                           int decrypt)
 {
-  if (nbytes == 0)
-    return;
+  const size_t rate = sizeof ctx->partial;
+  norx32_ctx *state = &ctx->state;
 
-  /* Process full blocks: easy */
-  while (nbytes >= RATE_BYTES)
+  norx32_enter(ctx, PHASE_PAYLOAD);
+
+  if (nbytes && !ctx->started)
   {
-    switch_domain(ctx, DOMAIN_PAYLOAD);
-    body_block_encrypt(ctx, plain, cipher);
-    plain += RATE_BYTES;
-    cipher += RATE_BYTES;
-    nbytes -= RATE_BYTES;
+    ctx->npartial = rate;
+    ctx->started = 1;
   }
 
-  /* Final padded block. */
-  uint8_t partial[RATE_BYTES];
-  memset(partial, 0, sizeof partial);
-  memcpy(partial, plain, nbytes);
-  partial[nbytes] ^= 0x01;
-  partial[sizeof(partial) - 1] ^= 0x80;
+  while (nbytes)
+  {
+    if (ctx->npartial == rate)
+    {
+      norx32_switch_domain(state, DOMAIN_PAYLOAD);
+      ctx->npartial = 0;
+    }
+
+    /* Whole blocks. */
+    if (ctx->npartial == 0 && nbytes >= rate)
+    {
+      if (decrypt)
+        norx32_body_block_decrypt(state, in, out, 0, RATE_WORDS);
+      else
+        norx32_body_block_encrypt(state, in, out);
+      in += rate;
+      out += rate;
+      nbytes -= rate;
+      ctx->npartial = rate;
+      continue;
+    }
+
+    /* Otherwise, bytewise up to the end of the block. */
+    while (nbytes && ctx->npartial < rate)
+    {
+      uint32_t *word = &state->s[ctx->npartial / 4];
+      unsigned shift = (ctx->npartial % 4) * 8;
+      uint8_t x = *in++;
+      uint8_t y = x ^ (uint8_t) (*word >> shift);
+
+      *out++ = y;
+      *word ^= (uint32_t) (decrypt ? y : x) << shift;
+      ctx->npartial++;
+      nbytes--;
+    }
+  }
+}
 
-  switch_domain(ctx, DOMAIN_PAYLOAD);
-  body_block_encrypt(ctx, partial, partial);
+void cf_norx32_header(cf_norx32_ctx *ctx,
+                      const uint8_t *header, size_t nheader)
+{
+  assert(ctx->phase == PHASE_HEADER);
+  norx32_absorb(ctx, DOMAIN_HEADER, header, nheader);
+}
 
-  memcpy(cipher, partial, nbytes);
+void cf_norx32_encrypt_update(cf_norx32_ctx *ctx,
+                              const uint8_t *plaintext,
+                              uint8_t *ciphertext,
+                              size_t nbytes)
+{
+  norx32_payload(ctx, plaintext, ciphertext, nbytes, 0);
 }
 
-static void body_block_decrypt(norx32_ctx *ctx,
-                               const uint8_t cipher[static RATE_BYTES],
-                               uint8_t plain[static RATE_BYTES],
-                               size_t start, size_t end)
+void cf_norx32_decrypt_update(cf_norx32_ctx *ctx,
+                              const uint8_t *ciphertext,
+                              uint8_t *plaintext,
+                              size_t nbytes)
 {
-  for (size_t i = start; i < end; i++)
-  {
-    uint32_t ct = read32_le(cipher);
-    write32_le(ctx->s[i] ^ ct, plain);
-    ctx->s[i] = ct;
-    plain += WORD_BYTES;
-    cipher += WORD_BYTES;
-  }
+  norx32_payload(ctx, ciphertext, plaintext, nbytes, 1);
 }
 
-static void undo_padding(norx32_ctx *ctx, size_t bytes)
+void cf_norx32_trailer(cf_norx32_ctx *ctx,
+                       const uint8_t *trailer, size_t ntrailer)
 {
-  assert(bytes < RATE_BYTES);
-  ctx->s[bytes / WORD_BYTES] ^= 0x01 << ((bytes % WORD_BYTES) * 8);
-  ctx->s[RATE_WORDS - 1] ^= 0x80000000;
+  norx32_enter(ctx, PHASE_TRAILER);
+  norx32_absorb(ctx, DOMAIN_TRAILER, trailer, ntrailer);
 }
 
-static void decrypt_body(norx32_ctx *ctx,
-                         const uint8_t *cipher, uint8_t *plain, size_t nbytes)
+void cf_norx32_finish(cf_norx32_ctx *ctx, uint8_t tag[static 16])
 {
-  if (nbytes == 0)
-    return;
+  norx32_enter(ctx, PHASE_TRAILER);
+  norx32_absorb_final(ctx);
+  norx32_get_tag(&ctx->state, tag);
+  mem_clean(ctx, sizeof *ctx);
+}
+
+int cf_norx32_verify(cf_norx32_ctx *ctx, const uint8_t tag[static 16])
+{
+  uint8_t ourtag[16];
+
+  cf_norx32_finish(ctx, ourtag);
+
+  int err = !mem_eq(ourtag, tag, sizeof ourtag);
+  mem_clean(ourtag, sizeof ourtag);
+  return err;
+}
+
+#define NORX_FN(name) norx64_ ## name
+#define NORX_ENCRYPT cf_norx64_encrypt
+#define NORX_DECRYPT cf_norx64_decrypt
+#define WORD uint64_t
+#define WORD_BYTES 8
+#define WORD_BITS 64
+#define READ_WORD read64_le
+#define WRITE_WORD write64_le
+#include "norx.core.c"
+#undef NORX_FN
+#undef NORX_ENCRYPT
+#undef NORX_DECRYPT
+#undef WORD
+#undef WORD_BYTES
+#undef WORD_BITS
+#undef READ_WORD
+#undef WRITE_WORD
+
+/* Parallel NORX32 (p > 1).  The payload is spread over p lanes, block
+ * i going to lane i % p.  Each lane is a full NORX32 state, branched
+ * from the state after the header and merged back before the trailer. */
+#define NORX32_LANES 4
+
+typedef struct
+{
+  norx32_ctx lane[NORX32_LANES];
+  unsigned p;
+} norx32_lanes;
+
+#if CF_SIMD
+/* Swaps rows and columns of the 4x4 matrix of words in a, b, c, d. */
+#define TRANSPOSE(a, b, c, d) do {                                  \
+    cf_u32x4 t0_ = CF_SIMD_SHUFFLE(a, b, 0, 4, 1, 5),               \
+             t1_ = CF_SIMD_SHUFFLE(a, b, 2, 6, 3, 7),               \
+             t2_ = CF_SIMD_SHUFFLE(c, d, 0, 4, 1, 5),               \
+             t3_ = CF_SIMD_SHUFFLE(c, d, 2, 6, 3, 7);               \
+    a = CF_SIMD_SHUFFLE(t0_, t2_, 0, 1, 4, 5);                      \
+    b = CF_SIMD_SHUFFLE(t0_, t2_, 2, 3, 6, 7);                      \
+    c = CF_SIMD_SHUFFLE(t1_, t3_, 0, 1, 4, 5);                      \
+    d = CF_SIMD_SHUFFLE(t1_, t3_, 2, 3, 6, 7);                      \
+  } while (0)
+
+/* Permutes all four lanes at once.  Word w of every lane is
+ * held in one vector, lane l in element l. */
+static void norx32_permute_x4(norx32_ctx lane[NORX32_LANES])
+{
+  cf_u32x4 s[16];
 
-  /* Process full blocks. */
-  while (nbytes >= RATE_BYTES)
+  for (int w = 0; w < 16; w += 4)
   {
-    switch_domain(ctx, DOMAIN_PAYLOAD);
-    body_block_decrypt(ctx, cipher, plain, 0, RATE_WORDS);
-    plain += RATE_BYTES;
-    cipher += RATE_BYTES;
-    nbytes -= RATE_BYTES;
+    for (int l = 0; l < 4; l++)
+      memcpy(&s[w + l], &lane[l].s[w], sizeof s[w]);
+    TRANSPOSE(s[w], s[w + 1], s[w + 2], s[w + 3]);
   }
 
-  /* Then partial blocks. */
-  size_t offset = 0;
-  switch_domain(ctx, DOMAIN_PAYLOAD);
+#define P(u, v, w, rr) \
+  (u) = ((u) ^ (v)) ^ (((u) & (v)) << 1); \
+  (w) = CF_SIMD_ROTL32((u) ^ (w), 32 - (rr));
 
-  undo_padding(ctx, nbytes);
+#define G(s, a, b, c, d) \
+  P(s[a], s[b], s[d], 8) \
+  P(s[c], s[d], s[b], 11) \
+  P(s[a], s[b], s[d], 16) \
+  P(s[c], s[d], s[b], 31)
 
-  /* In units of whole words. */
-  while (nbytes >= WORD_BYTES)
+  for (int i = 0; i < ROUNDS; i++)
   {
-    body_block_decrypt(ctx, cipher, plain, offset, offset + 1);
-    plain += WORD_BYTES;
-    cipher += WORD_BYTES;
-    nbytes -= WORD_BYTES;
-    offset += 1;
+    /* columns */
+    G(s, 0, 4, 8, 12);
+    G(s, 1, 5, 9, 13);
+    G(s, 2, 6, 10, 14);
+    G(s, 3, 7, 11, 15);
+
+    /* diagonals */
+    G(s, 0, 5, 10, 15);
+    G(s, 1, 6, 11, 12);
+    G(s, 2, 7, 8, 13);
+    G(s, 3, 4, 9, 14);
   }
 
-  /* And then, finally, bytewise. */
-  uint8_t tmp[WORD_BYTES];
-  write32_le(ctx->s[offset], tmp);
+#undef G
+#undef P
 
-  for (size_t i = 0; i < nbytes; i++)
+  for (int w = 0; w < 16; w += 4)
   {
-    uint8_t c = cipher[i];
-    plain[i] = tmp[i] ^ c;
-    tmp[i] = c;
+    TRANSPOSE(s[w], s[w + 1], s[w + 2], s[w + 3]);
+    for (int l = 0; l < 4; l++)
+      memcpy(&lane[l].s[w], &s[w + l], sizeof s[w]);
   }
+}
+
+#undef TRANSPOSE
+#endif
+
+/* Applies domain constant and the permutation to lanes 0 to n - 1.
+ * Other lanes in use are left as they were. */
+static void norx32_lanes_step(norx32_lanes *lanes, unsigned n, uint32_t constant)
+{
+  for (unsigned l = 0; l < n; l++)
+    lanes->lane[l].s[15] ^= constant;
+
+#if CF_SIMD
+  if (n > 1)
+  {
+    norx32_ctx keep[NORX32_LANES];
 
-  ctx->s[offset] = read32_le(tmp);
+    memcpy(keep + n, lanes->lane + n, (lanes->p - n) * sizeof keep[0]);
+    norx32_permute_x4(lanes->lane);
+    memcpy(lanes->lane + n, keep + n, (lanes->p - n) * sizeof keep[0]);
+
+    if (n < lanes->p)
+      mem_clean(keep, sizeof keep);
+    return;
+  }
+#endif
+
+  for (unsigned l = 0; l < n; l++)
+    norx32_permute(&lanes->lane[l]);
+}
+
+static void norx32_branch(norx32_ctx *ctx, norx32_lanes *lanes, unsigned p)
+{
+  memset(lanes, 0, sizeof *lanes);
+  lanes->p = p;
+
+  for (unsigned l = 0; l < p; l++)
+    lanes->lane[l] = *ctx;
+
+  norx32_lanes_step(lanes, p, DOMAIN_BRANCH);
+
+  /* Inject lane number. */
+  for (unsigned l = 0; l < p; l++)
+    for (int w = 0; w < RATE_WORDS; w++)
+      lanes->lane[l].s[w] ^= l;
+}
+
+static void norx32_merge(norx32_ctx *ctx, norx32_lanes *lanes)
+{
+  norx32_lanes_step(lanes, lanes->p, DOMAIN_MERGE);
+
+  memset(ctx, 0, sizeof *ctx);
+
+  for (unsigned l = 0; l < lanes->p; l++)
+    for (int w = 0; w < 16; w++)
+      ctx->s[w] ^= lanes->lane[l].s[w];
 }
 
-static void get_tag(norx32_ctx *ctx, uint8_t tag[static 16])
+static void norx32_lanes_body(norx32_ctx *ctx, unsigned p,
+                              const uint8_t *in, uint8_t *out, size_t nbytes,
+                              int decrypt)
 {
-  switch_domain(ctx, DOMAIN_TAG);
-  permute(ctx);
-  write32_le(ctx->s[0], tag + 0);
-  write32_le(ctx->s[1], tag + 4);
-  write32_le(ctx->s[2], tag + 8);
-  write32_le(ctx->s[3], tag + 12);
+  const size_t rate = RATE_WORDS * 4;
+
+  if (nbytes == 0)
+    return;
+
+  norx32_lanes lanes;
+  norx32_branch(ctx, &lanes, p);
+
+  /* Full blocks, in groups of one per lane.  The last group may be
+   * short. */
+  size_t nfull = nbytes / rate;
+
+  for (size_t i = 0; i < nfull; i += p)
+  {
+    unsigned n = (unsigned) MIN(nfull - i, (size_t) p);
+
+    norx32_lanes_step(&lanes, n, DOMAIN_PAYLOAD);
+
+    for (unsigned l = 0; l < n; l++)
+    {
+      if (decrypt)
+        norx32_body_block_decrypt(&lanes.lane[l], in, out, 0, RATE_WORDS);
+      else
+        norx32_body_block_encrypt(&lanes.lane[l], in, out);
+      in += rate;
+      out += rate;
+    }
+  }
+
+  /* The final padded block goes to the next lane in turn. */
+  norx32_ctx *last = &lanes.lane[nfull % p];
+
+  if (decrypt)
+    norx32_decrypt_final(last, in, out, nbytes % rate);
+  else
+    norx32_encrypt_final(last, in, out, nbytes % rate);
+
+  norx32_merge(ctx, &lanes);
+
+  mem_clean(&lanes, sizeof lanes);
 }
 
-void cf_norx32_encrypt(const uint8_t key[static 16],
-                       const uint8_t nonce[static 8],
-                       const uint8_t *header, size_t nheader,
-                       const uint8_t *plaintext, size_t nbytes,
-                       const uint8_t *trailer, size_t ntrailer,
-                       uint8_t *ciphertext,
-                       uint8_t tag[static 16])
+void cf_norx32_encrypt_parallel(unsigned p,
+                                const uint8_t key[static 16],
+                                const uint8_t nonce[static 8],
+                                const uint8_t *header, size_t nheader,
+                                const uint8_t *plaintext, size_t nbytes,
+                                const uint8_t *trailer, size_t ntrailer,
+                                uint8_t *ciphertext,
+                                uint8_t tag[static 16])
 {
+  assert(p >= 1 && p <= NORX32_LANES);
+
   norx32_ctx ctx;
 
-  init(&ctx, key, nonce);
-  do_header(&ctx, header, nheader);
-  encrypt_body(&ctx, plaintext, ciphertext, nbytes);
-  do_trailer(&ctx, trailer, ntrailer);
-  get_tag(&ctx, tag);
+  norx32_init(&ctx, key, nonce, p);
+  norx32_do_header(&ctx, header, nheader);
+  if (p == 1)
+    norx32_encrypt_body(&ctx, plaintext, ciphertext, nbytes);
+  else
+    norx32_lanes_body(&ctx, p, plaintext, ciphertext, nbytes, 0);
+  norx32_do_trailer(&ctx, trailer, ntrailer);
+  norx32_get_tag(&ctx, tag);
 
   mem_clean(&ctx, sizeof ctx);
 }
 
-int cf_norx32_decrypt(const uint8_t key[static 16],
-                      const uint8_t nonce[static 8],
-                      const uint8_t *header, size_t nheader,
-                      const uint8_t *ciphertext, size_t nbytes,
-                      const uint8_t *trailer, size_t ntrailer,
-                      const uint8_t tag[static 16],
-                      uint8_t *plaintext)
+int cf_norx32_decrypt_parallel(unsigned p,
+                               const uint8_t key[static 16],
+                               const uint8_t nonce[static 8],
+                               const uint8_t *header, size_t nheader,
+                               const uint8_t *ciphertext, size_t nbytes,
+                               const uint8_t *trailer, size_t ntrailer,
+                               const uint8_t tag[static 16],
+                               uint8_t *plaintext)
 {
+  assert(p >= 1 && p <= NORX32_LANES);
+
   norx32_ctx ctx;
   uint8_t ourtag[16];
 
-  init(&ctx, key, nonce);
-  do_header(&ctx, header, nheader);
-  decrypt_body(&ctx, ciphertext, plaintext, nbytes);
-  do_trailer(&ctx, trailer, ntrailer);
-  get_tag(&ctx, ourtag);
+  norx32_init(&ctx, key, nonce, p);
+  norx32_do_header(&ctx, header, nheader);
+  if (p == 1)
+    norx32_decrypt_body(&ctx, ciphertext, plaintext, nbytes);
+  else
+    norx32_lanes_body(&ctx, p, ciphertext, plaintext, nbytes, 1);
+  norx32_do_trailer(&ctx, trailer, ntrailer);
+  norx32_get_tag(&ctx, ourtag);
 
   int err = 0;
 
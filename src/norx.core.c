@@ -0,0 +1,330 @@
+/*
+ * cifra - embedded cryptography library
+ * Written in 2014 by Joseph Birr-Pixton <jpixton@gmail.com>
+ *
+ * To the extent possible under law, the author(s) have dedicated all
+ * copyright and related and neighboring rights to this software to the
+ * public domain worldwide. This software is distributed without any
+ * warranty.
+ *
+ * You should have received a copy of the CC0 Public Domain Dedication
+ * along with this software. If not, see
+ * <http://creativecommons.org/publicdomain/zero/1.0/>.
+ */
+
+/* NORX mode of operation.  This is included by norx.c once for each
+ * word size, with these defined:
+ *
+ * NORX_FN(name): prefixes name with the variant, eg. norx32_name.
+ * NORX_ENCRYPT, NORX_DECRYPT: public function names.
+ * WORD: word type.
+ * WORD_BYTES, WORD_BITS: word size.
+ * READ_WORD, WRITE_WORD: little-endian load and store of a WORD.
+ *
+ * and NORX_FN(permute) and NORX_FN(u), the permutation and the ten
+ * initialisation constants u2, u3, u8..u15, already defined.
+ *
+ * Keys are four words, nonces two words and tags four words.  The
+ * rate is 12 words.
+ */
+
+#define KEY_BYTES (4 * WORD_BYTES)
+#define NONCE_BYTES (2 * WORD_BYTES)
+#define TAG_BYTES (4 * WORD_BYTES)
+#define TAG_BITS (4 * WORD_BITS)
+#define RATE_BYTES (RATE_WORDS * WORD_BYTES)
+
+static void NORX_FN(init)(NORX_FN(ctx) *ctx,
+                          const uint8_t key[static KEY_BYTES],
+                          const uint8_t nonce[static NONCE_BYTES],
+                          WORD degree)
+{
+  const WORD *u = NORX_FN(u);
+
+  /* 1. Basic setup */
+  ctx->s[0] = READ_WORD(nonce + 0 * WORD_BYTES);
+  ctx->s[1] = READ_WORD(nonce + 1 * WORD_BYTES);
+  ctx->s[2] = u[0];
+  ctx->s[3] = u[1];
+
+  for (int i = 0; i < 4; i++)
+    ctx->s[4 + i] = READ_WORD(key + i * WORD_BYTES);
+
+  for (int i = 0; i < 8; i++)
+    ctx->s[8 + i] = u[2 + i];
+
+  /* 2. Parameter integration
+   * w = WORD_BITS
+   * l = 4
+   * p = degree
+   * t = 4w
+   */
+  ctx->s[12] ^= WORD_BITS;
+  ctx->s[13] ^= ROUNDS;
+  ctx->s[14] ^= degree;
+  ctx->s[15] ^= TAG_BITS;
+
+  NORX_FN(permute)(ctx);
+}
+
+/* Input domain separation constant for next step, and final permutation of
+ * preceeding step. */
+static void NORX_FN(switch_domain)(NORX_FN(ctx) *ctx, WORD constant)
+{
+  ctx->s[15] ^= constant;
+  NORX_FN(permute)(ctx);
+}
+
+typedef struct
+{
+  NORX_FN(ctx) *ctx;
+  WORD type;
+} NORX_FN(blockctx);
+
+static void NORX_FN(input_block_final)(void *vctx, const uint8_t *data)
+{
+  NORX_FN(blockctx) *bctx = vctx;
+  NORX_FN(ctx) *ctx = bctx->ctx;
+
+  /* just xor-in data. */
+  for (int i = 0; i < RATE_WORDS; i++)
+  {
+    ctx->s[i] ^= READ_WORD(data);
+    data += WORD_BYTES;
+  }
+}
+
+static void NORX_FN(input_block)(void *vctx, const uint8_t *data)
+{
+  /* Process block, then prepare for the next one. */
+  NORX_FN(blockctx) *bctx = vctx;
+  NORX_FN(input_block_final)(vctx, data);
+  NORX_FN(switch_domain)(bctx->ctx, bctx->type);
+}
+
+static void NORX_FN(input)(NORX_FN(ctx) *ctx, WORD type,
+                           const uint8_t *buf, size_t nbuf)
+{
+  uint8_t partial[RATE_BYTES];
+  size_t npartial = 0;
+  NORX_FN(blockctx) bctx = { ctx, type };
+
+  /* Process input. */
+  cf_blockwise_accumulate(partial, &npartial, sizeof partial,
+                          buf, nbuf,
+                          NORX_FN(input_block),
+                          &bctx);
+
+  /* Now pad partial. This contains the trailing portion of buf. */
+  memset(partial + npartial, 0, sizeof(partial) - npartial);
+  partial[npartial] = 0x01;
+  partial[sizeof(partial) - 1] ^= 0x80;
+
+  NORX_FN(input_block_final)(&bctx, partial);
+}
+
+static void NORX_FN(do_header)(NORX_FN(ctx) *ctx, const uint8_t *buf, size_t nbuf)
+{
+  if (nbuf)
+  {
+    NORX_FN(switch_domain)(ctx, DOMAIN_HEADER);
+    NORX_FN(input)(ctx, DOMAIN_HEADER, buf, nbuf);
+  }
+}
+
+static void NORX_FN(do_trailer)(NORX_FN(ctx) *ctx, const uint8_t *buf, size_t nbuf)
+{
+  if (nbuf)
+  {
+    NORX_FN(switch_domain)(ctx, DOMAIN_TRAILER);
+    NORX_FN(input)(ctx, DOMAIN_TRAILER, buf, nbuf);
+  }
+}
+
+static void NORX_FN(body_block_encrypt)(NORX_FN(ctx) *ctx,
+                                        const uint8_t plain[static RATE_BYTES],
+                                        uint8_t cipher[static RATE_BYTES])
+{
+  for (int i = 0; i < RATE_WORDS; i++)
+  {
+    ctx->s[i] ^= READ_WORD(plain);
+    WRITE_WORD(ctx->s[i], cipher);
+    plain += WORD_BYTES;
+    cipher += WORD_BYTES;
+  }
+}
+
+/* Final padded block of payload: nbytes is less than RATE_BYTES,
+ * and may be zero. */
+static void NORX_FN(encrypt_final)(NORX_FN(ctx) *ctx,
+                                   const uint8_t *plain, uint8_t *cipher, size_t nbytes)
+{
+  uint8_t partial[RATE_BYTES];
+  memset(partial, 0, sizeof partial);
+  memcpy(partial, plain, nbytes);
+  partial[nbytes] ^= 0x01;
+  partial[sizeof(partial) - 1] ^= 0x80;
+
+  NORX_FN(switch_domain)(ctx, DOMAIN_PAYLOAD);
+  NORX_FN(body_block_encrypt)(ctx, partial, partial);
+
+  memcpy(cipher, partial, nbytes);
+}
+
+static void NORX_FN(encrypt_body)(NORX_FN(ctx) *ctx,
+                                  const uint8_t *plain, uint8_t *cipher, size_t nbytes)
+{
+  if (nbytes == 0)
+    return;
+
+  /* Process full blocks: easy */
+  while (nbytes >= RATE_BYTES)
+  {
+    NORX_FN(switch_domain)(ctx, DOMAIN_PAYLOAD);
+    NORX_FN(body_block_encrypt)(ctx, plain, cipher);
+    plain += RATE_BYTES;
+    cipher += RATE_BYTES;
+    nbytes -= RATE_BYTES;
+  }
+
+  NORX_FN(encrypt_final)(ctx, plain, cipher, nbytes);
+}
+
+static void NORX_FN(body_block_decrypt)(NORX_FN(ctx) *ctx,
+                                        const uint8_t cipher[static RATE_BYTES],
+                                        uint8_t plain[static RATE_BYTES],
+                                        size_t start, size_t end)
+{
+  for (size_t i = start; i < end; i++)
+  {
+    WORD ct = READ_WORD(cipher);
+    WRITE_WORD(ctx->s[i] ^ ct, plain);
+    ctx->s[i] = ct;
+    plain += WORD_BYTES;
+    cipher += WORD_BYTES;
+  }
+}
+
+static void NORX_FN(undo_padding)(NORX_FN(ctx) *ctx, size_t bytes)
+{
+  assert(bytes < RATE_BYTES);
+  ctx->s[bytes / WORD_BYTES] ^= (WORD) 0x01 << ((bytes % WORD_BYTES) * 8);
+  ctx->s[RATE_WORDS - 1] ^= (WORD) 0x80 << (WORD_BITS - 8);
+}
+
+/* Final padded block of payload, as for encrypt_final. */
+static void NORX_FN(decrypt_final)(NORX_FN(ctx) *ctx,
+                                   const uint8_t *cipher, uint8_t *plain, size_t nbytes)
+{
+  size_t offset = 0;
+  NORX_FN(switch_domain)(ctx, DOMAIN_PAYLOAD);
+
+  NORX_FN(undo_padding)(ctx, nbytes);
+
+  /* In units of whole words. */
+  while (nbytes >= WORD_BYTES)
+  {
+    NORX_FN(body_block_decrypt)(ctx, cipher, plain, offset, offset + 1);
+    plain += WORD_BYTES;
+    cipher += WORD_BYTES;
+    nbytes -= WORD_BYTES;
+    offset += 1;
+  }
+
+  /* And then, finally, bytewise. */
+  uint8_t tmp[WORD_BYTES];
+  WRITE_WORD(ctx->s[offset], tmp);
+
+  for (size_t i = 0; i < nbytes; i++)
+  {
+    uint8_t c = cipher[i];
+    plain[i] = tmp[i] ^ c;
+    tmp[i] = c;
+  }
+
+  ctx->s[offset] = READ_WORD(tmp);
+}
+
+static void NORX_FN(decrypt_body)(NORX_FN(ctx) *ctx,
+                                  const uint8_t *cipher, uint8_t *plain, size_t nbytes)
+{
+  if (nbytes == 0)
+    return;
+
+  /* Process full blocks. */
+  while (nbytes >= RATE_BYTES)
+  {
+    NORX_FN(switch_domain)(ctx, DOMAIN_PAYLOAD);
+    NORX_FN(body_block_decrypt)(ctx, cipher, plain, 0, RATE_WORDS);
+    plain += RATE_BYTES;
+    cipher += RATE_BYTES;
+    nbytes -= RATE_BYTES;
+  }
+
+  /* Then partial blocks. */
+  NORX_FN(decrypt_final)(ctx, cipher, plain, nbytes);
+}
+
+static void NORX_FN(get_tag)(NORX_FN(ctx) *ctx, uint8_t tag[static TAG_BYTES])
+{
+  NORX_FN(switch_domain)(ctx, DOMAIN_TAG);
+  NORX_FN(permute)(ctx);
+
+  for (int i = 0; i < 4; i++)
+    WRITE_WORD(ctx->s[i], tag + i * WORD_BYTES);
+}
+
+void NORX_ENCRYPT(const uint8_t key[static KEY_BYTES],
+                  const uint8_t nonce[static NONCE_BYTES],
+                  const uint8_t *header, size_t nheader,
+                  const uint8_t *plaintext, size_t nbytes,
+                  const uint8_t *trailer, size_t ntrailer,
+                  uint8_t *ciphertext,
+                  uint8_t tag[static TAG_BYTES])
+{
+  NORX_FN(ctx) ctx;
+
+  NORX_FN(init)(&ctx, key, nonce, DEGREE);
+  NORX_FN(do_header)(&ctx, header, nheader);
+  NORX_FN(encrypt_body)(&ctx, plaintext, ciphertext, nbytes);
+  NORX_FN(do_trailer)(&ctx, trailer, ntrailer);
+  NORX_FN(get_tag)(&ctx, tag);
+
+  mem_clean(&ctx, sizeof ctx);
+}
+
+int NORX_DECRYPT(const uint8_t key[static KEY_BYTES],
+                 const uint8_t nonce[static NONCE_BYTES],
+                 const uint8_t *header, size_t nheader,
+                 const uint8_t *ciphertext, size_t nbytes,
+                 const uint8_t *trailer, size_t ntrailer,
+                 const uint8_t tag[static TAG_BYTES],
+                 uint8_t *plaintext)
+{
+  NORX_FN(ctx) ctx;
+  uint8_t ourtag[TAG_BYTES];
+
+  NORX_FN(init)(&ctx, key, nonce, DEGREE);
+  NORX_FN(do_header)(&ctx, header, nheader);
+  NORX_FN(decrypt_body)(&ctx, ciphertext, plaintext, nbytes);
+  NORX_FN(do_trailer)(&ctx, trailer, ntrailer);
+  NORX_FN(get_tag)(&ctx, ourtag);
+
+  int err = 0;
+
+  if (!mem_eq(ourtag, tag, sizeof ourtag))
+  {
+    err = 1;
+    mem_clean(plaintext, nbytes);
+    mem_clean(ourtag, sizeof ourtag);
+  }
+
+  mem_clean(&ctx, sizeof ctx);
+  return err;
+}
+
+#undef KEY_BYTES
+#undef NONCE_BYTES
+#undef TAG_BYTES
+#undef TAG_BITS
+#undef RATE_BYTES
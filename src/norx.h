@@ -21,8 +21,8 @@
 /**
  * The NORX AEAD cipher
  * ====================
- * This is an implementation of NORX32-4-1 with a one-shot
- * interface.  NORX is a CAESAR candidate with a core similar
+ * This is an implementation of NORX32-4-1 and NORX64-4-1
+ * with a one-shot interface.  NORX is a CAESAR candidate with a core similar
  * to ChaCha20 and a sponge structure like Keccak.
  *
  * This is NORX v2.0.  It is not compatible with earlier
@@ -34,6 +34,12 @@
  * the plaintext, followed by processing a second sequence
  * of additional data ('trailer').  It outputs a 128-bit
  * tag.
+ *
+ * NORX64 uses 64-bit words throughout: a 256-bit key, a
+ * 128-bit nonce and a 256-bit tag.  It absorbs 96 bytes per
+ * permutation rather than 48, so is roughly twice as fast
+ * as NORX32 on 64-bit machines.  NORX32 is the better choice
+ * on 32-bit machines.
  */
 
 /* .. c:function:: $DECL
@@ -82,4 +88,206 @@ int cf_norx32_decrypt(const uint8_t key[static 16],
                       const uint8_t tag[static 16],
                       uint8_t *plaintext);
 
+/* .. c:function:: $DECL
+ * NORX64-4-1 one-shot encryption interface.
+ *
+ * :param key: key material.
+ * :param nonce: per-message nonce.
+ * :param header: header buffer.
+ * :param nheader: number of header bytes.
+ * :param plaintext: plaintext bytes to be encrypted.
+ * :param nbytes: number of plaintext/ciphertext bytes.
+ * :param trailer: trailer buffer.
+ * :param ntrailer: number of trailer bytes.
+ * :param ciphertext: ciphertext output buffer, nbytes in length.
+ * :param tag: authentication tag output buffer.
+ */
+void cf_norx64_encrypt(const uint8_t key[static 32],
+                       const uint8_t nonce[static 16],
+                       const uint8_t *header, size_t nheader,
+                       const uint8_t *plaintext, size_t nbytes,
+                       const uint8_t *trailer, size_t ntrailer,
+                       uint8_t *ciphertext,
+                       uint8_t tag[static 32]);
+
+/* .. c:function:: $DECL
+ * NORX64-4-1 one-shot decryption interface.
+ *
+ * :return: 0 on success, non-zero on error.  Plaintext is zeroed on error.
+ *
+ * :param key: key material.
+ * :param nonce: per-message nonce.
+ * :param header: header buffer.
+ * :param nheader: number of header bytes.
+ * :param ciphertext: ciphertext bytes to be decrypted.
+ * :param nbytes: number of plaintext/ciphertext bytes.
+ * :param trailer: trailer buffer.
+ * :param ntrailer: number of trailer bytes.
+ * :param plaintext: plaintext output buffer, nbytes in length.
+ * :param tag: authentication tag output buffer.
+ */
+int cf_norx64_decrypt(const uint8_t key[static 32],
+                      const uint8_t nonce[static 16],
+                      const uint8_t *header, size_t nheader,
+                      const uint8_t *ciphertext, size_t nbytes,
+                      const uint8_t *trailer, size_t ntrailer,
+                      const uint8_t tag[static 32],
+                      uint8_t *plaintext);
+
+/**
+ * Parallel NORX32
+ * ---------------
+ * NORX also defines parallel instances, NORX32-4-p, where the
+ * payload is shared out over p independent lanes.  Each lane
+ * runs its own permutation.  Where SIMD instructions are
+ * available, up to four lanes are permuted together, so long
+ * payloads are fastest with p = 4.  Headers and trailers are
+ * processed as for NORX32-4-1.
+ *
+ * Each value of p is a different instance: the ciphertext and
+ * tag depend on it.  p = 1 gives the same results as
+ * :c:func:`cf_norx32_encrypt`.
+ */
+
+/* .. c:function:: $DECL
+ * NORX32-4-p one-shot encryption interface.
+ *
+ * :param p: degree of parallelism: 1 to 4.
+ *
+ * Other parameters are as for :c:func:`cf_norx32_encrypt`.
+ */
+void cf_norx32_encrypt_parallel(unsigned p,
+                                const uint8_t key[static 16],
+                                const uint8_t nonce[static 8],
+                                const uint8_t *header, size_t nheader,
+                                const uint8_t *plaintext, size_t nbytes,
+                                const uint8_t *trailer, size_t ntrailer,
+                                uint8_t *ciphertext,
+                                uint8_t tag[static 16]);
+
+/* .. c:function:: $DECL
+ * NORX32-4-p one-shot decryption interface.
+ *
+ * :return: 0 on success, non-zero on error.  Plaintext is zeroed on error.
+ *
+ * :param p: degree of parallelism: 1 to 4.
+ *
+ * Other parameters are as for :c:func:`cf_norx32_decrypt`.
+ */
+int cf_norx32_decrypt_parallel(unsigned p,
+                               const uint8_t key[static 16],
+                               const uint8_t nonce[static 8],
+                               const uint8_t *header, size_t nheader,
+                               const uint8_t *ciphertext, size_t nbytes,
+                               const uint8_t *trailer, size_t ntrailer,
+                               const uint8_t tag[static 16],
+                               uint8_t *plaintext);
+
+/**
+ * Incremental interface
+ * ---------------------
+ * This processes a NORX32-4-1 message in pieces of any length, in
+ * constant memory, so that no part of it needs to be buffered in
+ * full.  Call :c:func:`cf_norx32_init`, then :c:func:`cf_norx32_header`
+ * any number of times, then the update function for the direction
+ * any number of times, then :c:func:`cf_norx32_trailer` any number
+ * of times, then :c:func:`cf_norx32_finish` or
+ * :c:func:`cf_norx32_verify`.  Each step may be skipped, but they
+ * must come in this order.  The results are the same as for
+ * :c:func:`cf_norx32_encrypt` and :c:func:`cf_norx32_decrypt`.
+ *
+ * .. warning::
+ *
+ *    When decrypting, plaintext is output before the tag is checked.
+ *    Don't act on any of it until :c:func:`cf_norx32_verify`
+ *    succeeds, and throw it all away if it does not.
+ */
+
+/* .. c:type:: cf_norx32_ctx
+ * Incremental NORX32 context.
+ *
+ * .. c:member:: cf_norx32_ctx.state
+ * Permutation state.
+ *
+ * .. c:member:: cf_norx32_ctx.partial
+ * Unprocessed header or trailer bytes.
+ *
+ * .. c:member:: cf_norx32_ctx.npartial
+ * Number of bytes in `partial`.  During the payload, this is
+ * instead the number of bytes used of the current block.
+ *
+ * .. c:member:: cf_norx32_ctx.phase
+ * Header, payload or trailer: which part of the message is being
+ * processed.
+ *
+ * .. c:member:: cf_norx32_ctx.started
+ * Non-zero once any bytes of the current part have been
+ * processed.
+ */
+typedef struct
+{
+  struct cf_norx32_state
+  {
+    uint32_t s[16];
+  } state;
+  uint8_t partial[48];
+  size_t npartial;
+  int phase;
+  int started;
+} cf_norx32_ctx;
+
+/* .. c:function:: $DECL
+ * Starts encrypting or decrypting a message.
+ *
+ * :param ctx: context (written).
+ * :param key: key material.
+ * :param nonce: per-message nonce.
+ */
+void cf_norx32_init(cf_norx32_ctx *ctx,
+                    const uint8_t key[static 16],
+                    const uint8_t nonce[static 8]);
+
+/* .. c:function:: $DECL
+ * Adds `nheader` bytes of header.  This must not be called after
+ * the payload has started.
+ */
+void cf_norx32_header(cf_norx32_ctx *ctx,
+                      const uint8_t *header, size_t nheader);
+
+/* .. c:function:: $DECL
+ * Encrypts the next `nbytes` bytes of the payload.
+ * `plaintext` and `ciphertext` may be the same.
+ */
+void cf_norx32_encrypt_update(cf_norx32_ctx *ctx,
+                              const uint8_t *plaintext,
+                              uint8_t *ciphertext,
+                              size_t nbytes);
+
+/* .. c:function:: $DECL
+ * Decrypts the next `nbytes` bytes of the payload.
+ * `ciphertext` and `plaintext` may be the same.
+ */
+void cf_norx32_decrypt_update(cf_norx32_ctx *ctx,
+                              const uint8_t *ciphertext,
+                              uint8_t *plaintext,
+                              size_t nbytes);
+
+/* .. c:function:: $DECL
+ * Adds `ntrailer` bytes of trailer.  This ends the payload.
+ */
+void cf_norx32_trailer(cf_norx32_ctx *ctx,
+                       const uint8_t *trailer, size_t ntrailer);
+
+/* .. c:function:: $DECL
+ * Finishes encrypting, and writes the tag.  `ctx` is wiped.
+ */
+void cf_norx32_finish(cf_norx32_ctx *ctx, uint8_t tag[static 16]);
+
+/* .. c:function:: $DECL
+ * Finishes decrypting, and checks the tag.  `ctx` is wiped.
+ *
+ * :return: 0 if the tag is correct, non-zero otherwise.
+ */
+int cf_norx32_verify(cf_norx32_ctx *ctx, const uint8_t tag[static 16]);
+
 #endif
@@ -15,9 +15,9 @@
 #include "handy.h"
 #include "prp.h"
 #include "modes.h"
-#include "blockwise.h"
 #include "bitops.h"
 #include "gf128.h"
+#include "iov.h"
 #include "tassert.h"
 
 #include <string.h>
@@ -28,11 +28,13 @@
 /* We and RFC7253 assume 128-bit blocks. */
 #define BLOCK 16
 
+/* How many blocks to give the PRP at once. */
+#define OCB_LANES 4
+
 typedef struct
 {
   const cf_prp *prp;
   void *prpctx;                 /* Our PRP */
-  uint8_t *out;                 /* Output pointer for block processing */
   cf_gf128 L_star;              /* Zero block ciphertext */
   cf_gf128 L_dollar;            /* L_$ is double of L_* */
   cf_gf128 L[MAX_L];            /* L[0] is double of L_$, L[1] is double of L[0], etc. */
@@ -49,9 +51,8 @@ typedef struct
   uint32_t i;                   /* Block index, 1-based */
 } ocb_hash;
 
-static void ocb_init(ocb *o, const cf_prp *prp, void *prpctx,
-                     const uint8_t *nonce, size_t nnonce,
-                     size_t ntag)
+/* Key-dependent setup. */
+static void ocb_init_key(ocb *o, const cf_prp *prp, void *prpctx)
 {
   o->prp = prp;
   o->prpctx = prpctx;
@@ -71,19 +72,31 @@ static void ocb_init(ocb *o, const cf_prp *prp, void *prpctx,
 
   for (int i = 1; i < MAX_L; i++)
     cf_gf128_double(o->L[i - 1], o->L[i]);
+}
 
-  /* Compute nonce-dependent and per-encryption vars */
+/* Nonce-dependent setup, first half: produces the block
+ * to encipher to get Ktop, and returns bottom. */
+static uint8_t ocb_nonce_block(const uint8_t *nonce, size_t nnonce,
+                               size_t ntag,
+                               uint8_t full_nonce[BLOCK])
+{
   assert(nnonce > 0 && nnonce < BLOCK);
-  uint8_t full_nonce[BLOCK] = { 0 };
+  memset(full_nonce, 0, BLOCK);
   full_nonce[0] = ((ntag * 8) & 0x7f) << 1;
   full_nonce[BLOCK - 1 - nnonce] |= 0x01;
   memcpy(full_nonce + BLOCK - nnonce, nonce, nnonce);
   uint8_t bottom = full_nonce[BLOCK - 1] & 0x3f;
 
-  /* Make Ktop */
   full_nonce[BLOCK - 1] &= 0xc0;
+  return bottom;
+}
+
+/* Nonce-dependent setup, second half: from Ktop to Offset_0. */
+static void ocb_init_nonce(ocb *o, const uint8_t Ktop_block[BLOCK],
+                           uint8_t bottom)
+{
   uint8_t Ktop[BLOCK + 8];
-  prp->encrypt(prpctx, full_nonce, Ktop);
+  memcpy(Ktop, Ktop_block, BLOCK);
 
   /* Stretch Ktop */
   for (int i = 0; i < 8; i++)
@@ -96,10 +109,24 @@ static void ocb_init(ocb *o, const cf_prp *prp, void *prpctx,
   memset(o->checksum, 0, sizeof o->checksum);
 }
 
-static void ocb_start_cipher(ocb *o, uint8_t *output)
+static void ocb_init(ocb *o, const cf_prp *prp, void *prpctx,
+                     const uint8_t *nonce, size_t nnonce,
+                     size_t ntag)
+{
+  ocb_init_key(o, prp, prpctx);
+
+  /* Compute nonce-dependent and per-encryption vars */
+  uint8_t full_nonce[BLOCK];
+  uint8_t bottom = ocb_nonce_block(nonce, nnonce, ntag, full_nonce);
+
+  /* Make Ktop */
+  prp->encrypt(prpctx, full_nonce, full_nonce);
+  ocb_init_nonce(o, full_nonce, bottom);
+}
+
+static void ocb_start_cipher(ocb *o)
 {
   o->i = 1;
-  o->out = output;
 }
 
 static void ocb_add_Ln(ocb *o, uint32_t n, cf_gf128 out)
@@ -147,33 +174,59 @@ static void ocb_hash_sum(ocb *o, const uint8_t *block,
   cf_gf128_add(sum, tmp, sum);
 }
 
-static void ocb_hash_block(void *vctx, const uint8_t *block)
+/* Hashes whole blocks.  The blocks are independent given their
+ * offsets, so several go to the PRP at once. */
+static void ocb_hash_blocks(void *vctx, const uint8_t *block, size_t nblocks)
 {
   ocb_hash *h = vctx;
+  uint8_t tmp[OCB_LANES * BLOCK];
 
-  /* Offset_i = Offset_{i - 1} xor L{ntz(i)} */
-  ocb_add_Ln(h->o, count_trailing_zeroes(h->i), h->offset);
-
-  /* Sum_i = Sum_{i - 1} xor ENCIPHER(K, A_i xor Offset_i) */
-  ocb_hash_sum(h->o, block, h->sum, h->offset);
+  while (nblocks)
+  {
+    size_t n = MIN(nblocks, (size_t) OCB_LANES);
+
+    for (size_t j = 0; j < n; j++)
+    {
+      /* Offset_i = Offset_{i - 1} xor L{ntz(i)} */
+      ocb_add_Ln(h->o, count_trailing_zeroes(h->i), h->offset);
+      h->i++;
+
+      uint8_t offset_bytes[BLOCK];
+      cf_gf128_tobytes_be(h->offset, offset_bytes);
+      xor_bb(tmp + j * BLOCK, block + j * BLOCK, offset_bytes, BLOCK);
+    }
+
+    /* Sum_i = Sum_{i - 1} xor ENCIPHER(K, A_i xor Offset_i) */
+    cf_prp_encrypt_blocks(h->o->prp, h->o->prpctx, tmp, tmp, n);
+
+    for (size_t j = 0; j < n; j++)
+    {
+      cf_gf128 enc;
+      cf_gf128_frombytes_be(tmp + j * BLOCK, enc);
+      cf_gf128_add(h->sum, enc, h->sum);
+    }
+
+    block += n * BLOCK;
+    nblocks -= n;
+  }
 
-  h->i++;
+  mem_clean(tmp, sizeof tmp);
 }
 
-static void ocb_process_header(ocb *o, const uint8_t *header, size_t nheader,
+static void ocb_process_header(ocb *o,
+                               const cf_iovec *header, size_t nheaderiov,
                                uint8_t out[BLOCK])
 {
   ocb_hash ctx = { o };
   ocb_hash_init(&ctx);
 
-  uint8_t partial[BLOCK];
-  size_t npartial = 0;
+  size_t nheader = cf_iov_len(header, nheaderiov);
+  cf_iov_cursor c;
+  cf_iov_init(&c, header, nheaderiov);
+  cf_iov_read_blocks(&c, nheader / BLOCK, BLOCK, ocb_hash_blocks, &ctx);
 
-  cf_blockwise_accumulate(partial, &npartial,
-                          o->prp->blocksz,
-                          header, nheader,
-                          ocb_hash_block,
-                          &ctx);
+  uint8_t partial[BLOCK];
+  size_t npartial = nheader % BLOCK;
 
   if (npartial)
   {
@@ -181,6 +234,7 @@ static void ocb_process_header(ocb *o, const uint8_t *header, size_t nheader,
     cf_gf128_add(ctx.offset, o->L_star, ctx.offset);
 
     /* CipherInput = (A_* || 1 || zeros(127 - bitlen(A_*))) xor Offset_* */
+    cf_iov_gather(&c, partial, npartial);
     memset(partial + npartial, 0, sizeof(partial) - npartial);
     partial[npartial] = 0x80;
 
@@ -192,72 +246,140 @@ static void ocb_process_header(ocb *o, const uint8_t *header, size_t nheader,
   mem_clean(&ctx, sizeof ctx);
 }
 
-static void ocb_encrypt_block(void *vctx, const uint8_t *block)
+/* Encrypts or decrypts whole blocks.  As for the hash,
+ * several blocks go to the PRP at once.
+ *
+ * C_i = Offset_i xor ENCIPHER(K, P_i xor Offset_i)
+ * P_i = Offset_i xor DECIPHER(K, C_i xor Offset_i) */
+static void ocb_cipher_blocks(ocb *o, const uint8_t *in, uint8_t *out,
+                              size_t nblocks, int decrypt)
 {
-  ocb *o = vctx;
+  uint8_t offsets[OCB_LANES * BLOCK];
+  uint8_t tmp[OCB_LANES * BLOCK];
 
-  /* Offset_i = Offset_{i - 1} xor L{ntz(i)} */
-  ocb_add_Ln(o, count_trailing_zeroes(o->i), o->offset);
-
-  /* C_i = Offset_i xor ENCIPHER(K, P_i xor Offset_i) */
-  uint8_t offset_bytes[BLOCK];
-  cf_gf128_tobytes_be(o->offset, offset_bytes);
+  while (nblocks)
+  {
+    size_t n = MIN(nblocks, (size_t) OCB_LANES);
+
+    for (size_t j = 0; j < n; j++)
+    {
+      /* Offset_i = Offset_{i - 1} xor L{ntz(i)} */
+      ocb_add_Ln(o, count_trailing_zeroes(o->i), o->offset);
+      o->i++;
+
+      cf_gf128_tobytes_be(o->offset, offsets + j * BLOCK);
+      xor_bb(tmp + j * BLOCK, in + j * BLOCK, offsets + j * BLOCK, BLOCK);
+
+      /* Checksum_i = Checksum_{i - 1} xor P_i */
+      if (!decrypt)
+      {
+        cf_gf128 P;
+        cf_gf128_frombytes_be(in + j * BLOCK, P);
+        cf_gf128_add(o->checksum, P, o->checksum);
+      }
+    }
+
+    if (decrypt)
+      cf_prp_decrypt_blocks(o->prp, o->prpctx, tmp, tmp, n);
+    else
+      cf_prp_encrypt_blocks(o->prp, o->prpctx, tmp, tmp, n);
+
+    xor_bb(out, tmp, offsets, n * BLOCK);
+
+    if (decrypt)
+    {
+      for (size_t j = 0; j < n; j++)
+      {
+        cf_gf128 P;
+        cf_gf128_frombytes_be(out + j * BLOCK, P);
+        cf_gf128_add(o->checksum, P, o->checksum);
+      }
+    }
+
+    in += n * BLOCK;
+    out += n * BLOCK;
+    nblocks -= n;
+  }
 
-  uint8_t block_tmp[BLOCK];
-  xor_bb(block_tmp, block, offset_bytes, sizeof block_tmp);
-  o->prp->encrypt(o->prpctx, block_tmp, block_tmp);
-  xor_bb(o->out, block_tmp, offset_bytes, sizeof block_tmp);
-  o->out += sizeof block_tmp;
+  mem_clean(offsets, sizeof offsets);
+  mem_clean(tmp, sizeof tmp);
+}
 
-  /* Checksum_i = Checksum_{i - 1} xor P_i */
-  cf_gf128 P;
-  cf_gf128_frombytes_be(block, P);
-  cf_gf128_add(o->checksum, P, o->checksum);
+static void ocb_encrypt_blocks(void *vctx, const uint8_t *in, uint8_t *out, size_t nblocks)
+{
+  ocb_cipher_blocks(vctx, in, out, nblocks, 0);
+}
 
-  o->i++;
+static void ocb_decrypt_blocks(void *vctx, const uint8_t *in, uint8_t *out, size_t nblocks)
+{
+  ocb_cipher_blocks(vctx, in, out, nblocks, 1);
 }
 
-void cf_ocb_encrypt(const cf_prp *prp, void *prpctx,
-                    const uint8_t *plain, size_t nplain,
-                    const uint8_t *header, size_t nheader,
-                    const uint8_t *nonce, size_t nnonce,
-                    uint8_t *cipher, /* the same size as nplain */
-                    uint8_t *tag, size_t ntag)
+/* Computes the full tag, after the message is processed. */
+static void ocb_tag(ocb *o,
+                    const cf_iovec *header, size_t nheaderiov,
+                    uint8_t tag_bytes[BLOCK])
 {
-  ocb o;
-  ocb_init(&o, prp, prpctx, nonce, nnonce, ntag);
+  /* Compute: Tag = ENCIPHER(K, Checksum_m xor Offset_m xor L_$) xor HASH(K, A) */
+  cf_gf128 full_tag;
+  for (size_t i = 0; i < 4; i++)
+    full_tag[i] = o->checksum[i] ^ o->offset[i] ^ o->L_dollar[i];
 
-  /* Process blocks.  The blockwise machinery takes care of
-   * splitting the input into 128-bit blocks, and calling
-   * a function on each one. */
-  uint8_t partial[BLOCK];
-  size_t npartial = 0;
+  /* Convert tag to bytes for encryption */
+  cf_gf128_tobytes_be(full_tag, tag_bytes);
 
-  ocb_start_cipher(&o, cipher);
-  cf_blockwise_accumulate(partial, &npartial,
-                          prp->blocksz,
-                          plain, nplain,
-                          ocb_encrypt_block,
-                          &o);
+  /* ENCIPHER(...) */
+  o->prp->encrypt(o->prpctx, tag_bytes, tag_bytes);
+
+  /* Compute HASH(K, A). */
+  uint8_t hash_a[BLOCK];
+  ocb_process_header(o, header, nheaderiov, hash_a);
+
+  /* ... xor HASH(K, A) */
+  xor_bb(tag_bytes, tag_bytes, hash_a, BLOCK);
+
+  mem_clean(full_tag, sizeof full_tag);
+}
+
+/* Encryption, once o is initialised for key and nonce. */
+static void ocb_encrypt_core(ocb *o,
+                             const cf_iovec *plain, size_t nplainiov,
+                             const cf_iovec *header, size_t nheaderiov,
+                             const cf_iovec *cipher, size_t ncipheriov,
+                             uint8_t *tag, size_t ntag)
+{
+  size_t nplain = cf_iov_len(plain, nplainiov);
+  assert(cf_iov_len(cipher, ncipheriov) == nplain);
 
-  /* Move along plain and cipher. */
-  plain += (o.out - cipher);
-  cipher = o.out;
+  /* Process whole blocks. */
+  cf_iov_cursor in, out;
+  cf_iov_init(&in, plain, nplainiov);
+  cf_iov_init(&out, cipher, ncipheriov);
+
+  ocb_start_cipher(o);
+  cf_iov_transform_blocks(&in, &out, nplain / BLOCK, BLOCK,
+                          ocb_encrypt_blocks, o);
 
   /* If we have remaining data to pad and process,
    * it's in partial. */
+  size_t npartial = nplain % BLOCK;
+
   if (npartial)
   {
+    uint8_t partial[BLOCK];
+    cf_iov_gather(&in, partial, npartial);
+
     /* Offset_* = Offset_m xor L_* */
-    cf_gf128_add(o.offset, o.L_star, o.offset);
+    cf_gf128_add(o->offset, o->L_star, o->offset);
 
     /* Pad = ENCIPHER(K, Offset_*) */
     uint8_t pad[BLOCK];
-    cf_gf128_tobytes_be(o.offset, pad);
-    o.prp->encrypt(o.prpctx, pad, pad);
+    cf_gf128_tobytes_be(o->offset, pad);
+    o->prp->encrypt(o->prpctx, pad, pad);
 
     /* C_* = P_* xor Pad[1..bitlen(P_*)] */
-    xor_bb(cipher, partial, pad, npartial);
+    xor_bb(pad, partial, pad, npartial);
+    cf_iov_scatter(&out, pad, npartial);
     mem_clean(pad, sizeof pad);
 
     /* Checksum_* = Checksum_m xor (P_* || 1 || zeros(127 - bitlen(P_*))) */
@@ -266,96 +388,58 @@ void cf_ocb_encrypt(const cf_prp *prp, void *prpctx,
 
     cf_gf128 last_block;
     cf_gf128_frombytes_be(partial, last_block);
-    cf_gf128_add(o.checksum, last_block, o.checksum);
+    cf_gf128_add(o->checksum, last_block, o->checksum);
     mem_clean(last_block, sizeof last_block);
+    mem_clean(partial, sizeof partial);
   }
 
-  /* Compute: Tag = ENCIPHER(K, Checksum_m xor Offset_m xor L_$) xor HASH(K, A) */
-  cf_gf128 full_tag;
-  for (size_t i = 0; i < 4; i++)
-    full_tag[i] = o.checksum[i] ^ o.offset[i] ^ o.L_dollar[i];
-
-  /* Convert tag to bytes for encryption */
   uint8_t tag_bytes[BLOCK];
-  cf_gf128_tobytes_be(full_tag, tag_bytes);
-
-  /* ENCIPHER(...) */
-  o.prp->encrypt(o.prpctx, tag_bytes, tag_bytes);
-
-  /* Compute HASH(K, A). */
-  uint8_t hash_a[BLOCK];
-  ocb_process_header(&o, header, nheader, hash_a);
-
-  /* ... xor HASH(K, A) */
-  xor_bb(tag_bytes, tag_bytes, hash_a, sizeof tag_bytes);
+  ocb_tag(o, header, nheaderiov, tag_bytes);
 
   /* Copy out tag to caller. */
   memcpy(tag, tag_bytes, ntag);
-
-  mem_clean(&o, sizeof o);
+  mem_clean(tag_bytes, sizeof tag_bytes);
 }
 
-static void ocb_decrypt_block(void *vctx, const uint8_t *block)
+/* Decryption, once o is initialised for key and nonce. */
+static int ocb_decrypt_core(ocb *o,
+                            const cf_iovec *cipher, size_t ncipheriov,
+                            const cf_iovec *header, size_t nheaderiov,
+                            const uint8_t *tag, size_t ntag,
+                            const cf_iovec *plain, size_t nplainiov)
 {
-  ocb *o = vctx;
+  size_t ncipher = cf_iov_len(cipher, ncipheriov);
+  assert(cf_iov_len(plain, nplainiov) == ncipher);
 
-  /* Offset_i = Offset_{i - 1} xor L{ntz(i)} */
-  ocb_add_Ln(o, count_trailing_zeroes(o->i), o->offset);
+  /* Process whole blocks. */
+  cf_iov_cursor in, out;
+  cf_iov_init(&in, cipher, ncipheriov);
+  cf_iov_init(&out, plain, nplainiov);
 
-  /* P_i = Offset_i xor DECIPHER(K, C_i xor Offset_i) */
-  uint8_t offset_bytes[BLOCK];
-  cf_gf128_tobytes_be(o->offset, offset_bytes);
+  ocb_start_cipher(o);
+  cf_iov_transform_blocks(&in, &out, ncipher / BLOCK, BLOCK,
+                          ocb_decrypt_blocks, o);
 
-  uint8_t block_tmp[BLOCK];
-  xor_bb(block_tmp, block, offset_bytes, sizeof block_tmp);
-  o->prp->decrypt(o->prpctx, block_tmp, block_tmp);
-  xor_bb(o->out, block_tmp, offset_bytes, sizeof block_tmp);
-
-  /* Checksum_i = Checksum_{i - 1} xor P_i */
-  cf_gf128 P;
-  cf_gf128_frombytes_be(o->out, P);
-  o->out += sizeof block_tmp;
-  cf_gf128_add(o->checksum, P, o->checksum);
-
-  o->i++;
-}
-
-int cf_ocb_decrypt(const cf_prp *prp, void *prpctx,
-                   const uint8_t *cipher, size_t ncipher,
-                   const uint8_t *header, size_t nheader,
-                   const uint8_t *nonce, size_t nnonce,
-                   const uint8_t *tag, size_t ntag,
-                   uint8_t *plain)
-{
-  ocb o;
-  ocb_init(&o, prp, prpctx, nonce, nnonce, ntag);
-
-  /* Do blockwise decryption */
-  uint8_t partial[BLOCK];
-  size_t npartial = 0;
-
-  ocb_start_cipher(&o, plain);
-  cf_blockwise_accumulate(partial, &npartial,
-                          prp->blocksz,
-                          cipher, ncipher,
-                          ocb_decrypt_block,
-                          &o);
+  size_t npartial = ncipher % BLOCK;
 
   if (npartial)
   {
+    uint8_t partial[BLOCK];
+    cf_iov_gather(&in, partial, npartial);
+
     /* Offset_* = Offset_m xor L_* */
-    cf_gf128_add(o.offset, o.L_star, o.offset);
+    cf_gf128_add(o->offset, o->L_star, o->offset);
 
     /* Pad = ENCIPHER(K, Offset_*) */
     uint8_t pad[BLOCK];
-    cf_gf128_tobytes_be(o.offset, pad);
-    o.prp->encrypt(o.prpctx, pad, pad);
+    cf_gf128_tobytes_be(o->offset, pad);
+    o->prp->encrypt(o->prpctx, pad, pad);
 
     /* P_* = C_* xor Pad[1..bitlen(C_*)] */
     xor_bb(partial, partial, pad, npartial);
     mem_clean(pad, sizeof pad);
 
-    memcpy(o.out, partial, npartial);
+    cf_iov_scatter(&out, partial, npartial);
 
     /* Checksum_* = Checksum_m xor (P_* || 1 || zeros(127 - bitlen(P_*))) */
     memset(partial + npartial, 0, sizeof(partial) - npartial);
@@ -363,28 +447,13 @@ int cf_ocb_decrypt(const cf_prp *prp, void *prpctx,
 
     cf_gf128 last_block;
     cf_gf128_frombytes_be(partial, last_block);
-    cf_gf128_add(o.checksum, last_block, o.checksum);
+    cf_gf128_add(o->checksum, last_block, o->checksum);
     mem_clean(last_block, sizeof last_block);
+    mem_clean(partial, sizeof partial);
   }
 
-  /* Compute: Tag = ENCIPHER(K, Checksum_m xor Offset_m xor L_$) xor HASH(K, A) */
-  cf_gf128 full_tag;
-  for (size_t i = 0; i < 4; i++)
-    full_tag[i] = o.checksum[i] ^ o.offset[i] ^ o.L_dollar[i];
-
-  /* Convert tag to bytes for encryption */
   uint8_t tag_bytes[BLOCK];
-  cf_gf128_tobytes_be(full_tag, tag_bytes);
-
-  /* ENCIPHER(...) */
-  o.prp->encrypt(o.prpctx, tag_bytes, tag_bytes);
-
-  /* Compute HASH(K, A). */
-  uint8_t hash_a[BLOCK];
-  ocb_process_header(&o, header, nheader, hash_a);
-
-  /* ... xor HASH(K, A) */
-  xor_bb(tag_bytes, tag_bytes, hash_a, sizeof tag_bytes);
+  ocb_tag(o, header, nheaderiov, tag_bytes);
 
   /* Check against caller's tag. */
   int err;
@@ -394,11 +463,158 @@ int cf_ocb_decrypt(const cf_prp *prp, void *prpctx,
     err = 0;
   } else {
     err = 1;
-    mem_clean(plain, ncipher);
+    cf_iov_clean(plain, nplainiov);
   }
 
-  mem_clean(&o, sizeof o);
   mem_clean(tag_bytes, sizeof tag_bytes);
-  mem_clean(full_tag, sizeof full_tag);
   return err;
 }
+
+void cf_ocb_encrypt_iov(const cf_prp *prp, void *prpctx,
+                        const cf_iovec *plain, size_t nplainiov,
+                        const cf_iovec *header, size_t nheaderiov,
+                        const uint8_t *nonce, size_t nnonce,
+                        const cf_iovec *cipher, size_t ncipheriov,
+                        uint8_t *tag, size_t ntag)
+{
+  ocb o;
+  ocb_init(&o, prp, prpctx, nonce, nnonce, ntag);
+  ocb_encrypt_core(&o,
+                   plain, nplainiov,
+                   header, nheaderiov,
+                   cipher, ncipheriov,
+                   tag, ntag);
+  mem_clean(&o, sizeof o);
+}
+
+int cf_ocb_decrypt_iov(const cf_prp *prp, void *prpctx,
+                       const cf_iovec *cipher, size_t ncipheriov,
+                       const cf_iovec *header, size_t nheaderiov,
+                       const uint8_t *nonce, size_t nnonce,
+                       const uint8_t *tag, size_t ntag,
+                       const cf_iovec *plain, size_t nplainiov)
+{
+  ocb o;
+  ocb_init(&o, prp, prpctx, nonce, nnonce, ntag);
+  int err = ocb_decrypt_core(&o,
+                             cipher, ncipheriov,
+                             header, nheaderiov,
+                             tag, ntag,
+                             plain, nplainiov);
+  mem_clean(&o, sizeof o);
+  return err;
+}
+
+void cf_ocb_encrypt(const cf_prp *prp, void *prpctx,
+                    const uint8_t *plain, size_t nplain,
+                    const uint8_t *header, size_t nheader,
+                    const uint8_t *nonce, size_t nnonce,
+                    uint8_t *cipher, /* the same size as nplain */
+                    uint8_t *tag, size_t ntag)
+{
+  cf_iovec plain_iov = { (void *) plain, nplain },
+           header_iov = { (void *) header, nheader },
+           cipher_iov = { cipher, nplain };
+
+  cf_ocb_encrypt_iov(prp, prpctx,
+                     &plain_iov, 1,
+                     &header_iov, 1,
+                     nonce, nnonce,
+                     &cipher_iov, 1,
+                     tag, ntag);
+}
+
+int cf_ocb_decrypt(const cf_prp *prp, void *prpctx,
+                   const uint8_t *cipher, size_t ncipher,
+                   const uint8_t *header, size_t nheader,
+                   const uint8_t *nonce, size_t nnonce,
+                   const uint8_t *tag, size_t ntag,
+                   uint8_t *plain)
+{
+  cf_iovec cipher_iov = { (void *) cipher, ncipher },
+           header_iov = { (void *) header, nheader },
+           plain_iov = { plain, ncipher };
+
+  return cf_ocb_decrypt_iov(prp, prpctx,
+                            &cipher_iov, 1,
+                            &header_iov, 1,
+                            nonce, nnonce,
+                            tag, ntag,
+                            &plain_iov, 1);
+}
+
+/* Batches are done in groups of this many records: the
+ * Ktop blocks for a group are found in one PRP call. */
+#define OCB_BATCH 8
+
+static int ocb_batch(const cf_prp *prp, void *prpctx,
+                     cf_aead_record *recs, size_t nrecs,
+                     size_t ntag, int encrypt)
+{
+  ocb key, o;
+  uint8_t Ktop[OCB_BATCH][BLOCK];
+  uint8_t bottom[OCB_BATCH];
+  int err = 0;
+
+  /* L_*, L_$ and L_i once for the whole batch. */
+  ocb_init_key(&key, prp, prpctx);
+
+  while (nrecs)
+  {
+    size_t n = MIN(nrecs, (size_t) OCB_BATCH);
+
+    for (size_t i = 0; i < n; i++)
+      bottom[i] = ocb_nonce_block(recs[i].nonce, recs[i].nnonce, ntag, Ktop[i]);
+
+    cf_prp_encrypt_blocks(prp, prpctx, Ktop[0], Ktop[0], n);
+
+    for (size_t i = 0; i < n; i++)
+    {
+      cf_aead_record *r = &recs[i];
+      cf_iovec in = { (void *) r->in, r->nbytes },
+               header = { (void *) r->header, r->nheader },
+               out = { r->out, r->nbytes };
+
+      o = key;
+      ocb_init_nonce(&o, Ktop[i], bottom[i]);
+
+      if (encrypt)
+      {
+        ocb_encrypt_core(&o,
+                         &in, 1,
+                         &header, 1,
+                         &out, 1,
+                         r->tag, ntag);
+      } else {
+        r->err = ocb_decrypt_core(&o,
+                                  &in, 1,
+                                  &header, 1,
+                                  r->tag, ntag,
+                                  &out, 1);
+        err |= r->err;
+      }
+    }
+
+    recs += n;
+    nrecs -= n;
+  }
+
+  mem_clean(&key, sizeof key);
+  mem_clean(&o, sizeof o);
+  mem_clean(Ktop, sizeof Ktop);
+  return err;
+}
+
+void cf_ocb_encrypt_batch(const cf_prp *prp, void *prpctx,
+                          cf_aead_record *recs, size_t nrecs,
+                          size_t ntag)
+{
+  ocb_batch(prp, prpctx, recs, nrecs, ntag, 1);
+}
+
+int cf_ocb_decrypt_batch(const cf_prp *prp, void *prpctx,
+                         cf_aead_record *recs, size_t nrecs,
+                         size_t ntag)
+{
+  return ocb_batch(prp, prpctx, recs, nrecs, ntag, 0);
+}
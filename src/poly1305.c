@@ -12,202 +12,844 @@
  * <http://creativecommons.org/publicdomain/zero/1.0/>.
  */
 
+
 #include "poly1305.h"
 #include "bitops.h"
 #include "handy.h"
-#include "blockwise.h"
+#include "simd.h"
+#include "iov.h"
 
 #include <string.h>
-#include <stdio.h>
 
-void cf_poly1305_init(cf_poly1305 *ctx,
-                      const uint8_t r[static 16],
-                      const uint8_t s[static 16])
-{
-  memset(ctx, 0, sizeof *ctx);
+/* Poly1305 works modulo p = 2 ** 130 - 5.  Limbs are reduced only
+ * partially between blocks: 2 ** 130 = 5 (mod p), so a carry out of
+ * the top limb is multiplied by 5 and added back into the bottom one.
+ * The result is fully reduced once, at the end.
+ *
+ * hibit is the bit set above each message block: 2 ** 128 for whole
+ * blocks, and zero for the final padded block, which carries its own
+ * 1 byte. */
 
-  ctx->r[0]  = r[0];
-  ctx->r[1]  = r[1];
-  ctx->r[2]  = r[2];
-  ctx->r[3]  = r[3] & 0x0f;
-  ctx->r[4]  = r[4] & 0xfc;
-  ctx->r[5]  = r[5];
-  ctx->r[6]  = r[6];
-  ctx->r[7]  = r[7] & 0x0f;
-  ctx->r[8]  = r[8] & 0xfc;
-  ctx->r[9]  = r[9];
-  ctx->r[10] = r[10];
-  ctx->r[11] = r[11] & 0x0f;
-  ctx->r[12] = r[12] & 0xfc;
-  ctx->r[13] = r[13];
-  ctx->r[14] = r[14];
-  ctx->r[15] = r[15] & 0x0f;
-  ctx->r[16] = 0;
+#if CF_POLY1305_64BIT
 
-  memcpy(ctx->s, s, 16);
-}
+typedef unsigned __int128 u128;
+
+#define MASK44 UINT64_C(0xfffffffffff)
+#define MASK42 UINT64_C(0x3ffffffffff)
+#define HIBIT_WHOLE (UINT64_C(1) << 40)
 
-static void poly1305_add(uint32_t h[static 17],
-                         const uint32_t x[static 17])
+static void poly1305_set_r(cf_poly1305 *ctx, const uint8_t r[static 16])
 {
-  uint32_t carry = 0;
+  uint64_t t0 = read64_le(r), t1 = read64_le(r + 8);
+
+  /* Load and clamp. */
+  ctx->r[0] = t0 & UINT64_C(0xffc0fffffff);
+  ctx->r[1] = ((t0 >> 44) | (t1 << 20)) & UINT64_C(0xfffffc0ffff);
+  ctx->r[2] = (t1 >> 24) & UINT64_C(0x00ffffffc0f);
+}
 
-  for (int i = 0; i < 17; i++)
+static void poly1305_blocks(cf_poly1305 *ctx, const uint8_t *m,
+                            size_t nblocks, uint64_t hibit)
+{
+  const uint64_t r0 = ctx->r[0], r1 = ctx->r[1], r2 = ctx->r[2];
+  /* Limb products which wrap past 2 ** 130 come back times 5;
+   * the extra 4 is from the limbs being 44 bits but 2 ** 130
+   * being at bit 132 of three of them. */
+  const uint64_t s1 = r1 * (5 << 2), s2 = r2 * (5 << 2);
+  uint64_t h0 = ctx->h[0], h1 = ctx->h[1], h2 = ctx->h[2];
+
+  while (nblocks--)
   {
-    carry += h[i] + x[i];
-    h[i] = carry & 0xff;
-    carry >>= 8;
+    uint64_t t0 = read64_le(m), t1 = read64_le(m + 8);
+
+    h0 += t0 & MASK44;
+    h1 += ((t0 >> 44) | (t1 << 20)) & MASK44;
+    h2 += ((t1 >> 24) & MASK42) | hibit;
+
+    u128 d0 = (u128) h0 * r0 + (u128) h1 * s2 + (u128) h2 * s1;
+    u128 d1 = (u128) h0 * r1 + (u128) h1 * r0 + (u128) h2 * s2;
+    u128 d2 = (u128) h0 * r2 + (u128) h1 * r1 + (u128) h2 * r0;
+
+    uint64_t c;
+    c = (uint64_t) (d0 >> 44); h0 = (uint64_t) d0 & MASK44;
+    d1 += c;
+    c = (uint64_t) (d1 >> 44); h1 = (uint64_t) d1 & MASK44;
+    d2 += c;
+    c = (uint64_t) (d2 >> 42); h2 = (uint64_t) d2 & MASK42;
+    h0 += c * 5;
+    c = h0 >> 44; h0 &= MASK44;
+    h1 += c;
+
+    m += 16;
   }
+
+  ctx->h[0] = h0;
+  ctx->h[1] = h1;
+  ctx->h[2] = h2;
 }
 
-/* Minimal reduction/carry chain. */
-static void poly1305_min_reduce(uint32_t x[static 17])
+static void poly1305_finish_h(cf_poly1305 *ctx, uint8_t out[static 16])
 {
-  uint32_t carry = 0;
-  for (int i = 0; i < 16; i++)
+  uint64_t h0 = ctx->h[0], h1 = ctx->h[1], h2 = ctx->h[2], c;
+
+  /* Fully carry h. */
+  c = h1 >> 44; h1 &= MASK44;
+  h2 += c; c = h2 >> 42; h2 &= MASK42;
+  h0 += c * 5; c = h0 >> 44; h0 &= MASK44;
+  h1 += c; c = h1 >> 44; h1 &= MASK44;
+  h2 += c; c = h2 >> 42; h2 &= MASK42;
+  h0 += c * 5; c = h0 >> 44; h0 &= MASK44;
+  h1 += c;
+
+  /* g = h + -p = h - (2 ** 130 - 5) */
+  uint64_t g0 = h0 + 5; c = g0 >> 44; g0 &= MASK44;
+  uint64_t g1 = h1 + c; c = g1 >> 44; g1 &= MASK44;
+  uint64_t g2 = h2 + c - (UINT64_C(1) << 42);
+
+  /* Select h if g is negative, else g.  Do this in a side-channel
+   * silent way. */
+  uint64_t mask = (g2 >> 63) - 1;
+  h0 = (h0 & ~mask) | (g0 & mask);
+  h1 = (h1 & ~mask) | (g1 & mask);
+  h2 = (h2 & ~mask) | (g2 & mask);
+
+  /* h = (h + s) mod 2 ** 128 */
+  uint64_t t0 = read64_le(ctx->s), t1 = read64_le(ctx->s + 8);
+  h0 += t0 & MASK44; c = h0 >> 44; h0 &= MASK44;
+  h1 += (((t0 >> 44) | (t1 << 20)) & MASK44) + c; c = h1 >> 44; h1 &= MASK44;
+  h2 += ((t1 >> 24) & MASK42) + c;
+
+  write64_le(h0 | (h1 << 44), out);
+  write64_le((h1 >> 20) | (h2 << 24), out + 8);
+}
+
+#else
+
+#define MASK26 0x3ffffff
+#define HIBIT_WHOLE (UINT32_C(1) << 24)
+
+static void poly1305_set_r(cf_poly1305 *ctx, const uint8_t r[static 16])
+{
+  /* Load and clamp. */
+  ctx->r[0] = read32_le(r) & 0x3ffffff;
+  ctx->r[1] = (read32_le(r + 3) >> 2) & 0x3ffff03;
+  ctx->r[2] = (read32_le(r + 6) >> 4) & 0x3ffc0ff;
+  ctx->r[3] = (read32_le(r + 9) >> 6) & 0x3f03fff;
+  ctx->r[4] = (read32_le(r + 12) >> 8) & 0x00fffff;
+}
+
+static void poly1305_blocks(cf_poly1305 *ctx, const uint8_t *m,
+                            size_t nblocks, uint32_t hibit)
+{
+  const uint32_t r0 = ctx->r[0], r1 = ctx->r[1], r2 = ctx->r[2],
+                 r3 = ctx->r[3], r4 = ctx->r[4];
+  /* Limb products which wrap past 2 ** 130 come back times 5. */
+  const uint32_t s1 = r1 * 5, s2 = r2 * 5, s3 = r3 * 5, s4 = r4 * 5;
+  uint32_t h0 = ctx->h[0], h1 = ctx->h[1], h2 = ctx->h[2],
+           h3 = ctx->h[3], h4 = ctx->h[4];
+
+  while (nblocks--)
   {
-    carry += x[i];
-    x[i] = carry & 0xff;
-    carry >>= 8;
+    h0 += read32_le(m) & MASK26;
+    h1 += (read32_le(m + 3) >> 2) & MASK26;
+    h2 += (read32_le(m + 6) >> 4) & MASK26;
+    h3 += (read32_le(m + 9) >> 6) & MASK26;
+    h4 += (read32_le(m + 12) >> 8) | hibit;
+
+    uint64_t d0 = (uint64_t) h0 * r0 + (uint64_t) h1 * s4 + (uint64_t) h2 * s3 +
+                  (uint64_t) h3 * s2 + (uint64_t) h4 * s1;
+    uint64_t d1 = (uint64_t) h0 * r1 + (uint64_t) h1 * r0 + (uint64_t) h2 * s4 +
+                  (uint64_t) h3 * s3 + (uint64_t) h4 * s2;
+    uint64_t d2 = (uint64_t) h0 * r2 + (uint64_t) h1 * r1 + (uint64_t) h2 * r0 +
+                  (uint64_t) h3 * s4 + (uint64_t) h4 * s3;
+    uint64_t d3 = (uint64_t) h0 * r3 + (uint64_t) h1 * r2 + (uint64_t) h2 * r1 +
+                  (uint64_t) h3 * r0 + (uint64_t) h4 * s4;
+    uint64_t d4 = (uint64_t) h0 * r4 + (uint64_t) h1 * r3 + (uint64_t) h2 * r2 +
+                  (uint64_t) h3 * r1 + (uint64_t) h4 * r0;
+
+    uint32_t c;
+    c = (uint32_t) (d0 >> 26); h0 = (uint32_t) d0 & MASK26;
+    d1 += c;
+    c = (uint32_t) (d1 >> 26); h1 = (uint32_t) d1 & MASK26;
+    d2 += c;
+    c = (uint32_t) (d2 >> 26); h2 = (uint32_t) d2 & MASK26;
+    d3 += c;
+    c = (uint32_t) (d3 >> 26); h3 = (uint32_t) d3 & MASK26;
+    d4 += c;
+    c = (uint32_t) (d4 >> 26); h4 = (uint32_t) d4 & MASK26;
+    h0 += c * 5;
+    c = h0 >> 26; h0 &= MASK26;
+    h1 += c;
+
+    m += 16;
   }
 
-  /* 2 ** 130 - 5 = 0x3fffffffffffffffffffffffffffffffb
-   *                  ^
-   * So 2 bits of carry are put into top word.
-   * Remaining bits get multiplied by 5 and carried back
-   * into bottom */
-  carry += x[16];
-  x[16] = carry & 0x03;
-  carry = 5 * (carry >> 2);
+  ctx->h[0] = h0;
+  ctx->h[1] = h1;
+  ctx->h[2] = h2;
+  ctx->h[3] = h3;
+  ctx->h[4] = h4;
+}
+
+static void poly1305_finish_h(cf_poly1305 *ctx, uint8_t out[static 16])
+{
+  uint32_t h0 = ctx->h[0], h1 = ctx->h[1], h2 = ctx->h[2],
+           h3 = ctx->h[3], h4 = ctx->h[4], c;
+
+  /* Fully carry h. */
+  c = h1 >> 26; h1 &= MASK26;
+  h2 += c; c = h2 >> 26; h2 &= MASK26;
+  h3 += c; c = h3 >> 26; h3 &= MASK26;
+  h4 += c; c = h4 >> 26; h4 &= MASK26;
+  h0 += c * 5; c = h0 >> 26; h0 &= MASK26;
+  h1 += c;
+
+  /* g = h + -p = h - (2 ** 130 - 5) */
+  uint32_t g0 = h0 + 5; c = g0 >> 26; g0 &= MASK26;
+  uint32_t g1 = h1 + c; c = g1 >> 26; g1 &= MASK26;
+  uint32_t g2 = h2 + c; c = g2 >> 26; g2 &= MASK26;
+  uint32_t g3 = h3 + c; c = g3 >> 26; g3 &= MASK26;
+  uint32_t g4 = h4 + c - (UINT32_C(1) << 26);
+
+  /* Select h if g is negative, else g.  Do this in a side-channel
+   * silent way. */
+  uint32_t mask = (g4 >> 31) - 1;
+  h0 = (h0 & ~mask) | (g0 & mask);
+  h1 = (h1 & ~mask) | (g1 & mask);
+  h2 = (h2 & ~mask) | (g2 & mask);
+  h3 = (h3 & ~mask) | (g3 & mask);
+  h4 = (h4 & ~mask) | (g4 & mask);
+
+  /* Pack into 32-bit words. */
+  h0 = h0 | (h1 << 26);
+  h1 = (h1 >> 6) | (h2 << 20);
+  h2 = (h2 >> 12) | (h3 << 14);
+  h3 = (h3 >> 18) | (h4 << 8);
+
+  /* h = (h + s) mod 2 ** 128 */
+  uint64_t f;
+  f = (uint64_t) h0 + read32_le(ctx->s);      write32_le((uint32_t) f, out);
+  f = (uint64_t) h1 + read32_le(ctx->s + 4) + (f >> 32);  write32_le((uint32_t) f, out + 4);
+  f = (uint64_t) h2 + read32_le(ctx->s + 8) + (f >> 32);  write32_le((uint32_t) f, out + 8);
+  f = (uint64_t) h3 + read32_le(ctx->s + 12) + (f >> 32); write32_le((uint32_t) f, out + 12);
+}
+
+#endif
+
+#if CF_SIMD && CF_SIMD_HAVE_AVX2
+/* The AVX2 path works on four blocks at once, in radix 2 ** 26
+ * whatever the scalar representation.  Lane i accumulates blocks
+ * i, i + 4, i + 8, ..., multiplying by r^4 between groups.  At the
+ * end, lane i is multiplied by r^(4 - i) and the lanes summed.
+ *
+ * Runs of at least this many whole blocks use it. */
+#define AVX2_MIN_BLOCKS 16
+
+#define M26 0x3ffffff
+
+/* Carries x, of five limbs, to 26 bits each, with the carry out of
+ * the top limb folded back times 5.  Limb 1 may be left slightly
+ * over 26 bits. */
+static void carry26(uint64_t x[5], uint32_t out[5])
+{
+  uint64_t c;
+  c = x[0] >> 26; x[0] &= M26; x[1] += c;
+  c = x[1] >> 26; x[1] &= M26; x[2] += c;
+  c = x[2] >> 26; x[2] &= M26; x[3] += c;
+  c = x[3] >> 26; x[3] &= M26; x[4] += c;
+  c = x[4] >> 26; x[4] &= M26; x[0] += c * 5;
+  c = x[0] >> 26; x[0] &= M26; x[1] += c;
+
+  for (int i = 0; i < 5; i++)
+    out[i] = (uint32_t) x[i];
+}
+
+/* out = a * b, partially reduced. */
+static void mul26(uint32_t out[5], const uint32_t a[5], const uint32_t b[5])
+{
+  uint64_t d[5];
 
-  for (int i = 0; i < 16; i++)
+  for (int i = 0; i < 5; i++)
   {
-    carry += x[i];
-    x[i] = carry & 0xff;
-    carry >>= 8;
+    d[i] = 0;
+    for (int j = 0; j < 5; j++)
+    {
+      /* Limb products at or above 2 ** 130 come back times 5. */
+      uint64_t bj = i - j >= 0 ? b[i - j] : (uint64_t) b[i - j + 5] * 5;
+      d[i] += a[j] * bj;
+    }
   }
 
-  x[16] += carry;
+  carry26(d, out);
 }
 
-/* This is - 2 ** 130 - 5 in twos complement. */
-static const uint32_t negative_1305[17] = {
-  0x05, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-  0, 0, 0, 0, 0, 0, 0xfc
-};
+#if CF_POLY1305_64BIT
+/* Converts 44-bit limbs, each below 2 ** 44, to 26-bit ones. */
+static void limbs_to26(const uint64_t x[3], uint32_t out[5])
+{
+  out[0] = (uint32_t) x[0] & M26;
+  out[1] = (uint32_t) ((x[0] >> 26) | (x[1] << 18)) & M26;
+  out[2] = (uint32_t) (x[1] >> 8) & M26;
+  out[3] = (uint32_t) ((x[1] >> 34) | (x[2] << 10)) & M26;
+  out[4] = (uint32_t) (x[2] >> 16);
+}
 
-static void poly1305_full_reduce(uint32_t x[static 17])
+static void h_to26(cf_poly1305 *ctx, uint32_t out[5])
 {
-  uint32_t xsub[17];
+  /* Only h[1] can be over 44 bits. */
+  ctx->h[2] += ctx->h[1] >> 44;
+  ctx->h[1] &= MASK44;
+  limbs_to26(ctx->h, out);
+}
 
-  for (size_t i = 0; i < 17; i++)
-    xsub[i] = x[i];
+static void h_from26(cf_poly1305 *ctx, const uint32_t g[5])
+{
+  uint64_t h0 = g[0] + ((uint64_t) g[1] << 26);
+  uint64_t h1 = (h0 >> 44) + ((uint64_t) g[2] << 8) + ((uint64_t) g[3] << 34);
+  ctx->h[0] = h0 & MASK44;
+  ctx->h[1] = h1 & MASK44;
+  ctx->h[2] = (h1 >> 44) + ((uint64_t) g[4] << 16);
+}
 
-  poly1305_add(xsub, negative_1305);
+static void r_to26(const cf_poly1305 *ctx, uint32_t out[5])
+{
+  limbs_to26(ctx->r, out);
+}
+#else
+static void h_to26(cf_poly1305 *ctx, uint32_t out[5])
+{
+  memcpy(out, ctx->h, sizeof ctx->h);
+}
 
-  /* If x - (2 ** 130 - 5) is negative, then
-   * x didn't need reduction: we discard the results.
-   * Do this in a side-channel silent way. */
-  uint32_t negative_mask = mask_u32(xsub[16] & 0x80, 0x80);
-  uint32_t positive_mask = negative_mask ^ 0xffffffff;
+static void h_from26(cf_poly1305 *ctx, const uint32_t g[5])
+{
+  memcpy(ctx->h, g, sizeof ctx->h);
+}
 
-  for (size_t i = 0; i < 17; i++)
-    x[i] = (x[i] & negative_mask) | (xsub[i] & positive_mask);
+static void r_to26(const cf_poly1305 *ctx, uint32_t out[5])
+{
+  memcpy(out, ctx->r, sizeof ctx->r);
+}
+#endif
+
+static void poly1305_powers(cf_poly1305 *ctx)
+{
+  r_to26(ctx, ctx->rpow[3]);
+  mul26(ctx->rpow[2], ctx->rpow[3], ctx->rpow[3]);
+  mul26(ctx->rpow[1], ctx->rpow[2], ctx->rpow[3]);
+  mul26(ctx->rpow[0], ctx->rpow[2], ctx->rpow[2]);
+  ctx->rpow_ready = 1;
 }
 
-static void poly1305_mul(uint32_t x[static 17],
-                         const uint32_t y[static 17])
+/* h = h * r lane by lane, partially reduced.  s is 5 * r. */
+CF_SIMD_AVX2
+static inline void vmul26(cf_u64x4 h[5], const cf_u64x4 r[5], const cf_u64x4 s[5])
 {
-  uint32_t r[17];
+#define VMUL cf_simd_mul32_u64x4
+  cf_u64x4 d0 = VMUL(h[0], r[0]) + VMUL(h[1], s[4]) + VMUL(h[2], s[3]) +
+                VMUL(h[3], s[2]) + VMUL(h[4], s[1]);
+  cf_u64x4 d1 = VMUL(h[0], r[1]) + VMUL(h[1], r[0]) + VMUL(h[2], s[4]) +
+                VMUL(h[3], s[3]) + VMUL(h[4], s[2]);
+  cf_u64x4 d2 = VMUL(h[0], r[2]) + VMUL(h[1], r[1]) + VMUL(h[2], r[0]) +
+                VMUL(h[3], s[4]) + VMUL(h[4], s[3]);
+  cf_u64x4 d3 = VMUL(h[0], r[3]) + VMUL(h[1], r[2]) + VMUL(h[2], r[1]) +
+                VMUL(h[3], r[0]) + VMUL(h[4], s[4]);
+  cf_u64x4 d4 = VMUL(h[0], r[4]) + VMUL(h[1], r[3]) + VMUL(h[2], r[2]) +
+                VMUL(h[3], r[1]) + VMUL(h[4], r[0]);
+#undef VMUL
+
+  cf_u64x4 c;
+  c = d0 >> 26; h[0] = d0 & M26; d1 += c;
+  c = d1 >> 26; h[1] = d1 & M26; d2 += c;
+  c = d2 >> 26; h[2] = d2 & M26; d3 += c;
+  c = d3 >> 26; h[3] = d3 & M26; d4 += c;
+  c = d4 >> 26; h[4] = d4 & M26; h[0] += c + (c << 2);
+  c = h[0] >> 26; h[0] &= M26; h[1] += c;
+}
+
+/* h += the next four blocks at m, one per lane. */
+CF_SIMD_AVX2
+static inline void vadd_blocks(cf_u64x4 h[5], const uint8_t *m)
+{
+#define LANES(off) { read32_le(m + (off)), read32_le(m + 16 + (off)), \
+                     read32_le(m + 32 + (off)), read32_le(m + 48 + (off)) }
+  cf_u64x4 t0 = LANES(0), t1 = LANES(3), t2 = LANES(6),
+           t3 = LANES(9), t4 = LANES(12);
+#undef LANES
+
+  h[0] += t0 & M26;
+  h[1] += (t1 >> 2) & M26;
+  h[2] += (t2 >> 4) & M26;
+  h[3] += (t3 >> 6) & M26;
+  h[4] += (t4 >> 8) | (1 << 24);
+}
 
-  for (int i = 0; i < 17; i++)
+/* Processes nblocks whole blocks; nblocks is a non-zero multiple of 4. */
+CF_SIMD_AVX2
+static void poly1305_blocks_avx2(cf_poly1305 *ctx, const uint8_t *m, size_t nblocks)
+{
+  cf_u64x4 h[5], r[5], s[5];
+  uint32_t g[5];
+
+  if (!ctx->rpow_ready)
+    poly1305_powers(ctx);
+
+  h_to26(ctx, g);
+  for (int i = 0; i < 5; i++)
   {
-    uint32_t accum = 0;
+    h[i] = (cf_u64x4) { g[i], 0, 0, 0 };
+    r[i] = (cf_u64x4) { 0, 0, 0, 0 } + ctx->rpow[0][i];
+    s[i] = r[i] * 5;
+  }
 
-    for (int j = 0; j <= i; j++)
-      accum += x[j] * y[i - j];
+  vadd_blocks(h, m);
+  m += 64;
+  nblocks -= 4;
 
-    /* Add in carries.  These get shifted 130 bits
-     * to the right, with a combination of byte indexing
-     * and shifting (136 bits right, then 6 bits left).
-     *
-     * nb. 5 << 6 is made up of two parts:
-     *   5: reduction of 2 ** 130 leaves a multiple 5
-     *   shift 6 places left
-     *     17 * 8: byte indexing shift (136 bits)
-     *     130: desired shift
-     */
-    for (int j = i + 1; j < 17; j++)
-      accum += (5 << 6) * x[j] * y[i + 17 - j];
+  while (nblocks)
+  {
+    vmul26(h, r, s);
+    vadd_blocks(h, m);
+    m += 64;
+    nblocks -= 4;
+  }
 
-    r[i] = accum;
+  /* Lane i times r^(4 - i), then sum the lanes. */
+  for (int i = 0; i < 5; i++)
+  {
+    r[i] = (cf_u64x4) { ctx->rpow[0][i], ctx->rpow[1][i],
+                        ctx->rpow[2][i], ctx->rpow[3][i] };
+    s[i] = r[i] * 5;
   }
 
-  poly1305_min_reduce(r);
+  vmul26(h, r, s);
 
-  for (size_t i = 0; i < 17; i++)
-    x[i] = r[i];
+  uint64_t sum[5];
+  for (int i = 0; i < 5; i++)
+    sum[i] = h[i][0] + h[i][1] + h[i][2] + h[i][3];
+
+  carry26(sum, g);
+  h_from26(ctx, g);
+
+  mem_clean(h, sizeof h);
+  mem_clean(g, sizeof g);
+  mem_clean(sum, sizeof sum);
 }
 
-static void poly1305_block(cf_poly1305 *ctx,
-                           const uint32_t c[static 17])
+/* How many messages poly1305_batch_avx2 works on at once: two
+ * vectors of four lanes, so each step has two independent
+ * multiplications in flight. */
+#define BATCH_VECS 2
+#define BATCH_LANES (4 * BATCH_VECS)
+
+/* lane_mask[i] selects lane i of a cf_u64x4. */
+static const cf_u64x4 lane_mask[4] = {
+  { UINT64_MAX, 0, 0, 0 },
+  { 0, UINT64_MAX, 0, 0 },
+  { 0, 0, UINT64_MAX, 0 },
+  { 0, 0, 0, UINT64_MAX }
+};
+
+/* One message being processed by poly1305_batch_avx2.  msg is
+ * used as the fragment list for items given as msg/nmsg. */
+typedef struct
 {
-  poly1305_add(ctx->h, c);
-  poly1305_mul(ctx->h, ctx->r);
+  cf_poly1305_item *item;
+  cf_iovec msg;
+  cf_iov_cursor cursor;
+  size_t left;
+} batch_lane;
+
+/* Finishes an item processed by poly1305_batch_avx2, whose
+ * accumulator is g: writes or checks its tag. */
+static void batch_finish(cf_poly1305_item *item, const uint32_t g[5], int verify)
+{
+  cf_poly1305 ctx;
+  uint8_t tag[16];
+
+  memset(&ctx, 0, sizeof ctx);
+  h_from26(&ctx, g);
+  memcpy(ctx.s, item->key + 16, sizeof ctx.s);
+  poly1305_finish_h(&ctx, tag);
+
+  if (verify)
+    item->err = !mem_eq(tag, item->tag, sizeof tag);
+  else
+    memcpy(item->tag, tag, sizeof tag);
+
+  mem_clean(&ctx, sizeof ctx);
+  mem_clean(tag, sizeof tag);
 }
 
-static void poly1305_whole_block(void *vctx,
-                                 const uint8_t *buf)
+/* Starts item in lane l.  Returns 0 if there is nothing to do
+ * because the message is empty (its tag is finished here). */
+CF_SIMD_AVX2
+static int batch_lane_start(batch_lane *lanes, size_t l, cf_poly1305_item *item,
+                            cf_u64x4 h[][5], cf_u64x4 r[][5], cf_u64x4 s[][5],
+                            int verify)
 {
-  cf_poly1305 *ctx = vctx;
-  uint32_t c[17];
+  static const uint32_t zero[5] = { 0 };
+  batch_lane *lane = &lanes[l];
+  cf_poly1305 tmp;
+  uint32_t r26[5];
 
-  for (int i = 0; i < 16; i++)
-    c[i] = buf[i];
+  cf_simd_avx2_leave();
 
-  c[16] = 1;
-  poly1305_block(ctx, c);
+  if (item->iov)
+  {
+    cf_iov_init(&lane->cursor, item->iov, item->niov);
+    lane->left = cf_iov_len(item->iov, item->niov);
+  } else {
+    lane->msg = (cf_iovec) { (void *) item->msg, item->nmsg };
+    cf_iov_init(&lane->cursor, &lane->msg, 1);
+    lane->left = item->nmsg;
+  }
+
+  if (lane->left == 0)
+  {
+    batch_finish(item, zero, verify);
+    return 0;
+  }
+
+  poly1305_set_r(&tmp, item->key);
+  r_to26(&tmp, r26);
+
+  /* Whole vector operations: writing single lanes of vectors
+   * which are then read whole is very slow. */
+  cf_u64x4 mask = lane_mask[l % 4];
+  for (int i = 0; i < 5; i++)
+  {
+    cf_u64x4 ri = (cf_u64x4) { 0, 0, 0, 0 } + r26[i];
+    h[l / 4][i] &= ~mask;
+    r[l / 4][i] = (r[l / 4][i] & ~mask) | (ri & mask);
+    s[l / 4][i] = (s[l / 4][i] & ~mask) | (ri * 5 & mask);
+  }
+
+  lane->item = item;
+  mem_clean(&tmp, sizeof tmp);
+  return 1;
+}
+
+/* h += the block at m[k] for each lane k of m[0..3]. */
+CF_SIMD_AVX2
+static inline void vadd_lanes(cf_u64x4 h[5], const uint8_t *const m[4])
+{
+#define LANES(off) { read32_le(m[0] + (off)), read32_le(m[1] + (off)), \
+                     read32_le(m[2] + (off)), read32_le(m[3] + (off)) }
+  cf_u64x4 t0 = LANES(0), t1 = LANES(3), t2 = LANES(6),
+           t3 = LANES(9), t4 = LANES(12);
+#undef LANES
+
+  h[0] += t0 & M26;
+  h[1] += (t1 >> 2) & M26;
+  h[2] += (t2 >> 4) & M26;
+  h[3] += (t3 >> 6) & M26;
+  h[4] += (t4 >> 8) | (1 << 24);
 }
 
-static void poly1305_last_block(cf_poly1305 *ctx)
+/* Each lane runs one message: each step adds the next block of
+ * every lane's message to its accumulator, and multiplies by its r.
+ * Finished lanes are refilled with the next message.  Idle lanes
+ * have r = 0, so they stay at zero. */
+CF_SIMD_AVX2
+static int poly1305_batch_avx2(cf_poly1305_item *items, size_t nitems, int verify)
 {
-  uint32_t c[17] = { 0 };
+  batch_lane lanes[BATCH_LANES] = { { 0 } };
+  cf_u64x4 h[BATCH_VECS][5], r[BATCH_VECS][5], s[BATCH_VECS][5];
+  static const uint8_t zero_block[16];
+  const uint8_t *ptr[BATCH_LANES];
+  size_t stride[BATCH_LANES];
+  uint32_t limbs[5][BATCH_LANES];
+  uint8_t padded[16];
+  size_t next = 0, nactive = 0;
+
+  memset(h, 0, sizeof h);
+  memset(r, 0, sizeof r);
+  memset(s, 0, sizeof s);
+
+  while (1)
+  {
+    /* Fill idle lanes while there are messages left. */
+    for (size_t l = 0; l < BATCH_LANES; l++)
+    {
+      while (lanes[l].item == NULL && next < nitems)
+      {
+        if (batch_lane_start(lanes, l, &items[next++], h, r, s, verify))
+          nactive++;
+      }
+    }
+
+    if (nactive == 0)
+      break;
+
+    /* Find the run of whole blocks which every active lane has in
+     * one fragment: this is usually all but the last block.  Idle
+     * lanes read zero_block over and over. */
+    size_t run = SIZE_MAX;
+
+    for (size_t l = 0; l < BATCH_LANES; l++)
+    {
+      batch_lane *lane = &lanes[l];
+      cf_iov_cursor *c = &lane->cursor;
+
+      if (lane->item == NULL)
+      {
+        ptr[l] = zero_block;
+        stride[l] = 0;
+        continue;
+      }
+
+      if (c->niov == 0)
+      {
+        ptr[l] = zero_block;
+        stride[l] = 0;
+        run = 0;
+        continue;
+      }
+
+      size_t span = c->iov->len - c->offset;
+      run = MIN(run, MIN(span, lane->left) / 16);
+      ptr[l] = (const uint8_t *) c->iov->base + c->offset;
+      stride[l] = 16;
+    }
+
+    if (run)
+    {
+      for (size_t j = 0; j < run; j++)
+      {
+        for (int v = 0; v < BATCH_VECS; v++)
+        {
+          vadd_lanes(h[v], ptr + 4 * v);
+          vmul26(h[v], r[v], s[v]);
+        }
+
+        for (size_t l = 0; l < BATCH_LANES; l++)
+          ptr[l] += stride[l];
+      }
+
+      for (size_t l = 0; l < BATCH_LANES; l++)
+      {
+        if (lanes[l].item)
+        {
+          lanes[l].cursor.offset += 16 * run;
+          lanes[l].left -= 16 * run;
+        }
+      }
+    } else {
+      /* One block from each lane, which may straddle fragments or
+       * be the final partial block. */
+      for (size_t l = 0; l < BATCH_LANES; l++)
+      {
+        batch_lane *lane = &lanes[l];
+
+        if (lane->item == NULL)
+        {
+          for (int i = 0; i < 5; i++)
+            limbs[i][l] = 0;
+          continue;
+        }
+
+        size_t take = MIN(lane->left, (size_t) 16);
+        uint32_t hibit = 1 << 24;
+
+        cf_iov_gather(&lane->cursor, padded, take);
+        lane->left -= take;
+
+        /* The last block is padded with a 1 byte, then zeroes. */
+        if (take < 16)
+        {
+          memset(padded + take, 0, sizeof padded - take);
+          padded[take] = 1;
+          hibit = 0;
+        }
+
+        limbs[0][l] = read32_le(padded) & M26;
+        limbs[1][l] = (read32_le(padded + 3) >> 2) & M26;
+        limbs[2][l] = (read32_le(padded + 6) >> 4) & M26;
+        limbs[3][l] = (read32_le(padded + 9) >> 6) & M26;
+        limbs[4][l] = (read32_le(padded + 12) >> 8) | hibit;
+      }
+
+      for (int v = 0; v < BATCH_VECS; v++)
+      {
+        for (int i = 0; i < 5; i++)
+        {
+          const uint32_t *x = limbs[i] + 4 * v;
+          h[v][i] += (cf_u64x4) { x[0], x[1], x[2], x[3] };
+        }
+        vmul26(h[v], r[v], s[v]);
+      }
+    }
+
+    /* Retire finished lanes. */
+    for (size_t l = 0; l < BATCH_LANES; l++)
+    {
+      batch_lane *lane = &lanes[l];
+
+      if (lane->item == NULL || lane->left != 0)
+        continue;
+
+      cf_u64x4 mask = lane_mask[l % 4];
+      uint64_t x[5];
+      uint32_t g[5];
+      for (int i = 0; i < 5; i++)
+      {
+        x[i] = h[l / 4][i][l % 4];
+        h[l / 4][i] &= ~mask;
+        r[l / 4][i] &= ~mask;
+        s[l / 4][i] &= ~mask;
+      }
+
+      cf_simd_avx2_leave();
+      carry26(x, g);
+      batch_finish(lane->item, g, verify);
+      lane->item = NULL;
+      nactive--;
+      mem_clean(x, sizeof x);
+      mem_clean(g, sizeof g);
+    }
+  }
 
-  for (size_t i = 0; i < ctx->npartial; i++)
-    c[i] = ctx->partial[i];
+  mem_clean(h, sizeof h);
+  mem_clean(r, sizeof r);
+  mem_clean(s, sizeof s);
+  mem_clean(limbs, sizeof limbs);
+  mem_clean(padded, sizeof padded);
 
-  c[ctx->npartial] = 1;
-  poly1305_block(ctx, c);
+  int err = 0;
+  if (verify)
+  {
+    for (size_t i = 0; i < nitems; i++)
+      err |= items[i].err;
+  }
+  return err;
+}
+#endif
+
+void cf_poly1305_init(cf_poly1305 *ctx,
+                      const uint8_t r[static 16],
+                      const uint8_t s[static 16])
+{
+  memset(ctx, 0, sizeof *ctx);
+  poly1305_set_r(ctx, r);
+  memcpy(ctx->s, s, 16);
 }
 
 void cf_poly1305_update(cf_poly1305 *ctx,
                         const uint8_t *buf,
                         size_t nbytes)
 {
-  cf_blockwise_accumulate(ctx->partial, &ctx->npartial,
-                          sizeof ctx->partial,
-                          buf, nbytes,
-                          poly1305_whole_block,
-                          ctx);
+  /* Complete any partial block. */
+  if (ctx->npartial)
+  {
+    size_t take = MIN(nbytes, sizeof ctx->partial - ctx->npartial);
+    memcpy(ctx->partial + ctx->npartial, buf, take);
+    ctx->npartial += take;
+    buf += take;
+    nbytes -= take;
+
+    if (ctx->npartial == sizeof ctx->partial)
+    {
+      poly1305_blocks(ctx, ctx->partial, 1, HIBIT_WHOLE);
+      ctx->npartial = 0;
+    }
+  }
+
+#if CF_SIMD && CF_SIMD_HAVE_AVX2
+  /* Long runs of whole blocks: four at a time. */
+  if (nbytes >= 16 * AVX2_MIN_BLOCKS && cf_simd_have_avx2())
+  {
+    size_t nblocks = (nbytes / 16) & ~(size_t) 3;
+    poly1305_blocks_avx2(ctx, buf, nblocks);
+    buf += nblocks * 16;
+    nbytes -= nblocks * 16;
+  }
+#endif
+
+  /* Whole blocks straight from the input. */
+  if (nbytes >= 16)
+  {
+    size_t nblocks = nbytes / 16;
+    poly1305_blocks(ctx, buf, nblocks, HIBIT_WHOLE);
+    buf += nblocks * 16;
+    nbytes -= nblocks * 16;
+  }
+
+  /* Keep the rest for later. */
+  if (nbytes)
+  {
+    memcpy(ctx->partial, buf, nbytes);
+    ctx->npartial = nbytes;
+  }
 }
 
 void cf_poly1305_finish(cf_poly1305 *ctx,
                         uint8_t out[static 16])
 {
+  /* The last block is padded with a 1 byte, then zeroes. */
   if (ctx->npartial)
-    poly1305_last_block(ctx);
+  {
+    ctx->partial[ctx->npartial] = 1;
+    memset(ctx->partial + ctx->npartial + 1, 0,
+           sizeof ctx->partial - ctx->npartial - 1);
+    poly1305_blocks(ctx, ctx->partial, 1, 0);
+  }
 
-  uint32_t s[17];
-  for (size_t i = 0; i < 16; i++)
-    s[i] = ctx->s[i];
-  s[16] = 0;
+  poly1305_finish_h(ctx, out);
+  mem_clean(ctx, sizeof *ctx);
+}
+
+static void mac_piece(void *vctx, const uint8_t *data, size_t len)
+{
+  cf_poly1305_update(vctx, data, len);
+}
 
-  poly1305_full_reduce(ctx->h);
-  poly1305_add(ctx->h, s);
+static int poly1305_batch(cf_poly1305_item *items, size_t nitems, int verify)
+{
+#if CF_SIMD && CF_SIMD_HAVE_AVX2
+  if (cf_simd_have_avx2())
+    return poly1305_batch_avx2(items, nitems, verify);
+#endif
 
-  for (size_t i = 0; i < 16; i++)
-    out[i] = ctx->h[i];
+  int err = 0;
 
-  mem_clean(ctx, sizeof *ctx);
+  for (size_t i = 0; i < nitems; i++)
+  {
+    cf_poly1305_item *item = &items[i];
+    cf_poly1305 ctx;
+    uint8_t tag[16];
+
+    cf_poly1305_init(&ctx, item->key, item->key + 16);
+    if (item->iov)
+    {
+      cf_iov_cursor cursor;
+      cf_iov_init(&cursor, item->iov, item->niov);
+      cf_iov_read(&cursor, cf_iov_len(item->iov, item->niov), mac_piece, &ctx);
+    } else {
+      cf_poly1305_update(&ctx, item->msg, item->nmsg);
+    }
+    cf_poly1305_finish(&ctx, tag);
+
+    if (verify)
+    {
+      item->err = !mem_eq(tag, item->tag, sizeof tag);
+      err |= item->err;
+    } else {
+      memcpy(item->tag, tag, sizeof tag);
+    }
+
+    mem_clean(tag, sizeof tag);
+  }
+
+  return err;
 }
 
+void cf_poly1305_batch(cf_poly1305_item *items, size_t nitems)
+{
+  poly1305_batch(items, nitems, 0);
+}
+
+int cf_poly1305_verify_batch(cf_poly1305_item *items, size_t nitems)
+{
+  return poly1305_batch(items, nitems, 1);
+}
@@ -18,6 +18,9 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include "cf_config.h"
+#include "aead.h"
+
 /**
  * Poly1305
  * ========
@@ -33,10 +36,11 @@
  * Poly1305 incremental interface context.
  *
  * .. c:member:: cf_poly1305.h
- * Current accumulator.
+ * Current accumulator, as 44-bit limbs if :c:macro:`CF_POLY1305_64BIT`
+ * is 1, or 26-bit limbs otherwise.
  *
  * .. c:member:: cf_poly1305.r
- * Block multiplier.
+ * Block multiplier, in the same form.
  *
  * .. c:member:: cf_poly1305.s
  * Final XOR offset.
@@ -47,14 +51,30 @@
  * .. c:member:: cf_poly1305.npartial
  * Number of bytes of unprocessed input.
  *
+ * .. c:member:: cf_poly1305.rpow
+ * r^4, r^3, r^2 and r, as 26-bit limbs, for the vector code.  Only
+ * present if :c:macro:`CF_SIMD` is 1.
+ *
+ * .. c:member:: cf_poly1305.rpow_ready
+ * Non-zero once `rpow` has been computed.
+ *
  */
 typedef struct
 {
-  uint32_t h[17];
-  uint32_t r[17];
+#if CF_POLY1305_64BIT
+  uint64_t h[3];
+  uint64_t r[3];
+#else
+  uint32_t h[5];
+  uint32_t r[5];
+#endif
   uint8_t s[16];
   uint8_t partial[16];
   size_t npartial;
+#if CF_SIMD
+  uint32_t rpow[4][5];
+  int rpow_ready;
+#endif
 } cf_poly1305;
 
 /* .. c:function:: $DECL
@@ -88,4 +108,68 @@ void cf_poly1305_update(cf_poly1305 *ctx,
 void cf_poly1305_finish(cf_poly1305 *ctx,
                         uint8_t out[static 16]);
 
+/**
+ * Batches
+ * -------
+ * These compute or check the tags of many independent messages, each
+ * with its own one-time key, in one call.  Where the CPU has vector
+ * instructions for it, several messages are processed at once in
+ * different vector lanes, so many short messages are much quicker
+ * than one at a time.
+ */
+
+/* .. c:type:: cf_poly1305_item
+ * One message for :c:func:`cf_poly1305_batch` or
+ * :c:func:`cf_poly1305_verify_batch`.
+ *
+ * .. c:member:: cf_poly1305_item.key
+ * 32 bytes of one-time key: `r`, then `s`, as for :c:func:`cf_poly1305_init`.
+ *
+ * .. c:member:: cf_poly1305_item.msg
+ * Message (read).
+ *
+ * .. c:member:: cf_poly1305_item.nmsg
+ * Length of message.  Messages in a batch may be different lengths.
+ *
+ * .. c:member:: cf_poly1305_item.iov
+ * If not NULL, the message is instead the concatenation of these
+ * fragments, and `msg` and `nmsg` are ignored.
+ *
+ * .. c:member:: cf_poly1305_item.niov
+ * Number of fragments at `iov`.
+ *
+ * .. c:member:: cf_poly1305_item.tag
+ * 16 byte tag.  This is written by :c:func:`cf_poly1305_batch`, and
+ * read by :c:func:`cf_poly1305_verify_batch`.
+ *
+ * .. c:member:: cf_poly1305_item.err
+ * Written by :c:func:`cf_poly1305_verify_batch`: 0 if the tag is
+ * correct, non-zero otherwise.
+ */
+typedef struct
+{
+  const uint8_t *key;
+  const uint8_t *msg;
+  size_t nmsg;
+  const cf_iovec *iov;
+  size_t niov;
+  uint8_t *tag;
+  int err;
+} cf_poly1305_item;
+
+/* .. c:function:: $DECL
+ * Computes the tag of each of `nitems` messages.  Each result is the
+ * same as computing it with :c:func:`cf_poly1305_init`,
+ * :c:func:`cf_poly1305_update` and :c:func:`cf_poly1305_finish`.
+ */
+void cf_poly1305_batch(cf_poly1305_item *items, size_t nitems);
+
+/* .. c:function:: $DECL
+ * Checks the tag of each of `nitems` messages, in constant time,
+ * and sets each item's `err`.
+ *
+ * :return: 0 if every tag is correct, non-zero otherwise.
+ */
+int cf_poly1305_verify_batch(cf_poly1305_item *items, size_t nitems);
+
 #endif
@@ -37,6 +37,23 @@
  */
 typedef void (*cf_prp_block)(void *ctx, const uint8_t *in, uint8_t *out);
 
+/* .. c:type:: cf_prp_blocks
+ * Multiple block processing function type.
+ *
+ * This processes `nblocks` independent blocks (ie, in ECB mode).
+ * Implementations should interleave the work on each block, so the
+ * latency of one block is hidden behind the others.
+ *
+ * The `in` and `out` buffers may alias exactly.
+ *
+ * :rtype: void
+ * :param ctx: block cipher-specific context object.
+ * :param in: input blocks, `nblocks` blocks long.
+ * :param out: output blocks, `nblocks` blocks long.
+ * :param nblocks: number of blocks.
+ */
+typedef void (*cf_prp_blocks)(void *ctx, const uint8_t *in, uint8_t *out, size_t nblocks);
+
 /* .. c:type:: cf_prp
  * Describes an PRP in a general way.
  *
@@ -48,12 +65,22 @@ typedef void (*cf_prp_block)(void *ctx, const uint8_t *in, uint8_t *out);
  *
  * .. c:member:: cf_prp.decrypt
  * Block decryption function.
+ *
+ * .. c:member:: cf_prp.encrypt_blocks
+ * Multiple block encryption function.  This may be NULL, in which
+ * case `encrypt` is called for each block.
+ *
+ * .. c:member:: cf_prp.decrypt_blocks
+ * Multiple block decryption function.  This may be NULL, in which
+ * case `decrypt` is called for each block.
  */
 typedef struct
 {
   size_t blocksz;
   cf_prp_block encrypt;
   cf_prp_block decrypt;
+  cf_prp_blocks encrypt_blocks;
+  cf_prp_blocks decrypt_blocks;
 } cf_prp;
 
 /* .. c:macro:: CF_MAXBLOCK
@@ -61,4 +88,38 @@ typedef struct
  */
 #define CF_MAXBLOCK 16
 
+/* .. c:function:: void cf_prp_encrypt_blocks(const cf_prp *prp, void *prpctx, const uint8_t *in, uint8_t *out, size_t nblocks)
+ * Encrypts `nblocks` independent blocks from `in` to `out`, using
+ * :c:member:`cf_prp.encrypt_blocks` if the PRP has one. */
+static inline void cf_prp_encrypt_blocks(const cf_prp *prp, void *prpctx,
+                                         const uint8_t *in, uint8_t *out,
+                                         size_t nblocks)
+{
+  if (prp->encrypt_blocks)
+  {
+    prp->encrypt_blocks(prpctx, in, out, nblocks);
+    return;
+  }
+
+  for (size_t i = 0; i < nblocks; i++)
+    prp->encrypt(prpctx, in + i * prp->blocksz, out + i * prp->blocksz);
+}
+
+/* .. c:function:: void cf_prp_decrypt_blocks(const cf_prp *prp, void *prpctx, const uint8_t *in, uint8_t *out, size_t nblocks)
+ * Decrypts `nblocks` independent blocks from `in` to `out`, using
+ * :c:member:`cf_prp.decrypt_blocks` if the PRP has one. */
+static inline void cf_prp_decrypt_blocks(const cf_prp *prp, void *prpctx,
+                                         const uint8_t *in, uint8_t *out,
+                                         size_t nblocks)
+{
+  if (prp->decrypt_blocks)
+  {
+    prp->decrypt_blocks(prpctx, in, out, nblocks);
+    return;
+  }
+
+  for (size_t i = 0; i < nblocks; i++)
+    prp->decrypt(prpctx, in + i * prp->blocksz, out + i * prp->blocksz);
+}
+
 #endif
@@ -15,48 +15,51 @@
 #include "salsa20.h"
 #include "bitops.h"
 #include "blockwise.h"
+#include "handy.h"
+#include "simd.h"
 
 #include <string.h>
 #include <stdlib.h>
 
-void cf_salsa20_core(const uint8_t key0[16],
-                     const uint8_t key1[16],
-                     const uint8_t nonce[16],
-                     const uint8_t constant[16],
-                     uint8_t out[64])
+/* Reads the core function input into x, in the order the core
+ * uses it:
+ *
+ * c0
+ * key0
+ * c1
+ * nonce
+ * c2
+ * key1
+ * c3
+ *
+ * where c0, c1, c2, c3 = constant
+ */
+static void salsa20_setup(uint32_t x[16],
+                          const uint8_t key0[16],
+                          const uint8_t key1[16],
+                          const uint8_t nonce[16],
+                          const uint8_t constant[16])
+{
+  x[0] = read32_le(constant + 0);
+  x[5] = read32_le(constant + 4);
+  x[10] = read32_le(constant + 8);
+  x[15] = read32_le(constant + 12);
+
+  for (int i = 0; i < 4; i++)
+  {
+    x[1 + i] = read32_le(key0 + 4 * i);
+    x[6 + i] = read32_le(nonce + 4 * i);
+    x[11 + i] = read32_le(key1 + 4 * i);
+  }
+}
+
+/* The Salsa20 core function, on words. */
+static void salsa20_block(const uint32_t x[16], uint32_t out[16])
 {
-  /* unpack sequence is:
-   *
-   * c0
-   * key0
-   * c1
-   * nonce
-   * c2
-   * key1
-   * c3
-   *
-   * where c0, c1, c2, c3 = constant
-   */
-  
-  uint32_t z0, z1, z2, z3, z4, z5, z6, z7,
-           z8, z9, za, zb, zc, zd, ze, zf;
-
-  uint32_t x0 = z0 = read32_le(constant + 0),
-           x1 = z1 = read32_le(key0 + 0),
-           x2 = z2 = read32_le(key0 + 4),
-           x3 = z3 = read32_le(key0 + 8),
-           x4 = z4 = read32_le(key0 + 12),
-           x5 = z5 = read32_le(constant + 4),
-           x6 = z6 = read32_le(nonce + 0),
-           x7 = z7 = read32_le(nonce + 4),
-           x8 = z8 = read32_le(nonce + 8),
-           x9 = z9 = read32_le(nonce + 12),
-           xa = za = read32_le(constant + 8),
-           xb = zb = read32_le(key1 + 0),
-           xc = zc = read32_le(key1 + 4),
-           xd = zd = read32_le(key1 + 8),
-           xe = ze = read32_le(key1 + 12),
-           xf = zf = read32_le(constant + 12);
+  uint32_t z0 = x[0], z1 = x[1], z2 = x[2], z3 = x[3],
+           z4 = x[4], z5 = x[5], z6 = x[6], z7 = x[7],
+           z8 = x[8], z9 = x[9], za = x[10], zb = x[11],
+           zc = x[12], zd = x[13], ze = x[14], zf = x[15];
 
 #define QUARTER(v0, v1, v2, v3) \
   v1 ^= rotl32(v0 + v3, 7); \
@@ -82,81 +85,251 @@ void cf_salsa20_core(const uint8_t key0[16],
     ROW;
   }
 
-  x0 += z0;
-  x1 += z1;
-  x2 += z2;
-  x3 += z3;
-  x4 += z4;
-  x5 += z5;
-  x6 += z6;
-  x7 += z7;
-  x8 += z8;
-  x9 += z9;
-  xa += za;
-  xb += zb;
-  xc += zc;
-  xd += zd;
-  xe += ze;
-  xf += zf;
-
-  write32_le(x0, out + 0);
-  write32_le(x1, out + 4);
-  write32_le(x2, out + 8);
-  write32_le(x3, out + 12);
-  write32_le(x4, out + 16);
-  write32_le(x5, out + 20);
-  write32_le(x6, out + 24);
-  write32_le(x7, out + 28);
-  write32_le(x8, out + 32);
-  write32_le(x9, out + 36);
-  write32_le(xa, out + 40);
-  write32_le(xb, out + 44);
-  write32_le(xc, out + 48);
-  write32_le(xd, out + 52);
-  write32_le(xe, out + 56);
-  write32_le(xf, out + 60);
+  out[0] = x[0] + z0;
+  out[1] = x[1] + z1;
+  out[2] = x[2] + z2;
+  out[3] = x[3] + z3;
+  out[4] = x[4] + z4;
+  out[5] = x[5] + z5;
+  out[6] = x[6] + z6;
+  out[7] = x[7] + z7;
+  out[8] = x[8] + z8;
+  out[9] = x[9] + z9;
+  out[10] = x[10] + za;
+  out[11] = x[11] + zb;
+  out[12] = x[12] + zc;
+  out[13] = x[13] + zd;
+  out[14] = x[14] + ze;
+  out[15] = x[15] + zf;
+}
+
+#if CF_SIMD
+/* Multi-block cores: 4 blocks at once with 128-bit vectors, and 8 at
+ * once with AVX2 where the CPU has it. */
+#define VQUARTER(v0, v1, v2, v3) \
+  v1 ^= CF_SIMD_ROTL32(v0 + v3, 7); \
+  v2 ^= CF_SIMD_ROTL32(v1 + v0, 9); \
+  v3 ^= CF_SIMD_ROTL32(v2 + v1, 13);\
+  v0 ^= CF_SIMD_ROTL32(v3 + v2, 18)
+
+#define SALSA_FN salsa20_core_x4
+#define SALSA_VEC cf_u32x4
+#define SALSA_LANES 4
+#define SALSA_ATTR
+#define SALSA_XOR CF_SIMD_XOR_4X4
+#include "salsa20.simd.c"
+#undef SALSA_FN
+#undef SALSA_VEC
+#undef SALSA_LANES
+#undef SALSA_ATTR
+#undef SALSA_XOR
+
+#if CF_SIMD_HAVE_AVX2
+#define SALSA_FN salsa20_core_x8
+#define SALSA_VEC cf_u32x8
+#define SALSA_LANES 8
+#define SALSA_ATTR CF_SIMD_AVX2
+#define SALSA_XOR CF_SIMD_XOR_4X8
+#include "salsa20.simd.c"
+#undef SALSA_FN
+#undef SALSA_VEC
+#undef SALSA_LANES
+#undef SALSA_ATTR
+#undef SALSA_XOR
+#endif
+
+#undef VQUARTER
+#endif
+
+void cf_salsa20_core(const uint8_t key0[16],
+                     const uint8_t key1[16],
+                     const uint8_t nonce[16],
+                     const uint8_t constant[16],
+                     uint8_t out[64])
+{
+  uint32_t x[16], y[16];
+
+  salsa20_setup(x, key0, key1, nonce, constant);
+  salsa20_block(x, y);
+
+  for (int i = 0; i < 16; i++)
+    write32_le(y[i], out + 4 * i);
 }
 
 static const uint8_t *salsa20_tau = (const uint8_t *) "expand 16-byte k";
 static const uint8_t *salsa20_sigma = (const uint8_t *) "expand 32-byte k";
 
-void cf_salsa20_init(cf_salsa20_ctx *ctx, const uint8_t *key, size_t nkey, const uint8_t nonce[8])
+void cf_salsa20_init_custom(cf_salsa20_ctx *ctx, const uint8_t *key, size_t nkey,
+                            const uint8_t nonce[16])
 {
   switch (nkey)
   {
     case 16:
-      memcpy(ctx->key0, key, 16);
-      memcpy(ctx->key1, key, 16);
-      ctx->constant = salsa20_tau;
+      salsa20_setup(ctx->state, key, key, nonce, salsa20_tau);
       break;
     case 32:
-      memcpy(ctx->key0, key, 16);
-      memcpy(ctx->key1, key + 16, 16);
-      ctx->constant = salsa20_sigma;
+      salsa20_setup(ctx->state, key, key + 16, nonce, salsa20_sigma);
       break;
     default:
       abort();
   }
 
-  memset(ctx->nonce, 0, sizeof ctx->nonce);
-  memcpy(ctx->nonce, nonce, 8);
-  ctx->nblock = 0;
+  ctx->counter = 8;
   ctx->ncounter = 8;
+  ctx->nblock = 0;
+}
+
+void cf_salsa20_init(cf_salsa20_ctx *ctx, const uint8_t *key, size_t nkey, const uint8_t nonce[8])
+{
+  uint8_t fullnonce[16] = { 0 };
+  memcpy(fullnonce, nonce, 8);
+  cf_salsa20_init_custom(ctx, key, nkey, fullnonce);
+}
+
+void cf_hsalsa20(const uint8_t key[32], const uint8_t nonce[16], uint8_t out[32])
+{
+  uint32_t x[16], y[16];
+  static const int words[8] = { 0, 5, 10, 15, 6, 7, 8, 9 };
+
+  salsa20_setup(x, key, key + 16, nonce, salsa20_sigma);
+  salsa20_block(x, y);
+
+  /* Undo the feed-forward, and keep the diagonal and nonce words. */
+  for (int i = 0; i < 8; i++)
+    write32_le(y[words[i]] - x[words[i]], out + 4 * i);
+
+  mem_clean(x, sizeof x);
+  mem_clean(y, sizeof y);
+}
+
+void cf_xsalsa20_init(cf_salsa20_ctx *ctx, const uint8_t key[32], const uint8_t nonce[24])
+{
+  uint8_t subkey[32], fullnonce[16] = { 0 };
+
+  cf_hsalsa20(key, nonce, subkey);
+  memcpy(fullnonce, nonce + 16, 8);
+  cf_salsa20_init_custom(ctx, subkey, sizeof subkey, fullnonce);
+
+  mem_clean(subkey, sizeof subkey);
 }
 
 static void cf_salsa20_next_block(void *vctx, uint8_t *out)
 {
   cf_salsa20_ctx *ctx = vctx;
-  cf_salsa20_core(ctx->key0,
-                  ctx->key1,
-                  ctx->nonce,
-                  ctx->constant,
-                  out);
-  incr_le(ctx->nonce + 8, ctx->ncounter);
+  uint32_t ks[16];
+
+  salsa20_block(ctx->state, ks);
+  incr_le32(ctx->state + ctx->counter, ctx->ncounter);
+
+  for (int i = 0; i < 16; i++)
+    write32_le(ks[i], out + 4 * i);
+}
+
+#if CF_SIMD
+/* Writes input states for nlanes blocks to x, in the form the
+ * multi-block cores want, and advances the counter.  Only the
+ * counter words differ between blocks; fill_key says whether
+ * to write the others too. */
+static void salsa20_load_lanes(cf_salsa20_ctx *ctx, uint32_t *x,
+                               size_t nlanes, int fill_key)
+{
+  size_t first = fill_key ? 0 : ctx->counter,
+         last = fill_key ? 16 : ctx->counter + ctx->ncounter / 4;
+
+  for (size_t l = 0; l < nlanes; l++)
+  {
+    for (size_t w = first; w < last; w++)
+      x[w * nlanes + l] = ctx->state[w];
+    incr_le32(ctx->state + ctx->counter, ctx->ncounter);
+  }
 }
 
+/* XORs key stream into whole blocks, several at a time.  Returns
+ * the number of bytes done: any remainder is less than 4 blocks. */
+static size_t salsa20_cipher_lanes(cf_salsa20_ctx *ctx,
+                                   const uint8_t *input, uint8_t *output,
+                                   size_t bytes)
+{
+  uint32_t x[16 * 8];
+  size_t done = 0, nlanes = 4, loaded = 0;
+
+#if CF_SIMD_HAVE_AVX2
+  if (cf_simd_have_avx2() && bytes >= 64 * 8)
+    nlanes = 8;
+#endif
+
+  while (bytes - done >= 64 * 4)
+  {
+    /* Drop to 4 lanes for the last few blocks. */
+    if (bytes - done < 64 * nlanes)
+      nlanes = 4;
+
+    salsa20_load_lanes(ctx, x, nlanes, loaded != nlanes);
+    loaded = nlanes;
+
+#if CF_SIMD_HAVE_AVX2
+    if (nlanes == 8)
+      salsa20_core_x8(x, input + done, output + done);
+    else
+#endif
+      salsa20_core_x4(x, input + done, output + done);
+
+    done += 64 * nlanes;
+  }
+
+  mem_clean(x, sizeof x);
+  return done;
+}
+#endif
+
 void cf_salsa20_cipher(cf_salsa20_ctx *ctx, const uint8_t *input, uint8_t *output, size_t bytes)
 {
+  /* Use up any key stream left over from last time. */
+  if (ctx->nblock)
+  {
+    size_t taken = MIN(bytes, ctx->nblock);
+    cf_blockwise_xor(ctx->block, &ctx->nblock, 64,
+                     input, output, taken,
+                     cf_salsa20_next_block,
+                     ctx);
+    input += taken;
+    output += taken;
+    bytes -= taken;
+  }
+
+#if CF_SIMD
+  /* Runs of whole blocks: use the multi-block cores. */
+  if (bytes >= 64 * 4)
+  {
+    size_t done = salsa20_cipher_lanes(ctx, input, output, bytes);
+    input += done;
+    output += done;
+    bytes -= done;
+  }
+#endif
+
+  /* Whole blocks go directly from input to output. */
+  if (bytes >= 64)
+  {
+    uint32_t ks[16];
+
+    while (bytes >= 64)
+    {
+      salsa20_block(ctx->state, ks);
+      incr_le32(ctx->state + ctx->counter, ctx->ncounter);
+
+      for (int i = 0; i < 16; i++)
+        write32_le(read32_le(input + 4 * i) ^ ks[i], output + 4 * i);
+
+      input += 64;
+      output += 64;
+      bytes -= 64;
+    }
+
+    mem_clean(ks, sizeof ks);
+  }
+
+  /* Remaining partial block. */
   cf_blockwise_xor(ctx->block, &ctx->nblock, 64,
                    input, output, bytes,
                    cf_salsa20_next_block,
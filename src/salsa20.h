@@ -32,6 +32,11 @@
  * ChaCha20 is fundamentally like Salsa20, but
  * has a tweaked round function to improve security
  * margin without damaging performance.
+ *
+ * The reduced round variants ChaCha8 and ChaCha12 are
+ * also available.  They are faster, but have a much
+ * smaller security margin: they suit bulk key stream
+ * where speed matters more, such as filling test data.
  */
 
 /* Salsa20 core transform. */
@@ -51,17 +56,16 @@ void cf_chacha20_core(const uint8_t key0[16],
 /* .. c:type:: cf_salsa20_ctx
  * Incremental interface to Salsa20.
  *
- * .. c:member:: cf_salsa20_ctx.key0
- * Half of key material.
- *
- * .. c:member:: cf_salsa20_ctx.key1
- * Half of key material.
+ * .. c:member:: cf_salsa20_ctx.state
+ * Input to the core function for the next block, as words: the
+ * constants, key, nonce and block counter, in the order the
+ * cipher uses them.
  *
- * .. c:member:: cf_salsa20_ctx.nonce
- * Nonce and counter block.
+ * .. c:member:: cf_salsa20_ctx.counter
+ * Index in `state` of the least significant word of the block counter.
  *
- * .. c:member:: cf_salsa20_ctx.constant
- * Per-key-length constants.
+ * .. c:member:: cf_salsa20_ctx.ncounter
+ * Length, in bytes, of the block counter.
  *
  * .. c:member:: cf_salsa20_ctx.block
  * Buffer for unused key stream material.
@@ -72,12 +76,11 @@ void cf_chacha20_core(const uint8_t key0[16],
  */
 typedef struct
 {
-  uint8_t key0[16], key1[16];
-  uint8_t nonce[16];
-  const uint8_t *constant;
+  uint32_t state[16];
+  size_t counter;
+  size_t ncounter;
   uint8_t block[64];
   size_t nblock;
-  size_t ncounter;
 } cf_salsa20_ctx, cf_chacha20_ctx;
 
 /* .. c:type:: cf_chacha20_ctx
@@ -95,6 +98,46 @@ typedef struct
  */
 void cf_salsa20_init(cf_salsa20_ctx *ctx, const uint8_t *key, size_t nkey, const uint8_t nonce[8]);
 
+/* .. c:function:: $DECL
+ * Salsa20 initialisation function.  This version also sets the
+ * initial value of the 64-bit block counter, which follows the nonce.
+ *
+ * :param ctx: salsa20 context (written).
+ * :param key: key material.
+ * :param nkey: length of key in bytes, either 16 or 32.
+ * :param nonce: per-message nonce (8 bytes), then block counter (8 bytes, little endian).
+ */
+void cf_salsa20_init_custom(cf_salsa20_ctx *ctx, const uint8_t *key, size_t nkey,
+                            const uint8_t nonce[16]);
+
+/* .. c:function:: $DECL
+ * HSalsa20: derives a subkey from a key and a 128-bit nonce.
+ *
+ * This is the Salsa20 core without the final addition of the
+ * input, keeping only the words at the constant and nonce positions.
+ *
+ * :param key: key material.
+ * :param nonce: nonce.
+ * :param out: subkey output.
+ */
+void cf_hsalsa20(const uint8_t key[32], const uint8_t nonce[16], uint8_t out[32]);
+
+/* .. c:function:: $DECL
+ * XSalsa20 initialisation function.
+ *
+ * XSalsa20 extends Salsa20's nonce to 192 bits, so nonces can be
+ * chosen at random.  The first 16 bytes of the nonce and the key give
+ * a subkey (with :c:func:`cf_hsalsa20`), which is used with the
+ * last 8 bytes of the nonce and a block counter starting at zero.
+ *
+ * Use :c:func:`cf_salsa20_cipher` after this.
+ *
+ * :param ctx: salsa20 context (written).
+ * :param key: key material.
+ * :param nonce: per-message nonce.
+ */
+void cf_xsalsa20_init(cf_salsa20_ctx *ctx, const uint8_t key[32], const uint8_t nonce[24]);
+
 /* .. c:function:: $DECL
  * Chacha20 initialisation function.
  *
@@ -119,6 +162,34 @@ void cf_chacha20_init(cf_chacha20_ctx *ctx, const uint8_t *key, size_t nkey, con
 void cf_chacha20_init_custom(cf_chacha20_ctx *ctx, const uint8_t *key, size_t nkey,
                              const uint8_t nonce[16], size_t ncounter);
 
+/* .. c:function:: $DECL
+ * HChaCha20: derives a subkey from a key and a 128-bit nonce.
+ *
+ * This is the ChaCha20 core without the final addition of the
+ * input, keeping only the first and last rows of the output.
+ *
+ * :param key: key material.
+ * :param nonce: nonce.
+ * :param out: subkey output.
+ */
+void cf_hchacha20(const uint8_t key[32], const uint8_t nonce[16], uint8_t out[32]);
+
+/* .. c:function:: $DECL
+ * XChaCha20 initialisation function.
+ *
+ * XChaCha20 extends ChaCha20's nonce to 192 bits, so nonces can be
+ * chosen at random.  The first 16 bytes of the nonce and the key give
+ * a subkey (with :c:func:`cf_hchacha20`), which is used with the
+ * last 8 bytes of the nonce and a 64-bit block counter starting at zero.
+ *
+ * Use :c:func:`cf_chacha20_cipher` after this.
+ *
+ * :param ctx: chacha20 context (written).
+ * :param key: key material.
+ * :param nonce: per-message nonce.
+ */
+void cf_xchacha20_init(cf_chacha20_ctx *ctx, const uint8_t key[32], const uint8_t nonce[24]);
+
 /* .. c:function:: $DECL
  * Salsa20 encryption/decryption function.
  *
@@ -137,4 +208,139 @@ void cf_salsa20_cipher(cf_salsa20_ctx *ctx, const uint8_t *input, uint8_t *outpu
  */
 void cf_chacha20_cipher(cf_chacha20_ctx *ctx, const uint8_t *input, uint8_t *output, size_t count);
 
+/* .. c:function:: $DECL
+ * ChaCha12 encryption/decryption function.
+ *
+ * ChaCha12 is ChaCha20 with 12 rounds instead of 20.  It is set up
+ * with the chacha20 initialisation functions, and gives a different
+ * key stream for the same key and nonce.  Use a context with only
+ * one of the ChaCha variants.
+ *
+ * :param ctx: chacha20 context.
+ * :param input: input data buffer (read), `count` bytes long.
+ * :param output: output data buffer (written), `count` bytes long.
+ */
+void cf_chacha12_cipher(cf_chacha20_ctx *ctx, const uint8_t *input, uint8_t *output, size_t count);
+
+/* .. c:function:: $DECL
+ * ChaCha8 encryption/decryption function.
+ *
+ * As :c:func:`cf_chacha12_cipher`, but with 8 rounds.
+ *
+ * :param ctx: chacha20 context.
+ * :param input: input data buffer (read), `count` bytes long.
+ * :param output: output data buffer (written), `count` bytes long.
+ */
+void cf_chacha8_cipher(cf_chacha20_ctx *ctx, const uint8_t *input, uint8_t *output, size_t count);
+
+/* .. c:function:: $DECL
+ * Moves a chacha20 context to any point in its key stream.
+ *
+ * The next byte produced by :c:func:`cf_chacha20_cipher` will be
+ * key stream byte `offset`, counting from block counter zero.  The
+ * counter portion of the nonce given at initialisation is replaced;
+ * the rest of the nonce and the key are unchanged.  Seeking past the
+ * end of the counter wraps around, in the same way as running the
+ * cipher there would.
+ *
+ * This makes ranged access to a ChaCha20-encrypted object cost the
+ * same as the range itself, rather than the whole prefix.
+ *
+ * This is for use with :c:func:`cf_chacha20_cipher` only: a part
+ * block is generated with 20 rounds.  Use :c:func:`cf_chacha12_seek`
+ * or :c:func:`cf_chacha8_seek` with the reduced-round variants.
+ *
+ * :param ctx: chacha20 context.
+ * :param offset: key stream position, in bytes.
+ */
+void cf_chacha20_seek(cf_chacha20_ctx *ctx, uint64_t offset);
+
+/* .. c:function:: $DECL
+ * As :c:func:`cf_chacha20_seek`, for use with :c:func:`cf_chacha12_cipher`.
+ *
+ * :param ctx: chacha20 context.
+ * :param offset: key stream position, in bytes.
+ */
+void cf_chacha12_seek(cf_chacha20_ctx *ctx, uint64_t offset);
+
+/* .. c:function:: $DECL
+ * As :c:func:`cf_chacha20_seek`, for use with :c:func:`cf_chacha8_cipher`.
+ *
+ * :param ctx: chacha20 context.
+ * :param offset: key stream position, in bytes.
+ */
+void cf_chacha8_seek(cf_chacha20_ctx *ctx, uint64_t offset);
+
+/* .. c:function:: $DECL
+ * Encrypts or decrypts one slice of a ChaCha20 message.
+ *
+ * This is :c:func:`cf_chacha20_seek` followed by
+ * :c:func:`cf_chacha20_cipher`, but works on a copy of `ctx`, which
+ * is not modified.  So several threads may share one initialised
+ * context and each process a different slice of a large buffer, in
+ * parallel: for example, thread `t` of `n` might call::
+ *
+ *   cf_chacha20_cipher_slice(&ctx, t * len / n,
+ *                            in + t * len / n, out + t * len / n,
+ *                            (t + 1) * len / n - t * len / n);
+ *
+ * Slices may start and end at any byte, but for best performance
+ * should be multiples of 64 bytes.
+ *
+ * :param ctx: chacha20 context, initialised with any counter value.
+ * :param offset: key stream position of the start of this slice, in bytes.
+ * :param input: input data buffer (read), `count` bytes long.
+ * :param output: output data buffer (written), `count` bytes long.
+ * :param count: length of slice.
+ */
+void cf_chacha20_cipher_slice(const cf_chacha20_ctx *ctx, uint64_t offset,
+                              const uint8_t *input, uint8_t *output, size_t count);
+
+/* .. c:type:: cf_chacha20_item
+ * One message for :c:func:`cf_chacha20_batch`.  This uses the
+ * RFC7539 layout: a 32-bit block counter and a 96-bit nonce.
+ *
+ * .. c:member:: cf_chacha20_item.key
+ * 32 byte key.
+ *
+ * .. c:member:: cf_chacha20_item.nonce
+ * 12 byte nonce.
+ *
+ * .. c:member:: cf_chacha20_item.counter
+ * Block counter for the first 64 bytes of key stream.
+ *
+ * .. c:member:: cf_chacha20_item.in
+ * Input data (read).
+ *
+ * .. c:member:: cf_chacha20_item.out
+ * Output data (written).  This may be the same as `in`.
+ *
+ * .. c:member:: cf_chacha20_item.nbytes
+ * Length of input and output.
+ */
+typedef struct
+{
+  const uint8_t *key;
+  const uint8_t *nonce;
+  uint32_t counter;
+  const uint8_t *in;
+  uint8_t *out;
+  size_t nbytes;
+} cf_chacha20_item;
+
+/* .. c:function:: $DECL
+ * Encrypts or decrypts many independent messages, each with its
+ * own key and nonce.
+ *
+ * Where the CPU has vector instructions for it, short messages are
+ * processed several at a time, one per vector lane, so a batch of
+ * short messages under different keys runs much faster than one at
+ * a time.  Long messages are processed one at a time, using every
+ * lane for that message.
+ *
+ * :param items: messages to process.  See :c:type:`cf_chacha20_item`.
+ * :param nitems: number of messages.
+ */
+void cf_chacha20_batch(cf_chacha20_item *items, size_t nitems);
+
 #endif
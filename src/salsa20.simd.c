@@ -0,0 +1,82 @@
+/*
+ * cifra - embedded cryptography library
+ * Written in 2014 by Joseph Birr-Pixton <jpixton@gmail.com>
+ *
+ * To the extent possible under law, the author(s) have dedicated all
+ * copyright and related and neighboring rights to this software to the
+ * public domain worldwide. This software is distributed without any
+ * warranty.
+ *
+ * You should have received a copy of the CC0 Public Domain Dedication
+ * along with this software. If not, see
+ * <http://creativecommons.org/publicdomain/zero/1.0/>.
+ */
+
+
+/* Multi-block Salsa20 core.  This is included by salsa20.c once for
+ * each vector width, with these defined:
+ *
+ * SALSA_FN: function name.
+ * SALSA_VEC: vector type.
+ * SALSA_LANES: number of 32-bit lanes in SALSA_VEC.
+ * SALSA_ATTR: function attributes.
+ * SALSA_XOR: CF_SIMD_XOR_4X4 or CF_SIMD_XOR_4X8, to match.
+ *
+ * Lane l of each vector works on block l.  in[w * SALSA_LANES + l]
+ * is word w of the input state for block l.  The key stream for
+ * these blocks, one after another, is XORed with 64 * SALSA_LANES
+ * bytes of input and written to output.
+ *
+ * Because each vector holds one state word for several blocks, the
+ * column and row rounds index words exactly as the scalar core does:
+ * nothing needs rotating into diagonal position between rounds.
+ * The only shuffles are in SALSA_XOR, which transposes the result
+ * back into block order.
+ */
+SALSA_ATTR
+static void SALSA_FN(const uint32_t *in,
+                     const uint8_t *input, uint8_t *output)
+{
+  SALSA_VEC x[16];
+
+  for (int w = 0; w < 16; w++)
+    memcpy(&x[w], in + w * SALSA_LANES, sizeof x[w]);
+
+  SALSA_VEC z0 = x[0], z1 = x[1], z2 = x[2], z3 = x[3],
+            z4 = x[4], z5 = x[5], z6 = x[6], z7 = x[7],
+            z8 = x[8], z9 = x[9], za = x[10], zb = x[11],
+            zc = x[12], zd = x[13], ze = x[14], zf = x[15];
+
+  for (int i = 0; i < 10; i++)
+  {
+    VQUARTER(z0, z4, z8, zc);
+    VQUARTER(z5, z9, zd, z1);
+    VQUARTER(za, ze, z2, z6);
+    VQUARTER(zf, z3, z7, zb);
+    VQUARTER(z0, z1, z2, z3);
+    VQUARTER(z5, z6, z7, z4);
+    VQUARTER(za, zb, z8, z9);
+    VQUARTER(zf, zc, zd, ze);
+  }
+
+  x[0] += z0;
+  x[1] += z1;
+  x[2] += z2;
+  x[3] += z3;
+  x[4] += z4;
+  x[5] += z5;
+  x[6] += z6;
+  x[7] += z7;
+  x[8] += z8;
+  x[9] += z9;
+  x[10] += za;
+  x[11] += zb;
+  x[12] += zc;
+  x[13] += zd;
+  x[14] += ze;
+  x[15] += zf;
+
+  for (int w = 0; w < 16; w += 4)
+    SALSA_XOR(x[w], x[w + 1], x[w + 2], x[w + 3],
+              input + 4 * w, output + 4 * w, 64);
+}
@@ -0,0 +1,131 @@
+/*
+ * cifra - embedded cryptography library
+ * Written in 2014 by Joseph Birr-Pixton <jpixton@gmail.com>
+ *
+ * To the extent possible under law, the author(s) have dedicated all
+ * copyright and related and neighboring rights to this software to the
+ * public domain worldwide. This software is distributed without any
+ * warranty.
+ *
+ * You should have received a copy of the CC0 Public Domain Dedication
+ * along with this software. If not, see
+ * <http://creativecommons.org/publicdomain/zero/1.0/>.
+ */
+
+
+#include "secretbox.h"
+#include "salsa20.h"
+#include "poly1305.h"
+#include "handy.h"
+
+#define SUCCESS 0
+#define FAILURE 1
+
+/* cf_secretbox_decrypt MACs then decrypts this many bytes at a time. */
+#define DECRYPT_CHUNK 1024
+
+/* Sets up the cipher and MAC for one message.  The first 32 bytes
+ * of key stream are the Poly1305 key; the message uses the rest. */
+static void secretbox_start(cf_salsa20_ctx *salsa, cf_poly1305 *poly,
+                            const uint8_t key[static 32],
+                            const uint8_t nonce[static 24])
+{
+  uint8_t polykey[32] = { 0 };
+
+  cf_xsalsa20_init(salsa, key, nonce);
+  cf_salsa20_cipher(salsa, polykey, polykey, sizeof polykey);
+  cf_poly1305_init(poly, polykey, polykey + 16);
+  mem_clean(polykey, sizeof polykey);
+}
+
+void cf_secretbox_encrypt(const uint8_t key[static 32],
+                          const uint8_t nonce[static 24],
+                          const uint8_t *plaintext, size_t nbytes,
+                          uint8_t *ciphertext,
+                          uint8_t tag[static 16])
+{
+  cf_salsa20_ctx salsa;
+  cf_poly1305 poly;
+
+  secretbox_start(&salsa, &poly, key, nonce);
+  cf_salsa20_cipher(&salsa, plaintext, ciphertext, nbytes);
+  cf_poly1305_update(&poly, ciphertext, nbytes);
+  cf_poly1305_finish(&poly, tag);
+
+  mem_clean(&salsa, sizeof salsa);
+  mem_clean(&poly, sizeof poly);
+}
+
+int cf_secretbox_decrypt(const uint8_t key[static 32],
+                         const uint8_t nonce[static 24],
+                         const uint8_t *ciphertext, size_t nbytes,
+                         const uint8_t tag[static 16],
+                         uint8_t *plaintext)
+{
+  cf_salsa20_ctx salsa;
+  cf_poly1305 poly;
+  uint8_t ourtag[16], checktag[16];
+
+  /* tag may be in the buffer we're writing. */
+  memcpy(ourtag, tag, sizeof ourtag);
+
+  secretbox_start(&salsa, &poly, key, nonce);
+
+  /* MAC before decrypting: ciphertext and plaintext may be the same. */
+  const uint8_t *in = ciphertext;
+  uint8_t *out = plaintext;
+  size_t len = nbytes;
+
+  while (len)
+  {
+    size_t take = MIN(len, (size_t) DECRYPT_CHUNK);
+    cf_poly1305_update(&poly, in, take);
+    cf_salsa20_cipher(&salsa, in, out, take);
+    in += take;
+    out += take;
+    len -= take;
+  }
+
+  cf_poly1305_finish(&poly, checktag);
+
+  int err = SUCCESS;
+  if (!mem_eq(checktag, ourtag, sizeof checktag))
+  {
+    mem_clean(plaintext, nbytes);
+    err = FAILURE;
+  }
+
+  mem_clean(&salsa, sizeof salsa);
+  mem_clean(&poly, sizeof poly);
+  mem_clean(checktag, sizeof checktag);
+  return err;
+}
+
+void cf_secretbox_seal(const uint8_t key[static 32],
+                       const uint8_t nonce[static 24],
+                       const uint8_t *plaintext, size_t nbytes,
+                       uint8_t *boxed)
+{
+  uint8_t tag[CF_SECRETBOX_TAGLEN];
+
+  cf_secretbox_encrypt(key, nonce,
+                       plaintext, nbytes,
+                       boxed + CF_SECRETBOX_TAGLEN,
+                       tag);
+  memcpy(boxed, tag, sizeof tag);
+}
+
+int cf_secretbox_open(const uint8_t key[static 32],
+                      const uint8_t nonce[static 24],
+                      const uint8_t *boxed, size_t nboxed,
+                      uint8_t *plaintext)
+{
+  if (nboxed < CF_SECRETBOX_TAGLEN)
+    return FAILURE;
+
+  return cf_secretbox_decrypt(key, nonce,
+                              boxed + CF_SECRETBOX_TAGLEN,
+                              nboxed - CF_SECRETBOX_TAGLEN,
+                              boxed,
+                              plaintext);
+}
@@ -0,0 +1,119 @@
+/*
+ * cifra - embedded cryptography library
+ * Written in 2014 by Joseph Birr-Pixton <jpixton@gmail.com>
+ *
+ * To the extent possible under law, the author(s) have dedicated all
+ * copyright and related and neighboring rights to this software to the
+ * public domain worldwide. This software is distributed without any
+ * warranty.
+ *
+ * You should have received a copy of the CC0 Public Domain Dedication
+ * along with this software. If not, see
+ * <http://creativecommons.org/publicdomain/zero/1.0/>.
+ */
+
+
+#ifndef SECRETBOX_H
+#define SECRETBOX_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * The XSalsa20-Poly1305 secretbox
+ * ===============================
+ * This is NaCl's `crypto_secretbox` construction: XSalsa20 for
+ * encryption and Poly1305 over the ciphertext for authentication.
+ * The Poly1305 key is the first 32 bytes of the XSalsa20 key stream,
+ * and the message is encrypted with the key stream after it.
+ *
+ * It uses a 256-bit key and a 192-bit nonce.  The nonce is large
+ * enough to be chosen at random.
+ *
+ * Results are byte-for-byte compatible with NaCl and libsodium.
+ * :c:func:`cf_secretbox_seal` and :c:func:`cf_secretbox_open` use the
+ * combined format of libsodium's `crypto_secretbox_easy` (tag, then
+ * ciphertext); the other functions keep the tag separate, like
+ * `crypto_secretbox_detached`.
+ *
+ * This is a one-shot interface.
+ */
+
+/* .. c:macro:: CF_SECRETBOX_TAGLEN
+ * Length of a secretbox authentication tag, in bytes.
+ */
+#define CF_SECRETBOX_TAGLEN 16
+
+/* .. c:function:: $DECL
+ * Secretbox authenticated encryption.
+ *
+ * :param key: key material.
+ * :param nonce: per-message nonce.
+ * :param plaintext: plaintext bytes to be encrypted.
+ * :param nbytes: number of plaintext/ciphertext bytes.
+ * :param ciphertext: ciphertext output buffer, nbytes in length.
+ * :param tag: authentication tag output buffer.
+ */
+void cf_secretbox_encrypt(const uint8_t key[static 32],
+                          const uint8_t nonce[static 24],
+                          const uint8_t *plaintext, size_t nbytes,
+                          uint8_t *ciphertext,
+                          uint8_t tag[static 16]);
+
+/* .. c:function:: $DECL
+ * Secretbox authenticated decryption.
+ *
+ * :return: 0 on success, non-zero on error.  Plaintext is zeroed on error.
+ *
+ * :param key: key material.
+ * :param nonce: per-message nonce.
+ * :param ciphertext: ciphertext bytes to be decrypted.
+ * :param nbytes: number of plaintext/ciphertext bytes.
+ * :param tag: authentication tag.
+ * :param plaintext: plaintext output buffer, nbytes in length.
+ */
+int cf_secretbox_decrypt(const uint8_t key[static 32],
+                         const uint8_t nonce[static 24],
+                         const uint8_t *ciphertext, size_t nbytes,
+                         const uint8_t tag[static 16],
+                         uint8_t *plaintext);
+
+/* .. c:function:: $DECL
+ * Secretbox authenticated encryption, in combined format.
+ *
+ * `boxed` receives the tag followed by the ciphertext, and must be
+ * `nbytes + CF_SECRETBOX_TAGLEN` bytes long.  `plaintext` and the
+ * ciphertext part of `boxed` may overlap exactly.
+ *
+ * :param key: key material.
+ * :param nonce: per-message nonce.
+ * :param plaintext: plaintext bytes to be encrypted.
+ * :param nbytes: number of plaintext bytes.
+ * :param boxed: output buffer.
+ */
+void cf_secretbox_seal(const uint8_t key[static 32],
+                       const uint8_t nonce[static 24],
+                       const uint8_t *plaintext, size_t nbytes,
+                       uint8_t *boxed);
+
+/* .. c:function:: $DECL
+ * Secretbox authenticated decryption, in combined format.
+ *
+ * `boxed` is the tag followed by the ciphertext.  `plaintext` must
+ * be `nboxed - CF_SECRETBOX_TAGLEN` bytes long.
+ *
+ * :return: 0 on success, non-zero on error (including if `nboxed`
+ *          is shorter than a tag).  Plaintext is zeroed on error.
+ *
+ * :param key: key material.
+ * :param nonce: per-message nonce.
+ * :param boxed: tag and ciphertext.
+ * :param nboxed: length of `boxed`.
+ * :param plaintext: plaintext output buffer.
+ */
+int cf_secretbox_open(const uint8_t key[static 32],
+                      const uint8_t nonce[static 24],
+                      const uint8_t *boxed, size_t nboxed,
+                      uint8_t *plaintext);
+
+#endif
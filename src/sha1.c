@@ -19,6 +19,7 @@
 #include "bitops.h"
 #include "handy.h"
 #include "tassert.h"
+#include "simd.h"
 
 void cf_sha1_init(cf_sha1_context *ctx)
 {
@@ -30,10 +31,89 @@ void cf_sha1_init(cf_sha1_context *ctx)
   ctx->H[4] = 0xc3d2e1f0;
 }
 
+#if CF_SIMD && CF_SIMD_HAVE_SHANI
+/* One block with the SHA extensions.  A is in the top lane of abcd,
+ * and E in the top lane of e. */
+CF_SIMD_SHANI
+static void sha1_update_block_shani(uint32_t H[5], const uint8_t *inp)
+{
+  const __m128i bswap = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+
+  __m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *) &H[0]), 0x1b),
+          e = _mm_set_epi32((int) H[4], 0, 0, 0);
+  __m128i abcd_in = abcd,
+          e_in = e,
+          prev = abcd;
+
+  __m128i m0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (inp + 0)), bswap),
+          m1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (inp + 16)), bswap),
+          m2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (inp + 32)), bswap),
+          m3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (inp + 48)), bswap);
+
+  /* Four rounds, t = 4i to 4i + 3, with round function f.  wa holds
+   * W[t - 16] on entry and W[t] on exit; wb, wc and wd are the
+   * following groups.  E for each group after the first comes from
+   * A four rounds earlier. */
+#define ROUNDS4(wa, wb, wc, wd, i, f)                                   \
+  do {                                                                  \
+    if (i >= 4)                                                         \
+    {                                                                   \
+      wa = _mm_xor_si128(_mm_sha1msg1_epu32(wa, wb), wc);               \
+      wa = _mm_sha1msg2_epu32(wa, wd);                                  \
+    }                                                                   \
+    __m128i ew = (i == 0) ? _mm_add_epi32(e, wa)                        \
+                          : _mm_sha1nexte_epu32(prev, wa);              \
+    prev = abcd;                                                        \
+    abcd = _mm_sha1rnds4_epu32(abcd, ew, f);                            \
+  } while (0)
+
+  ROUNDS4(m0, m1, m2, m3, 0, 0);
+  ROUNDS4(m1, m2, m3, m0, 1, 0);
+  ROUNDS4(m2, m3, m0, m1, 2, 0);
+  ROUNDS4(m3, m0, m1, m2, 3, 0);
+  ROUNDS4(m0, m1, m2, m3, 4, 0);
+
+  ROUNDS4(m1, m2, m3, m0, 5, 1);
+  ROUNDS4(m2, m3, m0, m1, 6, 1);
+  ROUNDS4(m3, m0, m1, m2, 7, 1);
+  ROUNDS4(m0, m1, m2, m3, 8, 1);
+  ROUNDS4(m1, m2, m3, m0, 9, 1);
+
+  ROUNDS4(m2, m3, m0, m1, 10, 2);
+  ROUNDS4(m3, m0, m1, m2, 11, 2);
+  ROUNDS4(m0, m1, m2, m3, 12, 2);
+  ROUNDS4(m1, m2, m3, m0, 13, 2);
+  ROUNDS4(m2, m3, m0, m1, 14, 2);
+
+  ROUNDS4(m3, m0, m1, m2, 15, 3);
+  ROUNDS4(m0, m1, m2, m3, 16, 3);
+  ROUNDS4(m1, m2, m3, m0, 17, 3);
+  ROUNDS4(m2, m3, m0, m1, 18, 3);
+  ROUNDS4(m3, m0, m1, m2, 19, 3);
+
+#undef ROUNDS4
+
+  e = _mm_sha1nexte_epu32(prev, e_in);
+  abcd = _mm_add_epi32(abcd, abcd_in);
+
+  _mm_storeu_si128((__m128i *) &H[0], _mm_shuffle_epi32(abcd, 0x1b));
+  H[4] = (uint32_t) _mm_extract_epi32(e, 3);
+}
+#endif
+
 static void sha1_update_block(void *vctx, const uint8_t *inp)
 {
   cf_sha1_context *ctx = vctx;
 
+#if CF_SIMD && CF_SIMD_HAVE_SHANI
+  if (cf_simd_have_shani())
+  {
+    sha1_update_block_shani(ctx->H, inp);
+    ctx->blocks++;
+    return;
+  }
+#endif
+
   /* This is a 16-word window into the whole W array. */
   uint32_t W[16];
 
@@ -126,6 +126,111 @@ extern const cf_chash cf_sha224;
  */
 extern const cf_chash cf_sha256;
 
+/**
+ * Many messages
+ * -------------
+ * These hash many independent messages at once.  Where the CPU has
+ * vector instructions for it, and no SHA extensions, each message
+ * is given a lane of the vector registers: four lanes with SSE2 or
+ * NEON, or eight with AVX2.  Messages in different lanes may be
+ * different lengths: when one finishes, the next message takes over
+ * its lane.  On CPUs with the SHA extensions, messages are hashed
+ * one at a time, as that is quicker.
+ *
+ * Use :c:func:`cf_sha256_batch` when all the messages are to hand,
+ * or a :c:type:`cf_sha256_mb` queue when they arrive one by one.
+ */
+
+/* .. c:type:: cf_sha256_item
+ * One message to hash.
+ *
+ * .. c:member:: cf_sha256_item.msg
+ * Message (read).
+ *
+ * .. c:member:: cf_sha256_item.nmsg
+ * Length of message.
+ *
+ * .. c:member:: cf_sha256_item.hash
+ * `CF_SHA256_HASHSZ` bytes of output.
+ */
+typedef struct
+{
+  const void *msg;
+  size_t nmsg;
+  uint8_t *hash;
+} cf_sha256_item;
+
+/* .. c:function:: $DECL
+ * Computes the SHA256 hash of each of `nitems` messages.
+ */
+extern void cf_sha256_batch(cf_sha256_item *items, size_t nitems);
+
+/* .. c:macro:: CF_SHA256_MB_LANES
+ * The most messages a :c:type:`cf_sha256_mb` hashes at once. */
+#define CF_SHA256_MB_LANES 8
+
+/* .. c:type:: cf_sha256_mb
+ * Queue of messages being hashed together.  Items are added with
+ * :c:func:`cf_sha256_mb_submit`, and are hashed whenever every lane
+ * is full.  :c:func:`cf_sha256_mb_flush` finishes the rest.
+ *
+ * An item's hash is written at some point between submitting it
+ * and the next flush.  Until then, the item and its message must
+ * not be changed or freed.
+ *
+ * .. c:member:: cf_sha256_mb.H
+ * Intermediate values: `H[i][l]` is word `i` for lane `l`.
+ *
+ * .. c:member:: cf_sha256_mb.item
+ * The message in each lane, or NULL for an idle lane.
+ *
+ * .. c:member:: cf_sha256_mb.ptr
+ * Next block for each lane.
+ *
+ * .. c:member:: cf_sha256_mb.nbody
+ * Number of whole blocks of the message left to hash, for each lane.
+ *
+ * .. c:member:: cf_sha256_mb.ntail
+ * Number of padded final blocks left to hash, for each lane.
+ *
+ * .. c:member:: cf_sha256_mb.tail
+ * Padded final blocks, for each lane.
+ *
+ * .. c:member:: cf_sha256_mb.nlanes
+ * Number of lanes in use on this CPU.
+ *
+ * .. c:member:: cf_sha256_mb.nbusy
+ * Number of non-idle lanes.
+ */
+typedef struct
+{
+  uint32_t H[8][CF_SHA256_MB_LANES];
+  cf_sha256_item *item[CF_SHA256_MB_LANES];
+  const uint8_t *ptr[CF_SHA256_MB_LANES];
+  size_t nbody[CF_SHA256_MB_LANES];
+  unsigned ntail[CF_SHA256_MB_LANES];
+  uint8_t tail[CF_SHA256_MB_LANES][2 * CF_SHA256_BLOCKSZ];
+  unsigned nlanes;
+  unsigned nbusy;
+} cf_sha256_mb;
+
+/* .. c:function:: $DECL
+ * Sets up an empty queue.
+ */
+extern void cf_sha256_mb_init(cf_sha256_mb *mb);
+
+/* .. c:function:: $DECL
+ * Adds `item` to the queue.  If this fills the last idle lane, the
+ * queue is hashed until a lane is idle again.
+ */
+extern void cf_sha256_mb_submit(cf_sha256_mb *mb, cf_sha256_item *item);
+
+/* .. c:function:: $DECL
+ * Finishes hashing every item in the queue.  The queue is then empty,
+ * and may be used again.
+ */
+extern void cf_sha256_mb_flush(cf_sha256_mb *mb);
+
 /**
  * SHA384/SHA512
  * =============
@@ -232,4 +337,114 @@ extern const cf_chash cf_sha384;
  */
 extern const cf_chash cf_sha512;
 
+
+/**
+ * Many messages
+ * -------------
+ * As for SHA256, these hash many independent messages at once.  On
+ * CPUs with AVX2, each message is given one of four 64-bit lanes;
+ * elsewhere, messages are hashed one at a time.  A queue hashes
+ * either SHA384 or SHA512, chosen when it is set up.
+ */
+
+/* .. c:type:: cf_sha512_item
+ * One message to hash.
+ *
+ * .. c:member:: cf_sha512_item.msg
+ * Message (read).
+ *
+ * .. c:member:: cf_sha512_item.nmsg
+ * Length of message.
+ *
+ * .. c:member:: cf_sha512_item.hash
+ * `CF_SHA512_HASHSZ` bytes of output, or `CF_SHA384_HASHSZ` for
+ * SHA384.
+ */
+typedef struct
+{
+  const void *msg;
+  size_t nmsg;
+  uint8_t *hash;
+} cf_sha512_item;
+
+/* .. c:function:: $DECL
+ * Computes the SHA384 hash of each of `nitems` messages.
+ */
+extern void cf_sha384_batch(cf_sha512_item *items, size_t nitems);
+
+/* .. c:function:: $DECL
+ * Computes the SHA512 hash of each of `nitems` messages.
+ */
+extern void cf_sha512_batch(cf_sha512_item *items, size_t nitems);
+
+/* .. c:macro:: CF_SHA512_MB_LANES
+ * The most messages a :c:type:`cf_sha512_mb` hashes at once. */
+#define CF_SHA512_MB_LANES 4
+
+/* .. c:type:: cf_sha512_mb
+ * Queue of messages being hashed together.  This works like
+ * :c:type:`cf_sha256_mb`.
+ *
+ * .. c:member:: cf_sha512_mb.H
+ * Intermediate values: `H[i][l]` is word `i` for lane `l`.
+ *
+ * .. c:member:: cf_sha512_mb.item
+ * The message in each lane, or NULL for an idle lane.
+ *
+ * .. c:member:: cf_sha512_mb.ptr
+ * Next block for each lane.
+ *
+ * .. c:member:: cf_sha512_mb.nbody
+ * Number of whole blocks of the message left to hash, for each lane.
+ *
+ * .. c:member:: cf_sha512_mb.ntail
+ * Number of padded final blocks left to hash, for each lane.
+ *
+ * .. c:member:: cf_sha512_mb.tail
+ * Padded final blocks, for each lane.
+ *
+ * .. c:member:: cf_sha512_mb.hashsz
+ * Output size: `CF_SHA384_HASHSZ` or `CF_SHA512_HASHSZ`.
+ *
+ * .. c:member:: cf_sha512_mb.nlanes
+ * Number of lanes in use on this CPU.
+ *
+ * .. c:member:: cf_sha512_mb.nbusy
+ * Number of non-idle lanes.
+ */
+typedef struct
+{
+  uint64_t H[8][CF_SHA512_MB_LANES];
+  cf_sha512_item *item[CF_SHA512_MB_LANES];
+  const uint8_t *ptr[CF_SHA512_MB_LANES];
+  size_t nbody[CF_SHA512_MB_LANES];
+  unsigned ntail[CF_SHA512_MB_LANES];
+  uint8_t tail[CF_SHA512_MB_LANES][2 * CF_SHA512_BLOCKSZ];
+  unsigned hashsz;
+  unsigned nlanes;
+  unsigned nbusy;
+} cf_sha512_mb;
+
+/* .. c:function:: $DECL
+ * Sets up an empty queue for SHA384.
+ */
+extern void cf_sha384_mb_init(cf_sha512_mb *mb);
+
+/* .. c:function:: $DECL
+ * Sets up an empty queue for SHA512.
+ */
+extern void cf_sha512_mb_init(cf_sha512_mb *mb);
+
+/* .. c:function:: $DECL
+ * Adds `item` to the queue.  If this fills the last idle lane, the
+ * queue is hashed until a lane is idle again.
+ */
+extern void cf_sha512_mb_submit(cf_sha512_mb *mb, cf_sha512_item *item);
+
+/* .. c:function:: $DECL
+ * Finishes hashing every item in the queue.  The queue is then empty,
+ * and may be used again.
+ */
+extern void cf_sha512_mb_flush(cf_sha512_mb *mb);
+
 #endif
@@ -19,6 +19,7 @@
 #include "bitops.h"
 #include "handy.h"
 #include "tassert.h"
+#include "simd.h"
 
 static const uint32_t K[64] = {
   0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
@@ -46,17 +47,15 @@ static const uint32_t K[64] = {
 # define SSIG0(x) (rotr32((x), 7) ^ rotr32((x), 18) ^ ((x) >> 3))
 # define SSIG1(x) (rotr32((x), 17) ^ rotr32((x), 19) ^ ((x) >> 10))
 
+static const uint32_t sha256_iv[8] = {
+  0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+  0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
 void cf_sha256_init(cf_sha256_context *ctx)
 {
   memset(ctx, 0, sizeof *ctx);
-  ctx->H[0] = 0x6a09e667;
-  ctx->H[1] = 0xbb67ae85;
-  ctx->H[2] = 0x3c6ef372;
-  ctx->H[3] = 0xa54ff53a;
-  ctx->H[4] = 0x510e527f;
-  ctx->H[5] = 0x9b05688c;
-  ctx->H[6] = 0x1f83d9ab;
-  ctx->H[7] = 0x5be0cd19;
+  memcpy(ctx->H, sha256_iv, sizeof ctx->H);
 }
 
 void cf_sha224_init(cf_sha256_context *ctx)
@@ -72,21 +71,76 @@ void cf_sha224_init(cf_sha256_context *ctx)
   ctx->H[7] = 0xbefa4fa4;
 }
 
-static void sha256_update_block(void *vctx, const uint8_t *inp)
+#if CF_SIMD && CF_SIMD_HAVE_SHANI
+/* One block with the SHA extensions.  The state is kept as ABEF and
+ * CDGH, which is the order sha256rnds2 wants. */
+CF_SIMD_SHANI
+static void sha256_compress_shani(uint32_t H[8], const uint8_t *inp)
 {
-  cf_sha256_context *ctx = vctx;
+  const __m128i bswap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+  __m128i dcba = _mm_loadu_si128((const __m128i *) &H[0]),
+          hgfe = _mm_loadu_si128((const __m128i *) &H[4]);
+  __m128i cdab = _mm_shuffle_epi32(dcba, 0xb1),
+          efgh = _mm_shuffle_epi32(hgfe, 0x1b);
+  __m128i abef = _mm_alignr_epi8(cdab, efgh, 8),
+          cdgh = _mm_blend_epi16(efgh, cdab, 0xf0);
+  __m128i abef_in = abef,
+          cdgh_in = cdgh;
+
+  __m128i m0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (inp + 0)), bswap),
+          m1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (inp + 16)), bswap),
+          m2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (inp + 32)), bswap),
+          m3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (inp + 48)), bswap);
+
+  /* Four rounds, t = 4i to 4i + 3.  wa holds W[t - 16] on entry
+   * and W[t] on exit; wb, wc and wd are the following groups. */
+#define ROUNDS4(wa, wb, wc, wd, i)                                      \
+  do {                                                                  \
+    if (i >= 4)                                                         \
+    {                                                                   \
+      wa = _mm_add_epi32(_mm_sha256msg1_epu32(wa, wb),                  \
+                         _mm_alignr_epi8(wd, wc, 4));                   \
+      wa = _mm_sha256msg2_epu32(wa, wd);                                \
+    }                                                                   \
+    __m128i wk = _mm_add_epi32(wa, _mm_loadu_si128((const __m128i *) &K[4 * (i)])); \
+    cdgh = _mm_sha256rnds2_epu32(cdgh, abef, wk);                       \
+    abef = _mm_sha256rnds2_epu32(abef, cdgh, _mm_shuffle_epi32(wk, 0x0e)); \
+  } while (0)
+
+  for (int i = 0; i < 16; i += 4)
+  {
+    ROUNDS4(m0, m1, m2, m3, i);
+    ROUNDS4(m1, m2, m3, m0, i + 1);
+    ROUNDS4(m2, m3, m0, m1, i + 2);
+    ROUNDS4(m3, m0, m1, m2, i + 3);
+  }
 
+#undef ROUNDS4
+
+  abef = _mm_add_epi32(abef, abef_in);
+  cdgh = _mm_add_epi32(cdgh, cdgh_in);
+
+  __m128i feba = _mm_shuffle_epi32(abef, 0x1b),
+          dchg = _mm_shuffle_epi32(cdgh, 0xb1);
+  _mm_storeu_si128((__m128i *) &H[0], _mm_blend_epi16(feba, dchg, 0xf0));
+  _mm_storeu_si128((__m128i *) &H[4], _mm_alignr_epi8(dchg, feba, 8));
+}
+#endif
+
+static void sha256_compress(uint32_t H[8], const uint8_t *inp)
+{
   /* This is a 16-word window into the whole W array. */
   uint32_t W[16];
 
-  uint32_t a = ctx->H[0],
-           b = ctx->H[1],
-           c = ctx->H[2],
-           d = ctx->H[3],
-           e = ctx->H[4],
-           f = ctx->H[5],
-           g = ctx->H[6],
-           h = ctx->H[7],
+  uint32_t a = H[0],
+           b = H[1],
+           c = H[2],
+           d = H[3],
+           e = H[4],
+           f = H[5],
+           g = H[6],
+           h = H[7],
            Wt;
 
   for (size_t t = 0; t < 64; t++)
@@ -122,15 +176,34 @@ static void sha256_update_block(void *vctx, const uint8_t *inp)
     a = T1 + T2;
   }
 
-  ctx->H[0] += a;
-  ctx->H[1] += b;
-  ctx->H[2] += c;
-  ctx->H[3] += d;
-  ctx->H[4] += e;
-  ctx->H[5] += f;
-  ctx->H[6] += g;
-  ctx->H[7] += h;
+  H[0] += a;
+  H[1] += b;
+  H[2] += c;
+  H[3] += d;
+  H[4] += e;
+  H[5] += f;
+  H[6] += g;
+  H[7] += h;
+}
 
+/* One block, with the fastest compression function this CPU has. */
+static void sha256_block(uint32_t H[8], const uint8_t *inp)
+{
+#if CF_SIMD && CF_SIMD_HAVE_SHANI
+  if (cf_simd_have_shani())
+  {
+    sha256_compress_shani(H, inp);
+    return;
+  }
+#endif
+
+  sha256_compress(H, inp);
+}
+
+static void sha256_update_block(void *vctx, const uint8_t *inp)
+{
+  cf_sha256_context *ctx = vctx;
+  sha256_block(ctx->H, inp);
   ctx->blocks++;
 }
 
@@ -213,6 +286,183 @@ void cf_sha224_digest_final(cf_sha256_context *ctx, uint8_t hash[CF_SHA224_HASHS
   memcpy(hash, full, CF_SHA224_HASHSZ);
 }
 
+#if CF_SIMD
+#define VROTR(x, n) CF_SIMD_ROTL32(x, 32 - (n))
+#define VBSIG0(x) (VROTR((x), 2) ^ VROTR((x), 13) ^ VROTR((x), 22))
+#define VBSIG1(x) (VROTR((x), 6) ^ VROTR((x), 11) ^ VROTR((x), 25))
+#define VSSIG0(x) (VROTR((x), 7) ^ VROTR((x), 18) ^ ((x) >> 3))
+#define VSSIG1(x) (VROTR((x), 17) ^ VROTR((x), 19) ^ ((x) >> 10))
+
+#define SHA256_FN sha256_compress_x4
+#define SHA256_VEC cf_u32x4
+#define SHA256_LANES 4
+#define SHA256_ATTR
+#include "sha256.simd.c"
+#undef SHA256_FN
+#undef SHA256_VEC
+#undef SHA256_LANES
+#undef SHA256_ATTR
+
+#if CF_SIMD_HAVE_AVX2
+#define SHA256_FN sha256_compress_x8
+#define SHA256_VEC cf_u32x8
+#define SHA256_LANES 8
+#define SHA256_ATTR CF_SIMD_AVX2
+#include "sha256.simd.c"
+#undef SHA256_FN
+#undef SHA256_VEC
+#undef SHA256_LANES
+#undef SHA256_ATTR
+#endif
+
+#undef VROTR
+#undef VBSIG0
+#undef VBSIG1
+#undef VSSIG0
+#undef VSSIG1
+#endif
+
+void cf_sha256_mb_init(cf_sha256_mb *mb)
+{
+  memset(mb, 0, sizeof *mb);
+  mb->nlanes = 1;
+
+#if CF_SIMD
+  mb->nlanes = 4;
+# if CF_SIMD_HAVE_AVX2
+  if (cf_simd_have_avx2())
+    mb->nlanes = 8;
+# endif
+# if CF_SIMD_HAVE_SHANI
+  if (cf_simd_have_shani())
+    mb->nlanes = 1;
+# endif
+#endif
+}
+
+/* Starts hashing item in idle lane l.  The message's final partial
+ * block is padded into one or two blocks in tail[l]. */
+static void sha256_mb_start(cf_sha256_mb *mb, unsigned l, cf_sha256_item *item)
+{
+  const uint8_t *msg = item->msg;
+  size_t nbody = item->nmsg / CF_SHA256_BLOCKSZ,
+         rem = item->nmsg % CF_SHA256_BLOCKSZ;
+  uint8_t *tail = mb->tail[l];
+  unsigned ntail = rem + 1 + 8 > CF_SHA256_BLOCKSZ ? 2 : 1;
+
+  memset(tail, 0, sizeof mb->tail[l]);
+  memcpy(tail, msg + nbody * CF_SHA256_BLOCKSZ, rem);
+  tail[rem] = 0x80;
+  write64_be((uint64_t) item->nmsg * 8, tail + ntail * CF_SHA256_BLOCKSZ - 8);
+
+  for (int i = 0; i < 8; i++)
+    mb->H[i][l] = sha256_iv[i];
+
+  mb->item[l] = item;
+  mb->ptr[l] = nbody ? msg : tail;
+  mb->nbody[l] = nbody;
+  mb->ntail[l] = ntail;
+  mb->nbusy++;
+}
+
+/* Hashes one block in every busy lane, and retires lanes whose
+ * messages are finished. */
+static void sha256_mb_step(cf_sha256_mb *mb)
+{
+  static const uint8_t idle[CF_SHA256_BLOCKSZ];
+  const uint8_t *inp[CF_SHA256_MB_LANES];
+
+  for (unsigned l = 0; l < mb->nlanes; l++)
+    inp[l] = mb->item[l] ? mb->ptr[l] : idle;
+
+#if CF_SIMD
+# if CF_SIMD_HAVE_AVX2
+  if (mb->nlanes == 8)
+  {
+    sha256_compress_x8(mb->H, inp);
+    cf_simd_avx2_leave();
+  } else
+# endif
+  sha256_compress_x4(mb->H, inp);
+#else
+  for (unsigned l = 0; l < mb->nlanes; l++)
+  {
+    uint32_t H[8];
+
+    for (int i = 0; i < 8; i++)
+      H[i] = mb->H[i][l];
+    sha256_block(H, inp[l]);
+    for (int i = 0; i < 8; i++)
+      mb->H[i][l] = H[i];
+  }
+#endif
+
+  for (unsigned l = 0; l < mb->nlanes; l++)
+  {
+    cf_sha256_item *item = mb->item[l];
+
+    if (item == NULL)
+      continue;
+
+    if (mb->nbody[l])
+    {
+      mb->nbody[l]--;
+      mb->ptr[l] = mb->nbody[l] ? mb->ptr[l] + CF_SHA256_BLOCKSZ : mb->tail[l];
+      continue;
+    }
+
+    mb->ptr[l] += CF_SHA256_BLOCKSZ;
+    if (--mb->ntail[l])
+      continue;
+
+    for (int i = 0; i < 8; i++)
+      write32_be(mb->H[i][l], item->hash + 4 * i);
+
+    mem_clean(mb->tail[l], sizeof mb->tail[l]);
+    mb->item[l] = NULL;
+    mb->nbusy--;
+  }
+}
+
+void cf_sha256_mb_submit(cf_sha256_mb *mb, cf_sha256_item *item)
+{
+  if (mb->nlanes == 1)
+  {
+    cf_sha256_context ctx;
+    cf_sha256_init(&ctx);
+    cf_sha256_update(&ctx, item->msg, item->nmsg);
+    cf_sha256_digest_final(&ctx, item->hash);
+    return;
+  }
+
+  unsigned l = 0;
+  while (mb->item[l])
+    l++;
+
+  sha256_mb_start(mb, l, item);
+
+  while (mb->nbusy == mb->nlanes)
+    sha256_mb_step(mb);
+}
+
+void cf_sha256_mb_flush(cf_sha256_mb *mb)
+{
+  while (mb->nbusy)
+    sha256_mb_step(mb);
+
+  mem_clean(mb->H, sizeof mb->H);
+}
+
+void cf_sha256_batch(cf_sha256_item *items, size_t nitems)
+{
+  cf_sha256_mb mb;
+
+  cf_sha256_mb_init(&mb);
+  for (size_t i = 0; i < nitems; i++)
+    cf_sha256_mb_submit(&mb, &items[i]);
+  cf_sha256_mb_flush(&mb);
+}
+
 const cf_chash cf_sha224 = {
   .hashsz = CF_SHA224_HASHSZ,
   .blocksz = CF_SHA256_BLOCKSZ,
@@ -0,0 +1,82 @@
+/*
+ * cifra - embedded cryptography library
+ * Written in 2014 by Joseph Birr-Pixton <jpixton@gmail.com>
+ *
+ * To the extent possible under law, the author(s) have dedicated all
+ * copyright and related and neighboring rights to this software to the
+ * public domain worldwide. This software is distributed without any
+ * warranty.
+ *
+ * You should have received a copy of the CC0 Public Domain Dedication
+ * along with this software. If not, see
+ * <http://creativecommons.org/publicdomain/zero/1.0/>.
+ */
+
+/* Multi-lane SHA-256 compression function.  This is included by
+ * sha256.c once for each vector width, with these defined:
+ *
+ * SHA256_FN: function name.
+ * SHA256_VEC: vector type.
+ * SHA256_LANES: number of 32-bit lanes in SHA256_VEC.
+ * SHA256_ATTR: function attributes.
+ *
+ * Lane l of each vector works on a different message.  H[i][l] is
+ * word i of the state for lane l, and inp[l] is the next block of
+ * that lane's message.
+ */
+SHA256_ATTR
+static void SHA256_FN(uint32_t H[8][CF_SHA256_MB_LANES],
+                      const uint8_t *const inp[SHA256_LANES])
+{
+  SHA256_VEC W[16], S[8];
+
+  for (int i = 0; i < 8; i++)
+    memcpy(&S[i], H[i], sizeof S[i]);
+
+  SHA256_VEC a = S[0], b = S[1], c = S[2], d = S[3],
+             e = S[4], f = S[5], g = S[6], h = S[7],
+             Wt;
+
+  for (size_t t = 0; t < 64; t++)
+  {
+    /* As sha256_compress, with each word of the message schedule
+     * gathered from every lane's block. */
+    if (t < 16)
+    {
+      uint32_t col[SHA256_LANES];
+      for (int l = 0; l < SHA256_LANES; l++)
+        col[l] = read32_be(inp[l] + 4 * t);
+      memcpy(&Wt, col, sizeof Wt);
+      W[t] = Wt;
+    } else {
+      Wt = VSSIG1(W[(t - 2) % 16]) +
+           W[(t - 7) % 16] +
+           VSSIG0(W[(t - 15) % 16]) +
+           W[(t - 16) % 16];
+      W[t % 16] = Wt;
+    }
+
+    SHA256_VEC T1 = h + VBSIG1(e) + CH(e, f, g) + K[t] + Wt;
+    SHA256_VEC T2 = VBSIG0(a) + MAJ(a, b, c);
+    h = g;
+    g = f;
+    f = e;
+    e = d + T1;
+    d = c;
+    c = b;
+    b = a;
+    a = T1 + T2;
+  }
+
+  S[0] += a;
+  S[1] += b;
+  S[2] += c;
+  S[3] += d;
+  S[4] += e;
+  S[5] += f;
+  S[6] += g;
+  S[7] += h;
+
+  for (int i = 0; i < 8; i++)
+    memcpy(H[i], &S[i], sizeof S[i]);
+}
@@ -19,6 +19,7 @@
 #include "bitops.h"
 #include "handy.h"
 #include "tassert.h"
+#include "simd.h"
 
 static const uint64_t K[80] = {
   UINT64_C(0x428a2f98d728ae22), UINT64_C(0x7137449123ef65cd),
@@ -70,46 +71,214 @@ static const uint64_t K[80] = {
 # define SSIG0(x) (rotr64((x), 1) ^ rotr64((x), 8) ^ ((x) >> 7))
 # define SSIG1(x) (rotr64((x), 19) ^ rotr64((x), 61) ^ ((x) >> 6))
 
+static const uint64_t sha512_iv[8] = {
+  UINT64_C(0x6a09e667f3bcc908), UINT64_C(0xbb67ae8584caa73b),
+  UINT64_C(0x3c6ef372fe94f82b), UINT64_C(0xa54ff53a5f1d36f1),
+  UINT64_C(0x510e527fade682d1), UINT64_C(0x9b05688c2b3e6c1f),
+  UINT64_C(0x1f83d9abfb41bd6b), UINT64_C(0x5be0cd19137e2179)
+};
+
+static const uint64_t sha384_iv[8] = {
+  UINT64_C(0xcbbb9d5dc1059ed8), UINT64_C(0x629a292a367cd507),
+  UINT64_C(0x9159015a3070dd17), UINT64_C(0x152fecd8f70e5939),
+  UINT64_C(0x67332667ffc00b31), UINT64_C(0x8eb44a8768581511),
+  UINT64_C(0xdb0c2e0d64f98fa7), UINT64_C(0x47b5481dbefa4fa4)
+};
+
 void cf_sha512_init(cf_sha512_context *ctx)
 {
   memset(ctx, 0, sizeof *ctx);
-  ctx->H[0] = UINT64_C(0x6a09e667f3bcc908);
-  ctx->H[1] = UINT64_C(0xbb67ae8584caa73b);
-  ctx->H[2] = UINT64_C(0x3c6ef372fe94f82b);
-  ctx->H[3] = UINT64_C(0xa54ff53a5f1d36f1);
-  ctx->H[4] = UINT64_C(0x510e527fade682d1);
-  ctx->H[5] = UINT64_C(0x9b05688c2b3e6c1f);
-  ctx->H[6] = UINT64_C(0x1f83d9abfb41bd6b);
-  ctx->H[7] = UINT64_C(0x5be0cd19137e2179);
+  memcpy(ctx->H, sha512_iv, sizeof ctx->H);
 }
 
 void cf_sha384_init(cf_sha512_context *ctx)
 {
   memset(ctx, 0, sizeof *ctx);
-  ctx->H[0] = UINT64_C(0xcbbb9d5dc1059ed8);
-  ctx->H[1] = UINT64_C(0x629a292a367cd507);
-  ctx->H[2] = UINT64_C(0x9159015a3070dd17);
-  ctx->H[3] = UINT64_C(0x152fecd8f70e5939);
-  ctx->H[4] = UINT64_C(0x67332667ffc00b31);
-  ctx->H[5] = UINT64_C(0x8eb44a8768581511);
-  ctx->H[6] = UINT64_C(0xdb0c2e0d64f98fa7);
-  ctx->H[7] = UINT64_C(0x47b5481dbefa4fa4);
+  memcpy(ctx->H, sha384_iv, sizeof ctx->H);
 }
 
-static void sha512_update_block(void *vctx, const uint8_t *inp)
+#if CF_SIMD && CF_SIMD_HAVE_AVX2
+#define VROTR64(x, n) (((x) >> (n)) | ((x) << (64 - (n))))
+#define VBSIG0(x) (VROTR64((x), 28) ^ VROTR64((x), 34) ^ VROTR64((x), 39))
+#define VBSIG1(x) (VROTR64((x), 14) ^ VROTR64((x), 18) ^ VROTR64((x), 41))
+#define VSSIG0(x) (VROTR64((x), 1) ^ VROTR64((x), 8) ^ ((x) >> 7))
+#define VSSIG1(x) (VROTR64((x), 19) ^ VROTR64((x), 61) ^ ((x) >> 6))
+
+/* One round, with the working variables named rather than moved. */
+#define ROUND(a, b, c, d, e, f, g, h, wk)                               \
+  do {                                                                  \
+    uint64_t T1 = h + BSIG1(e) + CH(e, f, g) + (wk);                    \
+    d += T1;                                                            \
+    h = T1 + BSIG0(a) + MAJ(a, b, c);                                   \
+  } while (0)
+
+/* One block, with the message schedule computed four words at a
+ * time in vector registers, a group ahead of the rounds which use
+ * it.  The rounds are as sha512_compress. */
+CF_SIMD_AVX2
+static void sha512_compress_avx2(uint64_t H[8], const uint8_t *inp)
 {
-  cf_sha512_context *ctx = vctx;
+  /* W[i] holds words 4i to 4i + 3 of the last 16, and WK the
+   * same words plus their round constants. */
+  cf_u64x4 W[4], Kt, WK[4];
+  uint64_t wk[4];
+
+  for (size_t i = 0; i < 4; i++)
+  {
+    uint64_t w[4];
+    for (size_t j = 0; j < 4; j++)
+      w[j] = read64_be(inp + 32 * i + 8 * j);
+    memcpy(&W[i], w, sizeof W[i]);
+    memcpy(&Kt, &K[4 * i], sizeof Kt);
+    WK[i] = W[i] + Kt;
+  }
+
+  uint64_t a = H[0],
+           b = H[1],
+           c = H[2],
+           d = H[3],
+           e = H[4],
+           f = H[5],
+           g = H[6],
+           h = H[7];
+
+  for (size_t t = 0; t < 80; t += 4)
+  {
+    memcpy(wk, &WK[(t / 4) % 4], sizeof wk);
+
+    if (t < 64)
+    {
+      /* Words t + 16 to t + 19.  First, all but the SSIG1 term. */
+      cf_u64x4 w15 = CF_SIMD_SHUFFLE(W[0], W[1], 1, 2, 3, 4),
+               w7 = CF_SIMD_SHUFFLE(W[2], W[3], 1, 2, 3, 4),
+               Wt = W[0] + VSSIG0(w15) + w7;
 
+      /* SSIG1 of the two previous words gives the first two new
+       * words, which give the other two. */
+      cf_u64x4 w2 = CF_SIMD_SHUFFLE(W[3], W[3], 2, 3, 2, 3);
+      cf_u64x4 lo = Wt + VSSIG1(w2);
+      w2 = CF_SIMD_SHUFFLE(lo, lo, 0, 1, 0, 1);
+      Wt = CF_SIMD_SHUFFLE(lo, Wt + VSSIG1(w2), 0, 1, 6, 7);
+
+      W[0] = W[1];
+      W[1] = W[2];
+      W[2] = W[3];
+      W[3] = Wt;
+
+      memcpy(&Kt, &K[t + 16], sizeof Kt);
+      WK[(t / 4) % 4] = Wt + Kt;
+    }
+
+    ROUND(a, b, c, d, e, f, g, h, wk[0]);
+    ROUND(h, a, b, c, d, e, f, g, wk[1]);
+    ROUND(g, h, a, b, c, d, e, f, wk[2]);
+    ROUND(f, g, h, a, b, c, d, e, wk[3]);
+
+    /* Four rounds moved each variable four places. */
+    uint64_t t0 = a, t1 = b, t2 = c, t3 = d;
+    a = e;
+    b = f;
+    c = g;
+    d = h;
+    e = t0;
+    f = t1;
+    g = t2;
+    h = t3;
+  }
+
+  H[0] += a;
+  H[1] += b;
+  H[2] += c;
+  H[3] += d;
+  H[4] += e;
+  H[5] += f;
+  H[6] += g;
+  H[7] += h;
+
+  mem_clean(W, sizeof W);
+  mem_clean(WK, sizeof WK);
+  mem_clean(wk, sizeof wk);
+}
+
+#undef ROUND
+
+/* Four messages at once, one in each lane.  H[i][l] is word i of
+ * the state for lane l, and inp[l] is the next block of that lane's
+ * message.  Otherwise as sha512_compress. */
+CF_SIMD_AVX2
+static void sha512_compress_x4(uint64_t H[8][CF_SHA512_MB_LANES],
+                               const uint8_t *const inp[CF_SHA512_MB_LANES])
+{
+  cf_u64x4 W[16], S[8];
+
+  for (int i = 0; i < 8; i++)
+    memcpy(&S[i], H[i], sizeof S[i]);
+
+  cf_u64x4 a = S[0], b = S[1], c = S[2], d = S[3],
+           e = S[4], f = S[5], g = S[6], h = S[7],
+           Wt;
+
+  for (size_t t = 0; t < 80; t++)
+  {
+    if (t < 16)
+    {
+      uint64_t col[4];
+      for (int l = 0; l < 4; l++)
+        col[l] = read64_be(inp[l] + 8 * t);
+      memcpy(&Wt, col, sizeof Wt);
+      W[t] = Wt;
+    } else {
+      Wt = VSSIG1(W[(t - 2) % 16]) +
+           W[(t - 7) % 16] +
+           VSSIG0(W[(t - 15) % 16]) +
+           W[(t - 16) % 16];
+      W[t % 16] = Wt;
+    }
+
+    cf_u64x4 T1 = h + VBSIG1(e) + CH(e, f, g) + K[t] + Wt;
+    cf_u64x4 T2 = VBSIG0(a) + MAJ(a, b, c);
+    h = g;
+    g = f;
+    f = e;
+    e = d + T1;
+    d = c;
+    c = b;
+    b = a;
+    a = T1 + T2;
+  }
+
+  S[0] += a;
+  S[1] += b;
+  S[2] += c;
+  S[3] += d;
+  S[4] += e;
+  S[5] += f;
+  S[6] += g;
+  S[7] += h;
+
+  for (int i = 0; i < 8; i++)
+    memcpy(H[i], &S[i], sizeof S[i]);
+}
+
+#undef VROTR64
+#undef VBSIG0
+#undef VBSIG1
+#undef VSSIG0
+#undef VSSIG1
+#endif
+
+static void sha512_compress(uint64_t H[8], const uint8_t *inp)
+{
   uint64_t W[16];
 
-  uint64_t a = ctx->H[0],
-           b = ctx->H[1],
-           c = ctx->H[2],
-           d = ctx->H[3],
-           e = ctx->H[4],
-           f = ctx->H[5],
-           g = ctx->H[6],
-           h = ctx->H[7],
+  uint64_t a = H[0],
+           b = H[1],
+           c = H[2],
+           d = H[3],
+           e = H[4],
+           f = H[5],
+           g = H[6],
+           h = H[7],
            Wt;
 
   for (size_t t = 0; t < 80; t++)
@@ -138,15 +307,34 @@ static void sha512_update_block(void *vctx, const uint8_t *inp)
     a = T1 + T2;
   }
 
-  ctx->H[0] += a;
-  ctx->H[1] += b;
-  ctx->H[2] += c;
-  ctx->H[3] += d;
-  ctx->H[4] += e;
-  ctx->H[5] += f;
-  ctx->H[6] += g;
-  ctx->H[7] += h;
+  H[0] += a;
+  H[1] += b;
+  H[2] += c;
+  H[3] += d;
+  H[4] += e;
+  H[5] += f;
+  H[6] += g;
+  H[7] += h;
+}
 
+/* One block, with the fastest compression function this CPU has. */
+static void sha512_block(uint64_t H[8], const uint8_t *inp)
+{
+#if CF_SIMD && CF_SIMD_HAVE_AVX2
+  if (cf_simd_have_avx2())
+  {
+    sha512_compress_avx2(H, inp);
+    return;
+  }
+#endif
+
+  sha512_compress(H, inp);
+}
+
+static void sha512_update_block(void *vctx, const uint8_t *inp)
+{
+  cf_sha512_context *ctx = vctx;
+  sha512_block(ctx->H, inp);
   ctx->blocks++;
 }
 
@@ -230,6 +418,168 @@ void cf_sha384_digest_final(cf_sha512_context *ctx, uint8_t hash[CF_SHA384_HASHS
   memcpy(hash, full, CF_SHA384_HASHSZ);
 }
 
+void cf_sha384_mb_init(cf_sha512_mb *mb)
+{
+  cf_sha512_mb_init(mb);
+  mb->hashsz = CF_SHA384_HASHSZ;
+}
+
+void cf_sha512_mb_init(cf_sha512_mb *mb)
+{
+  memset(mb, 0, sizeof *mb);
+  mb->hashsz = CF_SHA512_HASHSZ;
+  mb->nlanes = 1;
+
+#if CF_SIMD && CF_SIMD_HAVE_AVX2
+  if (cf_simd_have_avx2())
+    mb->nlanes = 4;
+#endif
+}
+
+/* Starts hashing item in idle lane l.  The message's final partial
+ * block is padded into one or two blocks in tail[l]. */
+static void sha512_mb_start(cf_sha512_mb *mb, unsigned l, cf_sha512_item *item)
+{
+  const uint8_t *msg = item->msg;
+  const uint64_t *iv = mb->hashsz == CF_SHA384_HASHSZ ? sha384_iv : sha512_iv;
+  size_t nbody = item->nmsg / CF_SHA512_BLOCKSZ,
+         rem = item->nmsg % CF_SHA512_BLOCKSZ;
+  uint8_t *tail = mb->tail[l];
+  unsigned ntail = rem + 1 + 16 > CF_SHA512_BLOCKSZ ? 2 : 1;
+
+  /* The length is 128 bits; the top 64 are left zero. */
+  memset(tail, 0, sizeof mb->tail[l]);
+  memcpy(tail, msg + nbody * CF_SHA512_BLOCKSZ, rem);
+  tail[rem] = 0x80;
+  write64_be((uint64_t) item->nmsg * 8, tail + ntail * CF_SHA512_BLOCKSZ - 8);
+
+  for (int i = 0; i < 8; i++)
+    mb->H[i][l] = iv[i];
+
+  mb->item[l] = item;
+  mb->ptr[l] = nbody ? msg : tail;
+  mb->nbody[l] = nbody;
+  mb->ntail[l] = ntail;
+  mb->nbusy++;
+}
+
+/* Hashes one block in every busy lane, and retires lanes whose
+ * messages are finished. */
+static void sha512_mb_step(cf_sha512_mb *mb)
+{
+  static const uint8_t idle[CF_SHA512_BLOCKSZ];
+  const uint8_t *inp[CF_SHA512_MB_LANES];
+
+  for (unsigned l = 0; l < mb->nlanes; l++)
+    inp[l] = mb->item[l] ? mb->ptr[l] : idle;
+
+#if CF_SIMD && CF_SIMD_HAVE_AVX2
+  if (mb->nlanes == 4 && cf_simd_have_avx2())
+  {
+    sha512_compress_x4(mb->H, inp);
+    cf_simd_avx2_leave();
+  } else
+#endif
+  for (unsigned l = 0; l < mb->nlanes; l++)
+  {
+    uint64_t H[8];
+
+    if (mb->item[l] == NULL)
+      continue;
+
+    for (int i = 0; i < 8; i++)
+      H[i] = mb->H[i][l];
+    sha512_block(H, inp[l]);
+    for (int i = 0; i < 8; i++)
+      mb->H[i][l] = H[i];
+  }
+
+  for (unsigned l = 0; l < mb->nlanes; l++)
+  {
+    cf_sha512_item *item = mb->item[l];
+
+    if (item == NULL)
+      continue;
+
+    if (mb->nbody[l])
+    {
+      mb->nbody[l]--;
+      mb->ptr[l] = mb->nbody[l] ? mb->ptr[l] + CF_SHA512_BLOCKSZ : mb->tail[l];
+      continue;
+    }
+
+    mb->ptr[l] += CF_SHA512_BLOCKSZ;
+    if (--mb->ntail[l])
+      continue;
+
+    uint8_t full[CF_SHA512_HASHSZ];
+    for (int i = 0; i < 8; i++)
+      write64_be(mb->H[i][l], full + 8 * i);
+    memcpy(item->hash, full, mb->hashsz);
+
+    mem_clean(full, sizeof full);
+    mem_clean(mb->tail[l], sizeof mb->tail[l]);
+    mb->item[l] = NULL;
+    mb->nbusy--;
+  }
+}
+
+void cf_sha512_mb_submit(cf_sha512_mb *mb, cf_sha512_item *item)
+{
+  if (mb->nlanes == 1)
+  {
+    cf_sha512_context ctx;
+    uint8_t full[CF_SHA512_HASHSZ];
+
+    if (mb->hashsz == CF_SHA384_HASHSZ)
+      cf_sha384_init(&ctx);
+    else
+      cf_sha512_init(&ctx);
+    cf_sha512_update(&ctx, item->msg, item->nmsg);
+    cf_sha512_digest_final(&ctx, full);
+    memcpy(item->hash, full, mb->hashsz);
+    mem_clean(full, sizeof full);
+    return;
+  }
+
+  unsigned l = 0;
+  while (mb->item[l])
+    l++;
+
+  sha512_mb_start(mb, l, item);
+
+  while (mb->nbusy == mb->nlanes)
+    sha512_mb_step(mb);
+}
+
+void cf_sha512_mb_flush(cf_sha512_mb *mb)
+{
+  while (mb->nbusy)
+    sha512_mb_step(mb);
+
+  mem_clean(mb->H, sizeof mb->H);
+}
+
+void cf_sha384_batch(cf_sha512_item *items, size_t nitems)
+{
+  cf_sha512_mb mb;
+
+  cf_sha384_mb_init(&mb);
+  for (size_t i = 0; i < nitems; i++)
+    cf_sha512_mb_submit(&mb, &items[i]);
+  cf_sha512_mb_flush(&mb);
+}
+
+void cf_sha512_batch(cf_sha512_item *items, size_t nitems)
+{
+  cf_sha512_mb mb;
+
+  cf_sha512_mb_init(&mb);
+  for (size_t i = 0; i < nitems; i++)
+    cf_sha512_mb_submit(&mb, &items[i]);
+  cf_sha512_mb_flush(&mb);
+}
+
 const cf_chash cf_sha384 = {
   .hashsz = CF_SHA384_HASHSZ,
   .blocksz = CF_SHA384_BLOCKSZ,
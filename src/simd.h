@@ -0,0 +1,166 @@
+/*
+ * cifra - embedded cryptography library
+ * Written in 2014 by Joseph Birr-Pixton <jpixton@gmail.com>
+ *
+ * To the extent possible under law, the author(s) have dedicated all
+ * copyright and related and neighboring rights to this software to the
+ * public domain worldwide. This software is distributed without any
+ * warranty.
+ *
+ * You should have received a copy of the CC0 Public Domain Dedication
+ * along with this software. If not, see
+ * <http://creativecommons.org/publicdomain/zero/1.0/>.
+ */
+
+
+#ifndef SIMD_H
+#define SIMD_H
+
+#include "cf_config.h"
+
+#include <stdint.h>
+#include <string.h>
+
+/* Portable vector types and helpers, using GCC/clang vector
+ * extensions.  Only use these when CF_SIMD is 1.  Lane 0 is the
+ * lowest-addressed word in memory.
+ *
+ * A cf_u32x4 is one SSE2 or NEON register.  A cf_u32x8 or cf_u64x4 is
+ * one AVX2 register: code using it must be in a function marked
+ * CF_SIMD_AVX2, and only be called when cf_simd_have_avx2() says so. */
+
+#if CF_SIMD
+
+typedef uint32_t cf_u32x4 __attribute__((vector_size(16)));
+typedef uint32_t cf_u32x8 __attribute__((vector_size(32)));
+typedef uint64_t cf_u64x4 __attribute__((vector_size(32)));
+
+/* Rotate each lane of v left by n bits. */
+#define CF_SIMD_ROTL32(v, n) (((v) << (n)) | ((v) >> (32 - (n))))
+
+/* out = in ^ ks, for 16 bytes.  in and out may be unaligned, and
+ * may be the same. */
+static inline void cf_simd_xor16(const uint8_t *in, uint8_t *out, const uint8_t *ks)
+{
+  cf_u32x4 a, b;
+  memcpy(&a, in, 16);
+  memcpy(&b, ks, 16);
+  a ^= b;
+  memcpy(out, &a, 16);
+}
+
+/* Select lanes from a and b: index i is lane i of a, and index
+ * n + i is lane i of b, where n is the number of lanes. */
+#if defined(__clang__)
+# define CF_SIMD_SHUFFLE(a, b, ...) __builtin_shufflevector(a, b, __VA_ARGS__)
+#else
+# define CF_SIMD_SHUFFLE(a, b, ...) __builtin_shuffle(a, b, (__typeof__(a)) { __VA_ARGS__ })
+#endif
+
+/* Given four cf_u32x4 vectors a, b, c, d: for each lane l, XORs
+ * { a[l], b[l], c[l], d[l] } as little-endian words with the
+ * 16 bytes at in + l * stride, and writes them to out + l * stride. */
+#define CF_SIMD_XOR_4X4(a, b, c, d, in, out, stride) do {              \
+    cf_u32x4 t0_ = CF_SIMD_SHUFFLE(a, b, 0, 4, 1, 5),                   \
+             t1_ = CF_SIMD_SHUFFLE(a, b, 2, 6, 3, 7),                   \
+             t2_ = CF_SIMD_SHUFFLE(c, d, 0, 4, 1, 5),                   \
+             t3_ = CF_SIMD_SHUFFLE(c, d, 2, 6, 3, 7);                   \
+    cf_u32x4 u_[4] = {                                                  \
+      CF_SIMD_SHUFFLE(t0_, t2_, 0, 1, 4, 5),                            \
+      CF_SIMD_SHUFFLE(t0_, t2_, 2, 3, 6, 7),                            \
+      CF_SIMD_SHUFFLE(t1_, t3_, 0, 1, 4, 5),                            \
+      CF_SIMD_SHUFFLE(t1_, t3_, 2, 3, 6, 7)                             \
+    };                                                                  \
+    for (int l_ = 0; l_ < 4; l_++)                                      \
+      cf_simd_xor16((in) + l_ * (stride), (out) + l_ * (stride),        \
+                    (const uint8_t *) &u_[l_]);                         \
+  } while (0)
+
+/* As CF_SIMD_XOR_4X4, for four cf_u32x8 vectors. */
+#define CF_SIMD_XOR_4X8(a, b, c, d, in, out, stride) do {              \
+    cf_u32x8 t0_ = CF_SIMD_SHUFFLE(a, b, 0, 8, 1, 9, 4, 12, 5, 13),     \
+             t1_ = CF_SIMD_SHUFFLE(a, b, 2, 10, 3, 11, 6, 14, 7, 15),   \
+             t2_ = CF_SIMD_SHUFFLE(c, d, 0, 8, 1, 9, 4, 12, 5, 13),     \
+             t3_ = CF_SIMD_SHUFFLE(c, d, 2, 10, 3, 11, 6, 14, 7, 15);   \
+    cf_u32x8 u_[4] = {                                                  \
+      CF_SIMD_SHUFFLE(t0_, t2_, 0, 1, 8, 9, 4, 5, 12, 13),              \
+      CF_SIMD_SHUFFLE(t0_, t2_, 2, 3, 10, 11, 6, 7, 14, 15),            \
+      CF_SIMD_SHUFFLE(t1_, t3_, 0, 1, 8, 9, 4, 5, 12, 13),              \
+      CF_SIMD_SHUFFLE(t1_, t3_, 2, 3, 10, 11, 6, 7, 14, 15)             \
+    };                                                                  \
+    for (int l_ = 0; l_ < 4; l_++)                                      \
+    {                                                                   \
+      cf_simd_xor16((in) + l_ * (stride), (out) + l_ * (stride),        \
+                    (const uint8_t *) &u_[l_]);                         \
+      cf_simd_xor16((in) + (l_ + 4) * (stride), (out) + (l_ + 4) * (stride), \
+                    (const uint8_t *) &u_[l_] + 16);                    \
+    }                                                                   \
+  } while (0)
+
+#if defined(__x86_64__) || defined(__i386__)
+# define CF_SIMD_HAVE_AVX2 1
+# define CF_SIMD_AVX2 __attribute__((target("avx2")))
+
+# include <immintrin.h>
+
+/* For each lane, the 64-bit product of the low 32 bits of a and b.
+ * Plain multiplication of cf_u64x4 needs several instructions. */
+CF_SIMD_AVX2
+static inline cf_u64x4 cf_simd_mul32_u64x4(cf_u64x4 a, cf_u64x4 b)
+{
+  return (cf_u64x4) _mm256_mul_epu32((__m256i) a, (__m256i) b);
+}
+
+/* Call this in AVX2 code before calling out to code which isn't
+ * compiled for AVX2.  Some CPUs run SSE code very slowly while the
+ * upper halves of the AVX registers are in use.  The compiler does
+ * this itself on return from an AVX2 function, but not reliably
+ * before calls. */
+CF_SIMD_AVX2
+static inline void cf_simd_avx2_leave(void)
+{
+  _mm256_zeroupper();
+}
+
+/* Returns non-zero if this CPU supports AVX2. */
+static inline int cf_simd_have_avx2(void)
+{
+  static int have = -1;
+
+  if (have < 0)
+  {
+    __builtin_cpu_init();
+    have = __builtin_cpu_supports("avx2") ? 1 : 0;
+  }
+
+  return have;
+}
+
+/* SHA extensions (SHA-NI), for the SHA-1 and SHA-256 compression
+ * functions.  As for AVX2: code using them must be in a function
+ * marked CF_SIMD_SHANI, and only be called when cf_simd_have_shani()
+ * says so. */
+# define CF_SIMD_HAVE_SHANI 1
+# define CF_SIMD_SHANI __attribute__((target("sha,sse4.1")))
+
+/* Returns non-zero if this CPU supports the SHA extensions. */
+static inline int cf_simd_have_shani(void)
+{
+  static int have = -1;
+
+  if (have < 0)
+  {
+    __builtin_cpu_init();
+    have = __builtin_cpu_supports("sha") && __builtin_cpu_supports("sse4.1") ? 1 : 0;
+  }
+
+  return have;
+}
+#else
+# define CF_SIMD_HAVE_AVX2 0
+# define CF_SIMD_HAVE_SHANI 0
+#endif
+
+#endif
+
+#endif
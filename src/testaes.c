@@ -231,6 +231,21 @@ static void vector(const char *input, const char *output,
   
   cf_aes_decrypt(&ctx, outbuf, tmp);
   TEST_CHECK(memcmp(tmp, inbuf, 16) == 0);
+
+  /* Multiple block functions must agree, with lengths either side
+   * of their interleaving. */
+  uint8_t blocks[16 * 7];
+  for (size_t i = 0; i < 7; i++)
+    memcpy(blocks + 16 * i, inbuf, 16);
+
+  cf_aes_encrypt_blocks(&ctx, blocks, blocks, 7);
+  for (size_t i = 0; i < 7; i++)
+    TEST_CHECK(memcmp(blocks + 16 * i, outbuf, 16) == 0);
+
+  cf_aes_decrypt_blocks(&ctx, blocks, blocks, 7);
+  for (size_t i = 0; i < 7; i++)
+    TEST_CHECK(memcmp(blocks + 16 * i, inbuf, 16) == 0);
+
   cf_aes_finish(&ctx);
 }
 
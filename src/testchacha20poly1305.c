@@ -13,10 +13,20 @@
  */
 
 #include "chacha20poly1305.h"
+#include "salsa20.h"
+#include "poly1305.h"
+#include "bitops.h"
 #include "handy.h"
 #include "cutest.h"
 #include "testutil.h"
 
+/* Some tests are too big for microcontrollers. */
+#if defined(CORTEX_M0) || defined(CORTEX_M3) || defined(CORTEX_M4)
+# define MCU_TARGET 1
+#else
+# define MCU_TARGET 0
+#endif
+
 static void vector(const char *keystr,
                    const char *noncestr,
                    const char *headerstr,
@@ -554,9 +564,323 @@ static void test_lengths(void)
          "55c9421f09acea7640fba6b31eee94a1");
 }
 
+static void test_batch(void)
+{
+  enum { N = 7 };
+  uint8_t key[32], nonce[N][12], header[N][20], plain[N][100];
+  uint8_t cipher[N][100], tag[N][16], decrypted[N][100];
+  cf_aead_record enc[N], dec[N];
+
+  memset(key, 0x42, sizeof key);
+
+  for (size_t i = 0; i < N; i++)
+  {
+    memset(nonce[i], (int) i, sizeof nonce[i]);
+    memset(header[i], (int) (i + 0x10), sizeof header[i]);
+    memset(plain[i], (int) (i + 0x20), sizeof plain[i]);
+
+    size_t nheader = (i * 3) % sizeof header[i];
+    size_t nplain = (i * 37) % sizeof plain[i];
+    cf_aead_record e = { nonce[i], 12, header[i], nheader, plain[i], nplain, cipher[i], tag[i] };
+    cf_aead_record d = { nonce[i], 12, header[i], nheader, cipher[i], nplain, decrypted[i], tag[i] };
+    enc[i] = e;
+    dec[i] = d;
+  }
+
+  cf_chacha20poly1305_encrypt_batch(key, enc, N);
+
+  for (size_t i = 0; i < N; i++)
+  {
+    uint8_t out[100], ourtag[16];
+    cf_chacha20poly1305_encrypt(key, nonce[i],
+                                header[i], enc[i].nheader,
+                                plain[i], enc[i].nbytes,
+                                out, ourtag);
+    TEST_CHECK(memcmp(out, cipher[i], enc[i].nbytes) == 0);
+    TEST_CHECK(memcmp(ourtag, tag[i], sizeof ourtag) == 0);
+  }
+
+  tag[2][15] ^= 0x80;
+  TEST_CHECK(cf_chacha20poly1305_decrypt_batch(key, dec, N) != 0);
+
+  for (size_t i = 0; i < N; i++)
+  {
+    TEST_CHECK((dec[i].err != 0) == (i == 2));
+    if (i != 2)
+      TEST_CHECK(memcmp(decrypted[i], plain[i], dec[i].nbytes) == 0);
+  }
+}
+
+static void test_iov(void)
+{
+  uint8_t key[32], nonce[12], header[30], plain[150];
+  uint8_t expect_cipher[150], expect_tag[16];
+  uint8_t cipher[150], tag[16], decrypted[150];
+
+  memset(key, 0x11, sizeof key);
+  memset(nonce, 0x22, sizeof nonce);
+  for (size_t i = 0; i < sizeof header; i++)
+    header[i] = (uint8_t) (0x40 + i);
+  for (size_t i = 0; i < sizeof plain; i++)
+    plain[i] = (uint8_t) i;
+
+  /* Fragments split across ChaCha20 and Poly1305 block boundaries,
+   * differently for input and output. */
+  cf_iovec header_iov[] = { { header, 3 }, { header + 3, 0 }, { header + 3, 27 } };
+  cf_iovec plain_iov[] = { { plain, 1 }, { plain + 1, 70 }, { plain + 71, 0 }, { plain + 71, 79 } };
+  cf_iovec cipher_iov[] = { { cipher, 17 }, { cipher + 17, 64 }, { cipher + 81, 69 } };
+  cf_iovec out_iov[] = { { decrypted, 100 }, { decrypted + 100, 50 } };
+
+  cf_chacha20poly1305_encrypt(key, nonce, header, sizeof header,
+                              plain, sizeof plain, expect_cipher, expect_tag);
+  cf_chacha20poly1305_encrypt_iov(key, nonce, header_iov, 3,
+                                  plain_iov, 4, cipher_iov, 3, tag);
+  TEST_CHECK(memcmp(cipher, expect_cipher, sizeof cipher) == 0);
+  TEST_CHECK(memcmp(tag, expect_tag, sizeof tag) == 0);
+
+  TEST_CHECK(0 == cf_chacha20poly1305_decrypt_iov(key, nonce, header_iov, 3,
+                                                  cipher_iov, 3, tag, out_iov, 2));
+  TEST_CHECK(memcmp(decrypted, plain, sizeof plain) == 0);
+
+  tag[0] ^= 1;
+  TEST_CHECK(1 == cf_chacha20poly1305_decrypt_iov(key, nonce, header_iov, 3,
+                                                  cipher_iov, 3, tag, out_iov, 2));
+  uint8_t zero[150] = { 0 };
+  TEST_CHECK(memcmp(decrypted, zero, sizeof zero) == 0);
+}
+
+#if !MCU_TARGET
+/* The message is encrypted and decrypted in chunks: check a message
+ * spanning several of them against ChaCha20 and Poly1305 used
+ * directly, decrypted in place, and that the plaintext is removed
+ * when the tag is wrong. */
+static void test_long(void)
+{
+  uint8_t key[32], nonce[12], header[20], tag[16];
+  static uint8_t plain[20000], buf[20000], expect[20000];
+
+  memset(key, 0x33, sizeof key);
+  memset(nonce, 0x44, sizeof nonce);
+  memset(header, 0x55, sizeof header);
+  for (size_t i = 0; i < sizeof plain; i++)
+    plain[i] = (uint8_t) i;
+
+  cf_chacha20poly1305_encrypt(key, nonce, header, sizeof header,
+                              plain, sizeof plain, expect, tag);
+
+  {
+    uint8_t fullnonce[16] = { 0 }, polykey[64] = { 0 }, pad[16] = { 0 }, reftag[16];
+    cf_chacha20_ctx chacha;
+    cf_poly1305 poly;
+
+    memcpy(fullnonce + 4, nonce, 12);
+    cf_chacha20_init_custom(&chacha, key, sizeof key, fullnonce, 4);
+    cf_chacha20_cipher(&chacha, polykey, polykey, sizeof polykey);
+    cf_chacha20_cipher(&chacha, plain, buf, sizeof plain);
+    TEST_CHECK(memcmp(buf, expect, sizeof buf) == 0);
+
+    cf_poly1305_init(&poly, polykey, polykey + 16);
+    cf_poly1305_update(&poly, header, sizeof header);
+    cf_poly1305_update(&poly, pad, 12);
+    cf_poly1305_update(&poly, buf, sizeof buf);
+    write64_le(sizeof header, pad);
+    write64_le(sizeof buf, pad + 8);
+    cf_poly1305_update(&poly, pad, sizeof pad);
+    cf_poly1305_finish(&poly, reftag);
+    TEST_CHECK(memcmp(reftag, tag, sizeof tag) == 0);
+  }
+
+  memcpy(buf, expect, sizeof buf);
+  TEST_CHECK(0 == cf_chacha20poly1305_decrypt(key, nonce, header, sizeof header,
+                                              buf, sizeof buf, tag, buf));
+  TEST_CHECK(memcmp(buf, plain, sizeof plain) == 0);
+
+  memcpy(buf, expect, sizeof buf);
+  tag[15] ^= 0x01;
+  TEST_CHECK(1 == cf_chacha20poly1305_decrypt(key, nonce, header, sizeof header,
+                                              buf, sizeof buf, tag, buf));
+  memset(expect, 0, sizeof expect);
+  TEST_CHECK(memcmp(buf, expect, sizeof buf) == 0);
+}
+#endif
+
+#if !MCU_TARGET
+/* Pieces of awkward sizes, in place, must match the one-shot
+ * functions. */
+static void test_incremental(void)
+{
+  uint8_t key[32], nonce[12], header[45], tag[16], expect_tag[16];
+  static uint8_t plain[3000], expect[3000], buf[3000];
+  static const size_t pieces[] = { 0, 1, 15, 16, 17, 63, 64, 65, 300, 1000, 1409 };
+
+  memset(key, 0x66, sizeof key);
+  memset(nonce, 0x77, sizeof nonce);
+  for (size_t i = 0; i < sizeof header; i++)
+    header[i] = (uint8_t) (3 * i);
+  for (size_t i = 0; i < sizeof plain; i++)
+    plain[i] = (uint8_t) (i ^ (i >> 8));
+
+  cf_chacha20poly1305_encrypt(key, nonce, header, sizeof header,
+                              plain, sizeof plain, expect, expect_tag);
+
+  cf_chacha20poly1305_ctx ctx;
+  size_t off = 0;
+
+  memcpy(buf, plain, sizeof buf);
+  cf_chacha20poly1305_init(&ctx, key, nonce);
+  cf_chacha20poly1305_aad(&ctx, header, 7);
+  cf_chacha20poly1305_aad(&ctx, header + 7, sizeof header - 7);
+  for (size_t i = 0; i < ARRAYCOUNT(pieces); i++)
+  {
+    cf_chacha20poly1305_encrypt_update(&ctx, buf + off, buf + off, pieces[i]);
+    off += pieces[i];
+  }
+  cf_chacha20poly1305_encrypt_update(&ctx, buf + off, buf + off, sizeof buf - off);
+  cf_chacha20poly1305_encrypt_final(&ctx, tag);
+
+  TEST_CHECK(memcmp(buf, expect, sizeof buf) == 0);
+  TEST_CHECK(memcmp(tag, expect_tag, sizeof tag) == 0);
+
+  off = 0;
+  cf_chacha20poly1305_init(&ctx, key, nonce);
+  cf_chacha20poly1305_aad(&ctx, header, sizeof header);
+  for (size_t i = ARRAYCOUNT(pieces); i > 0; i--)
+  {
+    cf_chacha20poly1305_decrypt_update(&ctx, buf + off, buf + off, pieces[i - 1]);
+    off += pieces[i - 1];
+  }
+  cf_chacha20poly1305_decrypt_update(&ctx, buf + off, buf + off, sizeof buf - off);
+  TEST_CHECK(cf_chacha20poly1305_decrypt_final(&ctx, tag) == 0);
+  TEST_CHECK(memcmp(buf, plain, sizeof buf) == 0);
+
+  /* AAD only. */
+  cf_chacha20poly1305_encrypt(key, nonce, header, sizeof header,
+                              NULL, 0, NULL, expect_tag);
+  cf_chacha20poly1305_init(&ctx, key, nonce);
+  cf_chacha20poly1305_aad(&ctx, header, sizeof header);
+  cf_chacha20poly1305_encrypt_final(&ctx, tag);
+  TEST_CHECK(memcmp(tag, expect_tag, sizeof tag) == 0);
+
+  tag[0] ^= 0x80;
+  cf_chacha20poly1305_init(&ctx, key, nonce);
+  cf_chacha20poly1305_aad(&ctx, header, sizeof header);
+  TEST_CHECK(cf_chacha20poly1305_decrypt_final(&ctx, tag) != 0);
+}
+#endif
+
+#if !MCU_TARGET
+/* Packets under different keys, more than one group of them, with
+ * some in place: they must match the one-shot functions. */
+static void test_multi(void)
+{
+  enum { N = 45 };
+  uint8_t keys[N][32], nonces[N][12], header[40], tags[N][16], expect_tag[16];
+  static uint8_t plain[N][700], buf[N][700], expect[700];
+  cf_chacha20poly1305_packet pkts[N];
+
+  for (size_t i = 0; i < sizeof header; i++)
+    header[i] = (uint8_t) (0x80 + i);
+
+  for (size_t k = 0; k < N; k++)
+  {
+    for (size_t i = 0; i < 32; i++)
+      keys[k][i] = (uint8_t) (k * 11 + i);
+    for (size_t i = 0; i < 12; i++)
+      nonces[k][i] = (uint8_t) (k * 3 + i);
+    for (size_t i = 0; i < sizeof plain[k]; i++)
+      plain[k][i] = (uint8_t) (k + i);
+
+    pkts[k] = (cf_chacha20poly1305_packet) {
+      .key = keys[k],
+      .nonce = nonces[k],
+      .header = header,
+      .nheader = k % 41,
+      .in = plain[k],
+      .nbytes = k == 9 ? 650 : (k * 37) % 200,
+      .out = k % 3 ? buf[k] : plain[k],
+      .tag = tags[k]
+    };
+  }
+
+  /* Keep a copy of the in place packets' plaintext. */
+  memcpy(buf[0], plain[0], sizeof buf[0]);
+  for (size_t k = 3; k < N; k += 3)
+    memcpy(buf[k], plain[k], sizeof buf[k]);
+
+  cf_chacha20poly1305_encrypt_multi(pkts, N);
+
+  for (size_t k = 0; k < N; k++)
+  {
+    const uint8_t *orig = k % 3 ? plain[k] : buf[k];
+    cf_chacha20poly1305_encrypt(keys[k], nonces[k], header, pkts[k].nheader,
+                                orig, pkts[k].nbytes, expect, expect_tag);
+    TEST_CHECK(memcmp(expect, pkts[k].out, pkts[k].nbytes) == 0);
+    TEST_CHECK(memcmp(expect_tag, tags[k], 16) == 0);
+
+    /* Decrypt from wherever the ciphertext went, in place. */
+    pkts[k].in = pkts[k].out;
+  }
+
+  tags[20][3] ^= 0x10;
+  TEST_CHECK(cf_chacha20poly1305_decrypt_multi(pkts, N) != 0);
+
+  for (size_t k = 0; k < N; k++)
+  {
+    const uint8_t *orig = k % 3 ? plain[k] : buf[k];
+
+    if (k == 20)
+    {
+      uint8_t zero[700] = { 0 };
+      TEST_CHECK(pkts[k].err != 0);
+      TEST_CHECK(memcmp(pkts[k].out, zero, pkts[k].nbytes) == 0);
+    } else {
+      TEST_CHECK(pkts[k].err == 0);
+      TEST_CHECK(memcmp(pkts[k].out, orig, pkts[k].nbytes) == 0);
+    }
+  }
+}
+#endif
+
+static void test_xchacha(void)
+{
+  /* From draft-irtf-cfrg-xchacha-03 A.3.1. */
+  uint8_t key[32], nonce[24], header[12], plain[114], cipher[114], tag[16];
+  uint8_t expect_cipher[114], expect_tag[16], out[114];
+
+  unhex(key, sizeof key, "808182838485868788898a8b8c8d8e8f909192939495969798999a9b9c9d9e9f");
+  unhex(nonce, sizeof nonce, "404142434445464748494a4b4c4d4e4f5051525354555657");
+  unhex(header, sizeof header, "50515253c0c1c2c3c4c5c6c7");
+  unhex(plain, sizeof plain, "4c616469657320616e642047656e746c656d656e206f662074686520636c617373206f66202739393a204966204920636f756c64206f6666657220796f75206f6e6c79206f6e652074697020666f7220746865206675747572652c2073756e73637265656e20776f756c642062652069742e");
+  unhex(expect_cipher, sizeof expect_cipher, "bd6d179d3e83d43b9576579493c0e939572a1700252bfaccbed2902c21396cbb731c7f1b0b4aa6440bf3a82f4eda7e39ae64c6708c54c216cb96b72e1213b4522f8c9ba40db5d945b11b69b982c1bb9e3f3fac2bc369488f76b2383565d3fff921f9664c97637da9768812f615c68b13b52e");
+  unhex(expect_tag, sizeof expect_tag, "c0875924c1c7987947deafd8780acf49");
+
+  cf_xchacha20poly1305_encrypt(key, nonce, header, sizeof header,
+                               plain, sizeof plain, cipher, tag);
+  TEST_CHECK(memcmp(cipher, expect_cipher, sizeof cipher) == 0);
+  TEST_CHECK(memcmp(tag, expect_tag, sizeof tag) == 0);
+
+  TEST_CHECK(0 == cf_xchacha20poly1305_decrypt(key, nonce, header, sizeof header,
+                                               cipher, sizeof cipher, tag, out));
+  TEST_CHECK(memcmp(out, plain, sizeof plain) == 0);
+
+  nonce[0] ^= 1;
+  TEST_CHECK(1 == cf_xchacha20poly1305_decrypt(key, nonce, header, sizeof header,
+                                               cipher, sizeof cipher, tag, out));
+}
+
 TEST_LIST = {
   { "vectors", test_vectors },
   { "lentests", test_lengths },
+  { "batch", test_batch },
+  { "iov", test_iov },
+#if !MCU_TARGET
+  { "long", test_long },
+#endif
+#if !MCU_TARGET
+  { "incremental", test_incremental },
+  { "multi", test_multi },
+#endif
+  { "xchacha", test_xchacha },
   { 0 }
 };
 
@@ -15,6 +15,7 @@
 #include "drbg.h"
 #include "sha1.h"
 #include "sha2.h"
+#include "salsa20.h"
 
 #include "handy.h"
 #include "cutest.h"
@@ -192,6 +193,76 @@ static void test_hmacdrbg_sha512_vector_addnl(void)
   TEST_CHECK(memcmp(got, expect, sizeof got) == 0);
 }
 
+/* ChaCha20 key stream for key and the given stream ID. */
+static void chacha20_keystream(const uint8_t key[32], uint64_t stream,
+                               uint8_t *out, size_t nout)
+{
+  uint8_t nonce[8];
+  cf_chacha20_ctx ctx;
+
+  for (size_t i = 0; i < sizeof nonce; i++)
+    nonce[i] = (uint8_t) (stream >> (8 * i));
+
+  memset(out, 0, nout);
+  cf_chacha20_init(&ctx, key, 32, nonce);
+  cf_chacha20_cipher(&ctx, out, out, nout);
+}
+
+static void test_chacha20_rng(void)
+{
+  uint8_t seed[32], ks1[CF_CHACHA20_RNG_BUFSZ], ks2[CF_CHACHA20_RNG_BUFSZ];
+  uint8_t got[2000], expect[2000];
+
+  for (size_t i = 0; i < sizeof seed; i++)
+    seed[i] = (uint8_t) i;
+
+  chacha20_keystream(seed, 7, ks1, sizeof ks1);
+  chacha20_keystream(ks1, 7, ks2, sizeof ks2);
+
+  /* Small requests come from the buffer; the first 32 bytes of each
+   * refill are the next key. */
+  cf_chacha20_rng ctx;
+  cf_chacha20_rng_init(&ctx, seed, 7);
+  cf_chacha20_rng_gen(&ctx, got, 100);
+  cf_chacha20_rng_gen(&ctx, got + 100, 700);
+  TEST_CHECK(memcmp(got, ks1 + 32, sizeof ks1 - 32) == 0);
+  TEST_CHECK(memcmp(got + sizeof ks1 - 32, ks2 + 32, 800 - (sizeof ks1 - 32)) == 0);
+
+  /* Output is wiped from the buffer as it is handed out. */
+  uint8_t zero[CF_CHACHA20_RNG_BUFSZ] = { 0 };
+  TEST_CHECK(ctx.nbuf == sizeof ks2 - 32 - (800 - (sizeof ks1 - 32)));
+  TEST_CHECK(memcmp(ctx.buf + 32, zero, sizeof ctx.buf - 32 - ctx.nbuf) == 0);
+
+  /* Large requests go straight to the output, after the next key. */
+  cf_chacha20_rng_init(&ctx, seed, 7);
+  cf_chacha20_rng_gen(&ctx, got, sizeof ks1 - 32);
+  cf_chacha20_rng_gen(&ctx, got, sizeof got);
+  chacha20_keystream(ks1, 7, expect, sizeof expect);
+  TEST_CHECK(memcmp(got, expect + 32, sizeof got - 32) == 0);
+
+  uint8_t key3[32], ks3[64];
+  memcpy(key3, expect, sizeof key3);
+  chacha20_keystream(key3, 7, ks3, sizeof ks3);
+  cf_chacha20_rng_gen(&ctx, got, 16);
+  TEST_CHECK(memcmp(got, ks3 + 32, 16) == 0);
+
+  /* Streams are independent. */
+  cf_chacha20_rng other;
+  cf_chacha20_rng_init(&ctx, seed, 1);
+  cf_chacha20_rng_init(&other, seed, 2);
+  cf_chacha20_rng_gen(&ctx, got, 32);
+  cf_chacha20_rng_gen(&other, expect, 32);
+  TEST_CHECK(memcmp(got, expect, 32) != 0);
+
+  /* Forks are seeded from the parent's output. */
+  cf_chacha20_rng_init(&ctx, seed, 1);
+  cf_chacha20_rng_fork(&ctx, &other, 1);
+  chacha20_keystream(seed, 1, ks1, 64);
+  chacha20_keystream(ks1 + 32, 1, expect, 64);
+  cf_chacha20_rng_gen(&other, got, 32);
+  TEST_CHECK(memcmp(got, expect + 32, 32) == 0);
+}
+
 TEST_LIST = {
   { "hashdrbg-sha256", test_hashdrbg_sha256_vector },
   { "hashdrbg-sha256-addnl", test_hashdrbg_sha256_vector_addnl },
@@ -201,6 +272,7 @@ TEST_LIST = {
   { "hmacdrbg-sha256-addnl", test_hmacdrbg_sha256_vector_addnl },
   { "hmacdrbg-sha512", test_hmacdrbg_sha512_vector },
   { "hmacdrbg-sha512-addnl", test_hmacdrbg_sha512_vector_addnl },
+  { "chacha20-rng", test_chacha20_rng },
   { 0 }
 };
 
@@ -549,13 +549,13 @@ static void check_ccm(const void *key, size_t nkey,
   TEST_CHECK(err == 1);
 }
 
-#if !MCU_TARGET
 static void fill(uint8_t *buf, size_t len, uint8_t b)
 {
   for (size_t i = 0; i < len; i++)
     buf[i] = b++;
 }
 
+#if !MCU_TARGET
 static void test_ccm_long(void)
 {
   /* This is example 4 from SP800-38C, to test the long AAD code path. */
@@ -870,6 +870,475 @@ static void test_ocb_long(void)
 }
 #endif
 
+static void check_kw(const void *kek, size_t nkek,
+                     const void *plain, size_t nplain,
+                     const void *expect_wrapped, size_t nwrapped)
+{
+  uint8_t wrapped[40], unwrapped[32];
+
+  assert(nwrapped == nplain + 8);
+  assert(nwrapped <= sizeof wrapped);
+
+  cf_aes_context ctx;
+  cf_aes_init(&ctx, kek, nkek);
+
+  cf_kw_wrap(&cf_aes, &ctx, plain, nplain, wrapped);
+  TEST_CHECK(memcmp(wrapped, expect_wrapped, nwrapped) == 0);
+
+  int err = cf_kw_unwrap(&cf_aes, &ctx, expect_wrapped, nwrapped, unwrapped);
+  TEST_CHECK(err == 0);
+  TEST_CHECK(memcmp(unwrapped, plain, nplain) == 0);
+
+  wrapped[nwrapped - 1] ^= 0x01;
+  err = cf_kw_unwrap(&cf_aes, &ctx, wrapped, nwrapped, unwrapped);
+  TEST_CHECK(err == 1);
+
+  uint8_t zero[32] = { 0 };
+  TEST_CHECK(memcmp(unwrapped, zero, nplain) == 0);
+}
+
+static void test_kw(void)
+{
+  /* RFC3394 4.1 */
+  check_kw("\x00\x01\x02\x03\x04\x05\x06\x07\x08\x09\x0a\x0b\x0c\x0d\x0e\x0f", 16,
+           "\x00\x11\x22\x33\x44\x55\x66\x77\x88\x99\xaa\xbb\xcc\xdd\xee\xff", 16,
+           "\x1f\xa6\x8b\x0a\x81\x12\xb4\x47\xae\xf3\x4b\xd8\xfb\x5a\x7b\x82\x9d\x3e\x86\x23\x71\xd2\xcf\xe5", 24);
+
+  /* RFC3394 4.6 */
+  check_kw("\x00\x01\x02\x03\x04\x05\x06\x07\x08\x09\x0a\x0b\x0c\x0d\x0e\x0f\x10\x11\x12\x13\x14\x15\x16\x17\x18\x19\x1a\x1b\x1c\x1d\x1e\x1f", 32,
+           "\x00\x11\x22\x33\x44\x55\x66\x77\x88\x99\xaa\xbb\xcc\xdd\xee\xff\x00\x01\x02\x03\x04\x05\x06\x07\x08\x09\x0a\x0b\x0c\x0d\x0e\x0f", 32,
+           "\x28\xc9\xf4\x04\xc4\xb8\x10\xf4\xcb\xcc\xb3\x5c\xfb\x87\xf8\x26\x3f\x57\x86\xe2\xd8\x0e\xd3\x26\xcb\xc7\xf0\xe7\x1a\x99\xf4\x3b\xfb\x98\x8b\x9b\x7a\x02\xdd\x21", 40);
+}
+
+static void check_kwp(const void *kek, size_t nkek,
+                      const void *plain, size_t nplain,
+                      const void *expect_wrapped, size_t nwrapped)
+{
+  uint8_t wrapped[40], unwrapped[32];
+  size_t nunwrapped;
+
+  assert(nwrapped == CF_KWP_WRAPPED_SIZE(nplain));
+  assert(nwrapped <= sizeof wrapped);
+
+  cf_aes_context ctx;
+  cf_aes_init(&ctx, kek, nkek);
+
+  cf_kwp_wrap(&cf_aes, &ctx, plain, nplain, wrapped);
+  TEST_CHECK(memcmp(wrapped, expect_wrapped, nwrapped) == 0);
+
+  int err = cf_kwp_unwrap(&cf_aes, &ctx, expect_wrapped, nwrapped,
+                          unwrapped, &nunwrapped);
+  TEST_CHECK(err == 0);
+  TEST_CHECK(nunwrapped == nplain);
+  TEST_CHECK(memcmp(unwrapped, plain, nplain) == 0);
+
+  wrapped[0] ^= 0x01;
+  err = cf_kwp_unwrap(&cf_aes, &ctx, wrapped, nwrapped,
+                      unwrapped, &nunwrapped);
+  TEST_CHECK(err == 1);
+  TEST_CHECK(nunwrapped == 0);
+}
+
+static void test_kwp(void)
+{
+  /* RFC5649 6 */
+  check_kwp("\x58\x40\xdf\x6e\x29\xb0\x2a\xf1\xab\x49\x3b\x70\x5b\xf1\x6e\xa1\xae\x83\x38\xf4\xdc\xc1\x76\xa8", 24,
+            "\xc3\x7b\x7e\x64\x92\x58\x43\x40\xbe\xd1\x22\x07\x80\x89\x41\x15\x50\x68\xf7\x38", 20,
+            "\x13\x8b\xde\xaa\x9b\x8f\xa7\xfc\x61\xf9\x77\x42\xe7\x22\x48\xee\x5a\xe6\xae\x53\x60\xd1\xae\x6a\x5f\x54\xf3\x73\xfa\x54\x3b\x6a", 32);
+
+  check_kwp("\x58\x40\xdf\x6e\x29\xb0\x2a\xf1\xab\x49\x3b\x70\x5b\xf1\x6e\xa1\xae\x83\x38\xf4\xdc\xc1\x76\xa8", 24,
+            "\x46\x6f\x72\x50\x61\x73\x69", 7,
+            "\xaf\xbe\xb0\xf0\x7d\xfb\xf5\x41\x92\x00\xf2\xcc\xb5\x0b\xb2\x4f", 16);
+}
+
+static void test_kw_batch(void)
+{
+  /* A mixture of lengths and modes, more than fit in the
+   * batch at once, checked against the one-shot functions. */
+  enum { N = 21 };
+  uint8_t keys[N][32], wrapped[N][40], unwrapped[N][32];
+  cf_kw_item items[N];
+
+  cf_aes_context ctx;
+  cf_aes_init(&ctx, (const uint8_t *) "\x00\x01\x02\x03\x04\x05\x06\x07\x08\x09\x0a\x0b\x0c\x0d\x0e\x0f", 16);
+
+  for (size_t i = 0; i < N; i++)
+  {
+    int padded = i % 3 == 0;
+    size_t nkey = padded ? 1 + (i * 5) % 32 : 16 + 8 * (i % 3);
+
+    for (size_t j = 0; j < nkey; j++)
+      keys[i][j] = (uint8_t) (i * 31 + j);
+
+    items[i].wrapped = wrapped[i];
+    items[i].plain = unwrapped[i];
+    items[i].padded = padded;
+
+    if (padded)
+    {
+      cf_kwp_wrap(&cf_aes, &ctx, keys[i], nkey, wrapped[i]);
+      items[i].nwrapped = CF_KWP_WRAPPED_SIZE(nkey);
+    } else {
+      cf_kw_wrap(&cf_aes, &ctx, keys[i], nkey, wrapped[i]);
+      items[i].nwrapped = nkey + 8;
+    }
+  }
+
+  /* Corrupt one of each kind, and give one a bad length. */
+  wrapped[4][10] ^= 0x80;
+  wrapped[9][0] ^= 0x80;
+  items[14].nwrapped = 20;
+
+  int err = cf_kw_unwrap_batch(&cf_aes, &ctx, items, N);
+  TEST_CHECK(err != 0);
+
+  for (size_t i = 0; i < N; i++)
+  {
+    if (i == 4 || i == 9 || i == 14)
+    {
+      TEST_CHECK(items[i].err != 0);
+      TEST_CHECK(items[i].nplain == 0);
+      continue;
+    }
+
+    size_t nkey = items[i].padded ? 1 + (i * 5) % 32 : 16 + 8 * (i % 3);
+    TEST_CHECK(items[i].err == 0);
+    TEST_CHECK(items[i].nplain == nkey);
+    TEST_CHECK(memcmp(unwrapped[i], keys[i], nkey) == 0);
+  }
+}
+
+/* Batch tests: a batch of varied records must give the same
+ * results as the one-shot functions, and one bad tag must only
+ * fail its own record. */
+#define BATCH_N 11
+
+typedef struct
+{
+  uint8_t nonce[16], header[40], plain[80], cipher[80], tag[16], decrypted[80];
+} batch_bufs;
+
+static batch_bufs batch[BATCH_N];
+static cf_aead_record batch_enc[BATCH_N], batch_dec[BATCH_N];
+
+/* nnonce of zero means vary the nonce length. */
+static void batch_setup(size_t nnonce)
+{
+  for (size_t i = 0; i < BATCH_N; i++)
+  {
+    batch_bufs *b = &batch[i];
+    size_t nn = nnonce ? nnonce : 1 + (i * 5) % 15;
+    size_t nheader = (i * 7) % sizeof b->header;
+    size_t nplain = (i * 23) % sizeof b->plain;
+
+    memset(b, 0, sizeof *b);
+    for (size_t j = 0; j < sizeof b->nonce; j++)
+      b->nonce[j] = (uint8_t) (i + j);
+    for (size_t j = 0; j < sizeof b->header; j++)
+      b->header[j] = (uint8_t) (i * 3 + j);
+    for (size_t j = 0; j < sizeof b->plain; j++)
+      b->plain[j] = (uint8_t) (i * 5 + j);
+
+    cf_aead_record enc = { b->nonce, nn, b->header, nheader, b->plain, nplain, b->cipher, b->tag };
+    cf_aead_record dec = { b->nonce, nn, b->header, nheader, b->cipher, nplain, b->decrypted, b->tag };
+    batch_enc[i] = enc;
+    batch_dec[i] = dec;
+  }
+}
+
+static void batch_check_oneshot(size_t i, const uint8_t *cipher, const uint8_t *tag, size_t ntag)
+{
+  TEST_CHECK(memcmp(batch[i].cipher, cipher, batch_enc[i].nbytes) == 0);
+  TEST_CHECK(memcmp(batch[i].tag, tag, ntag) == 0);
+}
+
+static void batch_corrupt(void)
+{
+  batch[3].tag[0] ^= 0x01;
+}
+
+static void batch_check_decrypt(int err)
+{
+  uint8_t zero[80] = { 0 };
+
+  TEST_CHECK(err != 0);
+
+  for (size_t i = 0; i < BATCH_N; i++)
+  {
+    if (i == 3)
+    {
+      TEST_CHECK(batch_dec[i].err != 0);
+      TEST_CHECK(memcmp(batch[i].decrypted, zero, batch_dec[i].nbytes) == 0);
+    } else {
+      TEST_CHECK(batch_dec[i].err == 0);
+      TEST_CHECK(memcmp(batch[i].decrypted, batch[i].plain, batch_dec[i].nbytes) == 0);
+    }
+  }
+}
+
+static void test_batch(void)
+{
+  cf_aes_context aes;
+  cf_aes_init(&aes, (const uint8_t *) "\x00\x01\x02\x03\x04\x05\x06\x07\x08\x09\x0a\x0b\x0c\x0d\x0e\x0f", 16);
+
+  uint8_t cipher[80], tag[16];
+
+  /* GCM */
+  batch_setup(0);
+  cf_gcm_encrypt_batch(&cf_aes, &aes, batch_enc, BATCH_N, 16);
+  for (size_t i = 0; i < BATCH_N; i++)
+  {
+    cf_aead_record *r = &batch_enc[i];
+    cf_gcm_encrypt(&cf_aes, &aes, r->in, r->nbytes, r->header, r->nheader,
+                   r->nonce, r->nnonce, cipher, tag, 16);
+    batch_check_oneshot(i, cipher, tag, 16);
+  }
+  batch_corrupt();
+  batch_check_decrypt(cf_gcm_decrypt_batch(&cf_aes, &aes, batch_dec, BATCH_N, 16));
+
+  /* EAX */
+  batch_setup(0);
+  cf_eax_encrypt_batch(&cf_aes, &aes, batch_enc, BATCH_N, 12);
+  for (size_t i = 0; i < BATCH_N; i++)
+  {
+    cf_aead_record *r = &batch_enc[i];
+    cf_eax_encrypt(&cf_aes, &aes, r->in, r->nbytes, r->header, r->nheader,
+                   r->nonce, r->nnonce, cipher, tag, 12);
+    batch_check_oneshot(i, cipher, tag, 12);
+  }
+  batch_corrupt();
+  batch_check_decrypt(cf_eax_decrypt_batch(&cf_aes, &aes, batch_dec, BATCH_N, 12));
+
+  /* CCM, with L = 3 */
+  batch_setup(12);
+  cf_ccm_encrypt_batch(&cf_aes, &aes, batch_enc, BATCH_N, 3, 8);
+  for (size_t i = 0; i < BATCH_N; i++)
+  {
+    cf_aead_record *r = &batch_enc[i];
+    cf_ccm_encrypt(&cf_aes, &aes, r->in, r->nbytes, 3, r->header, r->nheader,
+                   r->nonce, r->nnonce, cipher, tag, 8);
+    batch_check_oneshot(i, cipher, tag, 8);
+  }
+  batch_corrupt();
+  batch_check_decrypt(cf_ccm_decrypt_batch(&cf_aes, &aes, batch_dec, BATCH_N, 3, 8));
+
+  /* OCB */
+  batch_setup(12);
+  cf_ocb_encrypt_batch(&cf_aes, &aes, batch_enc, BATCH_N, 16);
+  for (size_t i = 0; i < BATCH_N; i++)
+  {
+    cf_aead_record *r = &batch_enc[i];
+    cf_ocb_encrypt(&cf_aes, &aes, r->in, r->nbytes, r->header, r->nheader,
+                   r->nonce, r->nnonce, cipher, tag, 16);
+    batch_check_oneshot(i, cipher, tag, 16);
+  }
+  batch_corrupt();
+  batch_check_decrypt(cf_ocb_decrypt_batch(&cf_aes, &aes, batch_dec, BATCH_N, 16));
+}
+
+/* Scatter/gather tests: awkwardly fragmented inputs and outputs
+ * must give the same results as the contiguous functions. */
+static size_t iov_split(cf_iovec *iov, size_t maxiov,
+                        uint8_t *buf, size_t len,
+                        const size_t *pattern, size_t npattern)
+{
+  size_t niov = 0;
+
+  for (size_t i = 0; len || i < npattern; i++)
+  {
+    size_t take = MIN(len, pattern[i % npattern]);
+    assert(niov < maxiov);
+    iov[niov].base = buf;
+    iov[niov].len = take;
+    niov++;
+    buf += take;
+    len -= take;
+  }
+
+  return niov;
+}
+
+static void test_iov(void)
+{
+  static const size_t pat_a[] = { 0, 1, 15, 17, 3, 32 },
+                      pat_b[] = { 7, 0, 16, 9 },
+                      pat_c[] = { 5, 11 };
+
+  uint8_t plain[100], header[45], nonce[12];
+  uint8_t expect_cipher[100], expect_tag[16];
+  uint8_t cipher[100], tag[16], decrypted[100];
+  cf_iovec plain_iov[64], header_iov[64], cipher_iov[64], out_iov[64];
+  size_t nplain_iov, nheader_iov, ncipher_iov, nout_iov;
+
+  for (size_t i = 0; i < sizeof plain; i++)
+    plain[i] = (uint8_t) i;
+  for (size_t i = 0; i < sizeof header; i++)
+    header[i] = (uint8_t) (0x80 + i);
+  memset(nonce, 0x5a, sizeof nonce);
+
+  cf_aes_context aes;
+  cf_aes_init(&aes, (const uint8_t *) "\x00\x01\x02\x03\x04\x05\x06\x07\x08\x09\x0a\x0b\x0c\x0d\x0e\x0f", 16);
+
+  nplain_iov = iov_split(plain_iov, 64, plain, sizeof plain, pat_a, 6);
+  nheader_iov = iov_split(header_iov, 64, header, sizeof header, pat_c, 2);
+  ncipher_iov = iov_split(cipher_iov, 64, cipher, sizeof cipher, pat_b, 4);
+  nout_iov = iov_split(out_iov, 64, decrypted, sizeof decrypted, pat_c, 2);
+
+  /* GCM */
+  cf_gcm_encrypt(&cf_aes, &aes, plain, sizeof plain, header, sizeof header,
+                 nonce, sizeof nonce, expect_cipher, expect_tag, 16);
+  cf_gcm_encrypt_iov(&cf_aes, &aes, plain_iov, nplain_iov, header_iov, nheader_iov,
+                     nonce, sizeof nonce, cipher_iov, ncipher_iov, tag, 16);
+  TEST_CHECK(memcmp(cipher, expect_cipher, sizeof cipher) == 0);
+  TEST_CHECK(memcmp(tag, expect_tag, 16) == 0);
+  TEST_CHECK(0 == cf_gcm_decrypt_iov(&cf_aes, &aes, cipher_iov, ncipher_iov, header_iov, nheader_iov,
+                                     nonce, sizeof nonce, tag, 16, out_iov, nout_iov));
+  TEST_CHECK(memcmp(decrypted, plain, sizeof plain) == 0);
+  tag[0] ^= 1;
+  TEST_CHECK(0 != cf_gcm_decrypt_iov(&cf_aes, &aes, cipher_iov, ncipher_iov, header_iov, nheader_iov,
+                                     nonce, sizeof nonce, tag, 16, out_iov, nout_iov));
+
+  /* EAX */
+  cf_eax_encrypt(&cf_aes, &aes, plain, sizeof plain, header, sizeof header,
+                 nonce, sizeof nonce, expect_cipher, expect_tag, 16);
+  cf_eax_encrypt_iov(&cf_aes, &aes, plain_iov, nplain_iov, header_iov, nheader_iov,
+                     nonce, sizeof nonce, cipher_iov, ncipher_iov, tag, 16);
+  TEST_CHECK(memcmp(cipher, expect_cipher, sizeof cipher) == 0);
+  TEST_CHECK(memcmp(tag, expect_tag, 16) == 0);
+  TEST_CHECK(0 == cf_eax_decrypt_iov(&cf_aes, &aes, cipher_iov, ncipher_iov, header_iov, nheader_iov,
+                                     nonce, sizeof nonce, tag, 16, out_iov, nout_iov));
+  TEST_CHECK(memcmp(decrypted, plain, sizeof plain) == 0);
+  tag[0] ^= 1;
+  TEST_CHECK(0 != cf_eax_decrypt_iov(&cf_aes, &aes, cipher_iov, ncipher_iov, header_iov, nheader_iov,
+                                     nonce, sizeof nonce, tag, 16, out_iov, nout_iov));
+
+  /* CCM, with L = 3 */
+  cf_ccm_encrypt(&cf_aes, &aes, plain, sizeof plain, 3, header, sizeof header,
+                 nonce, sizeof nonce, expect_cipher, expect_tag, 16);
+  cf_ccm_encrypt_iov(&cf_aes, &aes, plain_iov, nplain_iov, 3, header_iov, nheader_iov,
+                     nonce, sizeof nonce, cipher_iov, ncipher_iov, tag, 16);
+  TEST_CHECK(memcmp(cipher, expect_cipher, sizeof cipher) == 0);
+  TEST_CHECK(memcmp(tag, expect_tag, 16) == 0);
+  TEST_CHECK(0 == cf_ccm_decrypt_iov(&cf_aes, &aes, cipher_iov, ncipher_iov, 3, header_iov, nheader_iov,
+                                     nonce, sizeof nonce, tag, 16, out_iov, nout_iov));
+  TEST_CHECK(memcmp(decrypted, plain, sizeof plain) == 0);
+  tag[0] ^= 1;
+  TEST_CHECK(0 != cf_ccm_decrypt_iov(&cf_aes, &aes, cipher_iov, ncipher_iov, 3, header_iov, nheader_iov,
+                                     nonce, sizeof nonce, tag, 16, out_iov, nout_iov));
+
+  /* OCB */
+  cf_ocb_encrypt(&cf_aes, &aes, plain, sizeof plain, header, sizeof header,
+                 nonce, sizeof nonce, expect_cipher, expect_tag, 16);
+  cf_ocb_encrypt_iov(&cf_aes, &aes, plain_iov, nplain_iov, header_iov, nheader_iov,
+                     nonce, sizeof nonce, cipher_iov, ncipher_iov, tag, 16);
+  TEST_CHECK(memcmp(cipher, expect_cipher, sizeof cipher) == 0);
+  TEST_CHECK(memcmp(tag, expect_tag, 16) == 0);
+  TEST_CHECK(0 == cf_ocb_decrypt_iov(&cf_aes, &aes, cipher_iov, ncipher_iov, header_iov, nheader_iov,
+                                     nonce, sizeof nonce, tag, 16, out_iov, nout_iov));
+  TEST_CHECK(memcmp(decrypted, plain, sizeof plain) == 0);
+  tag[0] ^= 1;
+  TEST_CHECK(0 != cf_ocb_decrypt_iov(&cf_aes, &aes, cipher_iov, ncipher_iov, header_iov, nheader_iov,
+                                     nonce, sizeof nonce, tag, 16, out_iov, nout_iov));
+}
+
+/* EAX and CCM MAC and encrypt in one pass: check in-place operation
+ * against separate buffers, and what is left in the buffer when the
+ * tag is wrong. */
+static void test_inplace(void)
+{
+  uint8_t key[16], nonce[13], header[7], tag[16];
+  uint8_t plain[67], expect[67], buf[67], zero[67] = { 0 };
+
+  fill(key, sizeof key, 0x40);
+  fill(nonce, sizeof nonce, 0x10);
+  fill(header, sizeof header, 0x30);
+  fill(plain, sizeof plain, 0x20);
+
+  cf_aes_context ctx;
+  cf_aes_init(&ctx, key, sizeof key);
+
+  /* EAX */
+  cf_eax_encrypt(&cf_aes, &ctx, plain, sizeof plain, header, sizeof header,
+                 nonce, sizeof nonce, expect, tag, sizeof tag);
+  memcpy(buf, plain, sizeof buf);
+  cf_eax_encrypt(&cf_aes, &ctx, buf, sizeof buf, header, sizeof header,
+                 nonce, sizeof nonce, buf, tag, sizeof tag);
+  TEST_CHECK(memcmp(buf, expect, sizeof buf) == 0);
+
+  TEST_CHECK(0 == cf_eax_decrypt(&cf_aes, &ctx, buf, sizeof buf, header, sizeof header,
+                                 nonce, sizeof nonce, tag, sizeof tag, buf));
+  TEST_CHECK(memcmp(buf, plain, sizeof buf) == 0);
+
+  /* Nothing is written on error, so the ciphertext survives. */
+  memcpy(buf, expect, sizeof buf);
+  tag[0] ^= 0x80;
+  TEST_CHECK(1 == cf_eax_decrypt(&cf_aes, &ctx, buf, sizeof buf, header, sizeof header,
+                                 nonce, sizeof nonce, tag, sizeof tag, buf));
+  TEST_CHECK(memcmp(buf, expect, sizeof buf) == 0);
+
+  /* CCM, with L = 2 */
+  cf_ccm_encrypt(&cf_aes, &ctx, plain, sizeof plain, 2, header, sizeof header,
+                 nonce, sizeof nonce, expect, tag, sizeof tag);
+  memcpy(buf, plain, sizeof buf);
+  cf_ccm_encrypt(&cf_aes, &ctx, buf, sizeof buf, 2, header, sizeof header,
+                 nonce, sizeof nonce, buf, tag, sizeof tag);
+  TEST_CHECK(memcmp(buf, expect, sizeof buf) == 0);
+
+  TEST_CHECK(0 == cf_ccm_decrypt(&cf_aes, &ctx, buf, sizeof buf, 2, header, sizeof header,
+                                 nonce, sizeof nonce, tag, sizeof tag, buf));
+  TEST_CHECK(memcmp(buf, plain, sizeof buf) == 0);
+
+  memcpy(buf, expect, sizeof buf);
+  tag[0] ^= 0x80;
+  TEST_CHECK(1 == cf_ccm_decrypt(&cf_aes, &ctx, buf, sizeof buf, 2, header, sizeof header,
+                                 nonce, sizeof nonce, tag, sizeof tag, buf));
+  TEST_CHECK(memcmp(buf, zero, sizeof buf) == 0);
+}
+
+#if !MCU_TARGET
+/* Check a long message decrypted in place, and that nothing is
+ * written when the tag is wrong. */
+static void test_gcm_long(void)
+{
+  uint8_t key[16], nonce[12], header[20], tag[16];
+  static uint8_t plain[5000], buf[5000], expect[5000];
+
+  fill(key, sizeof key, 0x40);
+  fill(nonce, sizeof nonce, 0x10);
+  fill(header, sizeof header, 0x30);
+  fill(plain, sizeof plain, 0x20);
+
+  cf_aes_context ctx;
+  cf_aes_init(&ctx, key, sizeof key);
+
+  cf_gcm_encrypt(&cf_aes, &ctx,
+                 plain, sizeof plain,
+                 header, sizeof header,
+                 nonce, sizeof nonce,
+                 expect,
+                 tag, sizeof tag);
+
+  memcpy(buf, expect, sizeof buf);
+  TEST_CHECK(0 == cf_gcm_decrypt(&cf_aes, &ctx,
+                                 buf, sizeof buf,
+                                 header, sizeof header,
+                                 nonce, sizeof nonce,
+                                 tag, sizeof tag,
+                                 buf));
+  TEST_CHECK(memcmp(buf, plain, sizeof plain) == 0);
+
+  memcpy(buf, expect, sizeof buf);
+  tag[15] ^= 0x01;
+  TEST_CHECK(1 == cf_gcm_decrypt(&cf_aes, &ctx,
+                                 buf, sizeof buf,
+                                 header, sizeof header,
+                                 nonce, sizeof nonce,
+                                 tag, sizeof tag,
+                                 buf));
+  TEST_CHECK(memcmp(buf, expect, sizeof buf) == 0);
+}
+#endif
+
 TEST_LIST = {
   { "cbc", test_cbc },
   { "cbcmac", test_cbcmac },
@@ -880,10 +1349,17 @@ TEST_LIST = {
   { "gcm", test_gcm },
   { "ccm", test_ccm },
   { "ocb", test_ocb },
+  { "kw", test_kw },
+  { "kwp", test_kwp },
+  { "kw-batch", test_kw_batch },
+  { "aead-batch", test_batch },
+  { "aead-iov", test_iov },
+  { "aead-inplace", test_inplace },
   /* These remaining tests are too big for microcontroller targets. */
 #if !MCU_TARGET
   { "ccm-long", test_ccm_long },
   { "ocb-long", test_ocb_long },
+  { "gcm-long", test_gcm_long },
 #endif
   { 0 }
 };
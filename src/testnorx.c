@@ -17,6 +17,13 @@
 #include "cutest.h"
 #include "testutil.h"
 
+/* Some tests are too big for microcontrollers. */
+#if defined(CORTEX_M0) || defined(CORTEX_M3) || defined(CORTEX_M4)
+# define MCU_TARGET 1
+#else
+# define MCU_TARGET 0
+#endif
+
 static void test_vector(void)
 {
   uint8_t K[16], N[8], A[128], M[128], Z[128], C[128], T[16];
@@ -110,9 +117,282 @@ static void test_kat(void)
   }
 }
 
+#if !MCU_TARGET
+/* Same layout and fill as testnorx.katdata.inc.  This was generated
+ * from a model of the v2.0 spec which reproduces the NORX32 KAT;
+ * it has not been checked against the reference implementation. */
+#include "testnorx64.katdata.inc"
+
+static void test_kat64(void)
+{
+  uint8_t K[32], N[16], H[256], W[256];
+  const uint8_t *kats = kat64_data;
+
+#define FILL(arr, c) \
+  do { \
+    for (size_t i = 0; i < sizeof arr; i++) \
+      arr[i] = (i * c + 123) & 0xff; \
+  } while (0)
+  FILL(N, 181);
+  FILL(K, 191);
+  FILL(H, 193);
+  FILL(W, 197);
+#undef FILL
+
+  for (size_t i = 0; i < sizeof W; i++)
+  {
+    uint8_t C[256];
+    uint8_t A[32];
+
+    cf_norx64_encrypt(K, N,
+                      H, i,
+                      W, i,
+                      NULL, 0,
+                      C, A);
+
+    TEST_CHECK(memcmp(kats, C, i) == 0);
+    kats += i;
+    TEST_CHECK(memcmp(kats, A, sizeof A) == 0);
+    kats += sizeof A;
+
+    uint8_t M[256] = { 0 };
+    TEST_CHECK(0 == cf_norx64_decrypt(K, N,
+                                      H, i,
+                                      C, i,
+                                      NULL, 0,
+                                      A, M));
+
+    TEST_CHECK(0 == memcmp(M, W, i));
+
+    A[31] ^= 0x01;
+    TEST_CHECK(cf_norx64_decrypt(K, N,
+                                 H, i,
+                                 C, i,
+                                 NULL, 0,
+                                 A, M));
+  }
+}
+#endif
+
+static void check_parallel_vector(unsigned p, const char *expect_C_hex, const char *expect_T_hex)
+{
+  uint8_t K[16], N[8], A[128], M[128], Z[128], C[128], T[16];
+
+  unhex(K, sizeof K, "000102030405060708090a0b0c0d0e0f");
+  unhex(N, sizeof N, "f0e0d0c0b0a09080");
+
+  for (unsigned i = 0; i < 128; i++)
+  {
+    A[i] = M[i] = Z[i] = i;
+  }
+
+  cf_norx32_encrypt_parallel(p, K, N,
+                             A, sizeof A,
+                             M, sizeof M,
+                             Z, sizeof Z,
+                             C, T);
+
+  uint8_t expect_C[128], expect_T[16];
+  unhex(expect_C, sizeof expect_C, expect_C_hex);
+  unhex(expect_T, sizeof expect_T, expect_T_hex);
+
+  TEST_CHECK(memcmp(C, expect_C, sizeof C) == 0);
+  TEST_CHECK(memcmp(T, expect_T, sizeof T) == 0);
+
+  uint8_t M2[128];
+  TEST_CHECK(0 ==
+             cf_norx32_decrypt_parallel(p, K, N,
+                                        A, sizeof A,
+                                        C, sizeof C,
+                                        Z, sizeof Z,
+                                        T,
+                                        M2));
+  TEST_CHECK(memcmp(M, M2, sizeof M) == 0);
+
+  T[0] ^= 0xff;
+  TEST_CHECK(cf_norx32_decrypt_parallel(p, K, N,
+                                        A, sizeof A,
+                                        C, sizeof C,
+                                        Z, sizeof Z,
+                                        T,
+                                        M2));
+}
+
+static void test_parallel_vector(void)
+{
+  /* Same inputs as test_vector, for NORX32-4-2 and NORX32-4-4. */
+  check_parallel_vector(2,
+                        "5dd7d4e7a0123a15a1f09b08510acfdb148d546bf1fc81f0d1642c210e9c568ca86c7960233d607bba210f097dc8fd35feb3f242814585bc89c6cc6a108fb9a238f748644a22832c4bb394947e919a8ad68ac526b2663e310c76bc2b044a505dcfa5aea4e3276493189fa775adbdb6e376e219418719d1245b3f58d55ac886c4",
+                        "36fd1ed2540acd5a5cb531d527462969");
+  check_parallel_vector(4,
+                        "42585cd082d2e4d1160d7b4a1a59eb517fa32e78a9f08c63042ae6c7665f826acdbf8eca079a8a473c6d24ed77f865e895ca5def520be417a9d3c1e894bba7dc4c429fbfb201976b878b89226f98aff021305bf60f2f53993e40b965aa127180889568acb059f76ba17b136b4670414b0acf9e7bfe96ed2f2d223af8080e4aea",
+                        "ecb36db410ddc77971f7d50477e1107a");
+}
+
+static void test_parallel_lengths(void)
+{
+  uint8_t K[16], N[8], H[1024], W[1024];
+
+#define FILL(arr, c) \
+  do { \
+    for (size_t i = 0; i < sizeof arr; i++) \
+      arr[i] = (i * c + 123) & 0xff; \
+  } while (0)
+  FILL(N, 181);
+  FILL(K, 191);
+  FILL(H, 193);
+  FILL(W, 197);
+#undef FILL
+
+  /* NORX32-4-4 tags for lengths which end each lane in turn, with
+   * header and trailer cut from H. */
+  static const struct
+  {
+    size_t len;
+    const char *tag;
+  } tags[] = {
+    { 0, "e818161fd50c722c137eebddf60b01ac" },
+    { 1, "35c5d72568fa39096a88be6f85ca7cef" },
+    { 47, "4897c0c0b699667eabf71e6d99d61e3d" },
+    { 48, "b5e5a3659ec0e6c1d50597888dc52f1a" },
+    { 95, "348028ae0c0ff9da82a3bad84be06553" },
+    { 96, "fe586c3a1dacd0ca764cc80a89d78f66" },
+    { 143, "17825c10d1b963c23fb07f28e26c1da4" },
+    { 144, "ebc8031e62b2344e4dd87d5f27b7f19c" },
+    { 191, "951e00e307b9c63f63a6ec4678fa43c1" },
+    { 192, "0c7f1d49d3e5ab59b0ec2ae23a7c560b" },
+    { 193, "bbd65058a95bfdea2f8b7f50ab290fc5" },
+    { 500, "93e890b0e5a8384ee0cbf9f9aacc8d00" },
+    { 1024, "fc74f5936b736e0a0593b95fd90f9d3f" },
+  };
+
+  for (size_t i = 0; i < ARRAYCOUNT(tags); i++)
+  {
+    size_t len = tags[i].len;
+    uint8_t C[1024], M[1024], T[16], expect_T[16];
+
+    cf_norx32_encrypt_parallel(4, K, N,
+                               H, len % 100,
+                               W, len,
+                               H, len % 37,
+                               C, T);
+    unhex(expect_T, sizeof expect_T, tags[i].tag);
+    TEST_CHECK(memcmp(T, expect_T, sizeof T) == 0);
+
+    /* Every degree round-trips, and p = 1 is plain NORX32. */
+    for (unsigned p = 1; p <= 4; p++)
+    {
+      cf_norx32_encrypt_parallel(p, K, N,
+                                 H, len % 100,
+                                 W, len,
+                                 H, len % 37,
+                                 C, T);
+      TEST_CHECK(0 == cf_norx32_decrypt_parallel(p, K, N,
+                                                 H, len % 100,
+                                                 C, len,
+                                                 H, len % 37,
+                                                 T, M));
+      TEST_CHECK(0 == memcmp(M, W, len));
+
+      if (p == 1)
+      {
+        uint8_t C1[1024], T1[16];
+        cf_norx32_encrypt(K, N,
+                          H, len % 100,
+                          W, len,
+                          H, len % 37,
+                          C1, T1);
+        TEST_CHECK(0 == memcmp(C, C1, len));
+        TEST_CHECK(0 == memcmp(T, T1, sizeof T));
+      }
+    }
+  }
+}
+
+/* Feeds buf to fn in pieces of assorted sizes. */
+#define PIECEWISE(fn, ctx, buf, nbuf) \
+  do { \
+    static const size_t sizes_[] = { 1, 3, 0, 47, 48, 49, 5, 100 }; \
+    size_t off_ = 0, k_ = 0; \
+    while (off_ < (nbuf)) \
+    { \
+      size_t n_ = MIN(sizes_[k_++ % ARRAYCOUNT(sizes_)], (nbuf) - off_); \
+      fn(ctx, (buf) + off_, n_); \
+      off_ += n_; \
+    } \
+  } while (0)
+
+#define ENCRYPT_UPDATE(ctx, buf, n) cf_norx32_encrypt_update(ctx, buf, C2 + (buf - W), n)
+#define DECRYPT_UPDATE(ctx, buf, n) cf_norx32_decrypt_update(ctx, buf, buf, n)
+
+static void test_incremental(void)
+{
+  uint8_t K[16], N[8], H[300], W[300], Z[300];
+
+#define FILL(arr, c) \
+  do { \
+    for (size_t i = 0; i < sizeof arr; i++) \
+      arr[i] = (i * c + 123) & 0xff; \
+  } while (0)
+  FILL(N, 181);
+  FILL(K, 191);
+  FILL(H, 193);
+  FILL(W, 197);
+  FILL(Z, 199);
+#undef FILL
+
+  static const size_t lengths[] = { 0, 1, 47, 48, 49, 95, 96, 97, 300 };
+
+  for (size_t i = 0; i < ARRAYCOUNT(lengths); i++)
+  {
+    for (size_t j = 0; j < ARRAYCOUNT(lengths); j++)
+    {
+      size_t nh = lengths[i], nw = lengths[j], nz = lengths[(i + j) % ARRAYCOUNT(lengths)];
+      uint8_t C[300], T[16], C2[300], T2[16];
+
+      cf_norx32_encrypt(K, N, H, nh, W, nw, Z, nz, C, T);
+
+      cf_norx32_ctx ctx;
+      cf_norx32_init(&ctx, K, N);
+      PIECEWISE(cf_norx32_header, &ctx, H, nh);
+      PIECEWISE(ENCRYPT_UPDATE, &ctx, W, nw);
+      PIECEWISE(cf_norx32_trailer, &ctx, Z, nz);
+      cf_norx32_finish(&ctx, T2);
+
+      TEST_CHECK(memcmp(C, C2, nw) == 0);
+      TEST_CHECK(memcmp(T, T2, sizeof T) == 0);
+
+      /* Decrypt in place. */
+      cf_norx32_init(&ctx, K, N);
+      PIECEWISE(cf_norx32_header, &ctx, H, nh);
+      PIECEWISE(DECRYPT_UPDATE, &ctx, C2, nw);
+      PIECEWISE(cf_norx32_trailer, &ctx, Z, nz);
+      TEST_CHECK(0 == cf_norx32_verify(&ctx, T));
+      TEST_CHECK(memcmp(C2, W, nw) == 0);
+
+      T[15] ^= 0x01;
+      cf_norx32_init(&ctx, K, N);
+      cf_norx32_header(&ctx, H, nh);
+      cf_norx32_decrypt_update(&ctx, C, C2, nw);
+      cf_norx32_trailer(&ctx, Z, nz);
+      TEST_CHECK(cf_norx32_verify(&ctx, T));
+    }
+  }
+}
+
+#undef PIECEWISE
+#undef ENCRYPT_UPDATE
+#undef DECRYPT_UPDATE
+
 TEST_LIST = {
   { "vector", test_vector },
   { "kat", test_kat },
+#if !MCU_TARGET
+  { "kat64", test_kat64 },
+#endif
+  { "parallel-vector", test_parallel_vector },
+  { "parallel-lengths", test_parallel_lengths },
+  { "incremental", test_incremental },
   { 0 }
 };
 
@@ -36,6 +36,14 @@ static void check(const char *rstr, const char *sstr,
   cf_poly1305_finish(&ctx, out);
 
   TEST_CHECK(memcmp(out, tag, 16) == 0);
+
+  /* Again, a byte at a time. */
+  cf_poly1305_init(&ctx, r, s);
+  for (size_t i = 0; i < nmsg; i++)
+    cf_poly1305_update(&ctx, msg + i, 1);
+  cf_poly1305_finish(&ctx, out);
+
+  TEST_CHECK(memcmp(out, tag, 16) == 0);
 }
 
 static void test_poly1305(void)
@@ -96,7 +104,135 @@ static void test_poly1305(void)
         "13000000000000000000000000000000");
 }
 
+static void test_poly1305_long(void)
+{
+  /* Generated by libsodium: crypto_onetimeauth.  All-ones input
+   * keeps the accumulator limbs near their largest. */
+  uint8_t key[32], msg[1000], tag[16], out[16];
+
+  unhex(key, sizeof key, "01060b10151a1f24292e33383d42474c51565b60656a6f74797e83888d92979c");
+  unhex(tag, sizeof tag, "8984817e238884d803ddabb8f6359ece");
+  memset(msg, 0xff, sizeof msg);
+
+  cf_poly1305 ctx;
+  cf_poly1305_init(&ctx, key, key + 16);
+  cf_poly1305_update(&ctx, msg, 7);
+  cf_poly1305_update(&ctx, msg + 7, sizeof msg - 7);
+  cf_poly1305_finish(&ctx, out);
+
+  TEST_CHECK(memcmp(out, tag, 16) == 0);
+}
+
+static void test_poly1305_paths(void)
+{
+  /* Long updates take the multi-block path where there is one;
+   * single bytes never do.  They must agree. */
+  uint8_t key[32], msg[1100], one[16], split[16];
+  static const size_t lengths[] = { 255, 256, 260, 300, 512, 1023, 1100 };
+
+  for (size_t i = 0; i < sizeof key; i++)
+    key[i] = (uint8_t) (0xff - i);
+  for (size_t i = 0; i < sizeof msg; i++)
+    msg[i] = (uint8_t) (i * 131 + (i >> 8));
+
+  for (size_t l = 0; l < ARRAYCOUNT(lengths); l++)
+  {
+    size_t n = lengths[l];
+    cf_poly1305 ctx;
+
+    cf_poly1305_init(&ctx, key, key + 16);
+    cf_poly1305_update(&ctx, msg, 3);
+    cf_poly1305_update(&ctx, msg + 3, n - 3);
+    cf_poly1305_finish(&ctx, one);
+
+    cf_poly1305_init(&ctx, key, key + 16);
+    for (size_t i = 0; i < n; i++)
+      cf_poly1305_update(&ctx, msg + i, 1);
+    cf_poly1305_finish(&ctx, split);
+
+    TEST_CHECK(memcmp(one, split, 16) == 0);
+  }
+}
+
+static void test_poly1305_batch(void)
+{
+  /* More items than lanes, with lengths which finish at different
+   * times, each with its own key.  They must match one at a time. */
+  static const size_t lengths[] = {
+    0, 1, 15, 16, 17, 31, 32, 33, 64, 100, 255, 256, 1000, 3, 0, 48, 129, 16, 1
+  };
+  enum { N = sizeof lengths / sizeof lengths[0] };
+  uint8_t keys[N][32], msg[1024], tags[N][16], expect[16];
+  cf_poly1305_item items[N];
+
+  for (size_t i = 0; i < sizeof msg; i++)
+    msg[i] = (uint8_t) (i * 7 + 1);
+
+  for (size_t k = 0; k < N; k++)
+  {
+    /* The last key is all ones, which stresses the carries. */
+    for (size_t i = 0; i < 32; i++)
+      keys[k][i] = k == N - 1 ? 0xff : (uint8_t) (k * 33 + i * 5);
+
+    items[k] = (cf_poly1305_item) {
+      .key = keys[k],
+      .msg = msg + k,
+      .nmsg = lengths[k],
+      .tag = tags[k]
+    };
+  }
+
+  cf_poly1305_batch(items, N);
+
+  for (size_t k = 0; k < N; k++)
+  {
+    cf_poly1305 ctx;
+    cf_poly1305_init(&ctx, keys[k], keys[k] + 16);
+    cf_poly1305_update(&ctx, items[k].msg, items[k].nmsg);
+    cf_poly1305_finish(&ctx, expect);
+    TEST_CHECK(memcmp(expect, tags[k], 16) == 0);
+  }
+
+  TEST_CHECK(cf_poly1305_verify_batch(items, N) == 0);
+  for (size_t k = 0; k < N; k++)
+    TEST_CHECK(items[k].err == 0);
+
+  /* Fragments give the same tags as contiguous messages. */
+  cf_iovec iov[3] = {
+    { msg + 12, 5 },
+    { msg + 17, 0 },
+    { msg + 17, lengths[12] - 5 }
+  };
+  uint8_t fragtag[16];
+  cf_poly1305_item frag = {
+    .key = keys[12],
+    .msg = msg,
+    .nmsg = 1,
+    .iov = iov,
+    .niov = 3,
+    .tag = fragtag
+  };
+  cf_poly1305_batch(&frag, 1);
+  TEST_CHECK(memcmp(fragtag, tags[12], 16) == 0);
+
+  /* One long message alone: every other lane is idle through runs
+   * of many whole blocks. */
+  items[12].tag = fragtag;
+  cf_poly1305_batch(&items[12], 1);
+  TEST_CHECK(memcmp(fragtag, tags[12], 16) == 0);
+  items[12].tag = tags[12];
+
+  /* A bad tag only fails its own item. */
+  tags[12][15] ^= 0x80;
+  TEST_CHECK(cf_poly1305_verify_batch(items, N) != 0);
+  for (size_t k = 0; k < N; k++)
+    TEST_CHECK(items[k].err == (k == 12));
+}
+
 TEST_LIST = {
   { "poly1305", test_poly1305 },
+  { "poly1305-long", test_poly1305_long },
+  { "poly1305-paths", test_poly1305_paths },
+  { "poly1305-batch", test_poly1305_batch },
   { 0 }
 };
@@ -18,6 +18,13 @@
 #include "handy.h"
 #include "cutest.h"
 
+/* Some tests are too big for microcontrollers. */
+#if defined(CORTEX_M0) || defined(CORTEX_M3) || defined(CORTEX_M4)
+# define MCU_TARGET 1
+#else
+# define MCU_TARGET 0
+#endif
+
 static void test_salsa20_core(void)
 {
   uint8_t k0[16], k1[16], nonce[16], sigma[16], out[64], expect[64];
@@ -93,21 +100,19 @@ static void test_salsa20_core(void)
 static void test_salsa20(void)
 {
   cf_salsa20_ctx ctx;
-  uint8_t key[32], nonce[8], cipher[64], expect[64];
+  uint8_t key[32], nonce[16], cipher[64], expect[64];
 
   unhex(key, 32, "0102030405060708090a0b0c0d0e0f10c9cacbcccdcecfd0d1d2d3d4d5d6d7d8");
-  memset(nonce, 0, 8);
+  unhex(nonce, 16, "65666768696a6b6c6d6e6f7071727374");
 
-  cf_salsa20_init(&ctx, key, sizeof key, nonce);
-  unhex(ctx.nonce, 16, "65666768696a6b6c6d6e6f7071727374");
+  cf_salsa20_init_custom(&ctx, key, sizeof key, nonce);
   memset(cipher, 0, 64);
   cf_salsa20_cipher(&ctx, cipher, cipher, 64);
 
   unhex(expect, 64, "45254427290f6bc1ff8b7a06aae9d9625990b66a1533c841ef31de22d772287e68c507e1c5991f02664e4cb054f5f6b8b1a0858206489577c0c384ecea67f64a");
   TEST_CHECK(memcmp(expect, cipher, 64) == 0);
 
-  cf_salsa20_init(&ctx, key, 16, nonce);
-  unhex(ctx.nonce, 16, "65666768696a6b6c6d6e6f7071727374");
+  cf_salsa20_init_custom(&ctx, key, 16, nonce);
   memset(cipher, 0, 64);
   cf_salsa20_cipher(&ctx, cipher, cipher, 64);
 
@@ -131,6 +136,63 @@ static void test_salsa20_against_nacl(void)
   TEST_CHECK(memcmp(expect, cipher, sizeof(cipher)) == 0);
 }
 
+static void test_salsa20_long_against_nacl(void)
+{
+  /* As above, but long enough to use every multi-block path:
+   * 8 blocks, then 4, then 3 one at a time, then a partial block. */
+  uint8_t key[32], nonce[8], cipher[1000], expect[1000];
+
+  unhex(key, 32, "7365637265746b65797365637265746b65797365637265746b65797365637265");
+  unhex(nonce, 8, "6e6f6e63656e6f6e");
+  unhex(expect, 1000, "cdb2a9faa90c95c11d9e0aa095ec4bca441ee3ebec629ebeb3037f37316b1e275c990e0668f90f38622cb1997e4dcd3c27f5323ce3729a8ae0f94e2cfe1fe58fc71aa5210cac089cc6b2fc092fb38686d1adb2d9763f8d89691e485547561e0da4d68c276708dca0bee1cd3667c76e5c79fe71ab18d32f63f3862024a78e8e669045da5f5506620c282553e6501c4e011a4cb2e2c139097ad5ee5f18d11ee921fb413705db2d872a321e9d7cc79218d5a3187ca97e9e3e5c110be4cca0ddd98e225f15d751ad07c5f41d814120920fb3ac99cfa7dd18d42fa35829ca4ade222babc1bf1a21defa723784a92c26256a417783944e6c6687b1c4084b045ab92398a05bfd83f25a0c52bc53ced0a73b4f5991022dff5b4264d324627d475db19b317ebc890ed453f46d93932551350fd1e18368113b68f061b1f89172223b4560ab5caff09c574981518ad9197c7b6d06c611e626efc4dc637e3a99dff9007df6b9a554cad1cdc4a0ac6d96f87e0628bf8defe465b96369b9f387b7fa3cc86c66af2064bd14e8c8ae976dbfc7eb1220ecddaba933eb7c9d292937817a245dc567d2758519817a2b46edc15868b86e070ce3e733ed33f738aaaed417373c329705494269b08aca34c5d8c23b1cece5c73fc8e36a94190b46492c62bd0f27ca4cc881e9996b0b459d23aff0fe3711caabd3b1cf05c75179a0942ea71b658cf1f66e5ac28924dfe27d6d315dd447a1fccdd2ff8f1ff8898d266c445d8c68c7abd3f25db8312a712373cbfefea12efbc5c250a3d2acd446d7e94ed6a071b5d5eb14dd6fd47e8bf329c5a27374bd0d98eca0c871ebdd4c3746ac93059f941b7d54cc6dedc99036d83b30fa59b7fd9791dd63901d3ff68448d63ab4b78bb858e59b3f47e91cd06a092ca29980e2bcb10432b8a497549cb249d059db79343128576c2ec2c571c42da52e6099aad2ad3b2520e89a47df444e1d3d44db885505d9a7d22bf7b4b072782fdb8f5aef6fbf8fc83b2ff4bd022296a5847c479819cfd8788753468a13e68a52da5452b78ed06d1ce4064a301f1319aece2e6e45277c7bb298d3cabdb2d35dfd622c9a6e418cb5eab175ce457691bc5056ab247d7769af14c0ed89a61f519da4f89d48beaa3be978481a111cdc4b89ae6caf4747bc45d01e5f74cb43add84e9606c8df2b857330ad0c6a78ef17f43f9e058bdda556d17b34e19db3890650f9b6fa86559cb942cda1fd6a2610f94595fd823c34df4a932953adb3103c8b0eb5c1539876568d7d4b61e64b0f119e46c30525e1d0b783f06e2e50c742e0a4c394259ada8e09fa434f19dd23e8aca933b10c9f8aaf90eab737eba957ed19bdef638db81e86137da2d8167bcf67f8354ee9693d96c8869f43f3b497c09ec5065a361a833c6ac7");
+  memset(cipher, 0, sizeof(cipher));
+
+  cf_salsa20_ctx ctx;
+  cf_salsa20_init(&ctx, key, 32, nonce);
+  cf_salsa20_cipher(&ctx, cipher, cipher, sizeof(cipher));
+
+  TEST_CHECK(memcmp(expect, cipher, sizeof(cipher)) == 0);
+}
+
+static void test_salsa20_lanes(void)
+{
+  uint8_t key[32], nonce[16], counter[16];
+  uint8_t expect[64 * 20], got[64 * 20];
+  static const size_t splits[] = { 1, 300, 700, 5, 64, 512, 1, 197 };
+
+  /* 64-bit counter, carrying into its top half part way through
+   * a group of blocks. */
+  for (size_t i = 0; i < sizeof key; i++)
+    key[i] = (uint8_t) (i * 7);
+  unhex(nonce, 16, "0001020304050607fbffffff00000000");
+  memcpy(counter, nonce, sizeof counter);
+
+  for (size_t b = 0; b < 20; b++)
+  {
+    cf_salsa20_core(key, key + 16, counter,
+                    (const uint8_t *) "expand 32-byte k",
+                    expect + 64 * b);
+
+    /* Little-endian increment of the counter bytes. */
+    for (size_t i = 8; i < 16 && ++counter[i] == 0; i++)
+      ;
+  }
+
+  cf_salsa20_ctx ctx;
+  cf_salsa20_init_custom(&ctx, key, sizeof key, nonce);
+  memset(got, 0, sizeof got);
+
+  size_t done = 0;
+  for (size_t i = 0; done < sizeof got; i++)
+  {
+    size_t n = MIN(splits[i % ARRAYCOUNT(splits)], sizeof got - done);
+    cf_salsa20_cipher(&ctx, got + done, got + done, n);
+    done += n;
+  }
+
+  TEST_CHECK(memcmp(expect, got, sizeof got) == 0);
+}
+
 static void test_chacha20_core(void)
 {
   uint8_t k0[16], k1[16], nonce[16], out[64], expect[64];
@@ -216,12 +278,281 @@ static void test_chacha20(void)
   cf_chacha20_cipher(&ctx, block, block, sizeof block);
 }
 
+/* Runs of several blocks are done by multi-block cores (where
+ * available): check them against cf_chacha20_core, across counter
+ * wrap-around and with awkwardly split calls. */
+static void check_chacha20_lanes(size_t ncounter, const char *noncestr)
+{
+  uint8_t key[32], nonce[16], counter[16];
+  uint8_t expect[64 * 20], got[64 * 20];
+  static const size_t splits[] = { 1, 300, 700, 5, 64, 512, 1, 197 };
+
+  for (size_t i = 0; i < sizeof key; i++)
+    key[i] = (uint8_t) (i * 7);
+  unhex(nonce, 16, noncestr);
+  memcpy(counter, nonce, sizeof counter);
+
+  for (size_t b = 0; b < 20; b++)
+  {
+    cf_chacha20_core(key, key + 16, counter,
+                     (const uint8_t *) "expand 32-byte k",
+                     expect + 64 * b);
+
+    /* Little-endian increment of the counter bytes. */
+    for (size_t i = 0; i < ncounter && ++counter[i] == 0; i++)
+      ;
+  }
+
+  cf_chacha20_ctx ctx;
+  cf_chacha20_init_custom(&ctx, key, sizeof key, nonce, ncounter);
+  memset(got, 0, sizeof got);
+
+  size_t done = 0;
+  for (size_t i = 0; done < sizeof got; i++)
+  {
+    size_t n = MIN(splits[i % ARRAYCOUNT(splits)], sizeof got - done);
+    cf_chacha20_cipher(&ctx, got + done, got + done, n);
+    done += n;
+  }
+
+  TEST_CHECK(memcmp(expect, got, sizeof got) == 0);
+}
+
+static void test_chacha20_lanes(void)
+{
+  /* 32-bit counter, wrapping within itself. */
+  check_chacha20_lanes(4, "fbffffff000102030405060708090a0b");
+  /* 64-bit counter, carrying into its top half. */
+  check_chacha20_lanes(8, "fbffffff000000000001020304050607");
+}
+
+static void test_hchacha20(void)
+{
+  /* From draft-irtf-cfrg-xchacha-03 2.2.1. */
+  uint8_t key[32], nonce[16], out[32], expect[32];
+
+  unhex(key, sizeof key, "000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f");
+  unhex(nonce, sizeof nonce, "000000090000004a0000000031415927");
+  unhex(expect, sizeof expect, "82413b4227b27bfed30e42508a877d73a0f9e4d58a74a853c12ec41326d3ecdc");
+
+  cf_hchacha20(key, nonce, out);
+  TEST_CHECK(memcmp(expect, out, sizeof out) == 0);
+}
+
+static void test_xchacha20(void)
+{
+  /* Generated by libsodium: crypto_stream_xchacha20_xor. */
+  uint8_t key[32], nonce[24], block[200], expect[200];
+
+  unhex(key, sizeof key, "000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f");
+  unhex(nonce, sizeof nonce, "404142434445464748494a4b4c4d4e4f5051525354555658");
+  unhex(expect, sizeof expect, "83bb7e485a2fe8d99761ccedd2da43c921e8906fa37528ea41c92b1c41ca0fde083dba2d70eeb2398ba676c47df1535dfbf421ef03faedab0ddbb96bcd76994a4e9b9a721f2ed4fa88aa8c4ab63dff1bb2993662e476cb19060f17532dc990d32eac8791db5664f1eb746d1ef6760f41abcb7e29710df16822a034cf38a6d14b6a1fe677e8b4526ed4345ff46474ef2d8d850df9eb8845c321f0e2a01c65eca103b220a12cd4af76438a7dccb0ad9827337c833181bc75eabf6b895e1caa9778be90a9bee8cde7bf");
+
+  for (size_t i = 0; i < sizeof block; i++)
+    block[i] = (uint8_t) i;
+
+  cf_chacha20_ctx ctx;
+  cf_xchacha20_init(&ctx, key, nonce);
+  cf_chacha20_cipher(&ctx, block, block, sizeof block);
+
+  TEST_CHECK(memcmp(expect, block, sizeof expect) == 0);
+}
+
+static void test_hsalsa20(void)
+{
+  /* From NaCl tests/core1.c. */
+  uint8_t key[32], nonce[16] = { 0 }, out[32], expect[32];
+
+  unhex(key, sizeof key, "4a5d9d5ba4ce2de1728e3bf480350f25e07e21c947d19e3376f09b3c1e161742");
+  unhex(expect, sizeof expect, "1b27556473e985d462cd51197a9a46c76009549eac6474f206c4ee0844f68389");
+
+  cf_hsalsa20(key, nonce, out);
+  TEST_CHECK(memcmp(expect, out, sizeof out) == 0);
+}
+
+static void test_xsalsa20(void)
+{
+  /* Generated by libsodium: crypto_stream_xsalsa20. */
+  uint8_t key[32], nonce[24], block[200] = { 0 }, expect[200];
+
+  unhex(key, sizeof key, "1b27556473e985d462cd51197a9a46c76009549eac6474f206c4ee0844f68389");
+  unhex(nonce, sizeof nonce, "69696ee955b62b73cd62bda875fc73d68219e0036b7a0b37");
+  unhex(expect, sizeof expect, "eea6a7251c1e72916d11c2cb214d3c252539121d8e234e652d651fa4c8cff880309e645a74e9e0a60d8243acd9177ab51a1beb8d5a2f5d700c093c5e5585579625337bd3ab619d615760d8c5b224a85b1d0efe0eb8a7ee163abb0376529fcc09bab506c618e13ce777d82c3ae9d1a6f972d4160287cbfe60bf2130fc0a6ff6049d0a5c8a82f429231f008082e845d7e189d37f9ed2b464e6b919e6523a8c1210bd52a02a4c3fe406d3085f5068d1909eeeca6369abc981a42e87fe665583f0ab85ae71f6f84f528e");
+
+  cf_salsa20_ctx ctx;
+  cf_xsalsa20_init(&ctx, key, nonce);
+  cf_salsa20_cipher(&ctx, block, block, 37);
+  cf_salsa20_cipher(&ctx, block + 37, block + 37, sizeof block - 37);
+
+  TEST_CHECK(memcmp(expect, block, sizeof expect) == 0);
+}
+
+static void test_chacha20_seek(void)
+{
+  uint8_t key[32], nonce[16] = { 0 };
+  uint8_t expect[64 * 12], got[64 * 12];
+  static const size_t offsets[] = { 0, 1, 63, 64, 65, 200, 256, 511, 700 };
+
+  for (size_t i = 0; i < sizeof key; i++)
+    key[i] = (uint8_t) (i * 3);
+  nonce[15] = 0x42;
+
+  cf_chacha20_ctx ctx;
+  cf_chacha20_init_custom(&ctx, key, sizeof key, nonce, 8);
+  memset(expect, 0, sizeof expect);
+  cf_chacha20_cipher(&ctx, expect, expect, sizeof expect);
+
+  /* Seeking backwards and forwards from a used context. */
+  for (size_t i = 0; i < ARRAYCOUNT(offsets); i++)
+  {
+    size_t off = offsets[i];
+    memset(got, 0, sizeof got);
+    cf_chacha20_seek(&ctx, off);
+    cf_chacha20_cipher(&ctx, got, got, sizeof got - off);
+    TEST_CHECK(memcmp(expect + off, got, sizeof got - off) == 0);
+  }
+
+  /* Slices in any order give the same result as one pass. */
+  cf_chacha20_init_custom(&ctx, key, sizeof key, nonce, 8);
+  memset(got, 0, sizeof got);
+  cf_chacha20_cipher_slice(&ctx, 333, got + 333, got + 333, sizeof got - 333);
+  cf_chacha20_cipher_slice(&ctx, 0, got, got, 7);
+  cf_chacha20_cipher_slice(&ctx, 7, got + 7, got + 7, 326);
+  TEST_CHECK(memcmp(expect, got, sizeof got) == 0);
+
+  /* The counter is replaced, even if init gave it a value. */
+  nonce[0] = 0x99;
+  cf_chacha20_init_custom(&ctx, key, sizeof key, nonce, 8);
+  memset(got, 0, sizeof got);
+  cf_chacha20_cipher_slice(&ctx, 64, got, got, 64);
+  TEST_CHECK(memcmp(expect + 64, got, 64) == 0);
+
+  /* A 32-bit counter wraps. */
+  uint8_t wrapnonce[16] = { 5, 0, 0, 0, 1, 2, 3 };
+  uint8_t a[64] = { 0 }, b[64] = { 0 };
+  cf_chacha20_init_custom(&ctx, key, sizeof key, wrapnonce, 4);
+  cf_chacha20_cipher_slice(&ctx, 64 * (UINT64_C(0x100000000) + 5), a, a, sizeof a);
+  cf_chacha20_cipher(&ctx, b, b, sizeof b);
+  TEST_CHECK(memcmp(a, b, sizeof a) == 0);
+}
+
+static void check_chacha_rounds(void (*cipher)(cf_chacha20_ctx *, const uint8_t *, uint8_t *, size_t),
+                                void (*seek)(cf_chacha20_ctx *, uint64_t),
+                                const char *expectstr)
+{
+  uint8_t key[32] = { 0 }, nonce[8] = { 0 }, expect[64];
+  uint8_t one[64 * 13], split[64 * 13];
+
+  unhex(expect, sizeof expect, expectstr);
+
+  cf_chacha20_ctx ctx;
+  cf_chacha20_init(&ctx, key, sizeof key, nonce);
+  memset(one, 0, sizeof one);
+  cipher(&ctx, one, one, sizeof one);
+  TEST_CHECK(memcmp(expect, one, sizeof expect) == 0);
+
+  /* Multi-block paths agree with one block at a time. */
+  cf_chacha20_init(&ctx, key, sizeof key, nonce);
+  memset(split, 0, sizeof split);
+  for (size_t i = 0; i < sizeof split; i += 64)
+    cipher(&ctx, split + i, split + i, 64);
+  TEST_CHECK(memcmp(one, split, sizeof one) == 0);
+
+  /* Seeking part way into a block uses the same rounds. */
+  static const size_t offsets[] = { 1, 63, 100, 300 };
+  for (size_t i = 0; i < ARRAYCOUNT(offsets); i++)
+  {
+    size_t off = offsets[i];
+    memset(split, 0, sizeof split);
+    seek(&ctx, off);
+    cipher(&ctx, split, split, sizeof split - off);
+    TEST_CHECK(memcmp(one + off, split, sizeof split - off) == 0);
+  }
+}
+
+#if !MCU_TARGET
+static void test_chacha20_batch(void)
+{
+  /* Different keys, nonces, counters (one wrapping) and lengths,
+   * including ones long enough to be done alone.  They must match
+   * the incremental interface. */
+  static const size_t lengths[] = {
+    0, 1, 63, 64, 65, 100, 128, 200, 511, 512, 1000, 3, 64, 17, 300, 77, 150, 40, 129
+  };
+  enum { N = sizeof lengths / sizeof lengths[0] };
+  uint8_t keys[N][32], nonces[N][12];
+  static uint8_t in[1000], out[N][1000], expect[1000];
+  cf_chacha20_item items[N];
+
+  for (size_t i = 0; i < sizeof in; i++)
+    in[i] = (uint8_t) (i * 13);
+
+  for (size_t k = 0; k < N; k++)
+  {
+    for (size_t i = 0; i < 32; i++)
+      keys[k][i] = (uint8_t) (k * 7 + i);
+    for (size_t i = 0; i < 12; i++)
+      nonces[k][i] = (uint8_t) (k + i * 31);
+
+    items[k] = (cf_chacha20_item) {
+      .key = keys[k],
+      .nonce = nonces[k],
+      .counter = k == 7 ? 0xffffffff : (uint32_t) k,
+      .in = in,
+      .out = out[k],
+      .nbytes = lengths[k]
+    };
+  }
+
+  cf_chacha20_batch(items, N);
+
+  for (size_t k = 0; k < N; k++)
+  {
+    uint8_t fullnonce[16];
+    cf_chacha20_ctx ctx;
+
+    fullnonce[0] = (uint8_t) items[k].counter;
+    fullnonce[1] = (uint8_t) (items[k].counter >> 8);
+    fullnonce[2] = (uint8_t) (items[k].counter >> 16);
+    fullnonce[3] = (uint8_t) (items[k].counter >> 24);
+    memcpy(fullnonce + 4, nonces[k], 12);
+    cf_chacha20_init_custom(&ctx, keys[k], 32, fullnonce, 4);
+    cf_chacha20_cipher(&ctx, in, expect, lengths[k]);
+
+    TEST_CHECK(memcmp(expect, out[k], lengths[k]) == 0);
+  }
+}
+#endif
+
+static void test_chacha_rounds(void)
+{
+  /* From draft-strombergson-chacha-test-vectors-01 TC1. */
+  check_chacha_rounds(cf_chacha8_cipher, cf_chacha8_seek,
+                      "3e00ef2f895f40d67f5bb8e81f09a5a12c840ec3ce9a7f3b181be188ef711a1e984ce172b9216f419f445367456d5619314a42a3da86b001387bfdb80e0cfe42");
+  check_chacha_rounds(cf_chacha12_cipher, cf_chacha12_seek,
+                      "9bf49a6a0755f953811fce125f2683d50429c3bb49e074147e0089a52eae155f0564f879d27ae3c02ce82834acfa8c793a629f2ca0de6919610be82f411326be");
+  check_chacha_rounds(cf_chacha20_cipher, cf_chacha20_seek,
+                      "76b8e0ada0f13d90405d6ae55386bd28bdd219b8a08ded1aa836efcc8b770dc7da41597c5157488d7724e03fb8d84a376a43b8f41518a11cc387b669b2ee6586");
+}
+
 TEST_LIST = {
   { "salsa20-core", test_salsa20_core },
   { "chacha20-core", test_chacha20_core },
   { "salsa20", test_salsa20 },
   { "salsa20-vs-nacl", test_salsa20_against_nacl },
+  { "salsa20-vs-nacl-long", test_salsa20_long_against_nacl },
+  { "salsa20-lanes", test_salsa20_lanes },
   { "chacha20", test_chacha20 },
+  { "chacha20-lanes", test_chacha20_lanes },
+  { "hchacha20", test_hchacha20 },
+  { "xchacha20", test_xchacha20 },
+  { "chacha20-seek", test_chacha20_seek },
+#if !MCU_TARGET
+  { "chacha20-batch", test_chacha20_batch },
+#endif
+  { "chacha-rounds", test_chacha_rounds },
+  { "hsalsa20", test_hsalsa20 },
+  { "xsalsa20", test_xsalsa20 },
   { 0 }
 };
 
@@ -0,0 +1,106 @@
+/*
+ * cifra - embedded cryptography library
+ * Written in 2014 by Joseph Birr-Pixton <jpixton@gmail.com>
+ *
+ * To the extent possible under law, the author(s) have dedicated all
+ * copyright and related and neighboring rights to this software to the
+ * public domain worldwide. This software is distributed without any
+ * warranty.
+ *
+ * You should have received a copy of the CC0 Public Domain Dedication
+ * along with this software. If not, see
+ * <http://creativecommons.org/publicdomain/zero/1.0/>.
+ */
+
+
+#include "secretbox.h"
+#include "handy.h"
+#include "cutest.h"
+#include "testutil.h"
+
+static void test_vector(void)
+{
+  /* From NaCl tests/secretbox.c.  NaCl's boxes start with 16 zero
+   * bytes; libsodium's combined format, used here, omits them. */
+  uint8_t key[32], nonce[24], plain[131], boxed[131 + 16], expect[131 + 16];
+  uint8_t out[131];
+
+  unhex(key, sizeof key, "1b27556473e985d462cd51197a9a46c76009549eac6474f206c4ee0844f68389");
+  unhex(nonce, sizeof nonce, "69696ee955b62b73cd62bda875fc73d68219e0036b7a0b37");
+  unhex(plain, sizeof plain, "be075fc53c81f2d5cf141316ebeb0c7b5228c52a4c62cbd44b66849b64244ffce5ecbaaf33bd751a1ac728d45e6c61296cdc3c01233561f41db66cce314adb310e3be8250c46f06dceea3a7fa1348057e2f6556ad6b1318a024a838f21af1fde048977eb48f59ffd4924ca1c60902e52f0a089bc76897040e082f937763848645e0705");
+  unhex(expect, sizeof expect, "f3ffc7703f9400e52a7dfb4b3d3305d98e993b9f48681273c29650ba32fc76ce48332ea7164d96a4476fb8c531a1186ac0dfc17c98dce87b4da7f011ec48c97271d2c20f9b928fe2270d6fb863d51738b48eeee314a7cc8ab932164548e526ae90224368517acfeabd6bb3732bc0e9da99832b61ca01b6de56244a9e88d5f9b37973f622a43d14a6599b1f654cb45a74e355a5");
+
+  cf_secretbox_seal(key, nonce, plain, sizeof plain, boxed);
+  TEST_CHECK(memcmp(boxed, expect, sizeof expect) == 0);
+
+  TEST_CHECK(0 == cf_secretbox_open(key, nonce, boxed, sizeof boxed, out));
+  TEST_CHECK(memcmp(out, plain, sizeof plain) == 0);
+
+  /* Detached form. */
+  uint8_t tag[16];
+  cf_secretbox_encrypt(key, nonce, plain, sizeof plain, out, tag);
+  TEST_CHECK(memcmp(tag, expect, sizeof tag) == 0);
+  TEST_CHECK(memcmp(out, expect + 16, sizeof out) == 0);
+
+  TEST_CHECK(0 == cf_secretbox_decrypt(key, nonce, out, sizeof out, tag, out));
+  TEST_CHECK(memcmp(out, plain, sizeof plain) == 0);
+}
+
+static void test_inplace(void)
+{
+  uint8_t key[32] = { 1 }, nonce[24] = { 2 };
+  uint8_t buf[16 + 3000], plain[3000], expect[16 + 3000];
+
+  for (size_t i = 0; i < sizeof plain; i++)
+    plain[i] = (uint8_t) (i * 7);
+
+  cf_secretbox_seal(key, nonce, plain, sizeof plain, expect);
+
+  memcpy(buf + 16, plain, sizeof plain);
+  cf_secretbox_seal(key, nonce, buf + 16, sizeof plain, buf);
+  TEST_CHECK(memcmp(buf, expect, sizeof expect) == 0);
+
+  TEST_CHECK(0 == cf_secretbox_open(key, nonce, buf, sizeof buf, buf + 16));
+  TEST_CHECK(memcmp(buf + 16, plain, sizeof plain) == 0);
+}
+
+static void test_fail(void)
+{
+  uint8_t key[32] = { 1 }, nonce[24] = { 2 };
+  uint8_t boxed[16 + 100], out[100];
+
+  memset(out, 0x5a, sizeof out);
+  cf_secretbox_seal(key, nonce, out, sizeof out, boxed);
+
+  /* Bad tag. */
+  boxed[0] ^= 1;
+  TEST_CHECK(1 == cf_secretbox_open(key, nonce, boxed, sizeof boxed, out));
+  boxed[0] ^= 1;
+
+  uint8_t zero[100] = { 0 };
+  TEST_CHECK(memcmp(out, zero, sizeof out) == 0);
+
+  /* Bad ciphertext. */
+  boxed[50] ^= 1;
+  TEST_CHECK(1 == cf_secretbox_open(key, nonce, boxed, sizeof boxed, out));
+  boxed[50] ^= 1;
+
+  /* Wrong nonce. */
+  nonce[23] ^= 1;
+  TEST_CHECK(1 == cf_secretbox_open(key, nonce, boxed, sizeof boxed, out));
+  nonce[23] ^= 1;
+
+  /* Too short. */
+  TEST_CHECK(1 == cf_secretbox_open(key, nonce, boxed, 15, out));
+
+  /* Empty message. */
+  cf_secretbox_seal(key, nonce, out, 0, boxed);
+  TEST_CHECK(0 == cf_secretbox_open(key, nonce, boxed, 16, out));
+}
+
+TEST_LIST = {
+  { "vector", test_vector },
+  { "inplace", test_inplace },
+  { "fail", test_fail },
+  { 0 }
+};
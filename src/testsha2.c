@@ -20,6 +20,7 @@
 #include "testutil.h"
 
 #include "testsha.h"
+#include "simd.h"
 
 #undef REALLY_SLOW_TEST
 
@@ -203,6 +204,141 @@ static void test_pbkdf2_sha256(void)
                       "\x89\xb6\x9d\x05\x16\xf8\x29\x89\x3c\x69\x62\x26\x65\x0a\x86\x87", 16);
 }
 
+static void check_sha256_mb(unsigned nlanes)
+{
+  static uint8_t msg[1000];
+  uint8_t hashes[300][CF_SHA256_HASHSZ];
+  cf_sha256_item items[300];
+  cf_sha256_mb mb;
+
+  for (size_t i = 0; i < sizeof msg; i++)
+    msg[i] = (i * 197 + 123) & 0xff;
+
+  /* Lengths either side of the one and two padding block cases,
+   * and a few long messages to keep some lanes busy. */
+  for (size_t i = 0; i < ARRAYCOUNT(items); i++)
+  {
+    items[i].msg = msg + (i % 7);
+    items[i].nmsg = (i % 37 == 5) ? 900 + i % 50 : i % 150;
+    items[i].hash = hashes[i];
+  }
+
+  cf_sha256_mb_init(&mb);
+  mb.nlanes = nlanes;
+
+  /* Flush part way through: the queue can be used again afterwards. */
+  for (size_t i = 0; i < 100; i++)
+    cf_sha256_mb_submit(&mb, &items[i]);
+  cf_sha256_mb_flush(&mb);
+
+  for (size_t i = 100; i < ARRAYCOUNT(items); i++)
+    cf_sha256_mb_submit(&mb, &items[i]);
+  cf_sha256_mb_flush(&mb);
+
+  for (size_t i = 0; i < ARRAYCOUNT(items); i++)
+  {
+    uint8_t expect[CF_SHA256_HASHSZ];
+    cf_hash(&cf_sha256, items[i].msg, items[i].nmsg, expect);
+    TEST_CHECK(memcmp(expect, hashes[i], sizeof expect) == 0);
+  }
+}
+
+static void test_sha256_mb(void)
+{
+  /* Whatever this CPU picks, then each lane count forced. */
+  cf_sha256_mb mb;
+  cf_sha256_mb_init(&mb);
+  check_sha256_mb(mb.nlanes);
+
+  check_sha256_mb(1);
+  check_sha256_mb(4);
+#if CF_SIMD && CF_SIMD_HAVE_AVX2
+  if (cf_simd_have_avx2())
+    check_sha256_mb(8);
+#endif
+
+  /* And the batch front end. */
+  uint8_t hash[2][CF_SHA256_HASHSZ], expect[CF_SHA256_HASHSZ];
+  cf_sha256_item items[2] = {
+    { "abc", 3, hash[0] },
+    { "", 0, hash[1] }
+  };
+
+  cf_sha256_batch(items, 2);
+  unhex(expect, sizeof expect, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+  TEST_CHECK(memcmp(expect, hash[0], sizeof expect) == 0);
+  unhex(expect, sizeof expect, "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+  TEST_CHECK(memcmp(expect, hash[1], sizeof expect) == 0);
+}
+
+static void check_sha512_mb(unsigned nlanes, const cf_chash *h)
+{
+  static uint8_t msg[1000];
+  uint8_t hashes[200][CF_SHA512_HASHSZ];
+  cf_sha512_item items[200];
+  cf_sha512_mb mb;
+
+  for (size_t i = 0; i < sizeof msg; i++)
+    msg[i] = (i * 197 + 123) & 0xff;
+
+  /* As check_sha256_mb, for the larger block. */
+  for (size_t i = 0; i < ARRAYCOUNT(items); i++)
+  {
+    items[i].msg = msg + (i % 7);
+    items[i].nmsg = (i % 37 == 5) ? 900 + i % 50 : (i * 3) % 280;
+    items[i].hash = hashes[i];
+  }
+
+  if (h == &cf_sha384)
+    cf_sha384_mb_init(&mb);
+  else
+    cf_sha512_mb_init(&mb);
+  mb.nlanes = nlanes;
+
+  for (size_t i = 0; i < 50; i++)
+    cf_sha512_mb_submit(&mb, &items[i]);
+  cf_sha512_mb_flush(&mb);
+
+  for (size_t i = 50; i < ARRAYCOUNT(items); i++)
+    cf_sha512_mb_submit(&mb, &items[i]);
+  cf_sha512_mb_flush(&mb);
+
+  for (size_t i = 0; i < ARRAYCOUNT(items); i++)
+  {
+    uint8_t expect[CF_SHA512_HASHSZ];
+    cf_hash(h, items[i].msg, items[i].nmsg, expect);
+    TEST_CHECK(memcmp(expect, hashes[i], h->hashsz) == 0);
+  }
+}
+
+static void test_sha512_mb(void)
+{
+  cf_sha512_mb mb;
+  cf_sha512_mb_init(&mb);
+  check_sha512_mb(mb.nlanes, &cf_sha512);
+
+  check_sha512_mb(1, &cf_sha512);
+  check_sha512_mb(4, &cf_sha512);
+  check_sha512_mb(1, &cf_sha384);
+  check_sha512_mb(4, &cf_sha384);
+
+  uint8_t hash[2][CF_SHA512_HASHSZ], expect[CF_SHA512_HASHSZ];
+  cf_sha512_item items[2] = {
+    { "abc", 3, hash[0] },
+    { "", 0, hash[1] }
+  };
+
+  cf_sha512_batch(items, 2);
+  unhex(expect, sizeof expect, "ddaf35a193617abacc417349ae20413112e6fa4e89a97ea20a9eeee64b55d39a2192992a274fc1a836ba3c23a3feebbd454d4423643ce80e2a9ac94fa54ca49f");
+  TEST_CHECK(memcmp(expect, hash[0], sizeof expect) == 0);
+  unhex(expect, sizeof expect, "cf83e1357eefb8bdf1542850d66d8007d620e4050b5715dc83f4a921d36ce9ce47d0d13c5d85f2b0ff8318d2877eec2f63b931bd47417a81a538327af927da3e");
+  TEST_CHECK(memcmp(expect, hash[1], sizeof expect) == 0);
+
+  cf_sha384_batch(items, 1);
+  unhex(expect, CF_SHA384_HASHSZ, "cb00753f45a35e8bb5a03d699ac65007272c32ab0eded1631a8b605a43ff5bed8086072ba1e7cc2358baeca134c825a7");
+  TEST_CHECK(memcmp(expect, hash[0], CF_SHA384_HASHSZ) == 0);
+}
+
 TEST_LIST = {
   { "sha224", test_sha224},
   { "sha256", test_sha256 },
@@ -216,6 +352,9 @@ TEST_LIST = {
 
   { "pbkdf2-sha256", test_pbkdf2_sha256 },
 
+  { "sha256-mb", test_sha256_mb },
+  { "sha512-mb", test_sha512_mb },
+
 #ifdef REALLY_SLOW_TEST
   { "sha256-long", test_sha256_long },
 #endif